@@ -0,0 +1,336 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Storage for an argument vector.
+ *
+ * Every argument is stored null terminated, back to back, in one byte
+ * arena with a table of offsets into it. Short argument lists live
+ * entirely within the object, so most Commands never touch the heap for
+ * their arguments, and copying the arena is a memcpy of each table
+ * rather than an allocation per argument.
+ *
+ * The char** needed by exec is built directly from the arena by argv().
+ */
+class ArgumentArena
+{
+private:
+	static constexpr size_t InlineByteCapacity = 256;
+	static constexpr size_t InlineArgumentCapacity = 16;
+
+	char* mBytes; // Null terminated arguments, back to back
+	size_t mByteCount; // Number of bytes in use
+	size_t mByteCapacity; // Size of mBytes
+	size_t* mOffsets; // Offset of each argument into mBytes
+	size_t mArgumentCount; // Number of arguments present
+	size_t mOffsetCapacity; // Number of slots in mOffsets
+
+	char mInlineBytes[ InlineByteCapacity ];
+	size_t mInlineOffsets[ InlineArgumentCapacity ];
+
+	// Pointers handed out by argv(), rebuilt on demand
+	mutable char* mInlineArgv[ InlineArgumentCapacity + 1 ];
+	mutable std::vector< char* > mArgv;
+
+	// Copy the contents of other to this instance.
+	void _copyAssignment(
+		const ArgumentArena& other )
+	{
+		_reserve( other.mByteCount, other.mArgumentCount );
+		memcpy( mBytes, other.mBytes, other.mByteCount );
+		memcpy( mOffsets, other.mOffsets, other.mArgumentCount * sizeof( size_t ) );
+		mByteCount = other.mByteCount;
+		mArgumentCount = other.mArgumentCount;
+	}
+
+	// Grow a buffer that may still be the inline buffer.
+	template < typename T >
+	static T* _grow(
+		T* buffer,
+		T* inlineBuffer,
+		size_t used,
+		size_t capacity )
+	{
+		void* newBuffer;
+
+		if ( buffer == inlineBuffer )
+		{
+			if ( nullptr != ( newBuffer = malloc( capacity * sizeof( T ) ) ) )
+			{
+				memcpy( newBuffer, buffer, used * sizeof( T ) );
+			}
+		}
+		else
+		{
+			newBuffer = realloc( buffer, capacity * sizeof( T ) );
+		}
+
+		if ( nullptr == newBuffer )
+		{
+			throw std::bad_alloc();
+		}
+
+		return static_cast< T* >( newBuffer );
+	}
+
+	// Initialize to an empty arena using the inline buffers
+	void _initialize()
+	{
+		mBytes = mInlineBytes;
+		mByteCount = 0;
+		mByteCapacity = InlineByteCapacity;
+		mOffsets = mInlineOffsets;
+		mArgumentCount = 0;
+		mOffsetCapacity = InlineArgumentCapacity;
+	}
+
+	// Move the contents of other to this instance.
+	void _moveAssignment(
+		ArgumentArena&& other )
+	{
+		if ( other.mBytes == other.mInlineBytes )
+		{
+			memcpy( mBytes, other.mBytes, other.mByteCount );
+		}
+		else
+		{
+			mBytes = std::exchange( other.mBytes, other.mInlineBytes );
+			mByteCapacity = std::exchange( other.mByteCapacity, InlineByteCapacity );
+		}
+
+		if ( other.mOffsets == other.mInlineOffsets )
+		{
+			memcpy( mOffsets, other.mOffsets, other.mArgumentCount * sizeof( size_t ) );
+		}
+		else
+		{
+			mOffsets = std::exchange( other.mOffsets, other.mInlineOffsets );
+			mOffsetCapacity = std::exchange( other.mOffsetCapacity, InlineArgumentCapacity );
+		}
+
+		mByteCount = std::exchange( other.mByteCount, 0 );
+		mArgumentCount = std::exchange( other.mArgumentCount, 0 );
+	}
+
+	// Release any heap storage and go back to the inline buffers
+	void _release()
+	{
+		if ( mBytes != mInlineBytes )
+		{
+			free( mBytes );
+		}
+
+		if ( mOffsets != mInlineOffsets )
+		{
+			free( mOffsets );
+		}
+
+		_initialize();
+	}
+
+	// Ensure there is room for at least the given number of bytes and arguments
+	void _reserve(
+		size_t byteCount,
+		size_t argumentCount )
+	{
+		if ( mByteCapacity < byteCount )
+		{
+			size_t capacity = std::max( byteCount, 2 * mByteCapacity );
+			mBytes = _grow( mBytes, mInlineBytes, mByteCount, capacity );
+			mByteCapacity = capacity;
+		}
+
+		if ( mOffsetCapacity < argumentCount )
+		{
+			size_t capacity = std::max( argumentCount, 2 * mOffsetCapacity );
+			mOffsets = _grow( mOffsets, mInlineOffsets, mArgumentCount, capacity );
+			mOffsetCapacity = capacity;
+		}
+	}
+
+public:
+	/**
+	 * Default constructor to an empty argument list.
+	 */
+	ArgumentArena()
+	{
+		_initialize();
+	}
+
+	/**
+	 * Copy constructor.
+	 * @param other ArgumentArena object to copy to this instance.
+	 */
+	ArgumentArena(
+		const ArgumentArena& other )
+	{
+		_initialize();
+		_copyAssignment( other );
+	}
+
+	/**
+	 * Move constructor.
+	 * @param other ArgumentArena object to move to this instance.
+	 */
+	ArgumentArena(
+		ArgumentArena&& other )
+	{
+		_initialize();
+		_moveAssignment( std::move( other ) );
+	}
+
+	/**
+	 * Destructor to release the resources.
+	 */
+	~ArgumentArena()
+	{
+		_release();
+	}
+
+	/**
+	 * Append an argument to the end of the list.
+	 * @param argument Pointer to the bytes of the argument.
+	 * @param length Number of bytes in the argument, excluding any null terminator.
+	 */
+	void append(
+		const char* argument,
+		size_t length )
+	{
+		_reserve( mByteCount + length + 1, mArgumentCount + 1 );
+		memcpy( mBytes + mByteCount, argument, length );
+		mBytes[ mByteCount + length ] = '\0';
+		mOffsets[ mArgumentCount++ ] = mByteCount;
+		mByteCount += length + 1;
+	}
+
+	/**
+	 * Get the null terminated argument vector to be handed to exec.
+	 * The vector is valid until the next modification of this arena.
+	 * @return A pointer to the argument vector is returned.
+	 */
+	char* const* argv() const
+	{
+		char** pointers = mInlineArgv;
+
+		if ( InlineArgumentCapacity < mArgumentCount )
+		{
+			mArgv.resize( mArgumentCount + 1 );
+			pointers = mArgv.data();
+		}
+
+		for ( size_t index( -1 ); ++index < mArgumentCount; )
+		{
+			pointers[ index ] = mBytes + mOffsets[ index ];
+		}
+
+		pointers[ mArgumentCount ] = nullptr;
+
+		return pointers;
+	}
+
+	/**
+	 * Replace the argument at the given index.
+	 * @param index Index of the argument to replace; must be less than size().
+	 * @param argument Pointer to the bytes of the argument.
+	 * @param length Number of bytes in the argument, excluding any null terminator.
+	 */
+	void assign(
+		size_t index,
+		const char* argument,
+		size_t length )
+	{
+		size_t begin = mOffsets[ index ];
+		size_t end = ( index + 1 < mArgumentCount ) ? mOffsets[ index + 1 ] : mByteCount;
+		size_t newEnd = begin + length + 1;
+
+		if ( newEnd > end )
+		{
+			_reserve( mByteCount + ( newEnd - end ), mArgumentCount );
+		}
+
+		memmove( mBytes + newEnd, mBytes + end, mByteCount - end );
+		memcpy( mBytes + begin, argument, length );
+		mBytes[ begin + length ] = '\0';
+		mByteCount = mByteCount + newEnd - end;
+
+		for ( size_t next( index ); ++next < mArgumentCount; )
+		{
+			mOffsets[ next ] = mOffsets[ next ] + newEnd - end;
+		}
+	}
+
+	/**
+	 * Remove every argument and release any heap storage.
+	 */
+	void clear()
+	{
+		_release();
+		mArgv.clear();
+	}
+
+	/**
+	 * Copy assignment operator.
+	 * @param other ArgumentArena object to copy to this instance.
+	 * @return A reference to this ArgumentArena object is returned.
+	 */
+	ArgumentArena& operator=(
+		const ArgumentArena& other )
+	{
+		if ( this != &other )
+		{
+			mByteCount = 0;
+			mArgumentCount = 0;
+			_copyAssignment( other );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Move assignment operator.
+	 * @param other ArgumentArena object to move to this instance.
+	 * @return A reference to this ArgumentArena object is returned.
+	 */
+	ArgumentArena& operator=(
+		ArgumentArena&& other )
+	{
+		if ( this != &other )
+		{
+			_release();
+			_moveAssignment( std::move( other ) );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Get the argument at the given index.
+	 * @param index Index of the argument; must be less than size().
+	 * @return A pointer to the null terminated argument is returned.
+	 */
+	const char* operator[](
+		size_t index ) const
+	{
+		return mBytes + mOffsets[ index ];
+	}
+
+	/**
+	 * Get the number of arguments present.
+	 * @return The number of arguments is returned.
+	 */
+	size_t size() const
+	{
+		return mArgumentCount;
+	}
+};
@@ -0,0 +1,189 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * A bounded pool of fixed-size buffers for streaming child output.
+ *
+ * At most capacity() buffers are ever allocated; they are allocated on
+ * demand and kept for reuse once released. When every buffer is in use,
+ * acquire() blocks until one is released, so the memory used stays flat
+ * however much output passes through the pool. A thread that must not
+ * block, such as the ChildReaper thread, takes one with tryAcquire()
+ * instead, and asks with notifyWhenAvailable() to be told of a release.
+ */
+class BufferPool
+{
+public:
+	static constexpr size_t DefaultBufferSize = 64 * 1024;
+	static constexpr size_t DefaultCapacity = 4;
+
+private:
+	std::mutex mMutex;
+	std::condition_variable mReleased;
+	size_t mBufferSize; // Size of each buffer
+	size_t mCapacity; // Maximum number of buffers
+	size_t mAllocated; // Number of buffers allocated
+	std::vector< char* > mFree; // Allocated buffers not in use
+	std::vector< std::function< void() > > mWaiters; // Notified upon the next release
+
+	// Take a buffer if one is free, or may still be allocated. The mutex must be held.
+	// @return The buffer is returned, else nullptr if every buffer is in use.
+	char* _take()
+	{
+		if ( not mFree.empty() )
+		{
+			char* buffer = mFree.back();
+			mFree.pop_back();
+			return buffer;
+		}
+
+		if ( mAllocated == mCapacity )
+		{
+			return nullptr;
+		}
+
+		char* buffer = static_cast< char* >( malloc( mBufferSize ) );
+
+		if ( nullptr == buffer )
+		{
+			throw std::bad_alloc();
+		}
+
+		++mAllocated;
+
+		return buffer;
+	}
+
+public:
+	/**
+	 * Construct an empty pool.
+	 * @param bufferSize Size of each buffer in bytes. [default: DefaultBufferSize]
+	 * @param capacity Maximum number of buffers. [default: DefaultCapacity]
+	 */
+	BufferPool(
+		size_t bufferSize = DefaultBufferSize,
+		size_t capacity = DefaultCapacity )
+	{
+		mBufferSize = ( 0 == bufferSize ) ? DefaultBufferSize : bufferSize;
+		mCapacity = ( 0 == capacity ) ? 1 : capacity;
+		mAllocated = 0;
+		mFree.reserve( mCapacity );
+	}
+
+	BufferPool( const BufferPool& ) = delete;
+	BufferPool& operator=( const BufferPool& ) = delete;
+
+	/**
+	 * Destructor to release the buffers. Every buffer must have been released.
+	 */
+	~BufferPool()
+	{
+		for ( char* buffer : mFree )
+		{
+			free( buffer );
+		}
+	}
+
+	/**
+	 * Take a buffer from the pool, blocking while every buffer is in use.
+	 * @return A buffer of bufferSize() bytes is returned.
+	 */
+	char* acquire()
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		while ( mFree.empty() and ( mAllocated == mCapacity ) )
+		{
+			mReleased.wait( lock );
+		}
+
+		return _take();
+	}
+
+	/**
+	 * Get the size of each buffer.
+	 * @return The buffer size in bytes is returned.
+	 */
+	size_t bufferSize() const
+	{
+		return mBufferSize;
+	}
+
+	/**
+	 * Get the maximum number of buffers.
+	 * @return The capacity of the pool is returned.
+	 */
+	size_t capacity() const
+	{
+		return mCapacity;
+	}
+
+	/**
+	 * Have a callable invoked once a buffer is released; at once, should one
+	 * be free already. It is invoked only once, without the pool locked, on
+	 * the thread releasing the buffer, which another waiter may take first.
+	 * @param available The callable to invoke.
+	 */
+	void notifyWhenAvailable(
+		std::function< void() > available )
+	{
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			if ( mFree.empty() and ( mAllocated == mCapacity ) )
+			{
+				mWaiters.push_back( std::move( available ) );
+				return;
+			}
+		}
+
+		available();
+	}
+
+	/**
+	 * Return a buffer to the pool.
+	 * @param buffer A buffer previously returned by acquire().
+	 */
+	void release(
+		char* buffer )
+	{
+		std::vector< std::function< void() > > waiters;
+
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+			mFree.push_back( buffer );
+			waiters.swap( mWaiters );
+		}
+
+		mReleased.notify_one();
+
+		// Every waiter tries again, as one may no longer want the buffer
+		for ( const auto& available : waiters )
+		{
+			available();
+		}
+	}
+
+	/**
+	 * Take a buffer from the pool without blocking.
+	 * @return A buffer of bufferSize() bytes is returned, else nullptr
+	 *         if every buffer is in use; see notifyWhenAvailable().
+	 */
+	char* tryAcquire()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return _take();
+	}
+};
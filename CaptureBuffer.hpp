@@ -0,0 +1,204 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OutputSink.hpp"
+
+/**
+ * A growable in-memory buffer capturing the output of a child process.
+ *
+ * The pipe is read directly into the spare capacity of the buffer, in
+ * chunks of at least ReadChunkSize bytes. Once the configured limit is
+ * reached, further output is read and discarded so the child is never
+ * blocked, and truncated() reports that output was lost.
+ *
+ * The buffer is cleared as each child is launched but keeps its
+ * capacity, so a buffer reused across executions stops allocating.
+ */
+class CaptureBuffer : public OutputSink
+{
+public:
+	static constexpr size_t DefaultLimit = 64 * 1024 * 1024;
+	static constexpr size_t ReadChunkSize = 64 * 1024;
+
+private:
+	char* mBuffer; // Captured bytes
+	size_t mSize; // Number of bytes captured
+	size_t mCapacity; // Size of mBuffer
+	size_t mLimit; // Maximum number of bytes to capture
+	bool mTruncated; // Output beyond the limit was discarded
+	bool mDiscarding; // The last region handed out was the discard buffer
+	char mDiscardBuffer[ 4096 ]; // Output beyond the limit is read into here
+
+public:
+	/**
+	 * Construct an empty capture buffer.
+	 * @param limit Maximum number of bytes to capture. [default: DefaultLimit]
+	 */
+	CaptureBuffer(
+		size_t limit = DefaultLimit )
+	{
+		mBuffer = nullptr;
+		mSize = 0;
+		mCapacity = 0;
+		mLimit = limit;
+		mTruncated = false;
+		mDiscarding = false;
+	}
+
+	CaptureBuffer( const CaptureBuffer& ) = delete;
+	CaptureBuffer& operator=( const CaptureBuffer& ) = delete;
+
+	/**
+	 * Destructor to release the resources.
+	 */
+	~CaptureBuffer()
+	{
+		free( mBuffer );
+	}
+
+	/**
+	 * Clear the captured output, keeping the allocated capacity.
+	 */
+	void begin() override
+	{
+		clear();
+	}
+
+	/**
+	 * Clear the captured output, keeping the allocated capacity.
+	 */
+	void clear()
+	{
+		mSize = 0;
+		mTruncated = false;
+		mDiscarding = false;
+	}
+
+	void commit(
+		size_t length ) override
+	{
+		if ( mDiscarding )
+		{
+			mTruncated = mTruncated or ( 0 < length );
+		}
+		else
+		{
+			mSize += length;
+		}
+	}
+
+	/**
+	 * Get the captured output split into lines. The line terminators are
+	 * not included and a final empty line (after a trailing '\n') is omitted.
+	 * The views are valid until the buffer is next modified.
+	 * @return A vector of views into the captured output is returned.
+	 */
+	std::vector< std::string_view > lines() const
+	{
+		std::vector< std::string_view > lines;
+		std::string_view remaining = view();
+
+		while ( not remaining.empty() )
+		{
+			size_t newline = remaining.find( '\n' );
+
+			if ( std::string_view::npos == newline )
+			{
+				lines.push_back( remaining );
+				break;
+			}
+
+			lines.push_back( remaining.substr( 0, newline ) );
+			remaining.remove_prefix( newline + 1 );
+		}
+
+		return lines;
+	}
+
+	/**
+	 * Get the maximum number of bytes captured.
+	 * @return The capture limit in bytes is returned.
+	 */
+	size_t limit() const
+	{
+		return mLimit;
+	}
+
+	char* prepare(
+		size_t& length ) override
+	{
+		mDiscarding = ( mSize >= mLimit );
+
+		if ( mDiscarding )
+		{
+			length = sizeof( mDiscardBuffer );
+			return mDiscardBuffer;
+		}
+
+		if ( mCapacity - mSize < ReadChunkSize )
+		{
+			size_t capacity = std::min( std::max( 2 * mCapacity, mSize + ReadChunkSize ), mLimit );
+			void* buffer = realloc( mBuffer, capacity );
+
+			if ( nullptr == buffer )
+			{
+				throw std::bad_alloc();
+			}
+
+			mBuffer = static_cast< char* >( buffer );
+			mCapacity = capacity;
+		}
+
+		length = std::min( mCapacity, mLimit ) - mSize;
+
+		return mBuffer + mSize;
+	}
+
+	/**
+	 * Get the number of bytes captured.
+	 * @return The number of bytes captured is returned.
+	 */
+	size_t size() const
+	{
+		return mSize;
+	}
+
+	/**
+	 * Get a copy of the captured output.
+	 * @return The captured output is returned as a string.
+	 */
+	std::string str() const
+	{
+		return std::string( view() );
+	}
+
+	/**
+	 * Check if output was discarded for exceeding the limit.
+	 * @return True is returned if the output was truncated.
+	 */
+	bool truncated() const
+	{
+		return mTruncated;
+	}
+
+	/**
+	 * Get a view of the captured output.
+	 * The view is valid until the buffer is next modified.
+	 * @return A view of the captured output is returned.
+	 */
+	std::string_view view() const
+	{
+		return std::string_view( mBuffer, mSize );
+	}
+};
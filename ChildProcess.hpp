@@ -0,0 +1,832 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <signal.h>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "CommandTrace.hpp"
+#include "OutputSink.hpp"
+#include "ResourceUsage.hpp"
+
+/**
+ * The runtime state of a single launched child process.
+ *
+ * Waiting is per instance and blocking: the first thread to wait
+ * reaps the child with wait4(), every other thread waiting on the same
+ * child sleeps on a condition variable until the exit is recorded.
+ * Threads waiting on different children never interact.
+ *
+ * Output of the child read by the parent (see addOutput()), and input
+ * fed to it from memory (see addInput()), is pumped by the same thread
+ * that reaps, and the child is only considered to have exited once all
+ * of its output has been read.
+ *
+ * Callbacks registered with onExit() are called by whichever thread
+ * reaps the child, which is the ChildReaper thread if it is watching.
+ *
+ * A ChildProcess does not reap its child on destruction.
+ */
+class ChildProcess
+{
+private:
+	friend class ChildReaper;
+
+	static constexpr unsigned int PidfdSignalProcessGroup = 1u << 2; // PIDFD_SIGNAL_PROCESS_GROUP
+	static constexpr std::chrono::milliseconds PollInterval{ 10 }; // Between reaps without a pidfd
+
+	// A pipe from the child read by the parent into a sink
+	struct OutputChannel
+	{
+		int fileDescriptor; // Read end of the pipe, -1 once at its end
+		std::shared_ptr< OutputSink > sink;
+		bool stalled; // Left unread by the last drain, as the sink had no room without blocking
+	};
+
+	// A pipe to the child fed by the parent from memory
+	struct InputChannel
+	{
+		int fileDescriptor; // Write end of the pipe, -1 once fed or closed by the child
+		const char* data; // Next byte to feed
+		size_t remaining; // Number of bytes left to feed
+		bool useVmsplice; // Map the pages into the pipe rather than copying them
+	};
+
+	pid_t mProcessID; // PID of the child process
+	int mPidFileDescriptor; // pidfd of the child process, -1 if not available
+
+	mutable std::mutex mMutex;
+	std::condition_variable mExitCondition;
+	std::vector< std::function< void( const ChildProcess& ) > > mExitCallbacks;
+	bool mReaping; // A thread is blocked in wait4() on this child
+	bool mHasExited; // The child has been reaped
+	int mStatus; // Wait status of the child
+	std::chrono::steady_clock::time_point mLaunchTime; // When the child was launched
+	std::chrono::steady_clock::time_point mExitTime; // When the child was reaped
+	struct rusage mResourceUsage; // Resources used by the child
+	bool mOutputTraced; // The first output has been traced; only touched while pumping
+	bool mExternallyReaped; // The ChildReaper drives the reaping of this child
+	std::vector< OutputChannel > mOutputChannels; // Only touched by the reaping thread
+	std::vector< InputChannel > mInputChannels; // Only touched by the reaping thread
+
+	// Check if every channel has reached its end.
+	bool _channelsFinished() const
+	{
+		for ( const OutputChannel& outputChannel : mOutputChannels )
+		{
+			if ( -1 != outputChannel.fileDescriptor )
+			{
+				return false;
+			}
+		}
+
+		for ( const InputChannel& inputChannel : mInputChannels )
+		{
+			if ( -1 != inputChannel.fileDescriptor )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Decode a wait status into an exit status; a child killed by a signal
+	// exits with 128 plus the signal number, as reported by the shell.
+	static int _decodeStatus(
+		int status )
+	{
+		if ( WIFSIGNALED( status ) )
+		{
+			return 128 + WTERMSIG( status );
+		}
+
+		return WIFEXITED( status ) ? WEXITSTATUS( status ) : 0;
+	}
+
+	// Read whatever is available on an output channel; unless {@param blocking},
+	// only for as long as the sink has room without blocking, see OutputSink::tryPrepare().
+	// @return True is returned if any output was read.
+	static bool _drainChannel(
+		OutputChannel& outputChannel,
+		bool blocking )
+	{
+		bool outputRead = false;
+
+		outputChannel.stalled = false;
+
+		while ( true )
+		{
+			size_t length;
+			char* region = blocking ? outputChannel.sink->prepare( length ) : outputChannel.sink->tryPrepare( length );
+
+			if ( nullptr == region )
+			{
+				outputChannel.stalled = true;
+				return outputRead;
+			}
+
+			ssize_t bytesRead = read( outputChannel.fileDescriptor, region, length );
+
+			if ( 0 < bytesRead )
+			{
+				outputChannel.sink->commit( static_cast< size_t >( bytesRead ) );
+				outputRead = true;
+				continue;
+			}
+
+			outputChannel.sink->commit( 0 );
+
+			if ( -1 == bytesRead )
+			{
+				if ( EINTR == errno )
+				{
+					continue;
+				}
+
+				if ( ( EAGAIN == errno ) or ( EWOULDBLOCK == errno ) )
+				{
+					return outputRead;
+				}
+			}
+
+			// End of the output, or an unrecoverable error
+			outputChannel.sink->finish();
+			close( outputChannel.fileDescriptor );
+			outputChannel.fileDescriptor = -1;
+			return outputRead;
+		}
+	}
+
+	// Feed whatever the pipe of an input channel has room for. SIGPIPE is
+	// blocked around the writes, so that a child closing its end of the
+	// pipe early yields EPIPE here rather than killing the parent.
+	static void _fillChannel(
+		InputChannel& inputChannel )
+	{
+		sigset_t pipeSignal;
+		sigset_t previousMask;
+		bool pipeBroken = false;
+
+		sigemptyset( &pipeSignal );
+		sigaddset( &pipeSignal, SIGPIPE );
+		pthread_sigmask( SIG_BLOCK, &pipeSignal, &previousMask );
+
+		while ( 0 < inputChannel.remaining )
+		{
+			ssize_t bytesWritten;
+
+			if ( inputChannel.useVmsplice )
+			{
+				struct iovec region = { const_cast< char* >( inputChannel.data ), inputChannel.remaining };
+				bytesWritten = vmsplice( inputChannel.fileDescriptor, &region, 1, SPLICE_F_NONBLOCK );
+
+				if ( ( -1 == bytesWritten ) and ( ( EINVAL == errno ) or ( ENOSYS == errno ) ) )
+				{
+					// Not supported for this pipe or kernel, copy instead
+					inputChannel.useVmsplice = false;
+					continue;
+				}
+			}
+			else
+			{
+				bytesWritten = write( inputChannel.fileDescriptor, inputChannel.data, inputChannel.remaining );
+			}
+
+			if ( 0 < bytesWritten )
+			{
+				inputChannel.data += bytesWritten;
+				inputChannel.remaining -= static_cast< size_t >( bytesWritten );
+				continue;
+			}
+
+			if ( ( -1 == bytesWritten ) and ( EINTR == errno ) )
+			{
+				continue;
+			}
+
+			if ( ( -1 == bytesWritten ) and ( ( EAGAIN == errno ) or ( EWOULDBLOCK == errno ) ) )
+			{
+				break;
+			}
+
+			// The child closed its end of the pipe, or an unrecoverable error
+			pipeBroken = ( EPIPE == errno );
+			inputChannel.remaining = 0;
+		}
+
+		if ( pipeBroken )
+		{
+			// Consume the SIGPIPE raised for this thread before unblocking it
+			struct timespec noWait = { 0, 0 };
+			sigtimedwait( &pipeSignal, nullptr, &noWait );
+		}
+
+		pthread_sigmask( SIG_SETMASK, &previousMask, nullptr );
+
+		if ( 0 == inputChannel.remaining )
+		{
+			close( inputChannel.fileDescriptor );
+			inputChannel.fileDescriptor = -1;
+		}
+	}
+
+	// Get the milliseconds left until a deadline, rounded up, for poll().
+	static int _millisecondsUntil(
+		std::chrono::steady_clock::time_point deadline )
+	{
+		auto remaining = std::chrono::ceil< std::chrono::milliseconds >( deadline - std::chrono::steady_clock::now() ).count();
+		return ( 0 > remaining ) ? 0 : static_cast< int >( std::min< decltype( remaining ) >( remaining, INT_MAX ) );
+	}
+
+	// Pump the output and input channels.
+	// @param timeout Milliseconds to pump for until all channels reach their end;
+	//                -1 to pump until they do, zero for a single pass, which
+	//                never blocks on a sink either.
+	// @return True is returned if all channels have reached their end.
+	bool _pumpChannels(
+		int timeout )
+	{
+		std::vector< struct pollfd > pollFileDescriptors;
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+			+ std::chrono::milliseconds( ( 0 < timeout ) ? timeout : 0 );
+		int remaining = timeout;
+
+		do
+		{
+			if ( 0 < timeout )
+			{
+				remaining = _millisecondsUntil( deadline );
+			}
+
+			pollFileDescriptors.clear();
+
+			for ( const OutputChannel& outputChannel : mOutputChannels )
+			{
+				if ( -1 != outputChannel.fileDescriptor )
+				{
+					pollFileDescriptors.push_back( { outputChannel.fileDescriptor, POLLIN, 0 } );
+				}
+			}
+
+			for ( const InputChannel& inputChannel : mInputChannels )
+			{
+				if ( -1 != inputChannel.fileDescriptor )
+				{
+					pollFileDescriptors.push_back( { inputChannel.fileDescriptor, POLLOUT, 0 } );
+				}
+			}
+
+			if ( pollFileDescriptors.empty() )
+			{
+				return true;
+			}
+
+			if ( -1 == ::poll( pollFileDescriptors.data(), pollFileDescriptors.size(), remaining ) )
+			{
+				if ( EINTR != errno )
+				{
+					return false;
+				}
+
+				continue;
+			}
+
+			for ( const struct pollfd& pollFileDescriptor : pollFileDescriptors )
+			{
+				if ( 0 == pollFileDescriptor.revents )
+				{
+					continue;
+				}
+
+				for ( OutputChannel& outputChannel : mOutputChannels )
+				{
+					if ( ( pollFileDescriptor.fd == outputChannel.fileDescriptor )
+						and _drainChannel( outputChannel, 0 != timeout ) and ( not mOutputTraced ) )
+					{
+						mOutputTraced = true;
+						CommandTrace::emit( TraceObserver::Event::FirstOutput,
+							std::chrono::steady_clock::now() - mLaunchTime, mProcessID );
+					}
+				}
+
+				for ( InputChannel& inputChannel : mInputChannels )
+				{
+					if ( pollFileDescriptor.fd == inputChannel.fileDescriptor )
+					{
+						_fillChannel( inputChannel );
+					}
+				}
+			}
+		} while ( 0 != remaining );
+
+		return _channelsFinished();
+	}
+
+	// Open a pidfd for the child, if it has none. The mutex must be held.
+	void _openPidFileDescriptor()
+	{
+#if defined( SYS_pidfd_open )
+		// Only while the PID cannot have been reused
+		if ( ( -1 == mPidFileDescriptor ) and ( not mHasExited ) and ( not mReaping ) )
+		{
+			mPidFileDescriptor = static_cast< int >( syscall( SYS_pidfd_open, mProcessID, 0 ) );
+		}
+#endif
+	}
+
+	// Close the pidfd of a reaped child. The mutex must be held.
+	void _closePidFileDescriptor()
+	{
+		if ( -1 != mPidFileDescriptor )
+		{
+			close( mPidFileDescriptor );
+			mPidFileDescriptor = -1;
+		}
+	}
+
+	// Record the exit of the child. The mutex must be held.
+	void _recordExit(
+		int status,
+		const struct rusage& resourceUsage )
+	{
+		if ( not mHasExited )
+		{
+			mStatus = status;
+			mExitTime = std::chrono::steady_clock::now();
+			mResourceUsage = resourceUsage;
+			mHasExited = true;
+		}
+
+		mExitCondition.notify_all();
+	}
+
+	// Reap the child if possible. The calling thread must hold the
+	// reaping role (mReaping) and must not hold the mutex.
+	void _reap(
+		int options )
+	{
+		int status = 0;
+		struct rusage resourceUsage;
+		pid_t returnValue;
+
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			// Never wait on the PID again once reaped; it may have been reused
+			if ( mHasExited )
+			{
+				return;
+			}
+		}
+
+		// The child has not finished until all of its output has been read
+		if ( not _pumpChannels( ( 0 == ( options & WNOHANG ) ) ? -1 : 0 ) )
+		{
+			return;
+		}
+
+		memset( &resourceUsage, 0, sizeof( resourceUsage ) );
+
+		do
+		{
+			returnValue = wait4( mProcessID, &status, options, &resourceUsage );
+		} while ( ( -1 == returnValue ) and ( EINTR == errno ) );
+
+		if ( 0 != returnValue )
+		{
+			std::vector< std::function< void( const ChildProcess& ) > > exitCallbacks;
+
+			{
+				std::lock_guard< std::mutex > lock( mMutex );
+
+				// On failure (ECHILD) the child was reaped by someone else,
+				// there is nothing left to wait for.
+				_recordExit( ( mProcessID == returnValue ) ? status : 0, resourceUsage );
+				exitCallbacks.swap( mExitCallbacks );
+
+				// Nothing is left to refer to, so do not hold on to the file
+				// descriptor; the ChildReaper closes it once unregistered
+				if ( not mExternallyReaped )
+				{
+					_closePidFileDescriptor();
+				}
+			}
+
+			CommandTrace::emit( TraceObserver::Event::Exit, mExitTime - mLaunchTime, mProcessID, _decodeStatus( mStatus ) );
+
+			// Called without the lock so that the callbacks may query this object
+			for ( const auto& exitCallback : exitCallbacks )
+			{
+				exitCallback( *this );
+			}
+		}
+	}
+
+	// Reap the child, giving up at a deadline. The calling thread must
+	// hold the reaping role (mReaping) and must not hold the mutex.
+	void _reapUntil(
+		std::chrono::steady_clock::time_point deadline )
+	{
+		while ( true )
+		{
+			int timeout = _millisecondsUntil( deadline );
+
+			// The child has not finished until all of its output has been read
+			if ( _pumpChannels( timeout ) )
+			{
+				_reap( WNOHANG );
+
+				if ( hasExited() )
+				{
+					return;
+				}
+
+				if ( -1 != mPidFileDescriptor )
+				{
+					// The pidfd becomes readable once the child exits
+					struct pollfd exitPoll = { mPidFileDescriptor, POLLIN, 0 };
+					::poll( &exitPoll, 1, _millisecondsUntil( deadline ) );
+				}
+				else
+				{
+					// Nothing to sleep on until the exit, so poll for it
+					std::this_thread::sleep_for( std::min< std::chrono::steady_clock::duration >(
+						PollInterval, deadline - std::chrono::steady_clock::now() ) );
+				}
+
+				_reap( WNOHANG );
+
+				if ( hasExited() )
+				{
+					return;
+				}
+			}
+
+			if ( 0 == timeout )
+			{
+				return;
+			}
+		}
+	}
+
+	// Take the reaping role, reap, and hand the role back.
+	// The lock must be held on entry and is held on return.
+	void _reapWithRole(
+		std::unique_lock< std::mutex >& lock,
+		int options )
+	{
+		mReaping = true;
+		lock.unlock();
+		_reap( options );
+		lock.lock();
+		mReaping = false;
+
+		// Wake any waiter so that it can take over the reaping role
+		mExitCondition.notify_all();
+	}
+
+public:
+	/**
+	 * Construct the state for a launched child.
+	 * @param processID PID of the child process.
+	 * @param pidFileDescriptor A pidfd for the child, ownership is taken. [default: -1]
+	 */
+	ChildProcess(
+		pid_t processID,
+		int pidFileDescriptor = -1 )
+	{
+		mProcessID = processID;
+		mPidFileDescriptor = pidFileDescriptor;
+		mReaping = false;
+		mHasExited = false;
+		mStatus = 0;
+		mLaunchTime = mExitTime = std::chrono::steady_clock::now();
+		memset( &mResourceUsage, 0, sizeof( mResourceUsage ) );
+		mOutputTraced = not CommandTrace::Enabled;
+		mExternallyReaped = false;
+	}
+
+	ChildProcess( const ChildProcess& ) = delete;
+	ChildProcess& operator=( const ChildProcess& ) = delete;
+
+	/**
+	 * Destructor to release the pidfd.
+	 */
+	~ChildProcess()
+	{
+		if ( -1 != mPidFileDescriptor )
+		{
+			close( mPidFileDescriptor );
+		}
+
+		for ( const OutputChannel& outputChannel : mOutputChannels )
+		{
+			if ( -1 != outputChannel.fileDescriptor )
+			{
+				close( outputChannel.fileDescriptor );
+			}
+		}
+
+		for ( const InputChannel& inputChannel : mInputChannels )
+		{
+			if ( -1 != inputChannel.fileDescriptor )
+			{
+				close( inputChannel.fileDescriptor );
+			}
+		}
+	}
+
+	/**
+	 * Feed the input pipe of the child from memory. Must be called
+	 * before the child is waited on or handed to the ChildReaper.
+	 * The memory is referenced, not copied, and must stay unchanged
+	 * until the child has been reaped.
+	 * @param fileDescriptor Write end of the pipe, ownership is taken;
+	 *                       it is switched to non-blocking mode.
+	 * @param data The bytes to feed; the pipe is closed once all are fed.
+	 */
+	void addInput(
+		int fileDescriptor,
+		std::string_view data )
+	{
+		if ( data.empty() )
+		{
+			close( fileDescriptor );
+			return;
+		}
+
+		fcntl( fileDescriptor, F_SETFL, fcntl( fileDescriptor, F_GETFL ) | O_NONBLOCK );
+		mInputChannels.push_back( InputChannel{ fileDescriptor, data.data(), data.size(), true } );
+	}
+
+	/**
+	 * Read an output pipe of the child into a sink. Must be called
+	 * before the child is waited on or handed to the ChildReaper.
+	 * @param fileDescriptor Read end of the pipe, ownership is taken;
+	 *                       it is switched to non-blocking mode.
+	 * @param sink The sink to read the output into.
+	 */
+	void addOutput(
+		int fileDescriptor,
+		std::shared_ptr< OutputSink > sink )
+	{
+		fcntl( fileDescriptor, F_SETFL, fcntl( fileDescriptor, F_GETFL ) | O_NONBLOCK );
+		mOutputChannels.push_back( OutputChannel{ fileDescriptor, std::move( sink ), false } );
+	}
+
+	/**
+	 * Get the wall clock time the child has run for.
+	 * @return The time from launch until the child was reaped is returned,
+	 *         or until now if the child has yet to be reaped.
+	 */
+	std::chrono::nanoseconds elapsed() const
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		std::chrono::steady_clock::time_point endTime = mHasExited ? mExitTime : std::chrono::steady_clock::now();
+		return std::chrono::duration_cast< std::chrono::nanoseconds >( endTime - mLaunchTime );
+	}
+
+	/**
+	 * Get the exit status of the child; 128 plus the signal number
+	 * should the child have been killed by a signal.
+	 * @return The exit status is returned, or zero if the child has yet to be reaped.
+	 */
+	int exitStatus() const
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return mHasExited ? _decodeStatus( mStatus ) : 0;
+	}
+
+	/**
+	 * Check if the child has been reaped.
+	 * @return True is returned if the child has exited and been reaped.
+	 */
+	bool hasExited() const
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return mHasExited;
+	}
+
+	/**
+	 * Register a callback to be called once the child has been reaped.
+	 * If the child has already been reaped, then the callback is called immediately.
+	 * @param exitCallback The callable to invoke with this object.
+	 */
+	void onExit(
+		std::function< void( const ChildProcess& ) > exitCallback )
+	{
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			if ( not mHasExited )
+			{
+				mExitCallbacks.push_back( std::move( exitCallback ) );
+				return;
+			}
+		}
+
+		exitCallback( *this );
+	}
+
+	/**
+	 * Get a pidfd referring to the child, opening one if needed.
+	 * @return The pidfd is returned, or -1 if the kernel does not support
+	 *         pidfds or the child has already been reaped.
+	 */
+	int pidFileDescriptor()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		_openPidFileDescriptor();
+		return mPidFileDescriptor;
+	}
+
+	/**
+	 * Reap the child if it has exited, without blocking.
+	 * @return True is returned if the child has exited.
+	 */
+	bool poll()
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		// If another thread is reaping, it will record the exit
+		if ( not ( mHasExited or mReaping or mExternallyReaped ) )
+		{
+			_reapWithRole( lock, WNOHANG );
+		}
+
+		return mHasExited;
+	}
+
+	/**
+	 * Get the PID of the child.
+	 * @return The PID of the child process is returned.
+	 */
+	pid_t processID() const
+	{
+		return mProcessID;
+	}
+
+	/**
+	 * Get the resources used by the child.
+	 * @return The resource usage reported by wait4() and the wall clock
+	 *         time are returned, zeroed if the child is yet to be reaped.
+	 */
+	ResourceUsage resourceUsage() const
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( not mHasExited )
+		{
+			return ResourceUsage();
+		}
+
+		return ResourceUsage( mResourceUsage, std::chrono::duration_cast< std::chrono::nanoseconds >( mExitTime - mLaunchTime ) );
+	}
+
+	/**
+	 * Send a signal to the child, unless it has already been reaped.
+	 * The pidfd is used where available, so the signal can never reach
+	 * another process that has since been given the same PID.
+	 * @param signalNumber The signal to send.
+	 * @param processGroup If true, signal the process group the child leads
+	 *                     instead; see SpawnPlan::setProcessGroup(). [default: false]
+	 * @return Zero is returned on success, else a negative error code is returned;
+	 *         -ESRCH should the child not lead a process group for {@param processGroup}.
+	 */
+	int sendSignal(
+		int signalNumber,
+		bool processGroup = false )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( mHasExited )
+		{
+			return -ESRCH;
+		}
+
+		// Never signal a group the child merely belongs to, such as that of the parent
+		if ( processGroup and ( mProcessID != getpgid( mProcessID ) ) )
+		{
+			return -ESRCH;
+		}
+
+#if defined( SYS_pidfd_send_signal )
+		if ( -1 != mPidFileDescriptor )
+		{
+			if ( 0 == syscall( SYS_pidfd_send_signal, mPidFileDescriptor, signalNumber, nullptr,
+				processGroup ? PidfdSignalProcessGroup : 0 ) )
+			{
+				return 0;
+			}
+
+			// Kernels before 6.9 reject the process group flag with EINVAL
+			if ( ( ENOSYS != errno ) and ( ( not processGroup ) or ( EINVAL != errno ) ) )
+			{
+				return -errno;
+			}
+		}
+#endif
+
+		// Without a pidfd, there remains a narrow window between the
+		// reaping thread's wait4() and the exit being recorded above
+		return ( 0 == kill( processGroup ? -mProcessID : mProcessID, signalNumber ) ) ? 0 : -errno;
+	}
+
+	/**
+	 * Get the signal that killed the child.
+	 * @return The signal number is returned, or zero if the child exited
+	 *         normally or has yet to be reaped.
+	 */
+	int terminatingSignal() const
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return ( mHasExited and WIFSIGNALED( mStatus ) ) ? WTERMSIG( mStatus ) : 0;
+	}
+
+	/**
+	 * Block until the child has exited, reaping it if no other thread is.
+	 * @return The exit status of the child is returned.
+	 */
+	int wait()
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		while ( not mHasExited )
+		{
+			if ( mReaping or mExternallyReaped )
+			{
+				mExitCondition.wait( lock );
+				continue;
+			}
+
+			_reapWithRole( lock, 0 );
+		}
+
+		return _decodeStatus( mStatus );
+	}
+
+	/**
+	 * Block until the child has exited or a deadline has passed, reaping it
+	 * if no other thread is. The output of the child is pumped meanwhile.
+	 * @param deadline The time to stop waiting at.
+	 * @return True is returned if the child has exited, false if the deadline passed first.
+	 */
+	bool waitUntil(
+		std::chrono::steady_clock::time_point deadline )
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		while ( not mHasExited )
+		{
+			if ( std::chrono::steady_clock::now() >= deadline )
+			{
+				return false;
+			}
+
+			if ( mReaping or mExternallyReaped )
+			{
+				mExitCondition.wait_until( lock, deadline );
+				continue;
+			}
+
+			// Something to sleep on until the exit, rather than polling for it
+			_openPidFileDescriptor();
+
+			mReaping = true;
+			lock.unlock();
+			_reapUntil( deadline );
+			lock.lock();
+			mReaping = false;
+
+			// Wake any waiter so that it can take over the reaping role
+			mExitCondition.notify_all();
+		}
+
+		return true;
+	}
+};
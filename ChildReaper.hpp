@@ -0,0 +1,533 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ChildProcess.hpp"
+
+/**
+ * An opt-in, process wide service that reaps watched children as soon
+ * as they exit, from a single thread.
+ *
+ * Children are watched through their pidfd in one epoll loop, along
+ * with any pipes read or fed by the parent, which are pumped from the
+ * same loop. Should
+ * the kernel not support pidfds, a SIGCHLD handler (chained to any
+ * previously installed handler) wakes the loop instead, which then
+ * polls the children that have no pidfd.
+ *
+ * Reaping records the exit status and resource usage in the ChildProcess
+ * and calls its onExit() callbacks on the reaper thread; callbacks should
+ * therefore be short, as should those of the sinks read into. A sink with
+ * no room without blocking, such as a StreamSink waiting on its pool, has
+ * its pipe disarmed until it says it has room; the other children are
+ * pumped meanwhile. The thread is only started on the first watch().
+ * A child must be handed to the reaper before any thread waits on it.
+ */
+class ChildReaper
+{
+private:
+	static constexpr uint64_t WakeKey = 0; // epoll key of the wake pipe
+
+	inline static std::atomic< int > WakeWriteFD{ -1 }; // Written to by the SIGCHLD handler
+	inline static struct sigaction PreviousAction; // Handler installed before ours
+
+	// A watched child and the epoll registrations made for it
+	struct Watch
+	{
+		std::shared_ptr< ChildProcess > childProcess;
+		int pidFileDescriptor; // -1 if the child is polled upon SIGCHLD instead
+		bool pidFileDescriptorArmed; // The pidfd is registered for EPOLLIN
+		std::vector< uint64_t > keys; // epoll keys registered for this child
+		std::vector< uint64_t > outputKeys; // By output channel, WakeKey if not registered
+		std::vector< bool > outputArmed; // By output channel, registered for EPOLLIN
+	};
+
+	std::mutex mMutex;
+	std::thread mThread;
+	int mEpollFD; // epoll instance watching pidfds, output pipes and the wake pipe
+	int mWakePipe[ 2 ]; // Wakes the loop for SIGCHLD and shutdown
+	bool mSignalHandlerInstalled;
+	bool mStop;
+	uint64_t mNextKey; // Next epoll key to hand out
+	std::unordered_map< uint64_t, std::shared_ptr< Watch > > mWatches; // By epoll key
+	std::vector< std::shared_ptr< Watch > > mUnwatchable; // Children without a pidfd
+	std::vector< std::pair< std::weak_ptr< Watch >, size_t > > mReady; // Output channels whose sink has room again
+
+	ChildReaper()
+	{
+		mEpollFD = -1;
+		mWakePipe[ 0 ] = mWakePipe[ 1 ] = -1;
+		mSignalHandlerInstalled = false;
+		mStop = false;
+		mNextKey = WakeKey + 1;
+	}
+
+	// Arm, or disarm, an output channel of a watch. The mutex must be held.
+	void _armOutput(
+		Watch& watch,
+		size_t index,
+		bool armed )
+	{
+		struct epoll_event event;
+
+		event.events = armed ? static_cast< uint32_t >( EPOLLIN ) : 0;
+		event.data.u64 = watch.outputKeys[ index ];
+		epoll_ctl( mEpollFD, EPOLL_CTL_MOD, watch.childProcess->mOutputChannels[ index ].fileDescriptor, &event );
+		watch.outputArmed[ index ] = armed;
+	}
+
+	// SIGCHLD handler for the fallback path; only async-signal-safe calls.
+	static void _handleSignal(
+		int signalNumber,
+		siginfo_t* information,
+		void* context )
+	{
+		int savedErrno = errno;
+		int wakeFD = WakeWriteFD.load();
+		char byte = 0;
+
+		if ( -1 != wakeFD )
+		{
+			ssize_t ignored = write( wakeFD, &byte, 1 );
+			(void)ignored;
+		}
+
+		if ( PreviousAction.sa_flags & SA_SIGINFO )
+		{
+			if ( nullptr != PreviousAction.sa_sigaction )
+			{
+				PreviousAction.sa_sigaction( signalNumber, information, context );
+			}
+		}
+		else if ( ( SIG_DFL != PreviousAction.sa_handler ) and ( SIG_IGN != PreviousAction.sa_handler ) )
+		{
+			PreviousAction.sa_handler( signalNumber );
+		}
+
+		errno = savedErrno;
+	}
+
+	// Install the SIGCHLD handler. The mutex must be held.
+	void _installSignalHandler()
+	{
+		struct sigaction action;
+
+		if ( mSignalHandlerInstalled )
+		{
+			return;
+		}
+
+		memset( &action, 0, sizeof( action ) );
+		action.sa_sigaction = &ChildReaper::_handleSignal;
+		action.sa_flags = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP;
+		sigemptyset( &action.sa_mask );
+
+		WakeWriteFD.store( mWakePipe[ 1 ] );
+		sigaction( SIGCHLD, &action, &PreviousAction );
+		mSignalHandlerInstalled = true;
+	}
+
+	// Register a file descriptor with epoll for a watch. The mutex must be held.
+	// @return True is returned if the file descriptor was registered.
+	bool _register(
+		const std::shared_ptr< Watch >& watch,
+		int fileDescriptor,
+		uint32_t events = EPOLLIN )
+	{
+		struct epoll_event event;
+
+		event.events = events;
+		event.data.u64 = mNextKey++;
+
+		if ( 0 != epoll_ctl( mEpollFD, EPOLL_CTL_ADD, fileDescriptor, &event ) )
+		{
+			return false;
+		}
+
+		watch->keys.push_back( event.data.u64 );
+		mWatches[ event.data.u64 ] = watch;
+
+		return true;
+	}
+
+	// The reaper loop
+	void _run()
+	{
+		struct epoll_event events[ 64 ];
+
+		while ( true )
+		{
+			int eventCount = epoll_wait( mEpollFD, events, 64, -1 );
+
+			if ( -1 == eventCount )
+			{
+				if ( EINTR == errno )
+				{
+					continue;
+				}
+
+				return;
+			}
+
+			for ( int index( -1 ); ++index < eventCount; )
+			{
+				if ( WakeKey == events[ index ].data.u64 )
+				{
+					if ( _sweepUnwatchable() )
+					{
+						return;
+					}
+
+					continue;
+				}
+
+				std::shared_ptr< Watch > watch;
+
+				{
+					std::lock_guard< std::mutex > lock( mMutex );
+					auto watched = mWatches.find( events[ index ].data.u64 );
+
+					if ( mWatches.end() == watched )
+					{
+						continue;
+					}
+
+					watch = watched->second;
+				}
+
+				_service( watch );
+			}
+		}
+	}
+
+	// Drain the output of, and try to reap, a watched child.
+	// Called without the mutex, as the exit callbacks may watch new children.
+	void _service(
+		const std::shared_ptr< Watch >& watch )
+	{
+		ChildProcess& childProcess = *watch->childProcess;
+
+		{
+			std::unique_lock< std::mutex > childLock( childProcess.mMutex );
+
+			// A thread that took the reaping role before the child was watched reaps it
+			if ( not ( childProcess.mHasExited or childProcess.mReaping ) )
+			{
+				childProcess._reapWithRole( childLock, WNOHANG );
+			}
+		}
+
+		bool hasExited = childProcess.hasExited();
+		bool channelsFinished = childProcess._channelsFinished();
+		std::vector< size_t > stalled;
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		if ( hasExited )
+		{
+			for ( uint64_t key : watch->keys )
+			{
+				mWatches.erase( key );
+			}
+
+			if ( -1 != watch->pidFileDescriptor )
+			{
+				epoll_ctl( mEpollFD, EPOLL_CTL_DEL, watch->pidFileDescriptor, nullptr );
+				watch->pidFileDescriptor = -1;
+
+				std::lock_guard< std::mutex > childLock( childProcess.mMutex );
+				childProcess._closePidFileDescriptor();
+			}
+
+			for ( size_t index( mUnwatchable.size() ); index--; )
+			{
+				if ( mUnwatchable[ index ] == watch )
+				{
+					mUnwatchable.erase( mUnwatchable.begin() + index );
+				}
+			}
+
+			return;
+		}
+
+		// The pidfd stays readable once the child exits, so it is disarmed
+		// until the remaining output has been read and input fed
+		if ( ( -1 != watch->pidFileDescriptor ) and ( channelsFinished != watch->pidFileDescriptorArmed ) )
+		{
+			struct epoll_event event;
+
+			event.events = channelsFinished ? static_cast< uint32_t >( EPOLLIN ) : 0;
+			event.data.u64 = watch->keys.front();
+			epoll_ctl( mEpollFD, EPOLL_CTL_MOD, watch->pidFileDescriptor, &event );
+			watch->pidFileDescriptorArmed = channelsFinished;
+		}
+
+		// A pipe left unread as its sink had no room is disarmed until the sink has,
+		// rather than waking the loop for as long as it stays readable
+		for ( size_t index( -1 ); ++index < watch->outputKeys.size(); )
+		{
+			const ChildProcess::OutputChannel& outputChannel = childProcess.mOutputChannels[ index ];
+
+			if ( ( WakeKey != watch->outputKeys[ index ] ) and ( -1 != outputChannel.fileDescriptor )
+				and ( outputChannel.stalled == watch->outputArmed[ index ] ) )
+			{
+				_armOutput( *watch, index, not outputChannel.stalled );
+
+				if ( outputChannel.stalled )
+				{
+					stalled.push_back( index );
+				}
+			}
+		}
+
+		lock.unlock();
+
+		// Without the mutex, as the sink may say it has room at once
+		for ( size_t index : stalled )
+		{
+			childProcess.mOutputChannels[ index ].sink->notifyWhenReady(
+				[ this, readyWatch = std::weak_ptr< Watch >( watch ), index ]()
+				{
+					std::lock_guard< std::mutex > readyLock( mMutex );
+					mReady.emplace_back( readyWatch, index );
+					_wake();
+				} );
+		}
+	}
+
+	// Start the reaper thread. The mutex must be held.
+	// @return Zero is returned on success, else a negative error code.
+	int _start()
+	{
+		struct epoll_event event;
+
+		if ( -1 != mEpollFD )
+		{
+			return 0;
+		}
+
+		if ( -1 == pipe2( mWakePipe, O_CLOEXEC | O_NONBLOCK ) )
+		{
+			return -errno;
+		}
+
+		if ( -1 == ( mEpollFD = epoll_create1( EPOLL_CLOEXEC ) ) )
+		{
+			int errorCode = -errno;
+			close( mWakePipe[ 0 ] );
+			close( mWakePipe[ 1 ] );
+			mWakePipe[ 0 ] = mWakePipe[ 1 ] = -1;
+			return errorCode;
+		}
+
+		event.events = EPOLLIN;
+		event.data.u64 = WakeKey;
+		epoll_ctl( mEpollFD, EPOLL_CTL_ADD, mWakePipe[ 0 ], &event );
+
+		mThread = std::thread( &ChildReaper::_run, this );
+
+		return 0;
+	}
+
+	// Drain the wake pipe, arm the output channels whose sink has room
+	// again, and poll every child without a pidfd.
+	// @return True is returned if the loop is to stop.
+	bool _sweepUnwatchable()
+	{
+		char buffer[ 64 ];
+		ssize_t bytesRead;
+		std::vector< std::shared_ptr< Watch > > unwatchable;
+
+		do
+		{
+			bytesRead = read( mWakePipe[ 0 ], buffer, sizeof( buffer ) );
+		} while ( 0 < bytesRead );
+
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			if ( mStop )
+			{
+				return true;
+			}
+
+			for ( const auto& ready : mReady )
+			{
+				std::shared_ptr< Watch > watch = ready.first.lock();
+
+				// Armed, it is drained as soon as it is serviced, and disarmed again should the sink still have no room
+				if ( ( nullptr != watch ) and ( mWatches.end() != mWatches.find( watch->outputKeys[ ready.second ] ) )
+					and ( -1 != watch->childProcess->mOutputChannels[ ready.second ].fileDescriptor )
+					and ( not watch->outputArmed[ ready.second ] ) )
+				{
+					_armOutput( *watch, ready.second, true );
+				}
+			}
+
+			mReady.clear();
+			unwatchable = mUnwatchable;
+		}
+
+		for ( const auto& watch : unwatchable )
+		{
+			_service( watch );
+		}
+
+		return false;
+	}
+
+	// Wake the reaper loop
+	void _wake()
+	{
+		char byte = 0;
+		ssize_t ignored = write( mWakePipe[ 1 ], &byte, 1 );
+		(void)ignored;
+	}
+
+public:
+	ChildReaper( const ChildReaper& ) = delete;
+	ChildReaper& operator=( const ChildReaper& ) = delete;
+
+	/**
+	 * Destructor to stop the reaper thread.
+	 * Children still being watched are left unreaped.
+	 */
+	~ChildReaper()
+	{
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			if ( -1 == mEpollFD )
+			{
+				return;
+			}
+
+			mStop = true;
+
+			if ( mSignalHandlerInstalled )
+			{
+				WakeWriteFD.store( -1 );
+				sigaction( SIGCHLD, &PreviousAction, nullptr );
+			}
+
+			_wake();
+		}
+
+		mThread.join();
+		close( mEpollFD );
+		close( mWakePipe[ 0 ] );
+		close( mWakePipe[ 1 ] );
+	}
+
+	/**
+	 * Get the process wide reaper.
+	 * @return A reference to the ChildReaper is returned.
+	 */
+	static ChildReaper& instance()
+	{
+		static ChildReaper Instance;
+		return Instance;
+	}
+
+	/**
+	 * Reap a child as soon as it exits.
+	 * Should another thread be reaping the child, in wait() or waitUntil(),
+	 * then this waits for it to exit or to give up, whichever is first.
+	 * @param childProcess The child process to watch.
+	 * @return Zero is returned on success, else a negative error code is returned.
+	 */
+	int watch(
+		std::shared_ptr< ChildProcess > childProcess )
+	{
+		{
+			std::unique_lock< std::mutex > lock( childProcess->mMutex );
+
+			// Already watched, or already reaped; by isRunning() or waitUntil() on
+			// another thread, say. The callbacks of a reaped child have been called.
+			if ( childProcess->mExternallyReaped or childProcess->mHasExited )
+			{
+				return 0;
+			}
+
+			childProcess->mExternallyReaped = true;
+
+			// The thread holding the reaping role owns the channels until it hands
+			// the role back; no other thread takes the role up from here on
+			childProcess->mExitCondition.wait( lock, [ &childProcess ]() { return not childProcess->mReaping; } );
+
+			if ( childProcess->mHasExited )
+			{
+				return 0;
+			}
+		}
+
+		int pidFileDescriptor = childProcess->pidFileDescriptor();
+		std::lock_guard< std::mutex > lock( mMutex );
+		int errorCode = _start();
+
+		if ( 0 != errorCode )
+		{
+			std::lock_guard< std::mutex > childLock( childProcess->mMutex );
+			childProcess->mExternallyReaped = false;
+
+			// Any waiter may take the reaping role up again
+			childProcess->mExitCondition.notify_all();
+			return errorCode;
+		}
+
+		std::shared_ptr< Watch > watch = std::make_shared< Watch >();
+		watch->childProcess = std::move( childProcess );
+		watch->pidFileDescriptor = -1;
+		watch->pidFileDescriptorArmed = false;
+
+		if ( ( -1 != pidFileDescriptor ) and _register( watch, pidFileDescriptor ) )
+		{
+			watch->pidFileDescriptor = pidFileDescriptor;
+			watch->pidFileDescriptorArmed = true;
+		}
+
+		for ( const auto& outputChannel : watch->childProcess->mOutputChannels )
+		{
+			bool registered = ( -1 != outputChannel.fileDescriptor ) and _register( watch, outputChannel.fileDescriptor );
+
+			watch->outputKeys.push_back( registered ? watch->keys.back() : WakeKey );
+			watch->outputArmed.push_back( registered );
+		}
+
+		for ( const auto& inputChannel : watch->childProcess->mInputChannels )
+		{
+			if ( -1 != inputChannel.fileDescriptor )
+			{
+				_register( watch, inputChannel.fileDescriptor, EPOLLOUT );
+			}
+		}
+
+		if ( -1 == watch->pidFileDescriptor )
+		{
+			// No pidfd; rely on SIGCHLD
+			_installSignalHandler();
+			mUnwatchable.push_back( watch );
+		}
+
+		// Sweep once in case the child has already exited
+		_wake();
+
+		return 0;
+	}
+};
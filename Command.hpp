@@ -5,80 +5,204 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <fcntl.h>
+#include <functional>
+#include <initializer_list>
 #include <map>
+#include <memory>
 #include <new>
 #include <signal.h>
 #include <string>
+#include <string_view>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 #include <vector>
 
+#include "ArgumentArena.hpp"
+#include "CaptureBuffer.hpp"
+#include "ChildProcess.hpp"
+#include "ChildReaper.hpp"
+#include "CommandFuture.hpp"
+#include "CommandSpec.hpp"
+#include "CommandTrace.hpp"
+#include "EnvironmentBlock.hpp"
+#include "ExecutableCache.hpp"
+#include "FileDescriptorPlan.hpp"
+#include "LaunchState.hpp"
+#include "LineSink.hpp"
+#include "LogFileNamer.hpp"
+#include "OutputReader.hpp"
+#include "ProcessAttributes.hpp"
+#include "RetryPolicy.hpp"
+#include "RotatingLog.hpp"
+#include "RotatingLogSink.hpp"
+#include "SpawnPlan.hpp"
+#include "SpawnServer.hpp"
+#include "StreamSink.hpp"
+#include "TerminationPolicy.hpp"
+#include "Watchdog.hpp"
+
 /**
  * Minimum required standard: C++17
  * Notes:
- *   - Not thread safe
+ *   - execute(), wait(), waitFor(), waitUntil(), terminate(), isRunning()
+ *     and the accessors of the outcome are thread safe; they may be called
+ *     at once from any number of threads. The Command is otherwise not
+ *     thread safe: set it up, copy or destroy it from one thread at a time.
  *   - clear(), terminate(), isRunning() are asynchronous.
  *   - terminate() can be made to be synchronous by supplying
  *     true as the parameter argument; which is false by default.
+ *   - waitFor() and waitUntil() bound the wait, setTimeout() bounds
+ *     the run of the child itself; see setTerminationPolicy().
+ *   - Copies share the CommandSpec of what is launched, and only copy it
+ *     once changed; a copy per execution is cheap. See spec().
  *
  * TODO:
- *   [ ] Capture std{err,out} from Command as either a string or a vector of strings.
- *   [ ] Implement redirect of stderr to stdout.
+ *   [x] Capture std{err,out} from Command as either a string or a vector of strings.
+ *   [x] Implement redirect of stderr to stdout.
  *
  * A management class for executing other applications
  * without all the hassle of having to write the same code repeatedly.
  *
  * There is a CommandPipeline object that can be used to daisy chain
  * Command objects into a complete pipeline. Only stdout is piped to stdin
- * per the usual piping behaviour. Redirecting stderr to stdout is something
- * that will need to be implemented here in Command.hpp.
+ * per the usual piping behaviour; redirectStderrToStdout() sends stderr
+ * down the pipe as well, and setFileDescriptorPlan() sets up any other
+ * descriptor of the child.
  *
- * At the moment a 1-to-many (for std(out|err) to many stdin) is not needed
- * any where, but should the occasion arise I can integrate that behaviour
- * at a later point in time.
+ * A 1-to-many (stdout to many stdin) is handled by the CommandPipeline, which
+ * can fan the output of its final stage out to several consumers and tap a
+ * copy of the output of any stage off to a file or a callback.
  */
 class Command
 {
 private:
+	friend class CommandBatch;
+	friend class CommandGraph;
 	friend class CommandPipeline;
 
-	char* mApplication; // Path to the application to be called
-	char** mArguments;  // Arguments to be passed to the application
-	size_t mArgumentCount; // Number of arguments present
-	size_t mArgumentsBufferSize; // Size of the arguments buffer
+	template < size_t >
+	friend class CommandTemplate;
+
+	LaunchState mLaunchState; // Idle, Spawning, Running or Exited
+
+	// The most recently launched child process, kept after it exits. Only
+	// accessed through std::atomic_load() and std::atomic_store(), as it is
+	// replaced by a launch while other threads may be reading it.
+	std::shared_ptr< ChildProcess > mChildProcess;
+
+	std::atomic< SpawnStage > mFailedSpawnStage; // Stage at which the most recent launch failed
+
+	// What is launched; shared with copies of this Command and
+	// copied on the first change made while it is shared.
+	std::shared_ptr< CommandSpec > mSpec;
+
+	// Add the file actions of the descriptor plan to the launch plan, after
+	// those of the standard streams. Each descriptor of the child is resolved
+	// to the descriptor of the parent it ends up a copy of, so that the actions
+	// hold in any order; one that is itself a target in the child is first
+	// copied clear of the targets, so that no action overwrites the source of
+	// a later one.
+	// @param sources The descriptors of the parent the standard streams are copies of.
+	// @param openedFDs Appended each descriptor opened here, for the caller to close once launched.
+	// @return Zero is returned on success, else a negative error code.
+	int _addFileDescriptorPlan(
+		SpawnPlan& spawnPlan,
+		const int sources[ 3 ],
+		std::vector< int >& openedFDs ) const
+	{
+		const std::vector< FileDescriptorPlan::Redirect >& redirects = mSpec->mSettings->fileDescriptorPlan.mRedirects;
+		std::map< int, int > copies = { { STDIN_FILENO, sources[ 0 ] }, { STDOUT_FILENO, sources[ 1 ] }, { STDERR_FILENO, sources[ 2 ] } };
+		int highestTarget = STDERR_FILENO;
+
+		for ( const FileDescriptorPlan::Redirect& redirect : redirects )
+		{
+			int source = redirect.sourceFileDescriptor;
+
+			highestTarget = std::max( highestTarget, redirect.fileDescriptor );
+
+			if ( FileDescriptorPlan::Kind::File == redirect.kind )
+			{
+				if ( -1 == ( source = open( redirect.filePath.c_str(), redirect.openFlags | O_CLOEXEC, 0644 ) ) )
+				{
+					return -errno;
+				}
+
+				openedFDs.push_back( source );
+			}
+			else if ( FileDescriptorPlan::Kind::Duplicate == redirect.kind )
+			{
+				// A descriptor not yet set up in the child is inherited from the parent
+				auto copy = copies.find( redirect.sourceFileDescriptor );
+				source = ( copies.end() == copy ) ? redirect.sourceFileDescriptor : copy->second;
+
+				if ( -1 == source )
+				{
+					return -EBADF;
+				}
+			}
+			else if ( FileDescriptorPlan::Kind::Close == redirect.kind )
+			{
+				source = -1;
+			}
+
+			copies[ redirect.fileDescriptor ] = source;
+		}
+
+		for ( auto& copy : copies )
+		{
+			auto target = copies.find( copy.second );
+
+			if ( ( -1 != copy.second ) and ( copies.end() != target ) and ( target->first != target->second ) )
+			{
+				int source = fcntl( copy.second, F_DUPFD_CLOEXEC, highestTarget + 1 );
+
+				if ( -1 == source )
+				{
+					return -errno;
+				}
 
-	// User set environment variables
-	std::map< std::string, std::string > mEnvironmentVariables;
+				openedFDs.push_back( source );
+				copy.second = source;
+			}
+		}
 
-	// If set, clear the preset environment variables
-	// before setting the user defined variables.
-	bool mClearEnvironmentVariables;
+		for ( const auto& copy : copies )
+		{
+			if ( not mSpec->mSettings->fileDescriptorPlan._redirects( copy.first ) )
+			{
+				continue;
+			}
 
-	std::atomic< uint32_t > mExecuteCalled;
-	std::atomic< bool > mIsExecuting;
-	std::atomic< bool > mSetForClear;
-	std::atomic< bool > mTerminateCalled;
+			if ( -1 == copy.second )
+			{
+				spawnPlan.addClose( copy.first );
+			}
+			else
+			{
+				spawnPlan.addDup2( copy.second, copy.first );
+			}
+		}
 
-	// 0 < mChildProcessID :: T == mIsExecuting
-	std::atomic< pid_t > mChildProcessID; // PID of the child process
-	//pid_t mChildProcessID; // PID of the child process
-	std::atomic< int > mExitStatus;
-	//int mExitStatus; // Exit status of the child process
+		if ( mSpec->mSettings->fileDescriptorPlan.mCloseOthers )
+		{
+			spawnPlan.closeFrom( STDERR_FILENO + 1 );
+		}
 
-	bool mRedirectStdoutToLogFile; // The stdout stream should be redirected to a log file
-	bool mRedirectStderrToLogFile; // The stderr stream should be redirected to a log file
-	std::string mStdoutLogFilePrefix; // Prefix of the stdout log file
-	std::string mStderrLogFilePrefix; // Prefix of the stderr log file
+		return 0;
+	}
 
 	// Append arguments to the end of the arguments list;
 	// expanding the list if needed.
@@ -86,7 +210,7 @@ private:
 		const std::vector< std::string >& arguments )
 	{
 		// Ignore the request if we're currently executing
-		if ( ( 0 == mExecuteCalled.load() ) and ( 0 > mChildProcessID.load() ) )
+		if ( _isExecuting() )
 		{
 			return;
 		}
@@ -97,28 +221,41 @@ private:
 			return;
 		}
 
-		// If needed, update the array size first
-		if ( mArgumentsBufferSize < ( mArgumentCount + arguments.size() + 1 ) )
-		{
-			size_t additionalBlock = 128 * ( ( arguments.size() + 127 ) / 128 );
-			void* newArray = realloc( mArguments, mArgumentsBufferSize + additionalBlock );
+		CommandSpec& spec = _mutableSpec();
 
-			if ( nullptr == newArray )
-			{
-				throw std::bad_alloc();
-			}
+		for ( const std::string& argument : arguments )
+		{
+			spec.mArguments.append( argument.data(), argument.size() );
+		}
+	}
 
-			mArguments = static_cast< char** >( newArray );
-			for ( size_t index( additionalBlock ); index--;
-				mArguments[ mArgumentsBufferSize + index ] = nullptr );
-			mArgumentsBufferSize += additionalBlock;
+	// Hand the read end of an output pipe to its reader, or to the child
+	// process to be drained into its sink. Nothing is done for -1.
+	static void _attachOutput(
+		ChildProcess& childProcess,
+		int fileDescriptor,
+		const std::shared_ptr< OutputSink >& sink,
+		const std::shared_ptr< OutputReader >& reader )
+	{
+		if ( -1 == fileDescriptor )
+		{
+			return;
 		}
 
-		// Append arguments to the end of the array
-		for ( const std::string& argument : arguments )
+		if ( nullptr != reader )
 		{
-			mArguments[ mArgumentCount++ ] = strdup( argument.c_str() );
+			reader->attach( fileDescriptor );
+			return;
 		}
+
+		sink->begin();
+		childProcess.addOutput( fileDescriptor, sink );
+	}
+
+	// Get the most recently launched child process, if any.
+	std::shared_ptr< ChildProcess > _childProcess() const
+	{
+		return std::atomic_load( &mChildProcess );
 	}
 
 	// Free and zero the contents of this Command object.
@@ -127,148 +264,77 @@ private:
 		// Terminate the child process
 		this->terminate( true );
 
-		// Clear the application
-		if ( nullptr != mApplication )
-		{
-			free( mApplication );
-			mApplication = nullptr;
-		}
+		std::atomic_store( &mChildProcess, std::shared_ptr< ChildProcess >() );
+		mLaunchState.reset();
+		mFailedSpawnStage = SpawnStage::None;
+		mSpec = CommandSpec::_empty();
+	}
 
-		// Clear the arguments
-		if ( nullptr != mArguments )
+	// Close each file descriptor that is open, skipping any that are -1.
+	static void _closeFileDescriptors(
+		std::initializer_list< int > fileDescriptors )
+	{
+		for ( int fileDescriptor : fileDescriptors )
 		{
-			for ( size_t index( -1 ); ++index < mArgumentsBufferSize; )
+			if ( -1 != fileDescriptor )
 			{
-				if ( nullptr != mArguments[ index ] )
-				{
-					free( mArguments[ index ] );
-					mArguments[ index ] = nullptr;
-				}
+				close( fileDescriptor );
 			}
-
-			free( mArguments );
-			mArguments = nullptr;
 		}
-
-		// Clear environment variables
-		mEnvironmentVariables.clear();
-		mClearEnvironmentVariables = false;
-
-		// Clear everything else
-		mArgumentCount = 0;
-		mArgumentsBufferSize = 0;
-
-		mExitStatus = 0;
-		mChildProcessID = -1;
-		mRedirectStdoutToLogFile = false;
-		mRedirectStderrToLogFile = false;
 	}
 
-	// Copy the contents of other to this instance.
+	// Copy the contents of other to this instance; the
+	// specification is shared rather than copied.
 	void _copyAssignment(
 		const Command& other )
 	{
 		this->_clear();
 
-		if ( nullptr != other.mApplication )
-		{
-			mApplication = strdup( other.mApplication );
-		}
-
-		mArgumentCount = other.mArgumentCount;
-		mArgumentsBufferSize = other.mArgumentsBufferSize;
-		mArguments = static_cast< char** >( calloc( mArgumentsBufferSize, sizeof( char* ) ) );
-		mEnvironmentVariables = other.mEnvironmentVariables;
-		mClearEnvironmentVariables = other.mClearEnvironmentVariables;
-
-		for ( size_t index( -1 ); ++index < mArgumentCount; )
-		{
-			mArguments[ index ] = strdup( other.mArguments[ index ] );
-		}
-
-		mRedirectStdoutToLogFile = other.mRedirectStdoutToLogFile;
-		mRedirectStderrToLogFile = other.mRedirectStderrToLogFile;
-		mStdoutLogFilePrefix = other.mStdoutLogFilePrefix;
-		mStderrLogFilePrefix = other.mStderrLogFilePrefix;
+		// Shared specifications are only ever read from
+		other._prepareSpec();
+		mSpec = other.mSpec;
 	}
 
-	// This method is intended to be called by
-	// the CommandPipeline class when initializing the pipeline.
-	int _forkRedirectToPipeAndExecute(
-		int* inPipe,
-		int* outPipe )
+	// Launch the child, relaunching it after the backoff of the retry policy
+	// upon a failure to launch that the policy retries. A terminate requested
+	// during a backoff stops the retries, with the error of the last attempt.
+	// @param attempt The number of attempts made so far; counted up by each.
+	// @return Zero is returned on success, else the error of the last attempt.
+	int _execute(
+		unsigned& attempt )
 	{
-		pid_t childProcessID;
-		std::string stdoutLogFilePath;
-		std::string stderrLogFilePath;
-
-		_getStdLogFilePaths( stdoutLogFilePath, stderrLogFilePath );
-
-		childProcessID = vfork();
-		if ( 0 > childProcessID )
-		{
-			return -errno;
-		}
+		const RetryPolicy& retryPolicy = mSpec->mSettings->retryPolicy;
+		int errorCode = 0;
 
-		// Child process
-		if ( 0 == childProcessID )
+		do
 		{
-			if ( nullptr != inPipe )
+			if ( 0 != attempt++ )
 			{
-				// Capture STDIN if we have a pipe
-				dup2( inPipe[ 0 ], STDIN_FILENO );
-				close( inPipe[ 0 ] );
-				close( inPipe[ 1 ] );
-			}
-
-			if ( nullptr != outPipe )
-			{
-				// Redirect STDOUT if we have a pipe
-				dup2( outPipe[ 1 ], STDOUT_FILENO );
-				close( outPipe[ 0 ] );
-				close( outPipe[ 1 ] );
-			}
+				std::this_thread::sleep_for( retryPolicy.backoff( attempt ) );
 
-			if ( mRedirectStderrToLogFile )
-			{
-				// Redirect STDERR to a log file
-				int stderrLogFileFD;
-				if ( -1 == ( stderrLogFileFD = open( stderrLogFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) )
+				if ( mLaunchState.terminateRequested() )
 				{
-					_exit( EXIT_FAILURE );
+					return errorCode;
 				}
-
-				dup2( stderrLogFileFD, STDERR_FILENO );
-				close( stderrLogFileFD );
-			}
-
-			if ( mClearEnvironmentVariables )
-			{
-				clearenv();
-			}
-
-			for ( const auto& [ variableName, value ] : mEnvironmentVariables )
-			{
-				setenv( variableName.c_str(), value.c_str(), true );
-			}
-
-			if ( '/' == mApplication[ 0 ] )
-			{
-				execv( mApplication, mArguments );
-			}
-			else
-			{
-				execvp( mApplication, mArguments );
 			}
 
-			_exit( EXIT_FAILURE );
-			return -EPERM;
-		}
+			errorCode = _launch( nullptr, nullptr );
+		} while ( retryPolicy.retriesLaunch( errorCode ) and ( attempt < retryPolicy.maxAttempts ) );
 
-		// Parent process
-		mChildProcessID = childProcessID;
+		return errorCode;
+	}
 
-		return 0;
+	// This method is intended to be called by
+	// the CommandPipeline class when initializing the pipeline.
+	// The process group and session, if given, take the place of
+	// the process group of the termination policy.
+	int _forkRedirectToPipeAndExecute(
+		int* inPipe,
+		int* outPipe,
+		pid_t processGroup = -1,
+		bool newSession = false )
+	{
+		return _launch( inPipe, outPipe, processGroup, newSession );
 	}
 
 	// Generate the name of the log files for stdout and stderr
@@ -276,25 +342,26 @@ private:
 		std::string& stdoutLogFilePath,
 		std::string& stderrLogFilePath )
 	{
-		time_t currentTime;
-		struct tm* currentTimeStruct;
-		char formattedTimeBuffer[ 128 ];
+		stdoutLogFilePath.clear();
+		stderrLogFilePath.clear();
 
-		time( &currentTime );
-		currentTimeStruct = localtime( &currentTime );
-		strftime( formattedTimeBuffer, sizeof( formattedTimeBuffer ),
-			"_%Y%m%d%H%M%S", currentTimeStruct );
+		// Nothing to name; skip the clock and the sequence number
+		if ( not ( mSpec->mRedirectStdoutToLogFile or mSpec->mRedirectStderrToLogFile ) )
+		{
+			return;
+		}
 
-		std::string dateTimeBasenameSuffix( formattedTimeBuffer );
+		// Shared by both streams; unique to this launch
+		std::string dateTimeBasenameSuffix = LogFileNamer::instance().suffix();
 
-		if ( mRedirectStdoutToLogFile )
+		if ( mSpec->mRedirectStdoutToLogFile )
 		{
-			if ( not mStdoutLogFilePrefix.empty() )
+			if ( not mSpec->mSettings->stdoutLogFilePrefix.empty() )
 			{
-				stdoutLogFilePath = mStdoutLogFilePrefix + "_";
+				stdoutLogFilePath = mSpec->mSettings->stdoutLogFilePrefix + "_";
 			}
 
-			stdoutLogFilePath.append( mArguments[ 0 ] );
+			stdoutLogFilePath.append( mSpec->mArguments[ 0 ] );
 			stdoutLogFilePath.append( dateTimeBasenameSuffix );
 			stdoutLogFilePath.append( ".stdout.log" );
 		}
@@ -303,14 +370,14 @@ private:
 			stdoutLogFilePath.clear();
 		}
 
-		if ( mRedirectStderrToLogFile )
+		if ( mSpec->mRedirectStderrToLogFile )
 		{
-			if ( not mStderrLogFilePrefix.empty() )
+			if ( not mSpec->mSettings->stderrLogFilePrefix.empty() )
 			{
-				stderrLogFilePath = mStderrLogFilePrefix + "_";
+				stderrLogFilePath = mSpec->mSettings->stderrLogFilePrefix + "_";
 			}
 
-			stderrLogFilePath.append( mArguments[ 0 ] );
+			stderrLogFilePath.append( mSpec->mArguments[ 0 ] );
 			stderrLogFilePath.append( dateTimeBasenameSuffix );
 			stderrLogFilePath.append( ".stderr.log" );
 		}
@@ -320,82 +387,219 @@ private:
 		}
 	}
 
+	// Check if there is a child process that has yet to be reaped
+	bool _hasRunningChild() const
+	{
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+		return ( nullptr != childProcess ) and ( not childProcess->hasExited() );
+	}
+
 	// Initialize the Command object
 	void _initialize()
 	{
-		mApplication = nullptr;
-		mArgumentCount = 1;
-		mArgumentsBufferSize = 128;
-		mArguments = static_cast< char** >( calloc( mArgumentsBufferSize, sizeof( char* ) ) );
-		mEnvironmentVariables.clear();
-		mClearEnvironmentVariables = false;
-		mChildProcessID = -1;
-		mExitStatus = 0;
-		mRedirectStdoutToLogFile = false;
-		mRedirectStderrToLogFile = false;
-		mStdoutLogFilePrefix.clear();
-		mStderrLogFilePrefix.clear();
+		mLaunchState.reset();
+		std::atomic_store( &mChildProcess, std::shared_ptr< ChildProcess >() );
+		mFailedSpawnStage = SpawnStage::None;
+		mSpec = CommandSpec::_empty();
+	}
+
+	// Check if the execute method is in progress or the child is yet to be reaped
+	bool _isExecuting() const
+	{
+		return ( LaunchState::Phase::Spawning == mLaunchState.phase() ) or _hasRunningChild();
+	}
+
+	// Launch the child through the Spawning state, from Idle or Exited; so that
+	// of threads launching at once only one does. A terminate requested by
+	// another thread during the launch is delivered once the child is started.
+	int _launch(
+		int* inPipe,
+		int* outPipe,
+		pid_t processGroup = -1,
+		bool newSession = false )
+	{
+		std::shared_ptr< ChildProcess > childProcess;
+		uint32_t launch;
+
+		// The child may have been reaped, by the ChildReaper say, without being waited on
+		if ( ( LaunchState::Phase::Running == mLaunchState.phase( launch ) )
+			and ( nullptr != ( childProcess = _childProcess() ) ) and childProcess->hasExited() )
+		{
+			mLaunchState.markExited( launch );
+		}
+
+		if ( not mLaunchState.beginSpawn() )
+		{
+			return -ECANCELED;
+		}
+
+		int errorCode = _spawn( inPipe, outPipe, processGroup, newSession );
+		LaunchState::Phase phase = ( 0 == errorCode ) ? LaunchState::Phase::Running
+			: ( ( nullptr == _childProcess() ) ? LaunchState::Phase::Idle : LaunchState::Phase::Exited );
+
+		if ( mLaunchState.endSpawn( phase ) )
+		{
+			_terminateChild( _childProcess() );
+		}
+
+		return errorCode;
 	}
 
 	// Move the contents of other to this instance.
 	void _moveAssignment(
 		Command&& other )
 	{
-		mApplication = std::exchange( other.mApplication, nullptr );
-		mArguments = std::exchange( other.mArguments, nullptr );
-		mArgumentCount = std::exchange( other.mArgumentCount, 0 );
-		mArgumentsBufferSize = std::exchange( other.mArgumentsBufferSize, 0 );
-		mEnvironmentVariables = std::move( other.mEnvironmentVariables );
-		mClearEnvironmentVariables = std::exchange( other.mClearEnvironmentVariables, false );
+		std::atomic_store( &mChildProcess, std::atomic_exchange( &other.mChildProcess, std::shared_ptr< ChildProcess >() ) );
+		mLaunchState = other.mLaunchState;
+		other.mLaunchState.reset();
+		mFailedSpawnStage = other.mFailedSpawnStage.exchange( SpawnStage::None );
+		mSpec = std::exchange( other.mSpec, CommandSpec::_empty() );
+	}
+
+	// Get the specification to change, copying it first should it be shared.
+	CommandSpec& _mutableSpec()
+	{
+		if ( 1 != mSpec.use_count() )
+		{
+			mSpec = std::shared_ptr< CommandSpec >( new CommandSpec( *mSpec ) );
+		}
+
+		// Any change may move the arguments the vector points into
+		mSpec->mArgv = nullptr;
+		return *mSpec;
+	}
+
+	// Open what the stdin stream of the child is to be redirected to, if anything.
+	// For data fed from memory, {@param parentFD} is set to the write end of the pipe.
+	int _openStdin(
+		int& childFD,
+		int& parentFD ) const
+	{
+		int pipeFDs[ 2 ];
+
+		switch ( mSpec->mStdinSource )
+		{
+		case CommandSpec::StdinSource::Data:
+			if ( -1 == pipe2( pipeFDs, O_CLOEXEC ) )
+			{
+				return -errno;
+			}
+
+			childFD = pipeFDs[ 0 ];
+			parentFD = pipeFDs[ 1 ];
+			break;
+
+		case CommandSpec::StdinSource::FileDescriptor:
+			// Duplicated so that the caller keeps ownership of theirs
+			if ( -1 == ( childFD = fcntl( mSpec->mStdinFileDescriptor, F_DUPFD_CLOEXEC, 0 ) ) )
+			{
+				return -errno;
+			}
+
+			break;
+
+		case CommandSpec::StdinSource::File:
+			// Handed to the child directly, nothing is copied through the parent
+			if ( -1 == ( childFD = open( mSpec->mSettings->stdinFilePath.c_str(), O_RDONLY | O_CLOEXEC ) ) )
+			{
+				return -errno;
+			}
+
+			break;
+
+		case CommandSpec::StdinSource::Inherit:
+			break;
+		}
+
+		return 0;
+	}
+
+	// Open what a standard stream of the child is to be redirected to, if anything.
+	// A pipe read into a sink or by a reader takes precedence over a log file.
+	static int _openStdStream(
+		bool readByParent,
+		bool logToFile,
+		const std::string& logFilePath,
+		int& childFD,
+		int& parentFD )
+	{
+		int pipeFDs[ 2 ];
+
+		if ( readByParent )
+		{
+			if ( -1 == pipe2( pipeFDs, O_CLOEXEC ) )
+			{
+				return -errno;
+			}
+
+			parentFD = pipeFDs[ 0 ];
+			childFD = pipeFDs[ 1 ];
+		}
+		else if ( logToFile )
+		{
+			if ( -1 == ( childFD = open( logFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 ) ) )
+			{
+				return -errno;
+			}
+		}
+
+		return 0;
+	}
+
+	// Build the envp block and argument vector of the specification, if stale.
+	// Only an unshared specification is ever stale, so this never races a launch.
+	void _prepareSpec() const
+	{
+		mSpec->_prepare();
+	}
+
+	// Get the value of PATH the child will search for the application
+	std::string _searchPath() const
+	{
+		auto variable = mSpec->mSettings->environmentVariables.find( "PATH" );
 
-		mChildProcessID = other.mChildProcessID.exchange( -1 );
-		mExitStatus = std::exchange( other.mExitStatus, 0 );
+		if ( mSpec->mSettings->environmentVariables.end() != variable )
+		{
+			return variable->second;
+		}
 
-		mRedirectStdoutToLogFile = std::exchange( other.mRedirectStdoutToLogFile, false );
-		mRedirectStderrToLogFile = std::exchange( other.mRedirectStderrToLogFile, false );
-		mStdoutLogFilePrefix = std::move( other.mStdoutLogFilePrefix );
-		mStderrLogFilePrefix = std::move( other.mStderrLogFilePrefix );
+		const char* searchPath = mSpec->mSettings->clearEnvironmentVariables ? nullptr : getenv( "PATH" );
+
+		// Same default as execvp() when PATH is not set
+		return std::string( ( nullptr == searchPath ) ? "/bin:/usr/bin" : searchPath );
 	}
 
-	// Set the name of the application in both mApplication and mArguments[ 0 ]
+	// Set the name of the application in both mApplication and mArguments[ 0 ] of the specification
 	void _setApplication(
 		const char* application )
 	{
 		// If we're currently executing, do nothing.
-		if ( ( 0 != mExecuteCalled.load() ) or ( 0 < mChildProcessID.load() ) )
+		if ( _isExecuting() )
 		{
 			return;
 		}
 
-		if ( nullptr != mApplication )
-		{
-			free( mApplication );
-			mApplication = nullptr;
-		}
+		CommandSpec& spec = _mutableSpec();
+		CommandSpec::Settings& settings = spec._mutableSettings();
 
-		if ( nullptr != mArguments[ 0 ] )
+		if ( nullptr != settings.application )
 		{
-			free( mArguments[ 0 ] );
-			mArguments[ 0 ] = nullptr;
+			free( settings.application );
+			settings.application = nullptr;
 		}
 
 		if ( ( nullptr == application )
 			or ( 0 == strlen( application ) ) )
 		{
+			spec.mArguments.assign( 0, "", 0 );
 			return;
 		}
 
-		mApplication = strdup( application );
+		settings.application = strdup( application );
 		const char* forwardSlash = strrchr( application, '/' );
+		const char* name = ( nullptr != forwardSlash ) ? ( forwardSlash + 1 ) : application;
 
-		if ( nullptr != forwardSlash )
-		{
-			mArguments[ 0 ] = strdup( forwardSlash + 1 );
-		}
-		else
-		{
-			mArguments[ 0 ] = strdup( application );
-		}
+		spec.mArguments.assign( 0, name, strlen( name ) );
 	}
 
 	// Set the user set environment variables
@@ -403,75 +607,316 @@ private:
 		const std::map< std::string, std::string >& environmentVariables )
 	{
 		// Ignore the request if we're currently executing
-		if ( ( 0 == mExecuteCalled.load() ) and ( 0 > mChildProcessID.load() ) )
+		if ( _isExecuting() )
 		{
 			return;
 		}
 
+		CommandSpec::Settings& settings = _mutableSpec()._mutableSettings();
+
 		for ( const auto& [ variableName, value ] : environmentVariables )
 		{
 			if ( not variableName.empty() )
 			{
-				mEnvironmentVariables[ variableName ] = value;
+				settings.environmentVariables[ variableName ] = value;
+				settings.environmentBlockValid = false;
 			}
 		}
 	}
-public:
-	/**
-	 * Default constructor to empty command.
-	 */
-	Command()
-	{
-		_initialize();
-	}
 
-	/**
-	 * Move constructor.
-	 * @param other Command object to move to this instance.
-	 */
-	Command(
-		Command&& other )
+	// Prepare the launch plan in the parent and spawn the child.
+	// The log files and capture pipes are opened here so that
+	// the child only has to dup2 and exec.
+	int _spawn(
+		int* inPipe,
+		int* outPipe,
+		pid_t processGroup,
+		bool newSession )
 	{
-		_initialize();
-		_moveAssignment( std::move( other ) );
-	}
+		int errorCode = 0;
+		int pidFileDescriptor;
+		pid_t childProcessID;
+		int stdinFD = -1; // What STDIN of the child is redirected to
+		int stdinWriteFD = -1; // Write end of the STDIN pipe fed by the parent
+		int stdoutFD = -1; // What STDOUT of the child is redirected to
+		int stderrFD = -1; // What STDERR of the child is redirected to
+		int stdoutReadFD = -1; // Read end of the STDOUT pipe read by the parent
+		int stderrReadFD = -1; // Read end of the STDERR pipe read by the parent
+		std::string stdoutLogFilePath;
+		std::string stderrLogFilePath;
+		std::vector< int > planFDs; // Opened for the descriptor plan
+		const FileDescriptorPlan& fileDescriptorPlan = mSpec->mSettings->fileDescriptorPlan;
 
-	/**
-	 * Copy constructor.
-	 * @param other Command object to copy to this instance.
-	 */
-	Command(
-		const Command& other )
-	{
-		_initialize();
-		_copyAssignment( other );
-	}
+		mFailedSpawnStage = SpawnStage::None;
 
-	/**
-	 * Construct the command and set the application to be ran.
-	 * @param application Name of the application to execute.
-	 */
-	Command(
-		const char* application )
-	{
-		_initialize();
-		_setApplication( application );
-	}
+		if ( nullptr == mSpec->mSettings->application )
+		{
+			return -EINVAL;
+		}
 
-	/**
-	 * Construct the command and set the application to be ran.
-	 * @param application Name of the application to execute.
-	 */
-	Command(
-		const std::string& application )
-	{
-		_initialize();
-		_setApplication( application.c_str() );
-	}
+		std::chrono::steady_clock::time_point traceStart = CommandTrace::now();
+		CommandTrace::emit( TraceObserver::Event::PreSpawn, std::chrono::nanoseconds( 0 ), 0, 0, mSpec->mSettings->application );
 
-	/**
-	 * Construct the command and set the application and arguments.
-	 * @param application Name of the application to execute.
+		_getStdLogFilePaths( stdoutLogFilePath, stderrLogFilePath );
+
+		// A standard stream replaced by the descriptor plan is not set up
+		if ( ( nullptr == inPipe ) and ( not fileDescriptorPlan._replaces( STDIN_FILENO ) ) )
+		{
+			errorCode = _openStdin( stdinFD, stdinWriteFD );
+		}
+
+		if ( ( 0 == errorCode ) and ( nullptr == outPipe ) and ( not fileDescriptorPlan._replaces( STDOUT_FILENO ) ) )
+		{
+			errorCode = _openStdStream( ( nullptr != mSpec->mStdoutSink ) or ( nullptr != mSpec->mStdoutReader ),
+				mSpec->mRedirectStdoutToLogFile, stdoutLogFilePath, stdoutFD, stdoutReadFD );
+		}
+
+		if ( ( 0 == errorCode ) and ( not fileDescriptorPlan._replaces( STDERR_FILENO ) ) )
+		{
+			errorCode = _openStdStream( ( nullptr != mSpec->mStderrSink ) or ( nullptr != mSpec->mStderrReader ),
+				mSpec->mRedirectStderrToLogFile, stderrLogFilePath, stderrFD, stderrReadFD );
+		}
+
+		if ( 0 != errorCode )
+		{
+			_closeFileDescriptors( { stdinFD, stdoutFD, stderrFD, stdinWriteFD, stdoutReadFD, stderrReadFD } );
+			mFailedSpawnStage = SpawnStage::OpenStream;
+			return errorCode;
+		}
+
+		_prepareSpec();
+
+		// Skip the PATH walk when the executable has already been resolved
+		std::string resolvedApplication = this->resolve();
+		const char* application = resolvedApplication.empty()
+			? mSpec->mSettings->application : resolvedApplication.c_str();
+
+		SpawnPlan spawnPlan( application, mSpec->mArgv, mSpec->mSettings->environmentBlock.data() );
+		spawnPlan.setBackend( mSpec->mSpawnBackend );
+		spawnPlan.setProcessAttributes( &mSpec->mSettings->processAttributes );
+
+		if ( newSession )
+		{
+			spawnPlan.setNewSession( true );
+		}
+		else if ( -1 != processGroup )
+		{
+			spawnPlan.setProcessGroup( processGroup );
+		}
+		else if ( mSpec->mTerminationPolicy.processGroup )
+		{
+			// Lead a new process group, so that it can be signalled as one
+			spawnPlan.setProcessGroup( 0 );
+		}
+
+		int sources[ 3 ] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+
+		if ( nullptr != inPipe )
+		{
+			// Capture STDIN if we have a pipe
+			spawnPlan.addDup2( sources[ 0 ] = inPipe[ 0 ], STDIN_FILENO );
+		}
+		else if ( -1 != stdinFD )
+		{
+			// Redirect STDIN from memory, a file descriptor or a file
+			spawnPlan.addDup2( sources[ 0 ] = stdinFD, STDIN_FILENO );
+		}
+
+		if ( nullptr != outPipe )
+		{
+			// Redirect STDOUT if we have a pipe
+			spawnPlan.addDup2( sources[ 1 ] = outPipe[ 1 ], STDOUT_FILENO );
+		}
+		else if ( -1 != stdoutFD )
+		{
+			// Redirect STDOUT to a capture pipe or log file
+			spawnPlan.addDup2( sources[ 1 ] = stdoutFD, STDOUT_FILENO );
+		}
+
+		if ( -1 != stderrFD )
+		{
+			// Redirect STDERR to a capture pipe or log file
+			spawnPlan.addDup2( sources[ 2 ] = stderrFD, STDERR_FILENO );
+		}
+
+		if ( ( not fileDescriptorPlan.empty() )
+			and ( 0 != ( errorCode = _addFileDescriptorPlan( spawnPlan, sources, planFDs ) ) ) )
+		{
+			_closeFileDescriptors( { stdinFD, stdoutFD, stderrFD, stdinWriteFD, stdoutReadFD, stderrReadFD } );
+
+			for ( int fileDescriptor : planFDs )
+			{
+				close( fileDescriptor );
+			}
+
+			mFailedSpawnStage = SpawnStage::OpenStream;
+			return errorCode;
+		}
+
+		// The pipeline ends are closed once the plan has copied what it needs of them;
+		// unless the plan has put a descriptor of its own in their place
+		for ( int fileDescriptor : { ( nullptr != inPipe ) ? inPipe[ 0 ] : -1, ( nullptr != inPipe ) ? inPipe[ 1 ] : -1,
+			( nullptr != outPipe ) ? outPipe[ 0 ] : -1, ( nullptr != outPipe ) ? outPipe[ 1 ] : -1 } )
+		{
+			if ( ( -1 != fileDescriptor ) and ( not fileDescriptorPlan._redirects( fileDescriptor ) ) )
+			{
+				spawnPlan.addClose( fileDescriptor );
+			}
+		}
+
+		if ( SpawnBackend::SpawnServer == mSpec->mSpawnBackend )
+		{
+			errorCode = SpawnServer::instance().spawn( spawnPlan, childProcessID, pidFileDescriptor );
+		}
+
+		// Launch the child ourselves if the spawn server is not available
+		if ( ( SpawnBackend::SpawnServer != mSpec->mSpawnBackend ) or ( -ENOTCONN == errorCode ) )
+		{
+			errorCode = spawnPlan.spawn( childProcessID, pidFileDescriptor );
+		}
+
+		_closeFileDescriptors( { stdinFD, stdoutFD, stderrFD } );
+
+		for ( int fileDescriptor : planFDs )
+		{
+			close( fileDescriptor );
+		}
+
+		if ( 0 != errorCode )
+		{
+			CommandTrace::emit( TraceObserver::Event::ExecFailed, CommandTrace::now() - traceStart, 0, -errorCode, mSpec->mSettings->application );
+			_closeFileDescriptors( { stdinWriteFD, stdoutReadFD, stderrReadFD } );
+			mFailedSpawnStage = spawnPlan.failedStage();
+			return errorCode;
+		}
+
+		CommandTrace::emit( TraceObserver::Event::Spawned, CommandTrace::now() - traceStart, childProcessID, 0, mSpec->mSettings->application );
+
+		std::shared_ptr< ChildProcess > childProcess = std::make_shared< ChildProcess >( childProcessID, pidFileDescriptor );
+
+		if ( -1 != stdinWriteFD )
+		{
+			childProcess->addInput( stdinWriteFD, mSpec->mStdinData );
+		}
+
+		_attachOutput( *childProcess, stdoutReadFD, mSpec->mStdoutSink, mSpec->mStdoutReader );
+		_attachOutput( *childProcess, stderrReadFD, mSpec->mStderrSink, mSpec->mStderrReader );
+
+		for ( const auto& exitCallback : mSpec->mSettings->exitCallbacks )
+		{
+			childProcess->onExit( exitCallback );
+		}
+
+		// Published before the Running state, which readers check first
+		std::atomic_store( &mChildProcess, childProcess );
+
+		if ( not mSpec->mSettings->exitCallbacks.empty() )
+		{
+			ChildReaper::instance().watch( childProcess );
+		}
+
+		if ( 0 < mSpec->mTimeout.count() )
+		{
+			// Pin the PID for the duration of the timeout
+			childProcess->pidFileDescriptor();
+			Watchdog::instance().schedule( childProcess, std::chrono::steady_clock::now() + mSpec->mTimeout, mSpec->mTerminationPolicy );
+		}
+
+		return 0;
+	}
+
+	// Signal the child per the termination policy, once the terminate is requested.
+	int _terminateChild(
+		const std::shared_ptr< ChildProcess >& childProcess )
+	{
+		int errorCode = Watchdog::terminate( childProcess, mSpec->mTerminationPolicy );
+
+		if ( -ESRCH == errorCode )
+		{
+			// Exited in the meantime
+			return 0;
+		}
+
+		if ( 0 != errorCode )
+		{
+			mLaunchState.clearTerminate();
+		}
+
+		return errorCode;
+	}
+public:
+	/**
+	 * Default constructor to empty command.
+	 */
+	Command()
+	{
+		_initialize();
+	}
+
+	/**
+	 * Move constructor.
+	 * @param other Command object to move to this instance.
+	 */
+	Command(
+		Command&& other )
+	{
+		_initialize();
+		_moveAssignment( std::move( other ) );
+	}
+
+	/**
+	 * Copy constructor.
+	 * @param other Command object to copy to this instance.
+	 */
+	Command(
+		const Command& other )
+	{
+		_initialize();
+		_copyAssignment( other );
+	}
+
+	/**
+	 * Construct the command to launch a specification, shared rather than copied.
+	 * @param spec The specification to launch, taken from spec(). If null,
+	 *             then the command is empty.
+	 */
+	Command(
+		std::shared_ptr< const CommandSpec > spec )
+	{
+		_initialize();
+
+		if ( nullptr != spec )
+		{
+			// Never changed while shared; see _mutableSpec()
+			mSpec = std::const_pointer_cast< CommandSpec >( std::move( spec ) );
+		}
+	}
+
+	/**
+	 * Construct the command and set the application to be ran.
+	 * @param application Name of the application to execute.
+	 */
+	Command(
+		const char* application )
+	{
+		_initialize();
+		_setApplication( application );
+	}
+
+	/**
+	 * Construct the command and set the application to be ran.
+	 * @param application Name of the application to execute.
+	 */
+	Command(
+		const std::string& application )
+	{
+		_initialize();
+		_setApplication( application.c_str() );
+	}
+
+	/**
+	 * Construct the command and set the application and arguments.
+	 * @param application Name of the application to execute.
 	 * @param arguments A vector of arguments to set along with the application.
 	 */
 	Command(
@@ -555,7 +1000,99 @@ public:
 	 */
 	std::string applicationName() const
 	{
-		return std::string( ( nullptr == mApplication ) ? "" : mApplication );
+		return std::string( ( nullptr == mSpec->mSettings->application ) ? "" : mSpec->mSettings->application );
+	}
+
+	/**
+	 * Capture the stderr stream of this command in memory.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param limit Maximum number of bytes to capture. [default: CaptureBuffer::DefaultLimit]
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& captureStderr(
+		size_t limit = CaptureBuffer::DefaultLimit )
+	{
+		return this->captureStderr( std::make_shared< CaptureBuffer >( limit ) );
+	}
+
+	/**
+	 * Capture the stderr stream of this command into a caller supplied buffer.
+	 * The buffer is cleared, keeping its capacity, each time the command is executed.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param buffer The buffer to capture into. If null, then capture is disabled.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& captureStderr(
+		std::shared_ptr< CaptureBuffer > buffer )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStderrSink = std::move( buffer );
+		spec.mStderrReader.reset();
+		return *this;
+	}
+
+	/**
+	 * Capture the stdout stream of this command in memory.
+	 * For a stage of a CommandPipeline, this only applies to the last stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param limit Maximum number of bytes to capture. [default: CaptureBuffer::DefaultLimit]
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& captureStdout(
+		size_t limit = CaptureBuffer::DefaultLimit )
+	{
+		return this->captureStdout( std::make_shared< CaptureBuffer >( limit ) );
+	}
+
+	/**
+	 * Capture the stdout stream of this command into a caller supplied buffer.
+	 * The buffer is cleared, keeping its capacity, each time the command is executed.
+	 * For a stage of a CommandPipeline, this only applies to the last stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param buffer The buffer to capture into. If null, then capture is disabled.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& captureStdout(
+		std::shared_ptr< CaptureBuffer > buffer )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStdoutSink = std::move( buffer );
+		spec.mStdoutReader.reset();
+		return *this;
+	}
+
+	/**
+	 * Get the buffer the stderr stream is captured into.
+	 * The capture is complete once the command has been waited on.
+	 * @return The capture buffer is returned, or null if stderr is not being captured.
+	 */
+	std::shared_ptr< CaptureBuffer > capturedStderr() const
+	{
+		return std::dynamic_pointer_cast< CaptureBuffer >( mSpec->mStderrSink );
+	}
+
+	/**
+	 * Get the buffer the stdout stream is captured into.
+	 * The capture is complete once the command has been waited on.
+	 * @return The capture buffer is returned, or null if stdout is not being captured.
+	 */
+	std::shared_ptr< CaptureBuffer > capturedStdout() const
+	{
+		return std::dynamic_pointer_cast< CaptureBuffer >( mSpec->mStdoutSink );
 	}
 
 	/**
@@ -575,17 +1112,23 @@ public:
 	void clearEnvironmentVariables()
 	{
 		// Ignore the request if we're currently executing
-		if ( ( 0 == mExecuteCalled.load() ) and ( 0 > mChildProcessID.load() ) )
+		if ( _isExecuting() )
 		{
 			return;
 		}
 
-		mEnvironmentVariables.clear();
-		mClearEnvironmentVariables = true;
+		CommandSpec::Settings& settings = _mutableSpec()._mutableSettings();
+
+		settings.environmentVariables.clear();
+		settings.clearEnvironmentVariables = true;
+		settings.environmentBlockValid = false;
 	}
 
 	/**
 	 * Initialize the execution of the application.
+	 * A failure to launch that the retry policy retries is relaunched after
+	 * its backoff, blocking the caller; see setRetryPolicy(). The Command is
+	 * left to be executed again after any failure.
 	 * @return If the application was successfully initialized, then
 	 *         zero is returned, else a non-zero error code is returned.
 	 *         If another thread is alread present in this method, or
@@ -593,383 +1136,967 @@ public:
 	 */
 	int execute()
 	{
-		// Set that we're in the execute method
-		uint32_t previous = mExecuteCalled.fetch_add( 1 );
-
-		if ( 0 < previous )
-		{
-			mExecuteCalled.fetch_add( -1 );
-			return -ECANCELED;
-		}
-
-		// executeCalled is non-zero at this point
-		if ( 0 < mChildProcessID.load() )
-		{
-			mExecuteCalled.fetch_add( -1 );
-			return -ECANCELED;
-		}
-
-		mExitStatus = 0;
-
-		int childProcessID;
-		std::string stdoutLogFilePath;
-		std::string stderrLogFilePath;
-
-		_getStdLogFilePaths( stdoutLogFilePath, stderrLogFilePath );
+		unsigned attempt = 0;
+		return _execute( attempt );
+	}
 
-		childProcessID = vfork();
-		if ( 0 > childProcessID )
-		{
-			return -errno;
-		}
+	/**
+	 * Execute the command and wait for it to complete.
+	 * An exit that the retry policy retries is relaunched after its backoff,
+	 * unless the child was ended by terminate(); the launches all count
+	 * towards the attempts of the policy.
+	 * @return The exit status of the command is returned.
+	 */
+	int executeAndWait()
+	{
+		const RetryPolicy& retryPolicy = mSpec->mSettings->retryPolicy;
+		unsigned attempt = 0;
+		int returnCode = 0;
 
-		// Child process
-		if ( 0 == childProcessID )
+		for ( ;; )
 		{
-			int stdoutLogFileFD;
-			int stderrLogFileFD;
+			returnCode = _execute( attempt );
 
-			if ( mRedirectStdoutToLogFile )
+			if ( -ECANCELED == returnCode )
 			{
-				// Redirect STDOUT to a log file
-				if ( -1 == ( stdoutLogFileFD = open( stdoutLogFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) )
-				{
-					_exit( EXIT_FAILURE );
-				}
-
-				dup2( stdoutLogFileFD, STDOUT_FILENO );
+				// Launched by another thread, whose exit it is to retry
+				return this->wait();
 			}
 
-			if ( mRedirectStderrToLogFile )
+			if ( 0 != returnCode )
 			{
-				// Redirect STDERR to a log file
-				if ( -1 == ( stderrLogFileFD = open( stderrLogFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 ) ) )
-				{
-					_exit( EXIT_FAILURE );
-				}
-
-				dup2( stderrLogFileFD, STDERR_FILENO );
+				return returnCode;
 			}
 
-			if ( mClearEnvironmentVariables )
-			{
-				clearenv();
-			}
+			returnCode = this->wait();
 
-			for ( const auto& [ variableName, value ] : mEnvironmentVariables )
+			if ( ( attempt >= retryPolicy.maxAttempts ) or mLaunchState.terminateRequested()
+				or ( not retryPolicy.retriesExit( returnCode, this->terminatingSignal() ) ) )
 			{
-				setenv( variableName.c_str(), value.c_str(), true );
+				return returnCode;
 			}
+		}
+	}
 
-			if ( '/' == mApplication[ 0 ] )
-			{
-				execv( mApplication, mArguments );
-			}
-			else
-			{
-				execvp( mApplication, mArguments );
-			}
+	/**
+	 * Execute the command without blocking on its completion.
+	 * The child is reaped by the ChildReaper service, from which
+	 * the returned future is completed. As with execute(), destroying
+	 * or clearing this Command terminates the child.
+	 * @return A CommandFuture for the exit status of the command is returned.
+	 *         Should the execution fail to start, then the future is already
+	 *         completed with the error code returned by execute().
+	 */
+	CommandFuture executeAsync()
+	{
+		CommandFuture commandFuture;
+		int errorCode = this->execute();
 
-			_exit( EXIT_FAILURE );
-			return -EPERM;
+		if ( 0 != errorCode )
+		{
+			commandFuture.state()->complete( errorCode );
+			return commandFuture;
 		}
 
-		// Parent process
-		mChildProcessID = childProcessID;
-		mExecuteCalled.fetch_add( -1 );
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+		std::shared_ptr< CommandFuture::State > state = commandFuture.state();
+
+		childProcess->onExit( [ state ]( const ChildProcess& exitedProcess )
+		{
+			state->complete( exitedProcess.exitStatus() );
+		} );
+
+		// Commands with exit callbacks are already being watched
+		if ( mSpec->mSettings->exitCallbacks.empty() )
+		{
+			ChildReaper::instance().watch( childProcess );
+		}
+
+		return commandFuture;
+	}
+
+	/**
+	 * Get the exit status of the application executed. If the application
+	 * is currently running, or has yet to run, then this method returns zero.
+	 * An application killed by a signal exits with 128 plus the signal number.
+	 * @return Exit status of the command is returned.
+	 */
+	int exitStatus()
+	{
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+		return ( nullptr == childProcess ) ? 0 : childProcess->exitStatus();
+	}
+
+	/**
+	 * Get the stage at which the most recent execution failed to launch
+	 * the application; such as SpawnStage::Exec for a missing binary, as
+	 * opposed to the application running and exiting with a failure.
+	 * @return The stage is returned, SpawnStage::None if the launch did not fail.
+	 */
+	SpawnStage failedSpawnStage() const
+	{
+		return mFailedSpawnStage;
+	}
+
+	/**
+	 * Get the user set environment variables.
+	 * @return A const reference to the map of user set environment variables.
+	 */
+	const std::map< std::string, std::string >& getEnvironmentVariables() const
+	{
+		// TODO: Should this also include the existing environment variables
+		//       and not just the user set variables?
+		return mSpec->mSettings->environmentVariables;
+	}
+
+	/**
+	 * Check if this application is currently executing.
+	 * @return True is returned if the application is currently executing, false otherwise.
+	 */
+	bool isRunning()
+	{
+		uint32_t launch;
+
+		if ( LaunchState::Phase::Spawning == mLaunchState.phase( launch ) )
+		{
+			return true;
+		}
+
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+
+		if ( nullptr == childProcess )
+		{
+			return false;
+		}
+
+		// The exit status is kept by the child process when reaped
+		if ( childProcess->poll() )
+		{
+			mLaunchState.markExited( launch );
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Append the stderr stream of this command to a log shared with other
+	 * children, rotated by size or age; rather than a log file per launch.
+	 * Whole lines are appended, so the output of children sharing the log
+	 * is never interleaved within a line.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param log The log to append to. If null, then the stream is no longer logged to it.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& logStderrTo(
+		std::shared_ptr< RotatingLog > log )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		if ( nullptr == log )
+		{
+			if ( nullptr != std::dynamic_pointer_cast< RotatingLogSink >( mSpec->mStderrSink ) )
+			{
+				_mutableSpec().mStderrSink.reset();
+			}
+
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStderrSink = std::make_shared< RotatingLogSink >( std::move( log ) );
+		spec.mStderrReader.reset();
+		return *this;
+	}
+
+	/**
+	 * Redirect the stderr stream of this command to a log file.
+	 * If the prefix is empty, then the stderr is not redirected to a file.
+	 * @param prefix The prefix of the log file; each launch logs to a file of its own,
+	 *               ${prefix}_${application}_${timestamp}_${pid}_${sequence}.stderr.log [default: ]
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& logStderrToFile(
+		const char* prefix )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mRedirectStderrToLogFile = true;
+
+		if ( ( nullptr == prefix )
+			or ( 0 == strlen( prefix ) ) )
+		{
+			spec._mutableSettings().stderrLogFilePrefix.clear();
+		}
+		else
+		{
+			spec._mutableSettings().stderrLogFilePrefix = std::string( prefix );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Redirect the stderr stream of this command to a log file.
+	 * If the prefix is empty, then the stderr is not redirected to a file.
+	 * @param prefix The prefix of the log file; each launch logs to a file of its own,
+	 *               ${prefix}_${application}_${timestamp}_${pid}_${sequence}.stderr.log [default: ]
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& logStderrToFile(
+		const std::string& prefix = std::string() )
+	{
+		return this->logStderrToFile( prefix.c_str() );
+	}
+
+	/**
+	 * Append the stdout stream of this command to a log shared with other
+	 * children, rotated by size or age; rather than a log file per launch.
+	 * Whole lines are appended, so the output of children sharing the log
+	 * is never interleaved within a line.
+	 * For a stage of a CommandPipeline, this only applies to the last stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param log The log to append to. If null, then the stream is no longer logged to it.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& logStdoutTo(
+		std::shared_ptr< RotatingLog > log )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		if ( nullptr == log )
+		{
+			if ( nullptr != std::dynamic_pointer_cast< RotatingLogSink >( mSpec->mStdoutSink ) )
+			{
+				_mutableSpec().mStdoutSink.reset();
+			}
+
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStdoutSink = std::make_shared< RotatingLogSink >( std::move( log ) );
+		spec.mStdoutReader.reset();
+		return *this;
+	}
+
+	/**
+	 * Redirect the stdout stream of this command to a log file.
+	 * If the prefix is empty, then the stdout is not redirected to a file.
+	 * @param prefix The prefix of the log file; each launch logs to a file of its own,
+	 *               ${prefix}_${application}_${timestamp}_${pid}_${sequence}.stdout.log [default: ]
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& logStdoutToFile(
+		const char* prefix )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mRedirectStdoutToLogFile = true;
+
+		if ( ( nullptr == prefix )
+			or ( 0 == strlen( prefix ) ) )
+		{
+			spec._mutableSettings().stdoutLogFilePrefix.clear();
+		}
+		else
+		{
+			spec._mutableSettings().stdoutLogFilePrefix = std::string( prefix );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Redirect the stdout stream of this command to a log file.
+	 * If the prefix is empty, then the stdout is not redirected to a file.
+	 * @param prefix The prefix of the log file; each launch logs to a file of its own,
+	 *               ${prefix}_${application}_${timestamp}_${pid}_${sequence}.stdout.log [default: ]
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& logStdoutToFile(
+		const std::string& prefix = std::string() )
+	{
+		return this->logStdoutToFile( prefix.c_str() );
+	}
+
+	/**
+	 * Register a callback to be called each time a launched child exits.
+	 * Setting a callback opts this Command into the ChildReaper service: the
+	 * child is reaped, and the callback called, on the reaper thread as soon as
+	 * the child exits. This method call will do nothing if the application is
+	 * currently executing.
+	 * @param exitCallback The callable to invoke with the exited child process.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& onExit(
+		std::function< void( const ChildProcess& ) > exitCallback )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() or ( nullptr == exitCallback ) )
+		{
+			return *this;
+		}
+
+		_mutableSpec()._mutableSettings().exitCallbacks.push_back( std::move( exitCallback ) );
+		return *this;
+	}
+
+	/**
+	 * Move assignment operator.
+	 * @param other Command object to move to this instance.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& operator=(
+		Command&& other )
+	{
+		if ( this != &other )
+		{
+			_moveAssignment( std::move( other ) );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Copy assignment operator.
+	 * @param other Command object to copy to this instance.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& operator=(
+		const Command& other )
+	{
+		if ( this != &other )
+		{
+			_copyAssignment( other );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Cast the Command object to a string.
+	 * Should no application be set, then the application
+	 * part of the command line will be set as "(null)"
+	 */
+	operator std::string() const
+	{
+		std::string commandAndArgs(
+			( nullptr == mSpec->mSettings->application ) ? "(null)" : mSpec->mSettings->application );
+
+		for ( size_t index( 0 ); ++index < mSpec->mArguments.size(); )
+		{
+			commandAndArgs.append( " " ).append( mSpec->mArguments[ index ] );
+		}
+
+		return commandAndArgs;
+	}
+
+	/**
+	 * Get the attributes applied to the child process before exec.
+	 * @return A const reference to the attributes is returned.
+	 */
+	const ProcessAttributes& processAttributes() const
+	{
+		return mSpec->mSettings->processAttributes;
+	}
+
+	/**
+	 * Redirect the stderr stream of the child to wherever its stdout stream
+	 * goes; as 2>&1 does, without a shell. Within a pipeline, stderr is then
+	 * piped into the next stage along with stdout. Appended to the file
+	 * descriptor plan; see setFileDescriptorPlan().
+	 * This method call will do nothing if the application is currently executing.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& redirectStderrToStdout()
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		_mutableSpec()._mutableSettings().fileDescriptorPlan.mergeStderrIntoStdout();
+		return *this;
+	}
+
+	/**
+	 * Get the resources used by the most recent execution of the application;
+	 * the CPU time, peak resident set size, page faults and context switches
+	 * accounted by the kernel, and the wall clock time it ran for.
+	 * @return The resource usage is returned, zeroed if the application
+	 *         is currently running or has yet to run.
+	 */
+	ResourceUsage resourceUsage()
+	{
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+		return ( nullptr == childProcess ) ? ResourceUsage() : childProcess->resourceUsage();
+	}
+
+	/**
+	 * Resolve the application against PATH ahead of execution.
+	 * The resolution is kept in the process wide ExecutableCache and
+	 * is consulted by every execution of an application not containing a '/'.
+	 * @return The absolute path to the executable is returned. If the application
+	 *         contains a '/', then the application itself is returned. An empty string
+	 *         is returned if no application is set or it could not be resolved.
+	 */
+	std::string resolve() const
+	{
+		if ( nullptr == mSpec->mSettings->application )
+		{
+			return std::string();
+		}
+
+		if ( nullptr != strchr( mSpec->mSettings->application, '/' ) )
+		{
+			return std::string( mSpec->mSettings->application );
+		}
+
+		return ExecutableCache::instance().resolve( mSpec->mSettings->application, _searchPath() );
+	}
+
+	/**
+	 * Get when a failed execution is relaunched.
+	 * @return A const reference to the retry policy is returned.
+	 */
+	const RetryPolicy& retryPolicy() const
+	{
+		return mSpec->mSettings->retryPolicy;
+	}
+
+	/**
+	 * Set the application to be executed by this mangement class.
+	 * @param application Name of the application to be executed.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& setApplication(
+		const char* application )
+	{
+		_setApplication( application );
+		return *this;
+	}
+
+	/**
+	 * Set the application to be executed by this mangement class.
+	 * @param application Name of the application to be executed.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& setApplication(
+		const std::string& application = std::string() )
+	{
+		_setApplication( application.c_str() );
+		return *this;
+	}
+
+	/**
+	 * Set an environment variable to be set for the application.
+	 * The environment variable will not be set for the calling application.
+	 * If {@param variableName} is empty, then {@param value} is ignored and nothing is done.
+	 * @param variableName Name of the environment variable.
+	 * @param value Value to set the variable to.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& setEnvironmentVariable(
+		const std::string& variableName,
+		const std::string& value )
+	{
+		_setEnvironmentVariables(
+			std::map< std::string, std::string > {
+				{ variableName, value }
+			} );
 
-		return 0;
+		return *this;
 	}
 
 	/**
-	 * Execute the command and wait for it to complete.
-	 * @return The exit status of the command is returned.
+	 * Set the environment variables to be set for the application.
+	 * The environment variables will not be set for the calling application.
+	 * If the variable name is empty, then the value will be ignored.
+	 * @param environmentVariables A map of variableName to values.
+	 * @return A reference to this Command object is returned.
 	 */
-	int executeAndWait()
+	Command& setEnvironmentVariables(
+		const std::map< std::string, std::string >& environmentVariables )
 	{
-		int returnCode = 0;
+		_setEnvironmentVariables( environmentVariables );
+		return *this;
+	}
 
-		if ( 0 == ( returnCode = this->execute() ) )
-		{
-			returnCode = this->wait();
-		}
-		else if ( -ECANCELED == returnCode )
+	/**
+	 * Set the redirections of the descriptors of the child, applied in order
+	 * once the standard streams are set up; files, descriptors of the parent,
+	 * copies of other descriptors of the child and closes, along with closing
+	 * every descriptor not handed to the child. They are resolved into the
+	 * file actions of the launch, so cost no more than the standard streams.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param fileDescriptorPlan The redirections to apply.
+	 * @return A reference to this Command object is returned.
+	 */
+	Command& setFileDescriptorPlan(
+		const FileDescriptorPlan& fileDescriptorPlan )
+	{
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
 		{
-			returnCode = this->wait();
+			return *this;
 		}
 
-		return returnCode;
+		_mutableSpec()._mutableSettings().fileDescriptorPlan = fileDescriptorPlan;
+		return *this;
 	}
 
 	/**
-	 * Get the exit status of the application executed. If the application
-	 * is currently running, or has yet to run, then this method returns zero.
-	 * @return Exit status of the command is returned.
+	 * Set the attributes applied to the child process before the exec of
+	 * the application; resource limits, CPU affinity, nice value, I/O
+	 * priority and cgroup. A child with attributes is always launched
+	 * through clone(2) and never through the SpawnServer, as the
+	 * attributes are applied by the child itself; with a cgroup, through
+	 * clone3(2), which copies the page tables of the caller as fork(2) does.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param processAttributes The attributes to apply.
+	 * @return A reference to this Command object is returned.
 	 */
-	int exitStatus()
+	Command& setProcessAttributes(
+		const ProcessAttributes& processAttributes )
 	{
-		return mExitStatus;
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		_mutableSpec()._mutableSettings().processAttributes = processAttributes;
+		return *this;
 	}
 
 	/**
-	 * Get the user set environment variables.
-	 * @return A const reference to the map of user set environment variables.
+	 * Set when a failed execution is relaunched: by execute() upon a failure
+	 * to launch, such as EAGAIN from fork, and by executeAndWait() upon an
+	 * exit as well, such as a kill by the OOM killer. Each relaunch reuses
+	 * the argument vector, envp block and resolved path already prepared.
+	 * The stages of a CommandPipeline are retried by the policy of the pipeline.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param retryPolicy The policy to apply. [default: a single attempt]
+	 * @return A reference to this Command object is returned.
 	 */
-	const std::map< std::string, std::string >& getEnvironmentVariables() const
+	Command& setRetryPolicy(
+		const RetryPolicy& retryPolicy )
 	{
-		// TODO: Should this also include the existing environment variables
-		//       and not just the user set variables?
-		return mEnvironmentVariables;
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		_mutableSpec()._mutableSettings().retryPolicy = retryPolicy;
+		return *this;
 	}
 
 	/**
-	 * Check if this application is currently executing.
-	 * @return True is returned if the application is currently executing, false otherwise.
+	 * Select the backend used to launch the child process.
+	 * SpawnBackend::SpawnServer requires SpawnServer::instance().start() to have
+	 * been called; until then, or should the helper go away, PosixSpawn is used.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param backend The spawn backend to use. [default: SpawnBackend::PosixSpawn]
+	 * @return A reference to this Command object is returned.
 	 */
-	bool isRunning()
+	Command& setSpawnBackend(
+		SpawnBackend backend )
 	{
-		int status, returnValue;
-
-		if ( 0 < mChildProcessID )
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
 		{
-			returnValue = waitpid( mChildProcessID, &status, WNOHANG );
-			return 0 == returnValue;
+			return *this;
 		}
 
-		return false;
+		_mutableSpec().mSpawnBackend = backend;
+		return *this;
 	}
 
 	/**
-	 * Redirect the stderr stream of this command to a log file.
-	 * If the prefix is empty, then the stderr is not redirected to a file.
-	 * @param prefix The prefix of the log file. ${prefix}.stderr.log [default: ]
+	 * Redirect the stdin stream of this command from a file descriptor.
+	 * The file descriptor is duplicated for each execution; the caller keeps ownership.
+	 * For a stage of a CommandPipeline, this only applies to the first stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param fileDescriptor The file descriptor to read stdin from. If negative,
+	 *                       then stdin is inherited from the parent.
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& logStderrToFile(
-		const char* prefix )
+	Command& setStdin(
+		int fileDescriptor )
 	{
 		// Ignore the request if we're currently executing
-		if ( ( 0 == mExecuteCalled.load() ) and ( 0 > mChildProcessID.load() ) )
+		if ( _isExecuting() )
 		{
 			return *this;
 		}
 
-		mRedirectStderrToLogFile = true;
+		CommandSpec& spec = _mutableSpec();
 
-		if ( ( nullptr == prefix )
-			or ( 0 == strlen( prefix ) ) )
-		{
-			mStderrLogFilePrefix.clear();
-		}
-		else
+		spec._resetStdin();
+
+		if ( 0 <= fileDescriptor )
 		{
-			mStderrLogFilePrefix = std::string( prefix );
+			spec.mStdinSource = CommandSpec::StdinSource::FileDescriptor;
+			spec.mStdinFileDescriptor = fileDescriptor;
 		}
 
 		return *this;
 	}
 
 	/**
-	 * Redirect the stderr stream of this command to a log file.
-	 * If the prefix is empty, then the stderr is not redirected to a file.
-	 * @param prefix The prefix of the log file. ${prefix}.stderr.log [default: ]
+	 * Feed the stdin stream of this command from memory.
+	 * The pages are spliced into the pipe where the kernel allows, so the data
+	 * is referenced, not copied; it must remain valid and unchanged until the
+	 * command has been waited on.
+	 * For a stage of a CommandPipeline, this only applies to the first stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param data The bytes to feed to the child, after which stdin is closed.
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& logStderrToFile(
-		const std::string& prefix = std::string() )
+	Command& setStdin(
+		std::string_view data )
 	{
-		return this->logStderrToFile( prefix.c_str() );
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec._resetStdin();
+		spec.mStdinSource = CommandSpec::StdinSource::Data;
+		spec.mStdinData = data;
+
+		return *this;
 	}
 
 	/**
-	 * Redirect the stdout stream of this command to a log file.
-	 * If the prefix is empty, then the stdout is not redirected to a file.
-	 * @param prefix The prefix of the log file. ${prefix}.stdout.log [default: ]
+	 * Redirect the stdin stream of this command from a file.
+	 * The file is opened for each execution and handed to the child as is.
+	 * For a stage of a CommandPipeline, this only applies to the first stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param path Path of the file to read stdin from. If empty, then stdin
+	 *             is inherited from the parent.
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& logStdoutToFile(
-		const char* prefix )
+	Command& setStdinFromFile(
+		const std::string& path )
 	{
 		// Ignore the request if we're currently executing
-		if ( ( 0 == mExecuteCalled.load() ) and ( 0 > mChildProcessID.load() ) )
+		if ( _isExecuting() )
 		{
 			return *this;
 		}
 
-		mRedirectStdoutToLogFile = true;
+		CommandSpec& spec = _mutableSpec();
 
-		if ( ( nullptr == prefix )
-			or ( 0 == strlen( prefix ) ) )
-		{
-			mStdoutLogFilePrefix.clear();
-		}
-		else
+		spec._resetStdin();
+
+		if ( not path.empty() )
 		{
-			mStdoutLogFilePrefix = std::string( prefix );
+			spec.mStdinSource = CommandSpec::StdinSource::File;
+			spec._mutableSettings().stdinFilePath = path;
 		}
 
 		return *this;
 	}
 
 	/**
-	 * Redirect the stdout stream of this command to a log file.
-	 * If the prefix is empty, then the stdout is not redirected to a file.
-	 * @param prefix The prefix of the log file. ${prefix}.stdout.log [default: ]
+	 * Set how the child process is terminated, by terminate() and upon its
+	 * timeout: the signal sent first, and the grace period after which
+	 * SIGKILL is sent should the child still be running. A policy with
+	 * processGroup set launches the child as the leader of a new process
+	 * group, never through the SpawnServer, and signals the whole group.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param terminationPolicy The policy to apply. [default: SIGTERM, without escalation]
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& logStdoutToFile(
-		const std::string& prefix = std::string() )
+	Command& setTerminationPolicy(
+		const TerminationPolicy& terminationPolicy )
 	{
-		return this->logStdoutToFile( prefix.c_str() );
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		_mutableSpec().mTerminationPolicy = terminationPolicy;
+		return *this;
 	}
 
 	/**
-	 * Move assignment operator.
-	 * @param other Command object to move to this instance.
+	 * Terminate the child process, per the termination policy, should it
+	 * still be running once the timeout has passed since its launch.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param timeout The time the child may run for, zero for no limit. [default: 0]
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& operator=(
-		Command&& other )
+	Command& setTimeout(
+		std::chrono::nanoseconds timeout )
 	{
-		if ( this != &other )
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
 		{
-			_moveAssignment( std::move( other ) );
+			return *this;
 		}
 
+		_mutableSpec().mTimeout = timeout;
 		return *this;
 	}
 
 	/**
-	 * Copy assignment operator.
-	 * @param other Command object to copy to this instance.
+	 * Get the specification of what this command launches; the application,
+	 * arguments, environment, redirections and launch options. It is built
+	 * in full, envp included, and is never changed while shared: a setter of
+	 * this command copies it first. Construct a Command from it to launch it
+	 * again, from any thread, without copying it.
+	 * @return The shared specification is returned.
+	 */
+	std::shared_ptr< const CommandSpec > spec() const
+	{
+		_prepareSpec();
+		return mSpec;
+	}
+
+	/**
+	 * Stream the stderr stream of this command to a callback as it arrives.
+	 * The callback is called on the thread reaping the child; the pipe is
+	 * not read while it runs, so a slow callback throttles the child.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param callback The callable to invoke with each chunk of output.
+	 * @param pool The pool to read chunks into. If null, then a pool of
+	 *             BufferPool::DefaultCapacity buffers is used. [default: nullptr]
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& operator=(
-		const Command& other )
+	Command& streamStderr(
+		StreamSink::Callback callback,
+		std::shared_ptr< BufferPool > pool = nullptr )
 	{
-		if ( this != &other )
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
 		{
-			_copyAssignment( other );
+			return *this;
 		}
 
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStderrSink = std::make_shared< StreamSink >( std::move( callback ), std::move( pool ) );
+		spec.mStderrReader.reset();
 		return *this;
 	}
 
 	/**
-	 * Cast the Command object to a string.
-	 * Should no application be set, then the application
-	 * part of the command line will be set as "(null)"
+	 * Hand the stderr stream of this command to a reader, read by the caller.
+	 * The reader must be read to its end before the command is waited on.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param reader The reader to attach on execution. If null, then streaming is disabled.
+	 * @return A reference to this Command object is returned.
 	 */
-	operator std::string() const
+	Command& streamStderr(
+		std::shared_ptr< OutputReader > reader )
 	{
-		std::string commandAndArgs(
-			( nullptr == mApplication ) ? "(null)" : mApplication );
-
-		for ( size_t index( 0 ); ++index < mArgumentCount; )
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
 		{
-			commandAndArgs.append( " " ).append( mArguments[ index ] );
+			return *this;
 		}
 
-		return commandAndArgs;
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStderrReader = std::move( reader );
+		spec.mStderrSink.reset();
+		return *this;
 	}
 
 	/**
-	 * Set the application to be executed by this mangement class.
-	 * @param application Name of the application to be executed.
+	 * Split the stderr stream of this command into records as it arrives, and
+	 * each record into fields should the splitter have a delimiter; handed to
+	 * the callback of the splitter as views into the buffers read into.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param splitter The splitter, with the callback of the records or fields.
+	 * @param pool The pool to read chunks into. If null, then a pool of
+	 *             BufferPool::DefaultCapacity buffers is used. [default: nullptr]
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& setApplication(
-		const char* application )
+	Command& streamStderrLines(
+		LineSplitter splitter,
+		std::shared_ptr< BufferPool > pool = nullptr )
 	{
-		_setApplication( application );
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStderrSink = std::make_shared< LineSink >( std::move( splitter ), std::move( pool ) );
+		spec.mStderrReader.reset();
 		return *this;
 	}
 
 	/**
-	 * Set the application to be executed by this mangement class.
-	 * @param application Name of the application to be executed.
+	 * Stream the stdout stream of this command to a callback as it arrives.
+	 * The callback is called on the thread reaping the child; the pipe is
+	 * not read while it runs, so a slow callback throttles the child.
+	 * For a stage of a CommandPipeline, this only applies to the last stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param callback The callable to invoke with each chunk of output.
+	 * @param pool The pool to read chunks into. If null, then a pool of
+	 *             BufferPool::DefaultCapacity buffers is used. [default: nullptr]
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& setApplication(
-		const std::string& application = std::string() )
+	Command& streamStdout(
+		StreamSink::Callback callback,
+		std::shared_ptr< BufferPool > pool = nullptr )
 	{
-		_setApplication( application.c_str() );
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStdoutSink = std::make_shared< StreamSink >( std::move( callback ), std::move( pool ) );
+		spec.mStdoutReader.reset();
 		return *this;
 	}
 
 	/**
-	 * Set an environment variable to be set for the application.
-	 * The environment variable will not be set for the calling application.
-	 * If {@param variableName} is empty, then {@param value} is ignored and nothing is done.
-	 * @param variableName Name of the environment variable.
-	 * @param value Value to set the variable to.
+	 * Hand the stdout stream of this command to a reader, read by the caller.
+	 * The reader must be read to its end before the command is waited on.
+	 * For a stage of a CommandPipeline, this only applies to the last stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param reader The reader to attach on execution. If null, then streaming is disabled.
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& setEnvironmentVariable(
-		const std::string& variableName,
-		const std::string& value )
+	Command& streamStdout(
+		std::shared_ptr< OutputReader > reader )
 	{
-		_setEnvironmentVariables(
-			std::map< std::string, std::string > {
-				{ variableName, value }
-			} );
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
 
+		spec.mStdoutReader = std::move( reader );
+		spec.mStdoutSink.reset();
 		return *this;
 	}
 
 	/**
-	 * Set the environment variables to be set for the application.
-	 * The environment variables will not be set for the calling application.
-	 * If the variable name is empty, then the value will be ignored.
-	 * @param environmentVariables A map of variableName to values.
+	 * Split the stdout stream of this command into records as it arrives, and
+	 * each record into fields should the splitter have a delimiter; handed to
+	 * the callback of the splitter as views into the buffers read into.
+	 * For a stage of a CommandPipeline, this only applies to the last stage.
+	 * This method call will do nothing if the application is currently executing.
+	 * @param splitter The splitter, with the callback of the records or fields.
+	 * @param pool The pool to read chunks into. If null, then a pool of
+	 *             BufferPool::DefaultCapacity buffers is used. [default: nullptr]
 	 * @return A reference to this Command object is returned.
 	 */
-	Command& setEnvironmentVariables(
-		const std::map< std::string, std::string >& environmentVariables )
+	Command& streamStdoutLines(
+		LineSplitter splitter,
+		std::shared_ptr< BufferPool > pool = nullptr )
 	{
-		_setEnvironmentVariables( environmentVariables );
+		// Ignore the request if we're currently executing
+		if ( _isExecuting() )
+		{
+			return *this;
+		}
+
+		CommandSpec& spec = _mutableSpec();
+
+		spec.mStdoutSink = std::make_shared< LineSink >( std::move( splitter ), std::move( pool ) );
+		spec.mStdoutReader.reset();
 		return *this;
 	}
 
 	/**
-	 * Send a terminate signal to the child process if one is running.
+	 * Send a terminate signal to the child process if one is running, per
+	 * the termination policy; SIGTERM by default, followed by SIGKILL once
+	 * the grace period of the policy has passed.
 	 * @param wait If set to true, wait on the child process after sending
-	 *             the SIGTERM signal to collect the exit status. [default: false]
-	 * @return Zero is returned on success, else an error code is returned.
+	 *             the signal to collect the exit status. [default: false]
+	 * @return Zero is returned on success, else a negative error code is
+	 *         returned; the exit status of the child if {@param wait} is true.
 	 */
 	int terminate(
 		bool wait = false )
 	{
-		static std::atomic< uint32_t > TerminateCount( 0 );
-
 		int errorCode = 0;
+		LaunchState::Phase phase;
 
-		if ( 0 < mChildProcessID )
-		{
-			uint32_t count = TerminateCount.fetch_add( 1 );
+		// Signal once per launch; the escalation, if any, is already scheduled
+		bool requested = mLaunchState.requestTerminate( phase );
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
 
-			if ( 0 == count )
-			{
-				if ( not mTerminateCalled.exchange( true ) )
-				{
-					errorCode = kill( mChildProcessID, SIGTERM );
+		// A launch in progress is terminated by the launching thread once started
+		bool running = ( LaunchState::Phase::Spawning == phase )
+			or ( ( nullptr != childProcess ) and ( not childProcess->hasExited() ) );
 
-					if ( 0 != errorCode )
-					{
-						mTerminateCalled.store( false );
-					}
-				}
-			}
+		if ( requested and running and ( LaunchState::Phase::Running == phase ) )
+		{
+			errorCode = _terminateChild( childProcess );
+		}
 
-			if ( wait and ( 0 == errorCode ) )
-			{
-				errorCode = this->wait();
-			}
+		if ( wait and running and ( 0 == errorCode ) )
+		{
+			errorCode = this->wait();
 		}
 
 		return errorCode;
 	}
 
+	/**
+	 * Get the signal that killed the application executed.
+	 * @return The signal number is returned, or zero if the application
+	 *         exited normally, is currently running or has yet to run.
+	 */
+	int terminatingSignal()
+	{
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+		return ( nullptr == childProcess ) ? 0 : childProcess->terminatingSignal();
+	}
+
+	/**
+	 * Get how the child process is terminated.
+	 * @return A const reference to the termination policy is returned.
+	 */
+	const TerminationPolicy& terminationPolicy() const
+	{
+		return mSpec->mTerminationPolicy;
+	}
+
 	/**
 	 * Wait on the application to finish if it's currently running.
 	 * This method will return immediately if the application has already
@@ -979,33 +2106,61 @@ public:
 	 */
 	int wait()
 	{
-		static std::atomic< uint32_t > WaitCount( 0 );
+		uint32_t launch;
+
+		mLaunchState.awaitSpawn( launch );
 
-		int exitStatus;
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
 
-		if ( 0 < mChildProcessID )
+		if ( nullptr != childProcess )
 		{
-			uint32_t count = WaitCount.fetch_add( 1 );
+			int exitStatus = childProcess->wait();
+			mLaunchState.markExited( launch );
 
-			if ( 0 == count )
-			{
-				int errorCode = waitpid( mChildProcessID, &exitStatus, 0 );
+			return exitStatus;
+		}
 
-				if ( -1 != errorCode )
-				{
-					mExitStatus = WEXITSTATUS( exitStatus );
-					mChildProcessID = -1;
-					mTerminateCalled.store( false );
-				}
+		return 0;
+	}
 
-				WaitCount.store( 0 );
-			}
-			else
+	/**
+	 * Wait on the application to finish, for at most a timeout.
+	 * The child is left running should the timeout pass first.
+	 * @param timeout The longest time to wait for.
+	 * @return Zero is returned if no application is running, -ETIMEDOUT if the
+	 *         timeout passed first, else the exit code of the application is returned.
+	 */
+	int waitFor(
+		std::chrono::nanoseconds timeout )
+	{
+		return waitUntil( std::chrono::steady_clock::now() + timeout );
+	}
+
+	/**
+	 * Wait on the application to finish, until at most a deadline.
+	 * The child is left running should the deadline pass first.
+	 * @param deadline The time to stop waiting at.
+	 * @return Zero is returned if no application is running, -ETIMEDOUT if the
+	 *         deadline passed first, else the exit code of the application is returned.
+	 */
+	int waitUntil(
+		std::chrono::steady_clock::time_point deadline )
+	{
+		uint32_t launch;
+
+		mLaunchState.awaitSpawn( launch );
+
+		std::shared_ptr< ChildProcess > childProcess = _childProcess();
+
+		if ( nullptr != childProcess )
+		{
+			if ( not childProcess->waitUntil( deadline ) )
 			{
-				while ( 0 != WaitCount.load() );
+				return -ETIMEDOUT;
 			}
 
-			return mExitStatus;
+			mLaunchState.markExited( launch );
+			return childProcess->exitStatus();
 		}
 
 		return 0;
@@ -0,0 +1,503 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Command.hpp"
+
+/**
+ * A class object for executing many independent commands
+ * with a bounded number of them running at once.
+ *
+ * Children are reaped by the ChildReaper service, and the moment one
+ * exits its slot is refilled with the next command from the reaper
+ * thread; nothing is polled. The exit status, resource usage and wall
+ * clock time of every command are collected as they complete.
+ *
+ * Notes:
+ *   - Not thread safe.
+ *   - The commands must not be modified while the batch is executing.
+ *   - Destroying the batch stops launching commands and waits for
+ *     those still running.
+ */
+class CommandBatch
+{
+public:
+	// The outcome of one command of the batch
+	struct Result
+	{
+		int exitStatus; // Exit status of the command, or a negative error code should it fail to launch
+		ResourceUsage resourceUsage; // Resources used by the command and the wall clock time it ran for
+	};
+
+private:
+	// The state of one execution of the batch, shared
+	// with the exit callbacks running on the reaper thread
+	struct Execution
+	{
+		std::mutex mutex;
+		std::condition_variable completed;
+		std::vector< Command >* commands; // The commands of the batch
+		std::vector< Result > results;
+		std::vector< std::shared_ptr< ChildProcess > > running; // By command index, while running
+		size_t maxInFlight; // Maximum number of commands running at once
+		size_t nextIndex; // Index of the next command to launch
+		size_t inFlight; // Number of commands launching or running
+		size_t remaining; // Number of commands yet to complete
+		bool stopped; // Stop launching commands
+		bool failed; // A command has failed
+		int exitStatus; // Exit status of the first command to fail, else zero
+		std::shared_ptr< CommandFuture::State > future; // Completed once every command has
+	};
+
+	std::vector< Command > mCommands;
+	size_t mMaxInFlight;
+	std::shared_ptr< Execution > mExecution; // The most recent execution
+
+	// Record the completion of a command and release its slot.
+	// @param childProcess The child of the command, null if it failed to launch.
+	static void _completed(
+		const std::shared_ptr< Execution >& execution,
+		size_t commandIndex,
+		int exitStatus,
+		const ChildProcess* childProcess )
+	{
+		std::shared_ptr< CommandFuture::State > future;
+		int batchExitStatus;
+
+		{
+			std::lock_guard< std::mutex > lock( execution->mutex );
+			Result& result = execution->results[ commandIndex ];
+
+			result.exitStatus = exitStatus;
+
+			if ( nullptr != childProcess )
+			{
+				result.resourceUsage = childProcess->resourceUsage();
+			}
+
+			if ( ( 0 != exitStatus ) and ( not execution->failed ) )
+			{
+				execution->failed = true;
+				execution->exitStatus = exitStatus;
+			}
+
+			execution->running[ commandIndex ].reset();
+			--execution->inFlight;
+
+			if ( 0 != --execution->remaining )
+			{
+				return;
+			}
+
+			execution->completed.notify_all();
+			future = std::move( execution->future );
+			batchExitStatus = execution->exitStatus;
+		}
+
+		if ( nullptr != future )
+		{
+			future->complete( batchExitStatus );
+		}
+	}
+
+	// Launch commands until every slot is taken or none are left.
+	// Called from the executing thread and, upon each exit, from the reaper thread.
+	static void _launch(
+		const std::shared_ptr< Execution >& execution )
+	{
+		while ( true )
+		{
+			size_t commandIndex;
+
+			{
+				std::lock_guard< std::mutex > lock( execution->mutex );
+
+				if ( execution->stopped
+					or ( execution->commands->size() == execution->nextIndex )
+					or ( execution->maxInFlight <= execution->inFlight ) )
+				{
+					return;
+				}
+
+				commandIndex = execution->nextIndex++;
+				++execution->inFlight;
+			}
+
+			Command& command = ( *execution->commands )[ commandIndex ];
+			int errorCode = command._forkRedirectToPipeAndExecute( nullptr, nullptr );
+
+			if ( 0 != errorCode )
+			{
+				_completed( execution, commandIndex, errorCode, nullptr );
+				continue;
+			}
+
+			std::shared_ptr< ChildProcess > childProcess = command._childProcess();
+
+			{
+				std::lock_guard< std::mutex > lock( execution->mutex );
+				execution->running[ commandIndex ] = childProcess;
+			}
+
+			childProcess->onExit( [ execution, commandIndex ]( const ChildProcess& exitedProcess )
+			{
+				_completed( execution, commandIndex, exitedProcess.exitStatus(), &exitedProcess );
+				_launch( execution );
+			} );
+
+			ChildReaper::instance().watch( childProcess );
+		}
+	}
+
+	// The number of commands run at once by default; one per core.
+	static size_t _defaultMaxInFlight()
+	{
+		unsigned int coreCount = std::thread::hardware_concurrency();
+		return ( 0 == coreCount ) ? 1 : coreCount;
+	}
+
+	// Stop launching commands, marking those never launched as cancelled.
+	// The mutex of the execution must be held.
+	// @return The future to complete is returned, should this complete the execution.
+	static std::shared_ptr< CommandFuture::State > _stop(
+		Execution& execution )
+	{
+		execution.stopped = true;
+
+		for ( ; execution.nextIndex < execution.commands->size(); ++execution.nextIndex )
+		{
+			execution.results[ execution.nextIndex ].exitStatus = -ECANCELED;
+			--execution.remaining;
+		}
+
+		if ( 0 != execution.remaining )
+		{
+			return nullptr;
+		}
+
+		execution.completed.notify_all();
+		return std::move( execution.future );
+	}
+
+	// Throw if a command does not have a set application.
+	static void _validate(
+		const Command& command,
+		size_t index )
+	{
+		if ( command.applicationName().empty() )
+		{
+			throw std::invalid_argument(
+				"Command at index " + std::to_string( index )
+				+ " does not have a set application" );
+		}
+	}
+
+public:
+	/**
+	 * Default constructor to an empty batch.
+	 */
+	CommandBatch()
+	{
+		mMaxInFlight = _defaultMaxInFlight();
+	}
+
+	/**
+	 * Construct a CommandBatch object with a list of commands.
+	 * @param commands A vector of Command objects to initialize the batch with.
+	 * @throw std::invalid_argument is thrown if any of the elements of {@param commands}
+	 *        does not have a set application to be executed.
+	 */
+	CommandBatch(
+		std::vector< Command > commands )
+	{
+		for ( size_t index( -1 ); ++index < commands.size(); )
+		{
+			_validate( commands[ index ], index );
+		}
+
+		mCommands = std::move( commands );
+		mMaxInFlight = _defaultMaxInFlight();
+	}
+
+	CommandBatch( const CommandBatch& ) = delete;
+	CommandBatch& operator=( const CommandBatch& ) = delete;
+
+	/**
+	 * Destructor to stop launching commands and wait for those still running.
+	 */
+	~CommandBatch()
+	{
+		if ( nullptr == mExecution )
+		{
+			return;
+		}
+
+		std::shared_ptr< CommandFuture::State > future;
+		std::unique_lock< std::mutex > lock( mExecution->mutex );
+
+		if ( nullptr != ( future = _stop( *mExecution ) ) )
+		{
+			lock.unlock();
+			future->complete( mExecution->exitStatus );
+			lock.lock();
+		}
+
+		mExecution->completed.wait( lock, [ this ]() { return 0 == mExecution->remaining; } );
+	}
+
+	/**
+	 * Append a Command to the batch.
+	 * This method call will do nothing if the batch is currently executing.
+	 * @param command The Command to be appended to the batch.
+	 * @return A reference to this CommandBatch object is returned.
+	 * @throw std::invalid_argument is thrown if {@param command} does not have a set application.
+	 */
+	CommandBatch& appendCommand(
+		Command command )
+	{
+		_validate( command, mCommands.size() );
+
+		if ( not isRunning() )
+		{
+			mCommands.push_back( std::move( command ) );
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Get a command of the batch, such as to read its captured output.
+	 * @param index Index of the command.
+	 * @return A reference to the Command is returned.
+	 * @throw std::out_of_range is thrown if {@param index} is out of range.
+	 */
+	Command& command(
+		size_t index )
+	{
+		return mCommands.at( index );
+	}
+
+	/**
+	 * Begin execution of the batch, launching up to maxInFlight() commands.
+	 * @return Zero is returned on success, or -ECANCELED if the batch is already executing.
+	 */
+	int execute()
+	{
+		if ( isRunning() )
+		{
+			return -ECANCELED;
+		}
+
+		std::shared_ptr< Execution > execution = std::make_shared< Execution >();
+		Result notRun;
+
+		notRun.exitStatus = 0;
+
+		execution->commands = &mCommands;
+		execution->results.resize( mCommands.size(), notRun );
+		execution->running.resize( mCommands.size() );
+		execution->maxInFlight = mMaxInFlight;
+		execution->nextIndex = 0;
+		execution->inFlight = 0;
+		execution->remaining = mCommands.size();
+		execution->stopped = false;
+		execution->failed = false;
+		execution->exitStatus = 0;
+
+		mExecution = execution;
+		_launch( execution );
+
+		return 0;
+	}
+
+	/**
+	 * Execute the batch and wait for every command to complete.
+	 * @return The exit status of the first command to fail is returned, zero if
+	 *         none failed, or -ECANCELED if the batch is already executing.
+	 */
+	int executeAndWait()
+	{
+		int returnCode = this->execute();
+
+		if ( 0 == returnCode )
+		{
+			returnCode = this->wait();
+		}
+
+		return returnCode;
+	}
+
+	/**
+	 * Begin execution of the batch without blocking on its completion.
+	 * @return A CommandFuture for the exit status of the first command to fail,
+	 *         else zero, is returned. Should the batch already be executing, then
+	 *         the future is already completed with -ECANCELED.
+	 */
+	CommandFuture executeAsync()
+	{
+		CommandFuture commandFuture;
+		int returnCode = this->execute();
+
+		if ( 0 == returnCode )
+		{
+			std::lock_guard< std::mutex > lock( mExecution->mutex );
+
+			if ( 0 != mExecution->remaining )
+			{
+				mExecution->future = commandFuture.state();
+				return commandFuture;
+			}
+
+			returnCode = mExecution->exitStatus;
+		}
+
+		commandFuture.state()->complete( returnCode );
+
+		return commandFuture;
+	}
+
+	/**
+	 * Check if the batch is executing.
+	 * @return True is returned if any command is yet to complete.
+	 */
+	bool isRunning() const
+	{
+		if ( nullptr == mExecution )
+		{
+			return false;
+		}
+
+		std::lock_guard< std::mutex > lock( mExecution->mutex );
+		return 0 != mExecution->remaining;
+	}
+
+	/**
+	 * Get the maximum number of commands run at once.
+	 * @return The maximum number of commands in flight is returned.
+	 */
+	size_t maxInFlight() const
+	{
+		return mMaxInFlight;
+	}
+
+	/**
+	 * Get the outcome of each command of the most recent execution.
+	 * The results of the commands yet to complete are zeroed, and those
+	 * never launched due to terminate() have an exit status of -ECANCELED.
+	 * @return A vector of the results, indexed by command, is returned.
+	 */
+	std::vector< Result > results() const
+	{
+		if ( nullptr == mExecution )
+		{
+			return std::vector< Result >();
+		}
+
+		std::lock_guard< std::mutex > lock( mExecution->mutex );
+		return mExecution->results;
+	}
+
+	/**
+	 * Set the maximum number of commands run at once, by default the number of cores.
+	 * Takes effect on the next execution.
+	 * @param maxInFlight The maximum number of commands in flight; zero restores the default.
+	 * @return A reference to this CommandBatch object is returned.
+	 */
+	CommandBatch& setMaxInFlight(
+		size_t maxInFlight )
+	{
+		mMaxInFlight = ( 0 == maxInFlight ) ? _defaultMaxInFlight() : maxInFlight;
+		return *this;
+	}
+
+	/**
+	 * Get the number of commands in the batch.
+	 * @return The number of commands is returned.
+	 */
+	size_t size() const
+	{
+		return mCommands.size();
+	}
+
+	/**
+	 * Stop launching commands and send a terminate signal to those running.
+	 * @param wait If set to true, wait for the running commands to exit. [default: false]
+	 * @return Zero is returned on success, else the first error from signalling is returned.
+	 */
+	int terminate(
+		bool wait = false )
+	{
+		int returnCode = 0;
+		int exitStatus = 0;
+		std::shared_ptr< CommandFuture::State > future;
+		std::vector< std::shared_ptr< ChildProcess > > running;
+
+		if ( nullptr == mExecution )
+		{
+			return 0;
+		}
+
+		{
+			std::lock_guard< std::mutex > lock( mExecution->mutex );
+			future = _stop( *mExecution );
+			exitStatus = mExecution->exitStatus;
+			running = mExecution->running;
+		}
+
+		if ( nullptr != future )
+		{
+			future->complete( exitStatus );
+		}
+
+		for ( const auto& childProcess : running )
+		{
+			if ( nullptr != childProcess )
+			{
+				int signalCode = childProcess->sendSignal( SIGTERM );
+
+				if ( ( 0 == returnCode ) and ( 0 != signalCode ) and ( -ESRCH != signalCode ) )
+				{
+					returnCode = signalCode;
+				}
+			}
+		}
+
+		if ( wait )
+		{
+			this->wait();
+		}
+
+		return returnCode;
+	}
+
+	/**
+	 * Wait for every command of the batch to complete.
+	 * @return The exit status of the first command to fail is returned, or zero if none failed.
+	 */
+	int wait()
+	{
+		if ( nullptr == mExecution )
+		{
+			return 0;
+		}
+
+		std::unique_lock< std::mutex > lock( mExecution->mutex );
+		mExecution->completed.wait( lock, [ this ]() { return 0 == mExecution->remaining; } );
+
+		return mExecution->exitStatus;
+	}
+};
@@ -0,0 +1,204 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if defined( __cpp_impl_coroutine ) && __has_include( <coroutine> )
+#include <coroutine>
+#define COMMAND_HAS_COROUTINES 1
+#endif
+
+/**
+ * The eventual exit status of an asynchronous execution.
+ *
+ * A CommandFuture is completed from the ChildReaper thread once the
+ * execution finishes. The result can be taken as a std::future< int >,
+ * or, when compiled as C++20 with coroutine support, the CommandFuture
+ * itself can be co_await'ed; the awaiting coroutine is resumed on the
+ * reaper thread.
+ *
+ * The result is the exit status upon completion, or the negative error
+ * code returned by the execute method should the execution fail to start.
+ */
+class CommandFuture
+{
+public:
+	// The state shared between a CommandFuture and its completion
+	class State
+	{
+	private:
+		std::mutex mMutex;
+		bool mCompleted;
+		int mResult;
+		std::promise< int > mPromise;
+		std::vector< std::function< void() > > mContinuations;
+
+	public:
+		State()
+		{
+			mCompleted = false;
+			mResult = 0;
+		}
+
+		/**
+		 * Complete the execution; only the first call has any effect.
+		 * @param result The exit status, or negative error code, of the execution.
+		 */
+		void complete(
+			int result )
+		{
+			std::vector< std::function< void() > > continuations;
+
+			{
+				std::lock_guard< std::mutex > lock( mMutex );
+
+				if ( mCompleted )
+				{
+					return;
+				}
+
+				mCompleted = true;
+				mResult = result;
+				mPromise.set_value( result );
+				continuations.swap( mContinuations );
+			}
+
+			for ( const auto& continuation : continuations )
+			{
+				continuation();
+			}
+		}
+
+		/**
+		 * Queue a continuation to run once completed.
+		 * @param continuation The callable to invoke upon completion.
+		 * @return False is returned, and the continuation is not queued,
+		 *         if the execution has already completed.
+		 */
+		bool continueWith(
+			std::function< void() > continuation )
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			if ( mCompleted )
+			{
+				return false;
+			}
+
+			mContinuations.push_back( std::move( continuation ) );
+			return true;
+		}
+
+		/**
+		 * Get the promise fulfilled upon completion.
+		 * @return A reference to the promise is returned.
+		 */
+		std::promise< int >& promise()
+		{
+			return mPromise;
+		}
+
+		/**
+		 * Get the result of the execution.
+		 * @param result Set to the result if completed.
+		 * @return True is returned if the execution has completed.
+		 */
+		bool result(
+			int& result )
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+			result = mResult;
+			return mCompleted;
+		}
+	};
+
+private:
+	std::shared_ptr< State > mState;
+	std::shared_future< int > mFuture;
+
+public:
+	/**
+	 * Default constructor to a new, uncompleted, future.
+	 */
+	CommandFuture()
+	{
+		mState = std::make_shared< State >();
+		mFuture = mState->promise().get_future().share();
+	}
+
+	/**
+	 * Get a std::future for the result of the execution.
+	 * @return A std::shared_future< int > for the result is returned.
+	 */
+	std::shared_future< int > future() const
+	{
+		return mFuture;
+	}
+
+	/**
+	 * Block until the execution completes.
+	 * @return The result of the execution is returned.
+	 */
+	int get() const
+	{
+		return mFuture.get();
+	}
+
+	/**
+	 * Check if the execution has completed.
+	 * @return True is returned if the execution has completed.
+	 */
+	bool ready() const
+	{
+		int result;
+		return mState->result( result );
+	}
+
+	/**
+	 * Get the shared state, used to complete the execution.
+	 * @return The shared state is returned.
+	 */
+	const std::shared_ptr< State >& state() const
+	{
+		return mState;
+	}
+
+#if defined( COMMAND_HAS_COROUTINES )
+	/**
+	 * Awaitable interface: check if the execution has completed.
+	 */
+	bool await_ready() const
+	{
+		return ready();
+	}
+
+	/**
+	 * Awaitable interface: resume the coroutine upon completion.
+	 * @return False is returned if the execution completed in the meantime.
+	 */
+	bool await_suspend(
+		std::coroutine_handle<> awaitingCoroutine ) const
+	{
+		return mState->continueWith( [ awaitingCoroutine ]() { awaitingCoroutine.resume(); } );
+	}
+
+	/**
+	 * Awaitable interface: the result of the execution.
+	 */
+	int await_resume() const
+	{
+		int result = 0;
+		mState->result( result );
+		return result;
+	}
+#endif
+};
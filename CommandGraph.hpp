@@ -0,0 +1,815 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Command.hpp"
+#include "CommandPipeline.hpp"
+#include "FileDescriptorPlan.hpp"
+#include "LaunchState.hpp"
+#include "PipeTee.hpp"
+#include "TerminationPolicy.hpp"
+#include "Watchdog.hpp"
+
+/**
+ * A class object for executing commands connected as a directed acyclic
+ * graph, where a CommandPipeline only chains stdout to stdin; one stage
+ * decompressing into several filters, joined again by a stage reading
+ * each of them on a descriptor of its own, say.
+ *
+ * Stages are named, and each edge runs from an output descriptor of one
+ * stage to an input descriptor of another. A stage may read any number of
+ * inputs; on numbered descriptors, or on /dev/fd paths handed to it as
+ * arguments, as the <( ) of a shell does. An output with more than one
+ * consumer has a PipeTee interposed, so that each consumer is sent a copy
+ * of the output; otherwise it is piped straight into its consumer.
+ *
+ *     CommandGraph graph;
+ *     graph.addStage( "unzip", Command( "zcat" ).appendArgument( "data.gz" ) )
+ *         .addStage( "errors", Command( "grep" ).appendArgument( "ERROR" ) )
+ *         .addStage( "warnings", Command( "grep" ).appendArgument( "WARN" ) )
+ *         .addStage( "merge", Command( "paste" ) )
+ *         .connect( "unzip", "errors" )
+ *         .connect( "unzip", "warnings" )
+ *         .connectAsArgument( "errors", "merge" )
+ *         .connectAsArgument( "warnings", "merge" );
+ *
+ * Every stage is started at once, so independent branches run concurrently,
+ * and is reaped by the ChildReaper service; on its one thread, which also
+ * reads the output of any stage into its sink, see CommandPipeline. As with
+ * a pipeline, should a stage fail, then every other stage still running is
+ * torn down; see setTearDownPolicy(). An edge is set up through the file descriptor plan of its
+ * stages, ahead of the redirections of their own plans; see
+ * Command::setFileDescriptorPlan().
+ *
+ * As with Command, execute(), wait(), terminate(), isRunning() and the
+ * accessors of the outcome are thread safe; the setup of the graph is not.
+ */
+class CommandGraph
+{
+public:
+	using StageResult = CommandPipeline::StageResult;
+
+private:
+	// An output descriptor of one stage read from an input descriptor of another
+	struct Edge
+	{
+		size_t producer;
+		int outputFileDescriptor;
+		size_t consumer;
+		int inputFileDescriptor;
+	};
+
+	struct Stage
+	{
+		std::string name;
+		Command command;
+		FileDescriptorPlan fileDescriptorPlan; // That of the command, which the edges precede at launch
+	};
+
+	// The state of one execution of the graph, shared with the exit
+	// callbacks of its stages which run on the ChildReaper thread
+	struct Execution
+	{
+		std::mutex mutex;
+		std::condition_variable completed;
+		std::vector< std::shared_ptr< ChildProcess > > stages;
+		std::vector< StageResult > results;
+		std::vector< std::unique_ptr< PipeTee > > tees; // Interposed on the outputs with several consumers
+		std::vector< size_t > teeStages; // Index of the stage producing the output of each tee
+		size_t remaining; // Number of stages yet to exit and tees yet to finish
+		bool failed; // A stage has exited with a non-zero status, or a tee lost output
+		int exitStatus; // Exit status of the first stage to fail, or the error of the tee, else zero
+		TerminationPolicy tearDownPolicy; // How the stages still running are torn down upon a failure
+		std::shared_ptr< CommandFuture::State > future; // Completed once every stage has exited
+	};
+
+	std::vector< Stage > mStages;
+	std::unordered_map< std::string, size_t > mStageIndices;
+	std::vector< Edge > mEdges;
+	LaunchState mLaunchState; // Idle, Spawning, Running or Exited
+	TerminationPolicy mTearDownPolicy; // How the stages are torn down upon a failure
+
+	// The most recent execution; only accessed through std::atomic_load()
+	// and std::atomic_store(), as it is replaced by an execution while
+	// other threads may be reading it.
+	std::shared_ptr< Execution > mExecution;
+
+	// Count a stage or tee of an execution as finished, completing the
+	// execution once none remain. The lock is released.
+	static void _countDown(
+		Execution& execution,
+		std::unique_lock< std::mutex >& lock )
+	{
+		if ( 0 != --execution.remaining )
+		{
+			return;
+		}
+
+		execution.completed.notify_all();
+
+		std::shared_ptr< CommandFuture::State > future = std::move( execution.future );
+		int exitStatus = execution.exitStatus;
+
+		lock.unlock();
+
+		if ( nullptr != future )
+		{
+			future->complete( exitStatus );
+		}
+	}
+
+	// Get the most recent execution, if any.
+	std::shared_ptr< Execution > _execution() const
+	{
+		return std::atomic_load( &mExecution );
+	}
+
+	// Determine if the edges form a cycle, by removing the stages without
+	// an input left until none remain; as Kahn's topological sort does.
+	bool _hasCycle() const
+	{
+		std::vector< size_t > inputs( mStages.size(), 0 );
+		std::vector< size_t > ready;
+		size_t removed = 0;
+
+		for ( const Edge& edge : mEdges )
+		{
+			++inputs[ edge.consumer ];
+		}
+
+		for ( size_t index( -1 ); ++index < mStages.size(); )
+		{
+			if ( 0 == inputs[ index ] )
+			{
+				ready.push_back( index );
+			}
+		}
+
+		while ( not ready.empty() )
+		{
+			size_t stageIndex = ready.back();
+			ready.pop_back();
+			++removed;
+
+			for ( const Edge& edge : mEdges )
+			{
+				if ( ( stageIndex == edge.producer ) and ( 0 == --inputs[ edge.consumer ] ) )
+				{
+					ready.push_back( edge.consumer );
+				}
+			}
+		}
+
+		return removed != mStages.size();
+	}
+
+	// Determine if a descriptor of a stage is the input of an edge, or redirected by its own plan.
+	bool _isInputTaken(
+		size_t stageIndex,
+		int fileDescriptor ) const
+	{
+		for ( const Edge& edge : mEdges )
+		{
+			if ( ( stageIndex == edge.consumer ) and ( fileDescriptor == edge.inputFileDescriptor ) )
+			{
+				return true;
+			}
+		}
+
+		return mStages[ stageIndex ].fileDescriptorPlan._redirects( fileDescriptor );
+	}
+
+	// Start every stage of the graph; see execute().
+	// @param failedExecution Set to the execution of a failed launch that
+	//                        started stages, which are torn down; to be waited on.
+	// @return Zero is returned on success, else a negative error code.
+	int _launch(
+		std::shared_ptr< Execution >& failedExecution )
+	{
+		int errorCode = 0;
+		std::vector< FileDescriptorPlan > plans( mStages.size() ); // The edges of each stage
+		std::vector< int > parentFDs; // The ends of the pipes handed to the stages
+		std::vector< bool > wired( mEdges.size(), false );
+		std::shared_ptr< Execution > execution = std::make_shared< Execution >();
+
+		execution->remaining = 0;
+		execution->failed = false;
+		execution->exitStatus = 0;
+		execution->tearDownPolicy = mTearDownPolicy;
+
+		if ( _hasCycle() )
+		{
+			return -EINVAL;
+		}
+
+		// One pipe per output; teed should it have more than one consumer
+		for ( size_t index( -1 ); ( 0 == errorCode ) and ( ++index < mEdges.size() ); )
+		{
+			const Edge& edge = mEdges[ index ];
+			std::vector< size_t > consumers;
+			int outputPipe[ 2 ];
+
+			if ( wired[ index ] )
+			{
+				continue;
+			}
+
+			for ( size_t other( index - 1 ); ++other < mEdges.size(); )
+			{
+				if ( ( edge.producer == mEdges[ other ].producer )
+					and ( edge.outputFileDescriptor == mEdges[ other ].outputFileDescriptor ) )
+				{
+					consumers.push_back( other );
+					wired[ other ] = true;
+				}
+			}
+
+			if ( 0 != pipe2( outputPipe, O_CLOEXEC ) )
+			{
+				errorCode = -errno;
+				break;
+			}
+
+			plans[ edge.producer ].redirectToFileDescriptor( edge.outputFileDescriptor, outputPipe[ 1 ] );
+			parentFDs.push_back( outputPipe[ 1 ] );
+
+			if ( 1 == consumers.size() )
+			{
+				plans[ edge.consumer ].redirectToFileDescriptor( edge.inputFileDescriptor, outputPipe[ 0 ] );
+				parentFDs.push_back( outputPipe[ 0 ] );
+				continue;
+			}
+
+			execution->tees.emplace_back( new PipeTee( outputPipe[ 0 ] ) );
+			execution->teeStages.push_back( edge.producer );
+
+			for ( size_t consumer : consumers )
+			{
+				int inputPipe[ 2 ];
+
+				if ( 0 != pipe2( inputPipe, O_CLOEXEC ) )
+				{
+					errorCode = -errno;
+					break;
+				}
+
+				// The tee feeds the write end once started
+				execution->tees.back()->addFileDescriptor( inputPipe[ 1 ] );
+				plans[ mEdges[ consumer ].consumer ].redirectToFileDescriptor( mEdges[ consumer ].inputFileDescriptor, inputPipe[ 0 ] );
+				parentFDs.push_back( inputPipe[ 0 ] );
+			}
+		}
+
+		for ( size_t index( -1 ); ( 0 == errorCode ) and ( ++index < mStages.size() ); )
+		{
+			Command& command = mStages[ index ].command;
+
+			// The command carries the plan of its most recent launch
+			command.setFileDescriptorPlan( plans[ index ].append( mStages[ index ].fileDescriptorPlan ) );
+
+			if ( 0 == ( errorCode = command._forkRedirectToPipeAndExecute( nullptr, nullptr ) ) )
+			{
+				execution->stages.push_back( command._childProcess() );
+			}
+		}
+
+		// The stages hold their ends of the pipes, and the tees theirs
+		for ( int fileDescriptor : parentFDs )
+		{
+			close( fileDescriptor );
+		}
+
+		if ( 0 != errorCode )
+		{
+			// Tees that are not started release their pipes here
+			execution->tees.clear();
+			execution->teeStages.clear();
+		}
+
+		execution->results.resize( execution->stages.size(), StageResult{ 0, false, 0, ResourceUsage() } );
+		execution->remaining = execution->stages.size() + execution->tees.size();
+
+		for ( size_t index( -1 ); ++index < execution->stages.size(); )
+		{
+			execution->stages[ index ]->onExit( [ execution, index ]( const ChildProcess& exitedProcess )
+			{
+				_stageExited( execution, index, exitedProcess );
+			} );
+
+			// Shared with every other watched child; nothing called back on it may block
+			ChildReaper::instance().watch( execution->stages[ index ] );
+		}
+
+		for ( size_t index( -1 ); ++index < execution->tees.size(); )
+		{
+			execution->tees[ index ]->start( [ execution, stageIndex = execution->teeStages[ index ] ]( int errorCode )
+			{
+				_teeFinished( execution, stageIndex, errorCode );
+			} );
+		}
+
+		if ( 0 != errorCode )
+		{
+			if ( execution->stages.empty() )
+			{
+				return errorCode;
+			}
+
+			// Break down the stages that did start; the error stands as the
+			// exit status, however the stages torn down exit
+			{
+				std::lock_guard< std::mutex > lock( execution->mutex );
+				execution->failed = true;
+				execution->exitStatus = errorCode;
+				_tearDown( *execution, mStages.size() );
+			}
+
+			// Published, and only waited on once out of Spawning, so that the
+			// threads waiting on the graph block on the teardown as well
+			std::atomic_store( &mExecution, execution );
+			failedExecution = std::move( execution );
+			return errorCode;
+		}
+
+		// Published before the Running state, which readers check first
+		std::atomic_store( &mExecution, std::move( execution ) );
+
+		return 0;
+	}
+
+	// Look up a stage by name.
+	// @throw std::invalid_argument is thrown if there is no such stage.
+	size_t _stage(
+		const std::string& name ) const
+	{
+		auto stageIndex = mStageIndices.find( name );
+
+		if ( mStageIndices.end() == stageIndex )
+		{
+			throw std::invalid_argument( "There is no stage named " + name );
+		}
+
+		return stageIndex->second;
+	}
+
+	// Record the exit of a stage. Should it have failed, and be the first
+	// to, then every stage still running is torn down immediately. A stage
+	// killed by SIGPIPE has not failed; its consumer stopped reading.
+	static void _stageExited(
+		const std::shared_ptr< Execution >& execution,
+		size_t stageIndex,
+		const ChildProcess& exitedProcess )
+	{
+		bool brokenPipe = ( SIGPIPE == exitedProcess.terminatingSignal() );
+		std::unique_lock< std::mutex > lock( execution->mutex );
+		StageResult& result = execution->results[ stageIndex ];
+
+		result.exitStatus = exitedProcess.exitStatus();
+		result.resourceUsage = exitedProcess.resourceUsage();
+
+		if ( ( 0 != result.exitStatus ) and ( not brokenPipe ) and ( not execution->failed ) )
+		{
+			execution->failed = true;
+			execution->exitStatus = result.exitStatus;
+			_tearDown( *execution, stageIndex );
+		}
+
+		_countDown( *execution, lock );
+	}
+
+	// Record a tee having finished copying an output of a stage. Should any
+	// of that output have been lost, the execution fails as though the stage
+	// had, with the error of the tee; the consumers saw the stream end early.
+	static void _teeFinished(
+		const std::shared_ptr< Execution >& execution,
+		size_t stageIndex,
+		int errorCode )
+	{
+		std::unique_lock< std::mutex > lock( execution->mutex );
+
+		if ( 0 != errorCode )
+		{
+			execution->results[ stageIndex ].outputError = errorCode;
+		}
+
+		if ( ( 0 != errorCode ) and ( not execution->failed ) )
+		{
+			execution->failed = true;
+			execution->exitStatus = errorCode;
+			_tearDown( *execution, SIZE_MAX );
+		}
+
+		_countDown( *execution, lock );
+	}
+
+	// Signal every stage other than {@param exceptIndex} that is still running,
+	// by the teardown policy of the execution; a stage outlasting its grace
+	// period is sent SIGKILL by the Watchdog. The mutex of the execution must be held.
+	static void _tearDown(
+		Execution& execution,
+		size_t exceptIndex )
+	{
+		const TerminationPolicy& policy = execution.tearDownPolicy;
+
+		for ( size_t index( -1 ); ++index < execution.stages.size(); )
+		{
+			if ( ( index != exceptIndex ) and ( 0 == Watchdog::terminate( execution.stages[ index ],
+				TerminationPolicy( policy.signalNumber, policy.gracePeriod ) ) ) )
+			{
+				execution.results[ index ].tornDown = true;
+			}
+		}
+	}
+
+	// Terminate every stage of the most recent execution.
+	// @return Zero is returned on success, else the first error code.
+	int _terminateStages()
+	{
+		int returnCode = 0;
+
+		for ( Stage& stage : mStages )
+		{
+			int terminateCode = stage.command.terminate();
+
+			if ( ( 0 == returnCode ) and ( 0 != terminateCode ) )
+			{
+				returnCode = terminateCode;
+			}
+		}
+
+		return returnCode;
+	}
+
+public:
+	/**
+	 * Default constructor to an empty graph.
+	 */
+	CommandGraph()
+	{
+		mTearDownPolicy = TerminationPolicy( SIGTERM, CommandPipeline::DefaultTearDownGracePeriod );
+	}
+
+	/**
+	 * Add a stage to the graph.
+	 * @param name Name of the stage, by which it is connected.
+	 * @param command The command the stage executes; its file descriptor
+	 *                plan is applied after the edges of the stage.
+	 * @return A reference to this CommandGraph object is returned.
+	 * @throw std::invalid_argument is thrown if {@param command} does not have a set
+	 *        application to be executed, or a stage of the same name exists.
+	 */
+	CommandGraph& addStage(
+		const std::string& name,
+		const Command& command )
+	{
+		// Sanity check
+		if ( command.applicationName().empty() )
+		{
+			throw std::invalid_argument( "Command of stage " + name + " does not have a set application" );
+		}
+
+		if ( 0 != mStageIndices.count( name ) )
+		{
+			throw std::invalid_argument( "There already is a stage named " + name );
+		}
+
+		mStageIndices[ name ] = mStages.size();
+		mStages.push_back( Stage{ name, command, command.spec()->fileDescriptorPlan() } );
+
+		return *this;
+	}
+
+	/**
+	 * Connect an output of one stage to an input of another. An output may
+	 * be connected to any number of inputs, each of which is sent a copy.
+	 * @param producer Name of the stage writing the output.
+	 * @param consumer Name of the stage reading the input.
+	 * @param inputFileDescriptor Descriptor of the consumer read from. [default: STDIN_FILENO]
+	 * @param outputFileDescriptor Descriptor of the producer written to. [default: STDOUT_FILENO]
+	 * @return A reference to this CommandGraph object is returned.
+	 * @throw std::invalid_argument is thrown if either stage does not exist, they
+	 *        are the same stage, a descriptor is negative, or the input is taken.
+	 */
+	CommandGraph& connect(
+		const std::string& producer,
+		const std::string& consumer,
+		int inputFileDescriptor = STDIN_FILENO,
+		int outputFileDescriptor = STDOUT_FILENO )
+	{
+		size_t producerIndex = _stage( producer );
+		size_t consumerIndex = _stage( consumer );
+
+		if ( producerIndex == consumerIndex )
+		{
+			throw std::invalid_argument( "Stage " + producer + " cannot read its own output" );
+		}
+
+		if ( ( 0 > inputFileDescriptor ) or ( 0 > outputFileDescriptor ) )
+		{
+			throw std::invalid_argument( "File descriptor is negative" );
+		}
+
+		if ( _isInputTaken( consumerIndex, inputFileDescriptor ) )
+		{
+			throw std::invalid_argument( "Input " + std::to_string( inputFileDescriptor )
+				+ " of stage " + consumer + " is already connected" );
+		}
+
+		mEdges.push_back( Edge{ producerIndex, outputFileDescriptor, consumerIndex, inputFileDescriptor } );
+
+		return *this;
+	}
+
+	/**
+	 * Connect an output of one stage to the consumer as a path; the input is
+	 * given the lowest free descriptor from 3 up, and /dev/fd/N is appended
+	 * to the arguments of the consumer, as the <( ) of a shell does. For a
+	 * consumer taking several inputs named on its command line.
+	 * @param producer Name of the stage writing the output.
+	 * @param consumer Name of the stage reading the input.
+	 * @param outputFileDescriptor Descriptor of the producer written to. [default: STDOUT_FILENO]
+	 * @return A reference to this CommandGraph object is returned.
+	 * @throw std::invalid_argument is thrown if either stage does not exist,
+	 *        or they are the same stage.
+	 */
+	CommandGraph& connectAsArgument(
+		const std::string& producer,
+		const std::string& consumer,
+		int outputFileDescriptor = STDOUT_FILENO )
+	{
+		size_t consumerIndex = _stage( consumer );
+		int inputFileDescriptor = STDERR_FILENO + 1;
+
+		while ( _isInputTaken( consumerIndex, inputFileDescriptor ) )
+		{
+			++inputFileDescriptor;
+		}
+
+		connect( producer, consumer, inputFileDescriptor, outputFileDescriptor );
+		mStages[ consumerIndex ].command.appendArgument( "/dev/fd/" + std::to_string( inputFileDescriptor ) );
+
+		return *this;
+	}
+
+	/**
+	 * Begin execution of the graph; every stage is started at once.
+	 * Every stage is reaped by the ChildReaper service as soon as it exits,
+	 * and should a stage exit with a non-zero status, then every other stage
+	 * still running is torn down; see setTearDownPolicy().
+	 * @return Zero is returned upon successful initialization of the graph.
+	 *         If an error occurs, then the stages started are broken down, the
+	 *         resources are released and an error code is returned. -EINVAL is
+	 *         returned if the edges form a cycle. The stages already started
+	 *         are torn down, and waited on once the graph has left Spawning;
+	 *         wait() then returns the error code as well.
+	 */
+	int execute()
+	{
+		std::shared_ptr< Execution > execution = _execution();
+		uint32_t launch;
+
+		// The stages are reaped by the ChildReaper, whether the graph is waited on or not
+		if ( LaunchState::Phase::Running == mLaunchState.phase( launch ) )
+		{
+			std::lock_guard< std::mutex > lock( execution->mutex );
+
+			if ( 0 == execution->remaining )
+			{
+				mLaunchState.markExited( launch );
+			}
+		}
+
+		if ( not mLaunchState.beginSpawn() )
+		{
+			return -ECANCELED;
+		}
+
+		std::shared_ptr< Execution > failedExecution;
+		int errorCode = _launch( failedExecution );
+		LaunchState::Phase phase = ( 0 == errorCode ) ? LaunchState::Phase::Running
+			: ( ( ( nullptr == execution ) and ( nullptr == failedExecution ) ) ? LaunchState::Phase::Idle : LaunchState::Phase::Exited );
+
+		if ( mLaunchState.endSpawn( phase ) )
+		{
+			_terminateStages();
+		}
+
+		if ( nullptr != failedExecution )
+		{
+			std::unique_lock< std::mutex > lock( failedExecution->mutex );
+			failedExecution->completed.wait( lock, [ &failedExecution ]() { return 0 == failedExecution->remaining; } );
+		}
+
+		return errorCode;
+	}
+
+	/**
+	 * Begin execution of the graph and wait for every stage to complete.
+	 * @return A negative error code is returned upon failure to initialize
+	 *         the graph, else the exit status of the graph is returned.
+	 */
+	int executeAndWait()
+	{
+		int exitStatus = 0;
+
+		if ( 0 == ( exitStatus = this->execute() ) )
+		{
+			exitStatus = this->wait();
+		}
+
+		return exitStatus;
+	}
+
+	/**
+	 * Begin execution of the graph without blocking on its completion.
+	 * @return A CommandFuture for the exit status of the graph is returned;
+	 *         that of the first stage to fail, else zero. Should the graph
+	 *         fail to start, then the future is already completed with the
+	 *         error code returned by execute().
+	 */
+	CommandFuture executeAsync()
+	{
+		CommandFuture commandFuture;
+		int errorCode = this->execute();
+
+		if ( 0 != errorCode )
+		{
+			commandFuture.state()->complete( errorCode );
+			return commandFuture;
+		}
+
+		{
+			std::shared_ptr< Execution > execution = _execution();
+			std::lock_guard< std::mutex > lock( execution->mutex );
+
+			if ( 0 != execution->remaining )
+			{
+				execution->future = commandFuture.state();
+				return commandFuture;
+			}
+
+			errorCode = execution->exitStatus;
+		}
+
+		commandFuture.state()->complete( errorCode );
+
+		return commandFuture;
+	}
+
+	/**
+	 * Return the exit status of the graph.
+	 * If the graph has yet to execute or is currently executing, then zero
+	 * is returned, else the exit status of the first stage to fail is
+	 * returned; zero if every stage succeeded.
+	 * @return The exit status of the graph is returned.
+	 */
+	int exitStatus()
+	{
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( nullptr == execution )
+		{
+			return 0;
+		}
+
+		std::lock_guard< std::mutex > lock( execution->mutex );
+		return ( 0 == execution->remaining ) ? execution->exitStatus : 0;
+	}
+
+	/**
+	 * Determine if any stage of the graph is running, or being started.
+	 * @return True is returned if the graph is running.
+	 */
+	bool isRunning()
+	{
+		LaunchState::Phase phase = mLaunchState.phase();
+
+		if ( LaunchState::Phase::Spawning == phase )
+		{
+			return true;
+		}
+
+		if ( LaunchState::Phase::Idle != phase )
+		{
+			for ( Stage& stage : mStages )
+			{
+				if ( stage.command.isRunning() )
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Set how the stages still running are torn down, once a stage fails or
+	 * the graph fails to launch: the signal sent first, and the grace period
+	 * until SIGKILL, which the Watchdog sends. A grace period of zero never
+	 * escalates, and so leaves a stage ignoring the signal to hold the graph.
+	 * The process group of the policy is not used.
+	 * @param tearDownPolicy The policy to apply. [default: SIGTERM, then SIGKILL
+	 *                       after CommandPipeline::DefaultTearDownGracePeriod]
+	 * @return A reference to this CommandGraph object is returned.
+	 */
+	CommandGraph& setTearDownPolicy(
+		const TerminationPolicy& tearDownPolicy )
+	{
+		mTearDownPolicy = tearDownPolicy;
+		return *this;
+	}
+
+	/**
+	 * Get the index of a stage, by which stageResults() is indexed;
+	 * stages are numbered in the order they were added.
+	 * @param name Name of the stage.
+	 * @return The index of the stage is returned.
+	 * @throw std::invalid_argument is thrown if there is no such stage.
+	 */
+	size_t stageIndex(
+		const std::string& name ) const
+	{
+		return _stage( name );
+	}
+
+	/**
+	 * Get the outcome of each stage of the most recent execution.
+	 * The results of the stages yet to exit are zeroed.
+	 * @return A vector of the results, indexed by stage, is returned.
+	 */
+	std::vector< StageResult > stageResults() const
+	{
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( nullptr == execution )
+		{
+			return std::vector< StageResult >();
+		}
+
+		std::lock_guard< std::mutex > lock( execution->mutex );
+		return execution->results;
+	}
+
+	/**
+	 * Terminate the execution of the graph.
+	 * @return Zero is returned upon success, else a non-zero exit code is returned.
+	 */
+	int terminate()
+	{
+		LaunchState::Phase phase;
+
+		mLaunchState.requestTerminate( phase );
+
+		// An execution in progress is terminated by the executing thread once started
+		if ( ( LaunchState::Phase::Idle == phase ) or ( LaunchState::Phase::Spawning == phase ) )
+		{
+			return 0;
+		}
+
+		return _terminateStages();
+	}
+
+	/**
+	 * Wait for every stage of the graph to complete execution; should any
+	 * stage fail, then the stages still running are terminated rather than
+	 * waited out.
+	 * @return The exit status of the first stage to fail is returned,
+	 *         or zero if every stage succeeded. Should a tee lose output
+	 *         first, its negative error code is returned instead.
+	 */
+	int wait()
+	{
+		uint32_t launch;
+
+		mLaunchState.awaitSpawn( launch );
+
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( nullptr == execution )
+		{
+			return 0;
+		}
+
+		std::unique_lock< std::mutex > lock( execution->mutex );
+		execution->completed.wait( lock, [ &execution ]() { return 0 == execution->remaining; } );
+		mLaunchState.markExited( launch );
+
+		return execution->exitStatus;
+	}
+};
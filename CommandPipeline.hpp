@@ -5,22 +5,759 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <signal.h>
 #include <stdexcept>
 #include <string>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include "Command.hpp"
+#include "LaunchState.hpp"
+#include "PipeTee.hpp"
+#include "RetryPolicy.hpp"
+#include "TerminationPolicy.hpp"
+#include "Watchdog.hpp"
 
 /**
  * A class object for handling the construction
  * and execution of commands that consume the output of prior commands.
+ *
+ * The output of the final stage may be fanned out to several consumers,
+ * each receiving a copy, and the output of any stage with a consumer may
+ * be tapped off to a file or a callback. Wherever a stage has more than
+ * one destination a PipeTee is interposed on its output; otherwise stages
+ * are piped straight into each other.
+ *
+ * The stages may be placed in a process group of their own, so that the
+ * pipeline, and whatever its stages start, is signalled as one; and as the
+ * child subreaper, so that what they leave behind is reaped by the pipeline.
+ *
+ * Every stage is reaped by the one ChildReaper thread, which also reads the
+ * output of any stage into its sink; the callbacks of those sinks are made
+ * on it, and so should be short. A sink without room, such as a StreamSink
+ * whose pool is exhausted, only has its own pipe left unread meanwhile;
+ * taps are fed by their PipeTee, on a thread of its own.
+ *
+ * As with Command, execute(), wait(), terminate(), suspend(), resume(),
+ * isRunning() and the accessors of the outcome are thread safe; the setup
+ * of the pipeline is not.
  */
 class CommandPipeline
 {
+public:
+	static constexpr std::chrono::seconds DefaultTearDownGracePeriod{ 5 }; // Until a stage torn down is sent SIGKILL
+
+	// The outcome of one stage of an execution of the pipeline
+	struct StageResult
+	{
+		int exitStatus; // Exit status of the stage
+		bool tornDown; // The stage was signalled as another stage failed
+		int outputError; // The error by which its PipeTee lost output of the stage, else zero
+		ResourceUsage resourceUsage; // Resources used by the stage and the wall clock time it ran for
+	};
+
+private:
+	// The state of one execution of the pipeline, shared with the
+	// exit callbacks of its stages which run on the ChildReaper thread
+	struct Execution
+	{
+		std::mutex mutex;
+		std::condition_variable completed;
+		std::vector< std::shared_ptr< ChildProcess > > stages;
+		std::vector< StageResult > results;
+		std::vector< std::unique_ptr< PipeTee > > tees; // Interposed on the output of tapped or fanned out stages
+		std::vector< size_t > teeStages; // Index of the stage each tee is interposed on
+		size_t remaining; // Number of stages yet to exit and tees yet to finish
+		size_t runningStages; // Number of stages yet to exit
+		std::vector< pid_t > processGroups; // Held by the stages, or by orphans yet to be reaped
+		bool reapOrphans; // The process is the child subreaper; orphans in the groups are reaped
+		bool failed; // A stage has exited with a non-zero status, or a tee lost output
+		int exitStatus; // Exit status of the first stage to fail, or the error of the tee, else zero
+		int terminatingSignal; // Signal that killed the first stage to fail, else zero
+		TerminationPolicy tearDownPolicy; // How the stages still running are torn down upon a failure
+		std::shared_ptr< CommandFuture::State > future; // Completed once every stage has exited
+	};
+
+	// A copy of the output of a stage, written to a file or handed to a callback
+	struct Tap
+	{
+		size_t stageIndex;
+		std::string filePath; // Empty for a callback
+		StreamSink::Callback callback;
+	};
+
 	std::vector< Command > mCommands;
-	bool mHasExecuted;
-	int mExitStatus;
+	std::vector< Command > mFanOut; // Consumers of the output of the final stage
+	std::vector< Tap > mTaps;
+	size_t mPipeBufferSize; // Buffer size of the pipes between stages, zero for the kernel default
+	std::unordered_map< size_t, size_t > mPipeBufferSizes; // Overrides by producing stage
+	LaunchState mLaunchState; // Idle, Spawning, Running or Exited
+	bool mProcessGroup; // The stages are launched into a process group of their own
+	bool mNewSession; // Each stage leads a new session, and so a process group of its own
+	bool mChildSubreaper; // Orphans of the stages are reparented to, and reaped by, the pipeline
+	RetryPolicy mRetryPolicy; // When a failed execution is relaunched
+	TerminationPolicy mTearDownPolicy; // How the stages are torn down upon a failure
+
+	// The most recent execution; only accessed through std::atomic_load()
+	// and std::atomic_store(), as it is replaced by an execution while
+	// other threads may be reading it.
+	std::shared_ptr< Execution > mExecution;
+
+	// Add the taps of a stage to the tee interposed on its output.
+	// @return Zero is returned on success, else a negative error code.
+	int _addTaps(
+		PipeTee& pipeTee,
+		size_t stageIndex ) const
+	{
+		for ( const Tap& tap : mTaps )
+		{
+			if ( stageIndex != tap.stageIndex )
+			{
+				continue;
+			}
+
+			if ( tap.filePath.empty() )
+			{
+				pipeTee.addCallback( tap.callback );
+				continue;
+			}
+
+			int fileDescriptor = open( tap.filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+			if ( -1 == fileDescriptor )
+			{
+				return -errno;
+			}
+
+			pipeTee.addFileDescriptor( fileDescriptor );
+		}
+
+		return 0;
+	}
+
+	// Count a stage or tee of an execution as finished, completing the
+	// execution once none remain. The lock is released.
+	static void _countDown(
+		Execution& execution,
+		std::unique_lock< std::mutex >& lock )
+	{
+		if ( 0 != --execution.remaining )
+		{
+			return;
+		}
+
+		execution.completed.notify_all();
+
+		std::shared_ptr< CommandFuture::State > future = std::move( execution.future );
+		int exitStatus = execution.exitStatus;
+
+		lock.unlock();
+
+		if ( nullptr != future )
+		{
+			future->complete( exitStatus );
+		}
+	}
+
+	// Launch the stages, relaunching them after the backoff of the retry policy
+	// upon a failure to launch that the policy retries. A terminate requested
+	// during a backoff stops the retries, with the error of the last attempt.
+	// @param attempt The number of attempts made so far; counted up by each.
+	// @return Zero is returned on success, else the error of the last attempt.
+	int _execute(
+		unsigned& attempt )
+	{
+		int errorCode = 0;
+
+		do
+		{
+			if ( 0 != attempt++ )
+			{
+				std::this_thread::sleep_for( mRetryPolicy.backoff( attempt ) );
+
+				if ( mLaunchState.terminateRequested() )
+				{
+					return errorCode;
+				}
+			}
+
+			errorCode = _start();
+		} while ( mRetryPolicy.retriesLaunch( errorCode ) and ( attempt < mRetryPolicy.maxAttempts ) );
+
+		return errorCode;
+	}
+
+	// Get the most recent execution, if any.
+	std::shared_ptr< Execution > _execution() const
+	{
+		return std::atomic_load( &mExecution );
+	}
+
+	// Determine if every stage and tee of an execution has finished.
+	static bool _isComplete(
+		const std::shared_ptr< Execution >& execution )
+	{
+		if ( nullptr == execution )
+		{
+			return false;
+		}
+
+		std::lock_guard< std::mutex > lock( execution->mutex );
+		return 0 == execution->remaining;
+	}
+
+	// Determine if the output of a stage is tapped.
+	bool _isTapped(
+		size_t stageIndex ) const
+	{
+		for ( const Tap& tap : mTaps )
+		{
+			if ( stageIndex == tap.stageIndex )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Start every stage of the pipeline; see execute().
+	// @param failedExecution Set to the execution of a failed launch that
+	//                        started stages, which are torn down; to be waited on.
+	// @return Zero is returned on success, else a negative error code.
+	int _launch(
+		std::shared_ptr< Execution >& failedExecution )
+	{
+		int errorCode = 0;
+		int directPipe[ 2 ] = { -1, -1 }; // Output of the previous stage when piped straight on
+		size_t numberCommands = mCommands.size();
+		size_t numberStages = numberCommands + mFanOut.size();
+		std::vector< std::unique_ptr< PipeTee > > tees( numberCommands ); // By producing stage
+		std::shared_ptr< Execution > execution = std::make_shared< Execution >();
+
+		execution->remaining = 0;
+		execution->runningStages = 0;
+		execution->reapOrphans = false;
+		execution->failed = false;
+		execution->exitStatus = 0;
+		execution->terminatingSignal = 0;
+		execution->tearDownPolicy = mTearDownPolicy;
+
+		// A fan out needs a producer, and a tap a consumer to pass the output on to
+		if ( ( 0 == numberCommands ) and ( not mFanOut.empty() ) )
+		{
+			return -EINVAL;
+		}
+
+		for ( const Tap& tap : mTaps )
+		{
+			if ( ( numberCommands <= tap.stageIndex )
+				or ( ( ( numberCommands - 1 ) == tap.stageIndex ) and mFanOut.empty() ) )
+			{
+				return -EINVAL;
+			}
+		}
+
+		// Set once for the process, and left set; it only changes where orphans are reparented to
+		if ( mProcessGroup and mChildSubreaper and ( 0 != prctl( PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0 ) ) )
+		{
+			return -errno;
+		}
+
+		// Once the process is the subreaper, orphans come to it whoever set it
+		if ( mProcessGroup )
+		{
+			int childSubreaper = 0;
+			prctl( PR_GET_CHILD_SUBREAPER, &childSubreaper, 0, 0, 0 );
+			execution->reapOrphans = ( 0 != childSubreaper );
+		}
+
+		for ( size_t index( -1 ); ++index < numberStages; )
+		{
+			bool fanningOut = ( numberCommands <= index );
+			Command& command = fanningOut ? mFanOut[ index - numberCommands ] : mCommands[ index ];
+			size_t consumers = fanningOut ? 0 : ( ( ( index + 1 ) < numberCommands ) ? 1 : mFanOut.size() );
+			bool tapped = ( not fanningOut ) and _isTapped( index );
+			PipeTee* feedingTee = ( 0 < index ) ? tees[ std::min( index, numberCommands ) - 1 ].get() : nullptr;
+			int inPipe[ 2 ] = { directPipe[ 0 ], directPipe[ 1 ] };
+			int outPipe[ 2 ] = { -1, -1 };
+
+			directPipe[ 0 ] = directPipe[ 1 ] = -1;
+
+			if ( nullptr != feedingTee )
+			{
+				errorCode = _openPipe( inPipe, _pipeBufferSize( std::min( index, numberCommands ) - 1 ) );
+			}
+
+			if ( ( 0 == errorCode ) and ( ( 0 < consumers ) or tapped ) )
+			{
+				errorCode = _openPipe( outPipe, _pipeBufferSize( index ) );
+			}
+
+			if ( 0 == errorCode )
+			{
+				// The first stage leads the group of the pipeline, which the others join;
+				// a group cannot be joined from another session, so each session has its own
+				pid_t processGroup = ( mProcessGroup and not mNewSession )
+					? ( execution->processGroups.empty() ? 0 : execution->processGroups[ 0 ] ) : -1;
+
+				errorCode = command._forkRedirectToPipeAndExecute(
+					( -1 != inPipe[ 0 ] ) ? inPipe : nullptr,
+					( -1 != outPipe[ 0 ] ) ? outPipe : nullptr,
+					processGroup, mProcessGroup and mNewSession );
+
+				if ( 0 == errorCode )
+				{
+					execution->stages.push_back( command._childProcess() );
+
+					if ( mProcessGroup and ( mNewSession or execution->processGroups.empty() ) )
+					{
+						execution->processGroups.push_back( execution->stages.back()->processID() );
+					}
+				}
+			}
+
+			if ( -1 != inPipe[ 0 ] )
+			{
+				close( inPipe[ 0 ] );
+
+				// The tee feeds the write end once started
+				if ( ( 0 == errorCode ) and ( nullptr != feedingTee ) )
+				{
+					feedingTee->addFileDescriptor( inPipe[ 1 ] );
+				}
+				else
+				{
+					close( inPipe[ 1 ] );
+				}
+			}
+
+			if ( 0 != errorCode )
+			{
+				if ( -1 != outPipe[ 0 ] )
+				{
+					close( outPipe[ 0 ] );
+					close( outPipe[ 1 ] );
+				}
+
+				break;
+			}
+
+			if ( -1 == outPipe[ 0 ] )
+			{
+				continue;
+			}
+
+			if ( ( 1 == consumers ) and ( not tapped ) )
+			{
+				directPipe[ 0 ] = outPipe[ 0 ];
+				directPipe[ 1 ] = outPipe[ 1 ];
+				continue;
+			}
+
+			// Interpose a tee; its consumers are handed to it as they are started
+			close( outPipe[ 1 ] );
+			tees[ index ].reset( new PipeTee( outPipe[ 0 ] ) );
+
+			if ( 0 != ( errorCode = _addTaps( *tees[ index ], index ) ) )
+			{
+				break;
+			}
+		}
+
+		if ( -1 != directPipe[ 0 ] )
+		{
+			close( directPipe[ 0 ] );
+			close( directPipe[ 1 ] );
+		}
+
+		if ( 0 == errorCode )
+		{
+			for ( size_t index( -1 ); ++index < tees.size(); )
+			{
+				if ( nullptr != tees[ index ] )
+				{
+					execution->tees.push_back( std::move( tees[ index ] ) );
+					execution->teeStages.push_back( index );
+				}
+			}
+		}
+
+		// Tees that are not started release their pipes here
+		tees.clear();
+
+		execution->results.resize( execution->stages.size(), StageResult{ 0, false, 0, ResourceUsage() } );
+		execution->remaining = execution->stages.size() + execution->tees.size();
+		execution->runningStages = execution->stages.size();
+
+		for ( size_t index( -1 ); ++index < execution->stages.size(); )
+		{
+			execution->stages[ index ]->onExit( [ execution, index ]( const ChildProcess& exitedProcess )
+			{
+				_stageExited( execution, index, exitedProcess );
+			} );
+
+			// Shared with every other watched child; nothing called back on it may block
+			ChildReaper::instance().watch( execution->stages[ index ] );
+		}
+
+		for ( size_t index( -1 ); ++index < execution->tees.size(); )
+		{
+			execution->tees[ index ]->start( [ execution, stageIndex = execution->teeStages[ index ] ]( int errorCode )
+			{
+				_teeFinished( execution, stageIndex, errorCode );
+			} );
+		}
+
+		if ( 0 != errorCode )
+		{
+			if ( execution->stages.empty() )
+			{
+				return errorCode;
+			}
+
+			// Break down the stages that did start; every one of them, as no stage index is excepted.
+			// The error stands as the exit status, however the stages torn down exit.
+			{
+				std::lock_guard< std::mutex > lock( execution->mutex );
+				execution->failed = true;
+				execution->exitStatus = errorCode;
+				_tearDown( *execution, SIZE_MAX );
+			}
+
+			// Published, and only waited on once out of Spawning, so that the
+			// threads waiting on the pipeline block on the teardown as well
+			std::atomic_store( &mExecution, execution );
+			failedExecution = std::move( execution );
+			return errorCode;
+		}
+
+		// Published before the Running state, which readers check first
+		std::atomic_store( &mExecution, std::move( execution ) );
+
+		return 0;
+	}
+
+	// Create a pipe, close on exec, with a buffer of {@param bufferSize} bytes
+	// clamped to the pipe maximum size. The resize is best effort; the kernel
+	// refuses it once the user has exhausted their allowance of pipe pages.
+	// @return Zero is returned on success, else a negative error code.
+	static int _openPipe(
+		int fileDescriptors[ 2 ],
+		size_t bufferSize )
+	{
+		if ( 0 != pipe2( fileDescriptors, O_CLOEXEC ) )
+		{
+			fileDescriptors[ 0 ] = fileDescriptors[ 1 ] = -1;
+			return -errno;
+		}
+
+		if ( 0 != bufferSize )
+		{
+			fcntl( fileDescriptors[ 1 ], F_SETPIPE_SZ, static_cast< int >( std::min( bufferSize, _pipeMaximumSize() ) ) );
+		}
+
+		return 0;
+	}
+
+	// Get the buffer size of the pipes carrying the output of a stage; zero for the kernel default.
+	size_t _pipeBufferSize(
+		size_t stageIndex ) const
+	{
+		auto pipeBufferSize = mPipeBufferSizes.find( stageIndex );
+		return ( mPipeBufferSizes.end() == pipeBufferSize ) ? mPipeBufferSize : pipeBufferSize->second;
+	}
+
+	// Get the largest buffer size an unprivileged process may give a pipe.
+	static size_t _pipeMaximumSize()
+	{
+		static const size_t PipeMaximumSize = []()
+		{
+			size_t pipeMaximumSize = 0;
+			std::ifstream( "/proc/sys/fs/pipe-max-size" ) >> pipeMaximumSize;
+
+			// The default of the kernel, should procfs not be mounted
+			return ( 0 == pipeMaximumSize ) ? size_t( 1024 * 1024 ) : pipeMaximumSize;
+		}();
+
+		return PipeMaximumSize;
+	}
+
+	// Reap the orphans of an execution that have exited, once every stage
+	// has; the stages are reaped by their own ChildProcess. A group without
+	// any child left in it is dropped, so that it is neither waited on nor
+	// signalled again once its ID may be reused. The mutex of the execution
+	// must be held.
+	static void _reapOrphans(
+		Execution& execution )
+	{
+		if ( 0 != execution.runningStages )
+		{
+			return;
+		}
+
+		if ( not execution.reapOrphans )
+		{
+			execution.processGroups.clear();
+			return;
+		}
+
+		for ( size_t index( execution.processGroups.size() ); index--; )
+		{
+			siginfo_t information;
+			int returnValue;
+
+			do
+			{
+				information.si_pid = 0;
+				returnValue = waitid( P_PGID, static_cast< id_t >( execution.processGroups[ index ] ),
+					&information, WEXITED | WNOHANG );
+			} while ( ( ( 0 == returnValue ) and ( 0 != information.si_pid ) )
+				or ( ( -1 == returnValue ) and ( EINTR == errno ) ) );
+
+			// No child is left in the group; else one is still running
+			if ( -1 == returnValue )
+			{
+				execution.processGroups.erase( execution.processGroups.begin() + index );
+			}
+		}
+	}
+
+	// Signal every process group of an execution.
+	// The mutex of the execution must be held.
+	static void _signalGroups(
+		Execution& execution,
+		int signalNumber )
+	{
+		for ( pid_t processGroup : execution.processGroups )
+		{
+			killpg( processGroup, signalNumber );
+		}
+	}
+
+	// Signal every stage of the most recent execution still running; or
+	// its process groups, which take in whatever the stages started too.
+	// @return Zero is returned on success, else a negative error code.
+	int _signalStages(
+		int signalNumber )
+	{
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( ( nullptr == execution ) or ( LaunchState::Phase::Spawning == mLaunchState.phase() ) )
+		{
+			return 0;
+		}
+
+		std::lock_guard< std::mutex > lock( execution->mutex );
+
+		if ( mProcessGroup )
+		{
+			_signalGroups( *execution, signalNumber );
+			return 0;
+		}
+
+		for ( const auto& stage : execution->stages )
+		{
+			int errorCode = stage->sendSignal( signalNumber );
+
+			if ( ( 0 != errorCode ) and ( -ESRCH != errorCode ) )
+			{
+				return errorCode;
+			}
+		}
+
+		return 0;
+	}
+
+	// Record the exit of a stage. Should it have failed, and be the first
+	// to, then every stage still running is torn down immediately; whether
+	// it is upstream or downstream of the failure. A stage killed by SIGPIPE
+	// has not failed; its consumer stopped reading, as head(1) does.
+	static void _stageExited(
+		const std::shared_ptr< Execution >& execution,
+		size_t stageIndex,
+		const ChildProcess& exitedProcess )
+	{
+		bool brokenPipe = ( SIGPIPE == exitedProcess.terminatingSignal() );
+		std::unique_lock< std::mutex > lock( execution->mutex );
+		StageResult& result = execution->results[ stageIndex ];
+
+		result.exitStatus = exitedProcess.exitStatus();
+		result.resourceUsage = exitedProcess.resourceUsage();
+
+		if ( ( 0 != result.exitStatus ) and ( not brokenPipe ) and ( not execution->failed ) )
+		{
+			execution->failed = true;
+			execution->exitStatus = result.exitStatus;
+			execution->terminatingSignal = exitedProcess.terminatingSignal();
+			_tearDown( *execution, stageIndex );
+		}
+
+		--execution->runningStages;
+		_reapOrphans( *execution );
+		_countDown( *execution, lock );
+	}
+
+	// Launch the stages through the Spawning state, from Idle or Exited; so that
+	// of threads launching at once only one does. A terminate requested by
+	// another thread during the launch is delivered once the stages are started.
+	int _start()
+	{
+		std::shared_ptr< Execution > execution = _execution();
+		uint32_t launch;
+
+		// The stages are reaped by the ChildReaper, whether the pipeline is waited on or not
+		if ( ( LaunchState::Phase::Running == mLaunchState.phase( launch ) ) and _isComplete( execution ) )
+		{
+			mLaunchState.markExited( launch );
+		}
+
+		if ( nullptr != execution )
+		{
+			std::lock_guard< std::mutex > lock( execution->mutex );
+			_reapOrphans( *execution );
+		}
+
+		if ( not mLaunchState.beginSpawn() )
+		{
+			return -ECANCELED;
+		}
+
+		std::shared_ptr< Execution > failedExecution;
+		int errorCode = _launch( failedExecution );
+		LaunchState::Phase phase = ( 0 == errorCode ) ? LaunchState::Phase::Running
+			: ( ( ( nullptr == execution ) and ( nullptr == failedExecution ) ) ? LaunchState::Phase::Idle : LaunchState::Phase::Exited );
+
+		if ( mLaunchState.endSpawn( phase ) )
+		{
+			_terminateStages();
+		}
+
+		if ( nullptr != failedExecution )
+		{
+			std::unique_lock< std::mutex > lock( failedExecution->mutex );
+			failedExecution->completed.wait( lock, [ &failedExecution ]() { return 0 == failedExecution->remaining; } );
+			_reapOrphans( *failedExecution );
+		}
+
+		return errorCode;
+	}
+
+	// Record a tee having finished copying the output of a stage. Should any
+	// of that output have been lost, the execution fails as though the stage
+	// had, with the error of the tee; the consumers saw the stream end early.
+	static void _teeFinished(
+		const std::shared_ptr< Execution >& execution,
+		size_t stageIndex,
+		int errorCode )
+	{
+		std::unique_lock< std::mutex > lock( execution->mutex );
+
+		if ( 0 != errorCode )
+		{
+			execution->results[ stageIndex ].outputError = errorCode;
+		}
+
+		if ( ( 0 != errorCode ) and ( not execution->failed ) )
+		{
+			execution->failed = true;
+			execution->exitStatus = errorCode;
+			_tearDown( *execution, SIZE_MAX );
+		}
+
+		_countDown( *execution, lock );
+	}
+
+	// Signal every stage other than {@param exceptIndex} that is still running,
+	// by the teardown policy of the execution; a stage outlasting its grace
+	// period is sent SIGKILL by the Watchdog, with the group it leads, if any.
+	// The mutex of the execution must be held.
+	static void _tearDown(
+		Execution& execution,
+		size_t exceptIndex )
+	{
+		const TerminationPolicy& policy = execution.tearDownPolicy;
+
+		if ( execution.processGroups.empty() )
+		{
+			for ( size_t index( -1 ); ++index < execution.stages.size(); )
+			{
+				if ( ( index != exceptIndex ) and ( 0 == Watchdog::terminate( execution.stages[ index ],
+					TerminationPolicy( policy.signalNumber, policy.gracePeriod ) ) ) )
+				{
+					execution.results[ index ].tornDown = true;
+				}
+			}
+
+			return;
+		}
+
+		_signalGroups( execution, policy.signalNumber );
+
+		for ( size_t index( -1 ); ++index < execution.stages.size(); )
+		{
+			const std::shared_ptr< ChildProcess >& stage = execution.stages[ index ];
+
+			execution.results[ index ].tornDown = ( index != exceptIndex ) and ( not stage->hasExited() );
+
+			if ( execution.results[ index ].tornDown and ( 0 < policy.gracePeriod.count() ) and ( SIGKILL != policy.signalNumber ) )
+			{
+				bool leader = ( execution.processGroups.end()
+					!= std::find( execution.processGroups.begin(), execution.processGroups.end(), stage->processID() ) );
+
+				Watchdog::instance().schedule( stage, std::chrono::steady_clock::now() + policy.gracePeriod,
+					TerminationPolicy( SIGKILL, std::chrono::nanoseconds( 0 ), leader ) );
+			}
+		}
+	}
+
+	// Terminate every stage of the most recent execution.
+	// @return Zero is returned on success, else the first error code.
+	int _terminateStages()
+	{
+		int terminateCode;
+		int returnCode = 0;
+
+		if ( mProcessGroup )
+		{
+			return _signalStages( SIGTERM );
+		}
+
+		for ( size_t index( -1 ); ++index < mCommands.size(); )
+		{
+			terminateCode = mCommands[ index ].terminate();
+
+			if ( ( 0 == returnCode ) and ( 0 != terminateCode ) )
+			{
+				returnCode = terminateCode;
+			}
+		}
+
+		for ( size_t index( -1 ); ++index < mFanOut.size(); )
+		{
+			terminateCode = mFanOut[ index ].terminate();
+
+			if ( ( 0 == returnCode ) and ( 0 != terminateCode ) )
+			{
+				returnCode = terminateCode;
+			}
+		}
+
+		return returnCode;
+	}
 
 public:
 	/**
@@ -28,8 +765,11 @@ public:
 	 */
 	CommandPipeline()
 	{
-		mExitStatus = 0;
-		mHasExecuted = false;
+		mPipeBufferSize = 0;
+		mProcessGroup = false;
+		mNewSession = false;
+		mChildSubreaper = false;
+		mTearDownPolicy = TerminationPolicy( SIGTERM, DefaultTearDownGracePeriod );
 	}
 
 	/**
@@ -41,6 +781,12 @@ public:
 	CommandPipeline(
 		const std::vector< Command >& commands )
 	{
+		mPipeBufferSize = 0;
+		mProcessGroup = false;
+		mNewSession = false;
+		mChildSubreaper = false;
+		mTearDownPolicy = TerminationPolicy( SIGTERM, DefaultTearDownGracePeriod );
+
 		// Sanity check
 		for ( size_t index( -1 ); ++index < commands.size(); )
 		{
@@ -124,6 +870,38 @@ public:
 		return *this;
 	}
 
+	/**
+	 * Append consumers of the output of the final stage of the pipeline;
+	 * each is fed a copy of the output. The consumers are stages of the
+	 * pipeline in their own right, numbered after the commands of the
+	 * pipeline in the order they were appended.
+	 * @param commands A vector of Command objects to consume the output of the final stage.
+	 * @return A reference to this CommandPipeline object is returned.
+	 * @throw std::invalid_argument is thrown if any of the elements of {@param commands}
+	 *        does not have a set application to be executed.
+	 */
+	CommandPipeline& appendFanOut(
+		const std::vector< Command >& commands )
+	{
+		// Sanity check
+		for ( size_t index( -1 ); ++index < commands.size(); )
+		{
+			if ( commands[ index ].applicationName().empty() )
+			{
+				throw std::invalid_argument(
+					"Command at index " + std::to_string( index )
+					+ " does not have a set application" );
+			}
+		}
+
+		for ( size_t index( -1 ); ++index < commands.size(); )
+		{
+			mFanOut.push_back( commands[ index ] );
+		}
+
+		return *this;
+	}
+
 	/**
 	 * Return the running status of the pipeline. Zero is returned
 	 * if nothing is running in the pipeline, one is returned if a
@@ -137,9 +915,21 @@ public:
 	{
 		bool running = false;
 		bool fallingEdge = false;
+		LaunchState::Phase phase = mLaunchState.phase();
+
+		if ( LaunchState::Phase::Spawning == phase )
+		{
+			return 1;
+		}
 
-		if ( mHasExecuted )
+		if ( LaunchState::Phase::Idle != phase )
 		{
+			// The fan out follows the final stage
+			for ( size_t index( -1 ); ++index < mFanOut.size(); )
+			{
+				running = running or mFanOut[ index ].isRunning();
+			}
+
 			for ( size_t index( mCommands.size() ); index--; )
 			{
 				if ( mCommands[ index ].isRunning() )
@@ -163,74 +953,290 @@ public:
 
 	/**
 	 * Begin execution of the pipeline.
+	 * Every stage is reaped by the ChildReaper service as soon as it exits,
+	 * and should a stage exit with a non-zero status, then every other stage
+	 * still running is torn down; see setTearDownPolicy().
 	 * @return Zero is returned upon successful initialization of the pipeline.
 	 *         If an error occurs, then the pipeline is broken down, the resources
-	 *         are released and an error code is returned.
+	 *         are released and an error code is returned. -EINVAL is returned
+	 *         if a tap is of a stage without a consumer. The stages already
+	 *         started are torn down, and waited on once the pipeline has left
+	 *         Spawning; wait() then returns the error code as well. A failure
+	 *         that the retry policy retries is relaunched after its backoff,
+	 *         blocking the caller; see setRetryPolicy().
 	 */
 	int execute()
 	{
-		mExitStatus = 0;
-
-		int pipes[ 2 ][ 2 ];
-		int inPipeIndex = 0, outPipeIndex = 1;
-		size_t numberCommands = mCommands.size();
-
-		for ( size_t index( -1 ); ++index < numberCommands; )
-		{
-			int* inPipe =  ( 0 < index ) ? pipes[ inPipeIndex ] : nullptr;
-			int* outPipe = ( index < ( numberCommands - 1 ) ) ? pipes[ outPipeIndex ] : nullptr;
-
-			if ( nullptr != outPipe )
-			{
-				pipe( pipes[ outPipeIndex ] );
-			}
-
-			mCommands[ index ]._forkRedirectToPipeAndExecute( inPipe, outPipe );
-
-			if ( nullptr != inPipe )
-			{
-				close( inPipe[ 0 ] );
-				close( inPipe[ 1 ] );
-			}
-
-			outPipeIndex = ( outPipeIndex + 1 ) & 0x1;
-			inPipeIndex = ( inPipeIndex + 1 ) & 0x1;
-		}
-
-		mHasExecuted = true;
-
-		return 0;
+		unsigned attempt = 0;
+		return _execute( attempt );
 	}
 
 	/**
 	 * Begin execution of the pipeline and wait for
 	 * everything to complete execution.
+	 * An exit status that the retry policy retries relaunches the pipeline
+	 * after its backoff, unless it was ended by terminate(); the launches
+	 * all count towards the attempts of the policy.
 	 * @return A negative error code is returned upon
 	 *         failure to initialize the pipeline, else the exit
 	 *         status of the pipeline is returned.
 	 */
 	int executeAndWait()
 	{
+		unsigned attempt = 0;
 		int exitStatus = 0;
 
-		if ( 0 == ( exitStatus = this->execute() ) )
+		while ( 0 == ( exitStatus = _execute( attempt ) ) )
 		{
 			exitStatus = this->wait();
+
+			if ( ( attempt >= mRetryPolicy.maxAttempts ) or mLaunchState.terminateRequested()
+				or ( not mRetryPolicy.retriesExit( exitStatus, this->terminatingSignal() ) ) )
+			{
+				break;
+			}
 		}
 
 		return exitStatus;
 	}
 
+	/**
+	 * Begin execution of the pipeline without blocking on its completion.
+	 * @return A CommandFuture for the exit status of the pipeline is returned;
+	 *         that of the first stage to fail, else zero. Should the pipeline
+	 *         fail to start, then the future is already completed with the
+	 *         error code returned by execute().
+	 */
+	CommandFuture executeAsync()
+	{
+		CommandFuture commandFuture;
+		int errorCode = this->execute();
+
+		if ( 0 != errorCode )
+		{
+			commandFuture.state()->complete( errorCode );
+			return commandFuture;
+		}
+
+		{
+			std::shared_ptr< Execution > execution = _execution();
+			std::lock_guard< std::mutex > lock( execution->mutex );
+
+			if ( 0 != execution->remaining )
+			{
+				execution->future = commandFuture.state();
+				return commandFuture;
+			}
+
+			errorCode = execution->exitStatus;
+		}
+
+		commandFuture.state()->complete( errorCode );
+
+		return commandFuture;
+	}
+
 	/**
 	 * Return the exit status of the pipeline.
 	 * If the pipeline has yet to execute or the pipeline is
 	 * currently executing, then zero is returned, else the
-	 * exit status of the last process is returned.
+	 * exit status of the first stage to fail is returned;
+	 * zero if every stage succeeded.
 	 * @return The exit status of the pipeline is returned.
 	 */
 	int exitStatus()
 	{
-		return mExitStatus;
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( nullptr == execution )
+		{
+			return 0;
+		}
+
+		std::lock_guard< std::mutex > lock( execution->mutex );
+		return ( 0 == execution->remaining ) ? execution->exitStatus : 0;
+	}
+
+	/**
+	 * Get the outcome of each stage of the most recent execution; the
+	 * commands of the pipeline followed by the consumers of its fan out.
+	 * The results of the stages yet to exit are zeroed.
+	 * @return A vector of the results, indexed by stage, is returned.
+	 */
+	std::vector< StageResult > stageResults() const
+	{
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( nullptr == execution )
+		{
+			return std::vector< StageResult >();
+		}
+
+		std::lock_guard< std::mutex > lock( execution->mutex );
+		return execution->results;
+	}
+
+	/**
+	 * Continue the stages of the pipeline after suspend(), with SIGCONT.
+	 * @return Zero is returned on success, else a negative error code.
+	 */
+	int resume()
+	{
+		return _signalStages( SIGCONT );
+	}
+
+	/**
+	 * Make the pipeline the child subreaper, as PR_SET_CHILD_SUBREAPER
+	 * of prctl(2) does, so that the processes left running by a stage as
+	 * it exits are reparented to it rather than to init; they are then
+	 * terminated along with the pipeline and reaped by it, once every stage
+	 * has exited, through wait() and the next execute(). This is a setting of
+	 * the whole process, left set once made, and only has effect in a process
+	 * group; see setProcessGroup(). A pipeline in a process group reaps its
+	 * orphans whenever the process is the subreaper, however it came to be.
+	 * Orphans that leave the groups of the pipeline are not reaped by it.
+	 * @param childSubreaper If true, reap the orphans of the stages. [default: false]
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& setChildSubreaper(
+		bool childSubreaper )
+	{
+		mChildSubreaper = childSubreaper;
+		return *this;
+	}
+
+	/**
+	 * Set the buffer size of every pipe carrying output between stages.
+	 * A larger buffer lets high throughput stages run further ahead of each
+	 * other before blocking. The size is clamped to /proc/sys/fs/pipe-max-size
+	 * and rounded up by the kernel to a power of two pages.
+	 * @param bufferSize Buffer size in bytes, zero for the kernel default.
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& setPipeBufferSize(
+		size_t bufferSize )
+	{
+		mPipeBufferSize = bufferSize;
+		return *this;
+	}
+
+	/**
+	 * Set the buffer size of the pipes carrying the output of one stage,
+	 * overriding the size set for the whole pipeline.
+	 * @param stageIndex Index of the stage producing the output.
+	 * @param bufferSize Buffer size in bytes, zero for the kernel default.
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& setPipeBufferSize(
+		size_t stageIndex,
+		size_t bufferSize )
+	{
+		mPipeBufferSizes[ stageIndex ] = bufferSize;
+		return *this;
+	}
+
+	/**
+	 * Launch every stage into one new process group, led by the first stage;
+	 * terminate(), suspend() and resume() are then one killpg(2) of the group,
+	 * taking in whatever the stages have started as well. The group replaces
+	 * that of the termination policy of each stage. With {@param newSession},
+	 * each stage instead leads a new session, without a controlling terminal;
+	 * as a process group cannot be joined from another session, each stage is
+	 * then the group of its own session, and these are signalled in turn.
+	 * A stage with exit callbacks of its own may be reaped, and its group
+	 * gone, before a later stage joins; such a pipeline fails to execute.
+	 * @param processGroup If true, launch the stages into a process group. [default: false]
+	 * @param newSession If true, each stage leads a new session. [default: false]
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& setProcessGroup(
+		bool processGroup,
+		bool newSession = false )
+	{
+		mProcessGroup = processGroup;
+		mNewSession = newSession;
+		return *this;
+	}
+
+	/**
+	 * Set when a failed execution of the pipeline is relaunched, as a
+	 * whole: by execute() upon a failure to launch, and by executeAndWait()
+	 * upon the exit of its first stage to fail as well. The retry policies
+	 * of the stages themselves are not applied.
+	 * @param retryPolicy The policy to apply. [default: a single attempt]
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& setRetryPolicy(
+		const RetryPolicy& retryPolicy )
+	{
+		mRetryPolicy = retryPolicy;
+		return *this;
+	}
+
+	/**
+	 * Set how the stages still running are torn down, once a stage fails or
+	 * the pipeline fails to launch: the signal sent first, and the grace
+	 * period until SIGKILL, which the Watchdog sends; to the stage, and the
+	 * process group it leads. A grace period of zero never escalates, and
+	 * so leaves a stage ignoring the signal to hold the pipeline. The process
+	 * group of the policy is not used; see setProcessGroup().
+	 * @param tearDownPolicy The policy to apply. [default: SIGTERM, then
+	 *                       SIGKILL after DefaultTearDownGracePeriod]
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& setTearDownPolicy(
+		const TerminationPolicy& tearDownPolicy )
+	{
+		mTearDownPolicy = tearDownPolicy;
+		return *this;
+	}
+
+	/**
+	 * Stop the stages of the pipeline with SIGSTOP, until resume().
+	 * Stages that have already exited are skipped.
+	 * @return Zero is returned on success, else a negative error code.
+	 */
+	int suspend()
+	{
+		return _signalStages( SIGSTOP );
+	}
+
+	/**
+	 * Tap a copy of the output of a stage off to a callback, called on a
+	 * thread of the pipeline with each chunk. The stage must have a consumer;
+	 * a later stage, or the fan out should it be the final stage.
+	 * @param stageIndex Index of the stage whose output is tapped.
+	 * @param callback The callable to invoke with each chunk of output.
+	 * @return A reference to this CommandPipeline object is returned.
+	 */
+	CommandPipeline& tapToCallback(
+		size_t stageIndex,
+		StreamSink::Callback callback )
+	{
+		mTaps.push_back( Tap{ stageIndex, std::string(), std::move( callback ) } );
+		return *this;
+	}
+
+	/**
+	 * Tap a copy of the output of a stage off to a file, which is truncated
+	 * upon execution. The stage must have a consumer; a later stage, or the
+	 * fan out should it be the final stage.
+	 * @param stageIndex Index of the stage whose output is tapped.
+	 * @param filePath Path of the file to write the copy to.
+	 * @return A reference to this CommandPipeline object is returned.
+	 * @throw std::invalid_argument is thrown if {@param filePath} is empty.
+	 */
+	CommandPipeline& tapToFile(
+		size_t stageIndex,
+		const std::string& filePath )
+	{
+		if ( filePath.empty() )
+		{
+			throw std::invalid_argument( "Tap does not have a file path" );
+		}
+
+		mTaps.push_back( Tap{ stageIndex, filePath, nullptr } );
+		return *this;
 	}
 
 	/**
@@ -239,55 +1245,63 @@ public:
 	 */
 	int terminate()
 	{
-		int terminateCode;
-		int returnCode = 0;
+		LaunchState::Phase phase;
 
-		if ( mHasExecuted )
+		mLaunchState.requestTerminate( phase );
+
+		// An execution in progress is terminated by the executing thread once started
+		if ( ( LaunchState::Phase::Idle == phase ) or ( LaunchState::Phase::Spawning == phase ) )
 		{
-			for ( size_t index( -1 ); ++index < mCommands.size(); )
-			{
-				terminateCode = mCommands[ index ].terminate();
+			return 0;
+		}
 
-				if ( ( 0 == returnCode ) and ( 0 != terminateCode ) )
-				{
-					returnCode = terminateCode;
-				}
-			}
+		return _terminateStages();
+	}
+
+	/**
+	 * Get the signal that killed the first stage of the pipeline to fail.
+	 * @return The signal number is returned, or zero if that stage exited
+	 *         normally, no stage failed or the pipeline is currently executing.
+	 */
+	int terminatingSignal()
+	{
+		std::shared_ptr< Execution > execution = _execution();
+
+		if ( nullptr == execution )
+		{
+			return 0;
 		}
 
-		return returnCode;
+		std::lock_guard< std::mutex > lock( execution->mutex );
+		return ( 0 == execution->remaining ) ? execution->terminatingSignal : 0;
 	}
 
 	/**
 	 * Wait for the pipeline to complete execution.
-	 * The strategy executed is to wait on each process individually
-	 * from the beginning of the pipeline toward the end until each
-	 * process has completed. If the pipeline is found to be broken,
-	 * then all remaining commands are terminated.
-	 * @return The exit code of the last process is returned.
+	 * Every stage is waited on at once; should any stage fail, then the
+	 * stages still running are terminated rather than waited out.
+	 * @return The exit status of the first stage to fail is returned,
+	 *         or zero if every stage succeeded. Should a tee lose output
+	 *         first, its negative error code is returned instead.
 	 */
 	int wait()
 	{
-		int waitCode = 0;
-		bool terminatePipeline = false;
+		uint32_t launch;
+
+		mLaunchState.awaitSpawn( launch );
+
+		std::shared_ptr< Execution > execution = _execution();
 
-		if ( mHasExecuted )
+		if ( nullptr == execution )
 		{
-			for ( size_t index( -1 ); ++index < mCommands.size(); )
-			{
-				if ( terminatePipeline )
-				{
-					mCommands[ index ].terminate();
-				}
-				else	
-				{
-					waitCode = mCommands[ index ].wait();
-					terminatePipeline = ( 0 != waitCode );
-					mExitStatus = waitCode;
-				}
-			}
+			return 0;
 		}
 
-		return waitCode;
+		std::unique_lock< std::mutex > lock( execution->mutex );
+		execution->completed.wait( lock, [ &execution ]() { return 0 == execution->remaining; } );
+		_reapOrphans( *execution );
+		mLaunchState.markExited( launch );
+
+		return execution->exitStatus;
 	}
 };
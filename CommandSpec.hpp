@@ -0,0 +1,347 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ArgumentArena.hpp"
+#include "ChildProcess.hpp"
+#include "EnvironmentBlock.hpp"
+#include "FileDescriptorPlan.hpp"
+#include "OutputReader.hpp"
+#include "OutputSink.hpp"
+#include "ProcessAttributes.hpp"
+#include "RetryPolicy.hpp"
+#include "SpawnPlan.hpp"
+#include "TerminationPolicy.hpp"
+
+/**
+ * The launch description of a Command: the application, argv, environment,
+ * redirections and launch options, without any of the state of a run.
+ *
+ * A specification is shared between Commands rather than copied; copying a
+ * Command, or constructing one from spec(), only takes a reference. Once
+ * shared it is never modified: changing a setting of a Command sharing its
+ * specification first gives that Command a copy of its own. A shared
+ * specification always has its envp block and argument vector built, so
+ * every launch from it, from any thread, goes straight to the spawn.
+ *
+ * The copy given to a Command to change only copies the arguments and the
+ * plain settings; the application, the environment with its envp block,
+ * the exit callbacks, the redirections and the process attributes are
+ * shared with the original until one of those is changed as well.
+ *
+ * Specifications are only ever made by a Command; see Command::spec().
+ */
+class CommandSpec
+{
+private:
+	friend class Command;
+
+	template < size_t >
+	friend class CommandTemplate;
+
+	// Where the stdin stream of the child is read from, unless it is a later pipeline stage
+	enum class StdinSource
+	{
+		Inherit,
+		Data,
+		FileDescriptor,
+		File
+	};
+
+	// The settings that allocate when copied: shared by the copies of a
+	// specification, such as the instances of a CommandTemplate, and only
+	// copied once one of them is changed; see _mutableSettings().
+	struct Settings
+	{
+		char* application; // Path to the application to be called
+
+		// User set environment variables
+		std::map< std::string, std::string > environmentVariables;
+
+		// If set, clear the preset environment variables
+		// before setting the user defined variables.
+		bool clearEnvironmentVariables;
+
+		// The envp handed to the child, built from the above on the first
+		// launch after a change and reused by every launch after that.
+		EnvironmentBlock environmentBlock;
+		bool environmentBlockValid;
+
+		// Called upon exit of each launched child; if any are
+		// set, the child is reaped by the ChildReaper service.
+		std::vector< std::function< void( const ChildProcess& ) > > exitCallbacks;
+
+		std::string stdoutLogFilePrefix; // Prefix of the stdout log file
+		std::string stderrLogFilePrefix; // Prefix of the stderr log file
+		std::string stdinFilePath; // Opened for the child
+		FileDescriptorPlan fileDescriptorPlan; // Redirections applied after the standard streams
+		ProcessAttributes processAttributes; // Applied to the child before exec
+		RetryPolicy retryPolicy; // When a failed execution is relaunched
+
+		Settings()
+		{
+			application = nullptr;
+			clearEnvironmentVariables = false;
+			environmentBlockValid = false;
+		}
+
+		Settings(
+			const Settings& other )
+			: environmentVariables( other.environmentVariables ),
+			environmentBlock( other.environmentBlock ),
+			exitCallbacks( other.exitCallbacks ),
+			stdoutLogFilePrefix( other.stdoutLogFilePrefix ),
+			stderrLogFilePrefix( other.stderrLogFilePrefix ),
+			stdinFilePath( other.stdinFilePath ),
+			fileDescriptorPlan( other.fileDescriptorPlan ),
+			processAttributes( other.processAttributes ),
+			retryPolicy( other.retryPolicy )
+		{
+			application = nullptr;
+			clearEnvironmentVariables = other.clearEnvironmentVariables;
+			environmentBlockValid = other.environmentBlockValid;
+
+			if ( ( nullptr != other.application ) and ( nullptr == ( application = strdup( other.application ) ) ) )
+			{
+				throw std::bad_alloc();
+			}
+		}
+
+		Settings& operator=( const Settings& ) = delete;
+
+		~Settings()
+		{
+			if ( nullptr != application )
+			{
+				free( application );
+			}
+		}
+	};
+
+	ArgumentArena mArguments; // Arguments to be passed to the application, [0] is its name
+	char* const* mArgv; // Built from mArguments by _prepare(), nullptr once stale
+
+	// Never changed while shared, as the specification itself; a const
+	// object is never made, so _mutableSettings() may cast the const away.
+	std::shared_ptr< const Settings > mSettings;
+
+	bool mRedirectStdoutToLogFile; // The stdout stream should be redirected to a log file
+	bool mRedirectStderrToLogFile; // The stderr stream should be redirected to a log file
+
+	// Sinks the stdout and stderr streams are read into by the parent, shared
+	// by copies of this specification. These take precedence over the log files.
+	std::shared_ptr< OutputSink > mStdoutSink;
+	std::shared_ptr< OutputSink > mStderrSink;
+
+	// Pull-style readers the stdout and stderr pipes are handed to instead;
+	// at most one of the sink and the reader of a stream is set.
+	std::shared_ptr< OutputReader > mStdoutReader;
+	std::shared_ptr< OutputReader > mStderrReader;
+
+	StdinSource mStdinSource;
+	std::string_view mStdinData; // Fed through a pipe; referenced, not copied
+	int mStdinFileDescriptor; // Duplicated for the child; not owned
+
+	SpawnBackend mSpawnBackend; // Backend used to launch the child process
+	TerminationPolicy mTerminationPolicy; // How terminate() and the timeout end the child
+	std::chrono::nanoseconds mTimeout; // From launch until the child is terminated, zero for none
+
+	CommandSpec()
+	{
+		_initialize();
+	}
+
+	// Copies the arguments, and shares the settings.
+	CommandSpec(
+		const CommandSpec& other )
+		: mArguments( other.mArguments ),
+		mSettings( other.mSettings ),
+		mStdoutSink( other.mStdoutSink ),
+		mStderrSink( other.mStderrSink ),
+		mStdoutReader( other.mStdoutReader ),
+		mStderrReader( other.mStderrReader ),
+		mStdinData( other.mStdinData ),
+		mTerminationPolicy( other.mTerminationPolicy ),
+		mTimeout( other.mTimeout )
+	{
+		// The argument vector refers to the arena it was built from, so it is not copied
+		mArgv = nullptr;
+		mRedirectStdoutToLogFile = other.mRedirectStdoutToLogFile;
+		mRedirectStderrToLogFile = other.mRedirectStderrToLogFile;
+		mStdinSource = other.mStdinSource;
+		mStdinFileDescriptor = other.mStdinFileDescriptor;
+		mSpawnBackend = other.mSpawnBackend;
+	}
+
+	CommandSpec& operator=( const CommandSpec& ) = delete;
+
+	// The specification of a default constructed Command, shared by all of them.
+	static const std::shared_ptr< CommandSpec >& _empty()
+	{
+		static const std::shared_ptr< CommandSpec > Empty = []()
+		{
+			std::shared_ptr< CommandSpec > empty( new CommandSpec() );
+			empty->_prepare();
+			return empty;
+		}();
+
+		return Empty;
+	}
+
+	// Initialize the specification
+	void _initialize()
+	{
+		mArguments.clear();
+		mArguments.append( "", 0 );
+		mArgv = nullptr;
+		mSettings = std::make_shared< Settings >();
+		mRedirectStdoutToLogFile = false;
+		mRedirectStderrToLogFile = false;
+		mStdoutSink.reset();
+		mStderrSink.reset();
+		mStdoutReader.reset();
+		mStderrReader.reset();
+		_resetStdin();
+		mSpawnBackend = SpawnBackend::PosixSpawn;
+		mTerminationPolicy = TerminationPolicy();
+		mTimeout = std::chrono::nanoseconds( 0 );
+	}
+
+	// Get the settings to change, copying them first should they be shared.
+	Settings& _mutableSettings()
+	{
+		if ( 1 != mSettings.use_count() )
+		{
+			mSettings = std::make_shared< Settings >( *mSettings );
+		}
+
+		return const_cast< Settings& >( *mSettings );
+	}
+
+	// Build the envp block and argument vector, if stale, so that the
+	// specification can be launched from without being modified. Only
+	// unshared settings are ever stale, as only _mutableSettings() makes them so.
+	void _prepare()
+	{
+		if ( not mSettings->environmentBlockValid )
+		{
+			Settings& settings = const_cast< Settings& >( *mSettings );
+
+			settings.environmentBlock.build( settings.environmentVariables, settings.clearEnvironmentVariables );
+			settings.environmentBlockValid = true;
+		}
+
+		if ( nullptr == mArgv )
+		{
+			mArgv = mArguments.argv();
+		}
+	}
+
+	// Have the child inherit the stdin stream of the parent.
+	void _resetStdin()
+	{
+		mStdinSource = StdinSource::Inherit;
+		mStdinData = std::string_view();
+		mStdinFileDescriptor = -1;
+
+		if ( not mSettings->stdinFilePath.empty() )
+		{
+			_mutableSettings().stdinFilePath.clear();
+		}
+	}
+
+public:
+	/**
+	 * Get the application to be executed.
+	 * @return The name of, or path to, the application is returned, or nullptr if not set.
+	 */
+	const char* application() const
+	{
+		return mSettings->application;
+	}
+
+	/**
+	 * Get the arguments handed to the application.
+	 * @return A const reference to the arguments is returned; [0] is the name of the application.
+	 */
+	const ArgumentArena& arguments() const
+	{
+		return mArguments;
+	}
+
+	/**
+	 * Get the environment variables set for the application.
+	 * @return A const reference to the map of variable names to values is returned.
+	 */
+	const std::map< std::string, std::string >& environmentVariables() const
+	{
+		return mSettings->environmentVariables;
+	}
+
+	/**
+	 * Get the redirections of the descriptors of the child, beyond the standard streams.
+	 * @return A const reference to the file descriptor plan is returned.
+	 */
+	const FileDescriptorPlan& fileDescriptorPlan() const
+	{
+		return mSettings->fileDescriptorPlan;
+	}
+
+	/**
+	 * Get the attributes applied to the child before the exec of the application.
+	 * @return A const reference to the process attributes is returned.
+	 */
+	const ProcessAttributes& processAttributes() const
+	{
+		return mSettings->processAttributes;
+	}
+
+	/**
+	 * Get when a failed execution is relaunched.
+	 * @return A const reference to the retry policy is returned.
+	 */
+	const RetryPolicy& retryPolicy() const
+	{
+		return mSettings->retryPolicy;
+	}
+
+	/**
+	 * Get the backend the child is launched with.
+	 * @return The spawn backend is returned.
+	 */
+	SpawnBackend spawnBackend() const
+	{
+		return mSpawnBackend;
+	}
+
+	/**
+	 * Get how the child is terminated.
+	 * @return A const reference to the termination policy is returned.
+	 */
+	const TerminationPolicy& terminationPolicy() const
+	{
+		return mTerminationPolicy;
+	}
+
+	/**
+	 * Get the time the child may run for.
+	 * @return The timeout is returned, zero for no limit.
+	 */
+	std::chrono::nanoseconds timeout() const
+	{
+		return mTimeout;
+	}
+};
@@ -0,0 +1,161 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+#include "Command.hpp"
+#include "CommandSpec.hpp"
+
+/**
+ * Marks an argument of a CommandTemplate that is filled in per instance.
+ */
+struct CommandPlaceholder
+{
+};
+
+/**
+ * A Command with placeholder arguments, for the many launches that only
+ * differ in an argument or two; such as the file a command is run on.
+ *
+ * The application, fixed arguments, environment and redirections are
+ * built once, into a CommandSpec with its envp block already prepared,
+ * and the argument index of each placeholder is fixed at construction.
+ * The number of placeholders is part of the type, deduced from the
+ * arguments, so an instantiation with the wrong number of values does
+ * not compile. An instantiation copies the argument arena of the
+ * specification and writes the bytes of each value into its slot; the
+ * environment, its envp block and every other setting that allocates are
+ * shared with the template, and nothing is parsed, resolved or rebuilt.
+ *
+ *     CommandTemplate gzip( Command( "gzip" ), "-c", "--", CommandPlaceholder() );
+ *     Command compress = gzip.instantiate( path );
+ *
+ * Values are strings, or integers which are formatted in decimal.
+ * Sinks of the base Command are shared by every instance, as with copies
+ * of a Command; give each instance its own should they run concurrently.
+ */
+template < size_t SlotCount >
+class CommandTemplate
+{
+private:
+	std::shared_ptr< const CommandSpec > mSpec; // Each slot holds an empty argument
+	std::array< size_t, SlotCount > mSlots; // Argument index of each placeholder, in order
+
+	// Append a fixed argument.
+	template < typename Part >
+	void _appendPart(
+		CommandSpec& spec,
+		size_t&,
+		const Part& part )
+	{
+		std::string_view argument( part );
+		spec.mArguments.append( argument.data(), argument.size() );
+	}
+
+	// Append the slot of a placeholder.
+	void _appendPart(
+		CommandSpec& spec,
+		size_t& slot,
+		const CommandPlaceholder& )
+	{
+		mSlots[ slot++ ] = spec.mArguments.size();
+		spec.mArguments.append( "", 0 );
+	}
+
+	// Write a value into its slot.
+	template < typename Value >
+	static void _fill(
+		CommandSpec& spec,
+		size_t index,
+		const Value& value )
+	{
+		if constexpr ( std::is_integral_v< Value > )
+		{
+			char digits[ 24 ];
+			std::to_chars_result result = std::to_chars( digits, digits + sizeof( digits ), value );
+			spec.mArguments.assign( index, digits, static_cast< size_t >( result.ptr - digits ) );
+		}
+		else
+		{
+			std::string_view argument( value );
+			spec.mArguments.assign( index, argument.data(), argument.size() );
+		}
+	}
+
+public:
+	/**
+	 * Construct the template from a base Command and the arguments appended to it.
+	 * @param base The application, leading arguments, environment, redirections
+	 *             and launch options shared by every instance.
+	 * @param parts The arguments following those of {@param base}; each either a
+	 *              string, or a CommandPlaceholder to be filled in per instance.
+	 */
+	template < typename... Parts >
+	CommandTemplate(
+		const Command& base,
+		const Parts&... parts )
+	{
+		static_assert( SlotCount == ( size_t( 0 ) + ... + size_t( std::is_same_v< Parts, CommandPlaceholder > ) ),
+			"The slot count must match the number of placeholders" );
+
+		Command command( base );
+		CommandSpec& spec = command._mutableSpec();
+		[[maybe_unused]] size_t slot = 0;
+
+		( _appendPart( spec, slot, parts ), ... );
+		mSpec = command.spec();
+	}
+
+	/**
+	 * Make a Command with each placeholder filled in; ready to be executed.
+	 * @param values The value of each placeholder in order, strings or integers.
+	 * @return The Command is returned.
+	 */
+	template < typename... Values >
+	Command instantiate(
+		const Values&... values ) const
+	{
+		static_assert( SlotCount == sizeof...( Values ), "A value is needed for each placeholder" );
+
+		Command command( mSpec );
+		CommandSpec& spec = command._mutableSpec();
+		[[maybe_unused]] size_t slot = 0;
+
+		( _fill( spec, mSlots[ slot++ ], values ), ... );
+		return command;
+	}
+
+	/**
+	 * Get the number of placeholders.
+	 * @return The number of values instantiate() takes is returned.
+	 */
+	static constexpr size_t slotCount()
+	{
+		return SlotCount;
+	}
+
+	/**
+	 * Get the specification instances are made from,
+	 * with an empty argument for each placeholder.
+	 * @return The shared specification is returned.
+	 */
+	const std::shared_ptr< const CommandSpec >& spec() const
+	{
+		return mSpec;
+	}
+};
+
+// Count the placeholders amongst the arguments of the template
+template < typename... Parts >
+CommandTemplate(
+	const Command&,
+	const Parts&... ) -> CommandTemplate< ( size_t( 0 ) + ... + size_t( std::is_same_v< Parts, CommandPlaceholder > ) ) >;
@@ -0,0 +1,150 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <vector>
+
+#include "TraceObserver.hpp"
+#include "TraceStatistics.hpp"
+
+/**
+ * Process wide tracing of the life of each child process: the pre-spawn,
+ * the spawn or its failure, the first output read by the parent and the
+ * exit, each timestamped and handed to every registered TraceObserver.
+ * The built-in TraceStatistics observer is always registered.
+ *
+ * Tracing is compiled in by defining COMMAND_ENABLE_TRACING, which must be
+ * done consistently for every translation unit. Otherwise emit() and now()
+ * are empty and compile down to nothing, and observers are never called.
+ */
+class CommandTrace
+{
+private:
+	using Observers = std::vector< std::shared_ptr< TraceObserver > >;
+
+	std::mutex mMutex; // Serializes the changes to the observers
+	std::shared_ptr< const Observers > mObservers; // Replaced, never modified, so emitting takes no lock
+	TraceStatistics mStatistics;
+
+	CommandTrace()
+	{
+		mObservers = std::make_shared< const Observers >();
+	}
+
+	// Hand a record to every observer.
+	void _dispatch(
+		const TraceObserver::Record& record )
+	{
+		mStatistics.onEvent( record );
+
+		std::shared_ptr< const Observers > observers = std::atomic_load( &mObservers );
+
+		for ( const auto& observer : *observers )
+		{
+			observer->onEvent( record );
+		}
+	}
+
+public:
+#if defined( COMMAND_ENABLE_TRACING )
+	static constexpr bool Enabled = true;
+#else
+	static constexpr bool Enabled = false;
+#endif
+
+	CommandTrace( const CommandTrace& ) = delete;
+	CommandTrace& operator=( const CommandTrace& ) = delete;
+
+	/**
+	 * Register an observer of every event.
+	 * @param observer The observer to register.
+	 */
+	void addObserver(
+		std::shared_ptr< TraceObserver > observer )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		std::shared_ptr< Observers > observers = std::make_shared< Observers >( *mObservers );
+
+		observers->push_back( std::move( observer ) );
+		std::atomic_store( &mObservers, std::shared_ptr< const Observers >( std::move( observers ) ) );
+	}
+
+	/**
+	 * Trace an event, if tracing is enabled.
+	 * @param event The event that occurred.
+	 * @param latency The time since the previous milestone of the child; see TraceObserver::Record.
+	 * @param processID PID of the child, zero before it is launched. [default: 0]
+	 * @param value The errno for ExecFailed, the exit status for Exit. [default: 0]
+	 * @param application The application of the Command for the spawn events. [default: nullptr]
+	 */
+	static void emit(
+		TraceObserver::Event event,
+		std::chrono::nanoseconds latency,
+		pid_t processID = 0,
+		int value = 0,
+		const char* application = nullptr )
+	{
+		if constexpr ( Enabled )
+		{
+			instance()._dispatch( TraceObserver::Record{
+				event, std::chrono::steady_clock::now(), latency, application, processID, value } );
+		}
+	}
+
+	/**
+	 * Get the process wide trace.
+	 * @return A reference to the CommandTrace is returned.
+	 */
+	static CommandTrace& instance()
+	{
+		static CommandTrace Instance;
+		return Instance;
+	}
+
+	/**
+	 * Get the time to measure a latency from, if tracing is enabled.
+	 * @return The current time is returned, or the epoch of the clock if disabled.
+	 */
+	static std::chrono::steady_clock::time_point now()
+	{
+		if constexpr ( Enabled )
+		{
+			return std::chrono::steady_clock::now();
+		}
+
+		return std::chrono::steady_clock::time_point();
+	}
+
+	/**
+	 * Unregister an observer.
+	 * @param observer The observer to unregister.
+	 */
+	void removeObserver(
+		const std::shared_ptr< TraceObserver >& observer )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		std::shared_ptr< Observers > observers = std::make_shared< Observers >( *mObservers );
+
+		observers->erase( std::remove( observers->begin(), observers->end(), observer ), observers->end() );
+		std::atomic_store( &mObservers, std::shared_ptr< const Observers >( std::move( observers ) ) );
+	}
+
+	/**
+	 * Get the built-in statistics; counters and latency histograms of every event.
+	 * They remain zero unless tracing is enabled.
+	 * @return A reference to the statistics is returned.
+	 */
+	TraceStatistics& statistics()
+	{
+		return mStatistics;
+	}
+};
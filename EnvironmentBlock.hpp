@@ -0,0 +1,200 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern char** environ;
+
+/**
+ * A prebuilt, contiguous environment for a child process.
+ *
+ * All of the "NAME=value" strings live in a single arena and the
+ * null terminated envp vector points into it, so the block can be
+ * handed straight to execve() or posix_spawn() as often as needed.
+ *
+ * When no variables are set and the inherited environment is not
+ * cleared, the block stays empty and data() returns nullptr so that
+ * the child inherits the live environment of the caller. Otherwise
+ * the inherited environment is captured at the time build() is called.
+ */
+class EnvironmentBlock
+{
+private:
+	std::vector< char > mArena; // "NAME=value\0" strings, back to back
+	std::vector< char* > mEnvironment; // Null terminated vector into mArena
+	bool mInherit; // Inherit the environment of the caller as is
+
+	// Point the envp vector at the strings in the arena.
+	void _rebuildPointers()
+	{
+		mEnvironment.clear();
+
+		if ( mInherit )
+		{
+			return;
+		}
+
+		for ( size_t offset( 0 ); offset < mArena.size();
+			offset += strlen( mArena.data() + offset ) + 1 )
+		{
+			mEnvironment.push_back( mArena.data() + offset );
+		}
+
+		mEnvironment.push_back( nullptr );
+	}
+
+public:
+	/**
+	 * Default constructor to an environment inherited from the caller.
+	 */
+	EnvironmentBlock()
+	{
+		mInherit = true;
+	}
+
+	/**
+	 * Copy constructor.
+	 * @param other EnvironmentBlock object to copy to this instance.
+	 */
+	EnvironmentBlock(
+		const EnvironmentBlock& other )
+	{
+		*this = other;
+	}
+
+	/**
+	 * Move constructor.
+	 * @param other EnvironmentBlock object to move to this instance.
+	 */
+	EnvironmentBlock(
+		EnvironmentBlock&& other )
+	{
+		*this = std::move( other );
+	}
+
+	/**
+	 * Build the block from a set of user variables.
+	 * @param environmentVariables A map of variable names to values.
+	 * @param clearInherited If true, the environment of the caller is not included.
+	 */
+	void build(
+		const std::map< std::string, std::string >& environmentVariables,
+		bool clearInherited )
+	{
+		mArena.clear();
+		mInherit = ( not clearInherited ) and environmentVariables.empty();
+
+		if ( mInherit )
+		{
+			mEnvironment.clear();
+			return;
+		}
+
+		size_t arenaSize = 0;
+		std::vector< const char* > inherited;
+
+		if ( not clearInherited )
+		{
+			for ( char** variable = environ; nullptr != *variable; ++variable )
+			{
+				const char* equalSign = strchr( *variable, '=' );
+				size_t nameLength = ( nullptr == equalSign )
+					? strlen( *variable ) : static_cast< size_t >( equalSign - *variable );
+
+				if ( 0 == environmentVariables.count( std::string( *variable, nameLength ) ) )
+				{
+					inherited.push_back( *variable );
+					arenaSize += strlen( *variable ) + 1;
+				}
+			}
+		}
+
+		for ( const auto& [ variableName, value ] : environmentVariables )
+		{
+			arenaSize += variableName.size() + value.size() + 2;
+		}
+
+		mArena.reserve( arenaSize );
+
+		for ( const char* variable : inherited )
+		{
+			mArena.insert( mArena.end(), variable, variable + strlen( variable ) + 1 );
+		}
+
+		for ( const auto& [ variableName, value ] : environmentVariables )
+		{
+			mArena.insert( mArena.end(), variableName.begin(), variableName.end() );
+			mArena.push_back( '=' );
+			mArena.insert( mArena.end(), value.begin(), value.end() );
+			mArena.push_back( '\0' );
+		}
+
+		_rebuildPointers();
+	}
+
+	/**
+	 * Reset the block back to an environment inherited from the caller.
+	 */
+	void clear()
+	{
+		mArena.clear();
+		mEnvironment.clear();
+		mInherit = true;
+	}
+
+	/**
+	 * Get the envp vector to hand to execve() or posix_spawn().
+	 * @return The null terminated environment vector is returned, or
+	 *         nullptr if the environment of the caller is to be inherited.
+	 */
+	char* const* data() const
+	{
+		return mInherit ? nullptr : mEnvironment.data();
+	}
+
+	/**
+	 * Copy assignment operator.
+	 * @param other EnvironmentBlock object to copy to this instance.
+	 * @return A reference to this EnvironmentBlock object is returned.
+	 */
+	EnvironmentBlock& operator=(
+		const EnvironmentBlock& other )
+	{
+		if ( this != &other )
+		{
+			mArena = other.mArena;
+			mInherit = other.mInherit;
+			_rebuildPointers();
+		}
+
+		return *this;
+	}
+
+	/**
+	 * Move assignment operator.
+	 * @param other EnvironmentBlock object to move to this instance.
+	 * @return A reference to this EnvironmentBlock object is returned.
+	 */
+	EnvironmentBlock& operator=(
+		EnvironmentBlock&& other )
+	{
+		if ( this != &other )
+		{
+			// Moving a vector keeps its storage, so the pointers remain valid
+			mArena = std::move( other.mArena );
+			mEnvironment = std::move( other.mEnvironment );
+			mInherit = std::exchange( other.mInherit, true );
+			other.clear();
+		}
+
+		return *this;
+	}
+};
@@ -0,0 +1,164 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <unordered_map>
+
+/**
+ * A process wide, thread safe cache of application names resolved
+ * against PATH, so that repeated launches of the same application
+ * do not repeat the PATH walk (and its failed execve() per entry).
+ *
+ * Entries are keyed on both the application name and the PATH value
+ * they were resolved against. Each hit is checked against the inode
+ * and modification time recorded at resolution, so a replaced or
+ * removed binary is resolved again. A binary newly installed earlier
+ * in PATH is not noticed; clear() can be used for that case.
+ *
+ * Resolution against a PATH with relative entries (including empty
+ * entries, which denote the current directory) is never cached.
+ */
+class ExecutableCache
+{
+private:
+	struct Entry
+	{
+		std::string path; // Absolute path to the executable
+		dev_t device;
+		ino_t inode;
+		struct timespec modificationTime;
+	};
+
+	std::shared_mutex mMutex;
+	std::unordered_map< std::string, Entry > mEntries;
+
+	ExecutableCache() = default;
+
+	// Check that the file at the entry path is still the one that was resolved
+	static bool _isCurrent(
+		const Entry& entry )
+	{
+		struct stat fileStatus;
+
+		return ( 0 == stat( entry.path.c_str(), &fileStatus ) )
+			and ( fileStatus.st_dev == entry.device )
+			and ( fileStatus.st_ino == entry.inode )
+			and ( fileStatus.st_mtim.tv_sec == entry.modificationTime.tv_sec )
+			and ( fileStatus.st_mtim.tv_nsec == entry.modificationTime.tv_nsec );
+	}
+
+	// Walk PATH the same way execvp() does. False is returned
+	// if the application is not found or PATH is not cacheable.
+	static bool _search(
+		const std::string& application,
+		const std::string& searchPath,
+		Entry& entry )
+	{
+		size_t begin = 0;
+
+		while ( begin <= searchPath.size() )
+		{
+			size_t end = searchPath.find( ':', begin );
+
+			if ( std::string::npos == end )
+			{
+				end = searchPath.size();
+			}
+
+			if ( ( end == begin ) or ( '/' != searchPath[ begin ] ) )
+			{
+				return false;
+			}
+
+			std::string candidate = searchPath.substr( begin, end - begin );
+			struct stat fileStatus;
+
+			candidate.append( "/" ).append( application );
+
+			if ( ( 0 == stat( candidate.c_str(), &fileStatus ) )
+				and S_ISREG( fileStatus.st_mode )
+				and ( 0 == access( candidate.c_str(), X_OK ) ) )
+			{
+				entry.path = std::move( candidate );
+				entry.device = fileStatus.st_dev;
+				entry.inode = fileStatus.st_ino;
+				entry.modificationTime = fileStatus.st_mtim;
+				return true;
+			}
+
+			begin = end + 1;
+		}
+
+		return false;
+	}
+
+public:
+	ExecutableCache( const ExecutableCache& ) = delete;
+	ExecutableCache& operator=( const ExecutableCache& ) = delete;
+
+	/**
+	 * Get the process wide cache.
+	 * @return A reference to the ExecutableCache is returned.
+	 */
+	static ExecutableCache& instance()
+	{
+		static ExecutableCache Instance;
+		return Instance;
+	}
+
+	/**
+	 * Remove all cached resolutions.
+	 */
+	void clear()
+	{
+		std::unique_lock< std::shared_mutex > lock( mMutex );
+		mEntries.clear();
+	}
+
+	/**
+	 * Resolve an application name to the absolute path of the executable.
+	 * @param application Name of the application; must not contain a '/'.
+	 * @param searchPath The value of PATH to resolve against.
+	 * @return The absolute path to the executable is returned. An empty
+	 *         string is returned if the application could not be found, or
+	 *         if {@param searchPath} contains relative entries.
+	 */
+	std::string resolve(
+		const std::string& application,
+		const std::string& searchPath )
+	{
+		std::string key = application;
+		key.append( 1, '\0' ).append( searchPath );
+
+		{
+			std::shared_lock< std::shared_mutex > lock( mMutex );
+			auto hit = mEntries.find( key );
+
+			if ( ( mEntries.end() != hit ) and _isCurrent( hit->second ) )
+			{
+				return hit->second.path;
+			}
+		}
+
+		Entry entry;
+
+		if ( not _search( application, searchPath, entry ) )
+		{
+			std::unique_lock< std::shared_mutex > lock( mMutex );
+			mEntries.erase( key );
+			return std::string();
+		}
+
+		std::unique_lock< std::shared_mutex > lock( mMutex );
+		return ( mEntries[ key ] = std::move( entry ) ).path;
+	}
+};
@@ -0,0 +1,232 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * The file descriptors of a child process beyond its standard streams, as
+ * the redirections of a shell would set them up: 2>&1, 3>file, 4<&5, 5>&-,
+ * and closing every descriptor the child is not handed. They replace
+ * wrapping the application in sh -c, and the extra exec that costs.
+ *
+ * The redirections are applied in order, after the standard streams are
+ * set up by the Command; so 2>&1 sends stderr wherever stdout goes, be it
+ * a log file, a capture pipe or the next stage of a pipeline. A standard
+ * stream the plan replaces before duplicating it is not set up at all.
+ *
+ * Everything is resolved by the parent into the one list of dup2() and
+ * close() actions of the SpawnPlan, files opened and all; the child does
+ * nothing more than it already does for the standard streams.
+ */
+class FileDescriptorPlan
+{
+private:
+	friend class Command;
+	friend class CommandGraph;
+
+	enum class Kind
+	{
+		File, // Opened by the parent for each launch
+		Parent, // A descriptor of the parent, as it is numbered there
+		Duplicate, // Another descriptor of the child, as it is at this point of the plan
+		Close
+	};
+
+	struct Redirect
+	{
+		int fileDescriptor; // Descriptor of the child
+		Kind kind;
+		int sourceFileDescriptor; // For Parent and Duplicate
+		std::string filePath; // For File
+		int openFlags; // For File
+	};
+
+	std::vector< Redirect > mRedirects;
+	bool mCloseOthers; // Close every descriptor from 3 up that is not redirected
+
+	// Determine if a descriptor of the child is set by the plan.
+	bool _redirects(
+		int fileDescriptor ) const
+	{
+		for ( const Redirect& redirect : mRedirects )
+		{
+			if ( fileDescriptor == redirect.fileDescriptor )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Determine if a descriptor of the child is redirected before anything is duplicated
+	// from it; should it be a standard stream, it then need not be set up by the Command.
+	bool _replaces(
+		int fileDescriptor ) const
+	{
+		for ( const Redirect& redirect : mRedirects )
+		{
+			if ( ( Kind::Duplicate == redirect.kind ) and ( fileDescriptor == redirect.sourceFileDescriptor ) )
+			{
+				return false;
+			}
+
+			if ( fileDescriptor == redirect.fileDescriptor )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Check the numbers of a redirect.
+	static void _validate(
+		int fileDescriptor,
+		int sourceFileDescriptor = 0 )
+	{
+		if ( ( 0 > fileDescriptor ) or ( 0 > sourceFileDescriptor ) )
+		{
+			throw std::invalid_argument( "File descriptor is negative" );
+		}
+	}
+
+public:
+	/**
+	 * Default constructor to a plan redirecting nothing.
+	 */
+	FileDescriptorPlan()
+	{
+		mCloseOthers = false;
+	}
+
+	/**
+	 * Append the redirections of another plan to those of this one.
+	 * @param other The plan whose redirections follow; its closing of the
+	 *              other descriptors is taken on as well.
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 */
+	FileDescriptorPlan& append(
+		const FileDescriptorPlan& other )
+	{
+		mRedirects.insert( mRedirects.end(), other.mRedirects.begin(), other.mRedirects.end() );
+		mCloseOthers = mCloseOthers or other.mCloseOthers;
+		return *this;
+	}
+
+	/**
+	 * Close a descriptor in the child; as n>&- does.
+	 * @param fileDescriptor The descriptor of the child to close.
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 * @throw std::invalid_argument is thrown if {@param fileDescriptor} is negative.
+	 */
+	FileDescriptorPlan& close(
+		int fileDescriptor )
+	{
+		_validate( fileDescriptor );
+		mRedirects.push_back( Redirect{ fileDescriptor, Kind::Close, -1, std::string(), 0 } );
+		return *this;
+	}
+
+	/**
+	 * Close every descriptor of the child from 3 up but those redirected by
+	 * this plan; with close_range(2), so that nothing the parent has open,
+	 * without close on exec, leaks into the application.
+	 * @param closeOthers If true, close the descriptors not redirected. [default: true]
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 */
+	FileDescriptorPlan& closeOthers(
+		bool closeOthers = true )
+	{
+		mCloseOthers = closeOthers;
+		return *this;
+	}
+
+	/**
+	 * Make a descriptor of the child a copy of another; as n>&m does.
+	 * @param fileDescriptor The descriptor of the child to redirect.
+	 * @param sourceFileDescriptor The descriptor of the child it is to be a copy of,
+	 *                             as redirected by the plan up to this point.
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 * @throw std::invalid_argument is thrown if either descriptor is negative.
+	 */
+	FileDescriptorPlan& duplicate(
+		int fileDescriptor,
+		int sourceFileDescriptor )
+	{
+		_validate( fileDescriptor, sourceFileDescriptor );
+		mRedirects.push_back( Redirect{ fileDescriptor, Kind::Duplicate, sourceFileDescriptor, std::string(), 0 } );
+		return *this;
+	}
+
+	/**
+	 * Determine if the plan does anything.
+	 * @return True is returned if nothing is redirected or closed.
+	 */
+	bool empty() const
+	{
+		return mRedirects.empty() and ( not mCloseOthers );
+	}
+
+	/**
+	 * Send the stderr stream of the child wherever its stdout stream goes; 2>&1.
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 */
+	FileDescriptorPlan& mergeStderrIntoStdout()
+	{
+		return duplicate( STDERR_FILENO, STDOUT_FILENO );
+	}
+
+	/**
+	 * Redirect a descriptor of the child to a descriptor of the parent; the
+	 * end of a pipe, a socket or a file the caller holds. The descriptor is
+	 * not taken ownership of, and must stay open until the child is launched.
+	 * @param fileDescriptor The descriptor of the child to redirect.
+	 * @param parentFileDescriptor The descriptor of the parent it is to be a copy of.
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 * @throw std::invalid_argument is thrown if either descriptor is negative.
+	 */
+	FileDescriptorPlan& redirectToFileDescriptor(
+		int fileDescriptor,
+		int parentFileDescriptor )
+	{
+		_validate( fileDescriptor, parentFileDescriptor );
+		mRedirects.push_back( Redirect{ fileDescriptor, Kind::Parent, parentFileDescriptor, std::string(), 0 } );
+		return *this;
+	}
+
+	/**
+	 * Redirect a descriptor of the child to a file, opened upon each launch;
+	 * as n>file does by default, or n<file, n>>file and n<>file by the flags.
+	 * On failure to open the file the launch fails with SpawnStage::OpenStream.
+	 * @param fileDescriptor The descriptor of the child to redirect.
+	 * @param filePath Path of the file; created with mode 0644 if need be.
+	 * @param openFlags Flags of open(2). [default: O_WRONLY | O_CREAT | O_TRUNC]
+	 * @return A reference to this FileDescriptorPlan object is returned.
+	 * @throw std::invalid_argument is thrown if {@param fileDescriptor} is negative
+	 *        or {@param filePath} is empty.
+	 */
+	FileDescriptorPlan& redirectToFile(
+		int fileDescriptor,
+		const std::string& filePath,
+		int openFlags = O_WRONLY | O_CREAT | O_TRUNC )
+	{
+		_validate( fileDescriptor );
+
+		if ( filePath.empty() )
+		{
+			throw std::invalid_argument( "Redirect does not have a file path" );
+		}
+
+		mRedirects.push_back( Redirect{ fileDescriptor, Kind::File, -1, filePath, openFlags } );
+		return *this;
+	}
+};
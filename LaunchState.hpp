@@ -0,0 +1,251 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * The lifecycle of a Command or CommandPipeline as one lock free atomic word,
+ * so that it can be launched, waited on, polled and terminated from any thread.
+ *
+ *     Idle -> Spawning -> Running -> Exited -> Spawning -> ...
+ *
+ * Only the one thread to move it into Spawning launches; another launching
+ * at the same time is refused. A terminate requested while Spawning is held
+ * in the word and handed to the launching thread as it leaves Spawning, so
+ * that it is not lost on a child yet to exist. The request also marks the
+ * child as signalled, so that it is only signalled once per launch.
+ *
+ * Each launch is numbered in the word as well, so that an exit observed
+ * by a thread that has fallen behind never marks a later launch Exited.
+ *
+ * A thread waiting out a launch blocks on a condition variable, flagging
+ * the word so that only a launch that is waited on takes the mutex to wake
+ * it; every other transition stays a single compare and swap.
+ */
+class LaunchState
+{
+public:
+	enum class Phase : uint32_t
+	{
+		Idle, // Never launched, or the last launch failed before starting anything
+		Spawning, // A launch is in progress
+		Running, // Launched; may have exited without being observed to yet
+		Exited // Launched and observed to have exited
+	};
+
+private:
+	static constexpr uint32_t PhaseMask = 0x3;
+	static constexpr uint32_t TerminateRequested = 0x4;
+	static constexpr uint32_t Awaited = 0x8; // A thread is blocked in awaitSpawn(); only set while Spawning
+	static constexpr uint32_t LaunchShift = 4; // The launch number is held above the flags, and wraps
+
+	std::atomic< uint32_t > mState;
+	std::mutex mMutex; // Only taken to block on, or wake, a launch in progress
+	std::condition_variable mSpawned; // Notified as a launch that is waited on leaves Spawning
+
+	static Phase _phase(
+		uint32_t state )
+	{
+		return static_cast< Phase >( state & PhaseMask );
+	}
+
+public:
+	/**
+	 * Default constructor to Idle.
+	 */
+	LaunchState()
+	{
+		mState = static_cast< uint32_t >( Phase::Idle );
+	}
+
+	/**
+	 * Copy constructor; a snapshot of the state of other.
+	 * @param other LaunchState object to copy to this instance.
+	 */
+	LaunchState(
+		const LaunchState& other )
+	{
+		mState = other.mState.load() & ~Awaited;
+	}
+
+	/**
+	 * Copy assignment operator; a snapshot of the state of other.
+	 * @param other LaunchState object to copy to this instance.
+	 * @return A reference to this LaunchState object is returned.
+	 */
+	LaunchState& operator=(
+		const LaunchState& other )
+	{
+		mState = other.mState.load() & ~Awaited;
+		return *this;
+	}
+
+	/**
+	 * Wait out a launch in progress by another thread, blocking until it
+	 * leaves Spawning; so that a wait does not miss the child being launched.
+	 * A launch only spans starting its children, not waiting on any of them.
+	 * @param launch Set to the number of the launch, for markExited().
+	 * @return The phase after the launch is returned.
+	 */
+	Phase awaitSpawn(
+		uint32_t& launch )
+	{
+		uint32_t state = mState.load();
+
+		if ( Phase::Spawning == _phase( state ) )
+		{
+			std::unique_lock< std::mutex > lock( mMutex );
+
+			// Flagged with the mutex held, which endSpawn() takes to notify; so the wake up is not missed
+			while ( Phase::Spawning == _phase( state = mState.load() ) )
+			{
+				if ( ( 0 != ( state & Awaited ) ) or mState.compare_exchange_weak( state, state | Awaited ) )
+				{
+					mSpawned.wait( lock );
+				}
+			}
+		}
+
+		launch = state >> LaunchShift;
+		return _phase( state );
+	}
+
+	/**
+	 * Enter Spawning from Idle or Exited as the next launch, dropping any terminate request.
+	 * @return True is returned if the caller is to launch, false if a launch
+	 *         is in progress or the last launch is still Running.
+	 */
+	bool beginSpawn()
+	{
+		uint32_t state = mState.load();
+
+		do
+		{
+			if ( ( Phase::Spawning == _phase( state ) ) or ( Phase::Running == _phase( state ) ) )
+			{
+				return false;
+			}
+		} while ( not mState.compare_exchange_weak( state,
+			( ( ( state >> LaunchShift ) + 1 ) << LaunchShift ) | static_cast< uint32_t >( Phase::Spawning ) ) );
+
+		return true;
+	}
+
+	/**
+	 * Withdraw the terminate request, should signalling the child have failed.
+	 */
+	void clearTerminate()
+	{
+		mState.fetch_and( ~TerminateRequested );
+	}
+
+	/**
+	 * Leave Spawning, for the thread that entered it.
+	 * @param phase Running for a launch, else Idle or Exited for a failed one.
+	 * @return True is returned if a terminate was requested during the launch;
+	 *         the launching thread is then to terminate what it launched.
+	 */
+	bool endSpawn(
+		Phase phase )
+	{
+		uint32_t state = mState.load();
+		uint32_t nextState;
+
+		do
+		{
+			// Only the terminate request and the waiting flag change while Spawning
+			nextState = ( state & ~( PhaseMask | Awaited ) ) | static_cast< uint32_t >( phase );
+		} while ( not mState.compare_exchange_weak( state, nextState ) );
+
+		if ( 0 != ( state & Awaited ) )
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+			mSpawned.notify_all();
+		}
+
+		return ( Phase::Running == phase ) and ( 0 != ( state & TerminateRequested ) );
+	}
+
+	/**
+	 * Move from Running to Exited, once the exit of a launch has been observed.
+	 * Nothing is done in any other phase, nor should a later launch have begun.
+	 * @param launch Number of the launch observed to have exited.
+	 */
+	void markExited(
+		uint32_t launch )
+	{
+		uint32_t state = mState.load();
+
+		do
+		{
+			if ( ( Phase::Running != _phase( state ) ) or ( launch != ( state >> LaunchShift ) ) )
+			{
+				return;
+			}
+		} while ( not mState.compare_exchange_weak( state, ( state & ~PhaseMask ) | static_cast< uint32_t >( Phase::Exited ) ) );
+	}
+
+	/**
+	 * Get the current phase.
+	 * @return The phase is returned.
+	 */
+	Phase phase() const
+	{
+		return _phase( mState.load() );
+	}
+
+	/**
+	 * Get the current phase and launch.
+	 * @param launch Set to the number of the launch, for markExited().
+	 * @return The phase is returned.
+	 */
+	Phase phase(
+		uint32_t& launch ) const
+	{
+		uint32_t state = mState.load();
+
+		launch = state >> LaunchShift;
+		return _phase( state );
+	}
+
+	/**
+	 * Request a terminate of the current launch.
+	 * @param phase Set to the phase the request was made in; should it be
+	 *              Spawning, then the launching thread delivers the terminate.
+	 * @return True is returned for the first request since the launch began,
+	 *         false should the terminate already have been requested.
+	 */
+	bool requestTerminate(
+		Phase& phase )
+	{
+		uint32_t previous = mState.fetch_or( TerminateRequested );
+
+		phase = _phase( previous );
+		return 0 == ( previous & TerminateRequested );
+	}
+
+	/**
+	 * Go back to Idle, dropping any terminate request.
+	 */
+	void reset()
+	{
+		mState = static_cast< uint32_t >( Phase::Idle );
+	}
+
+	/**
+	 * Determine if a terminate was requested since the current launch began;
+	 * or since the last one did, once it has exited or failed.
+	 * @return True is returned if a terminate was requested.
+	 */
+	bool terminateRequested() const
+	{
+		return 0 != ( mState.load() & TerminateRequested );
+	}
+};
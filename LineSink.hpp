@@ -0,0 +1,52 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "BufferPool.hpp"
+#include "LineSplitter.hpp"
+#include "StreamSink.hpp"
+
+/**
+ * A StreamSink splitting the output of a child into records, and fields,
+ * as it arrives; each buffer of the pool is split in place and released,
+ * so the memory used stays flat however much output the child produces.
+ *
+ * The splitter is reset as each child is launched and finished once its
+ * output ends, so that the last record is delivered without a terminator.
+ */
+class LineSink : public StreamSink
+{
+private:
+	LineSplitter mSplitter;
+
+public:
+	/**
+	 * Construct a sink splitting the output with a splitter.
+	 * @param splitter The splitter, with the callback of the records or fields.
+	 * @param pool The pool to take buffers from. If null, then the sink
+	 *             uses a pool of its own. [default: nullptr]
+	 */
+	LineSink(
+		LineSplitter splitter,
+		std::shared_ptr< BufferPool > pool = nullptr )
+		: StreamSink( [ this ]( const char* data, size_t length ) { mSplitter.feed( data, length ); }, std::move( pool ) ),
+		mSplitter( std::move( splitter ) )
+	{
+	}
+
+	void begin() override
+	{
+		mSplitter.reset();
+	}
+
+	void finish() override
+	{
+		mSplitter.finish();
+	}
+};
@@ -0,0 +1,282 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON )
+#include <arm_neon.h>
+#endif
+
+/**
+ * Splits a stream of output, chunk by chunk, into '\n' terminated records,
+ * and optionally each record into fields at a delimiter; the output of a
+ * child parsed as it is read, without first capturing it whole.
+ *
+ * Records are handed to the callback as views into the chunk being fed,
+ * and so are never copied; only a record straddling two chunks is, as it
+ * must outlive the first of them. The views are only valid for the call.
+ *
+ * Records alone are found with memchr(), which the C library vectorizes.
+ * With fields, both the terminator and the delimiter are searched for in
+ * one pass, 32 bytes at a time with AVX2, 16 with SSE2 or NEON, else one
+ * at a time; as selected when compiled, by -mavx2 for one.
+ *
+ * A splitter is a StreamSink::Callback, through std::ref() so that it can be
+ * finished once the output ends; see LineSink, which does so by itself.
+ */
+class LineSplitter
+{
+public:
+	using Callback = std::function< void( std::string_view record ) >;
+	using FieldCallback = std::function< void( const std::vector< std::string_view >& fields ) >;
+
+private:
+	Callback mCallback;
+	FieldCallback mFieldCallback;
+	bool mSplitFields;
+	char mFieldDelimiter;
+	std::string mCarry; // The start of a record straddling two chunks
+	std::vector< std::string_view > mFields; // Fields of the record being split; reused
+
+	// Hand a record, without its terminator, to the callback.
+	void _deliver(
+		const char* begin,
+		const char* end )
+	{
+		if ( not mSplitFields )
+		{
+			mCallback( std::string_view( begin, end - begin ) );
+			return;
+		}
+
+		mFields.clear();
+
+		for ( const char* fieldEnd; end != ( fieldEnd = _scan( begin, end ) ); begin = fieldEnd + 1 )
+		{
+			mFields.emplace_back( begin, fieldEnd - begin );
+		}
+
+		mFields.emplace_back( begin, end - begin );
+		mFieldCallback( mFields );
+	}
+
+	// Find the first terminator, or the first delimiter if splitting fields.
+	// @return A pointer to it is returned, or {@param end} if there is none.
+	const char* _scan(
+		const char* begin,
+		const char* end ) const
+	{
+		if ( not mSplitFields )
+		{
+			const void* found = memchr( begin, '\n', end - begin );
+			return ( nullptr == found ) ? end : static_cast< const char* >( found );
+		}
+
+#if defined( __AVX2__ )
+		const __m256i terminators = _mm256_set1_epi8( '\n' );
+		const __m256i delimiters = _mm256_set1_epi8( mFieldDelimiter );
+
+		for ( ; 32 <= end - begin; begin += 32 )
+		{
+			__m256i block = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( begin ) );
+			uint32_t mask = static_cast< uint32_t >( _mm256_movemask_epi8(
+				_mm256_or_si256( _mm256_cmpeq_epi8( block, terminators ), _mm256_cmpeq_epi8( block, delimiters ) ) ) );
+
+			if ( 0 != mask )
+			{
+				return begin + __builtin_ctz( mask );
+			}
+		}
+#endif
+
+#if defined( __SSE2__ )
+		const __m128i terminators16 = _mm_set1_epi8( '\n' );
+		const __m128i delimiters16 = _mm_set1_epi8( mFieldDelimiter );
+
+		for ( ; 16 <= end - begin; begin += 16 )
+		{
+			__m128i block = _mm_loadu_si128( reinterpret_cast< const __m128i* >( begin ) );
+			uint32_t mask = static_cast< uint32_t >( _mm_movemask_epi8(
+				_mm_or_si128( _mm_cmpeq_epi8( block, terminators16 ), _mm_cmpeq_epi8( block, delimiters16 ) ) ) );
+
+			if ( 0 != mask )
+			{
+				return begin + __builtin_ctz( mask );
+			}
+		}
+#elif defined( __ARM_NEON )
+		const uint8x16_t terminators16 = vdupq_n_u8( '\n' );
+		const uint8x16_t delimiters16 = vdupq_n_u8( static_cast< uint8_t >( mFieldDelimiter ) );
+
+		for ( ; 16 <= end - begin; begin += 16 )
+		{
+			uint8x16_t block = vld1q_u8( reinterpret_cast< const uint8_t* >( begin ) );
+			uint8x16_t matches = vorrq_u8( vceqq_u8( block, terminators16 ), vceqq_u8( block, delimiters16 ) );
+
+			// Narrowed to four bits per byte, as NEON has no movemask
+			uint64_t mask = vget_lane_u64( vreinterpret_u64_u8( vshrn_n_u16( vreinterpretq_u16_u8( matches ), 4 ) ), 0 );
+
+			if ( 0 != mask )
+			{
+				return begin + ( __builtin_ctzll( mask ) >> 2 );
+			}
+		}
+#endif
+
+		for ( ; begin != end; ++begin )
+		{
+			if ( ( '\n' == *begin ) or ( mFieldDelimiter == *begin ) )
+			{
+				return begin;
+			}
+		}
+
+		return end;
+	}
+
+public:
+	/**
+	 * Construct a splitter of records.
+	 * @param callback The callable to invoke with each record.
+	 */
+	explicit LineSplitter(
+		Callback callback )
+	{
+		mCallback = std::move( callback );
+		mSplitFields = false;
+		mFieldDelimiter = '\n';
+	}
+
+	/**
+	 * Construct a splitter of records into fields.
+	 * @param fieldDelimiter The character fields are delimited by; such as '\t' or ','.
+	 * @param callback The callable to invoke with the fields of each record.
+	 * @throw std::invalid_argument is thrown if {@param fieldDelimiter} is '\n'.
+	 */
+	LineSplitter(
+		char fieldDelimiter,
+		FieldCallback callback )
+	{
+		if ( '\n' == fieldDelimiter )
+		{
+			throw std::invalid_argument( "Field delimiter is the record terminator" );
+		}
+
+		mFieldCallback = std::move( callback );
+		mSplitFields = true;
+		mFieldDelimiter = fieldDelimiter;
+	}
+
+	/**
+	 * Split a chunk of output; a StreamSink::Callback.
+	 * @param data The chunk.
+	 * @param length Number of bytes in the chunk.
+	 */
+	void operator()(
+		const char* data,
+		size_t length )
+	{
+		feed( data, length );
+	}
+
+	/**
+	 * Split a chunk of output; every record it completes is handed to the
+	 * callback, and what is left of the chunk is kept for the next one.
+	 * @param data The chunk.
+	 * @param length Number of bytes in the chunk.
+	 */
+	void feed(
+		const char* data,
+		size_t length )
+	{
+		const char* end = data + length;
+
+		if ( not mCarry.empty() )
+		{
+			const void* found = memchr( data, '\n', length );
+
+			if ( nullptr == found )
+			{
+				mCarry.append( data, length );
+				return;
+			}
+
+			const char* terminator = static_cast< const char* >( found );
+
+			mCarry.append( data, terminator - data );
+			_deliver( mCarry.data(), mCarry.data() + mCarry.size() );
+			mCarry.clear();
+			data = terminator + 1;
+		}
+
+		// Fields are split as the terminators are found, in the same pass
+		const char* recordBegin = data;
+		const char* fieldBegin = data;
+
+		mFields.clear();
+
+		for ( const char* found; end != ( found = _scan( data, end ) ); data = found + 1 )
+		{
+			if ( '\n' != *found )
+			{
+				mFields.emplace_back( fieldBegin, found - fieldBegin );
+				fieldBegin = found + 1;
+				continue;
+			}
+
+			if ( mSplitFields )
+			{
+				mFields.emplace_back( fieldBegin, found - fieldBegin );
+				mFieldCallback( mFields );
+				mFields.clear();
+			}
+			else
+			{
+				mCallback( std::string_view( recordBegin, found - recordBegin ) );
+			}
+
+			recordBegin = fieldBegin = found + 1;
+		}
+
+		mCarry.assign( recordBegin, end - recordBegin );
+	}
+
+	/**
+	 * Hand the last record to the callback, should the output not have
+	 * ended with a terminator; as CaptureBuffer::lines(), no empty record
+	 * follows a final '\n'. The splitter is then ready for another stream.
+	 */
+	void finish()
+	{
+		if ( not mCarry.empty() )
+		{
+			_deliver( mCarry.data(), mCarry.data() + mCarry.size() );
+		}
+
+		reset();
+	}
+
+	/**
+	 * Drop what is kept of a record yet to be terminated, to start on another stream.
+	 */
+	void reset()
+	{
+		mCarry.clear();
+		mFields.clear();
+	}
+};
@@ -0,0 +1,92 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * A process wide source of unique log file name suffixes.
+ *
+ * A suffix is the local time in seconds, the PID of the process and a
+ * sequence number that is never repeated within it; so no two launches
+ * get the same name, however close together, nor launches by different
+ * processes in the same second. The formatted time is cached for the
+ * second it was formatted in, so the time zone lookups of localtime_r()
+ * and strftime() are paid at most once per second rather than per launch.
+ */
+class LogFileNamer
+{
+private:
+	std::mutex mMutex; // Guards the cached timestamp
+	time_t mCachedSecond; // The second mTimestamp was formatted for
+	char mTimestamp[ 32 ]; // Formatted as %Y%m%d%H%M%S
+	std::atomic< uint64_t > mSequence; // Next sequence number
+
+	LogFileNamer()
+	{
+		mCachedSecond = -1;
+		mTimestamp[ 0 ] = '\0';
+		mSequence = 0;
+	}
+
+public:
+	LogFileNamer( const LogFileNamer& ) = delete;
+	LogFileNamer& operator=( const LogFileNamer& ) = delete;
+
+	/**
+	 * Get the process wide namer.
+	 * @return A reference to the LogFileNamer is returned.
+	 */
+	static LogFileNamer& instance()
+	{
+		static LogFileNamer Instance;
+		return Instance;
+	}
+
+	/**
+	 * Get a unique suffix for a log file name.
+	 * @return "_${timestamp}_${pid}_${sequence}" is returned; see timestamp().
+	 */
+	std::string suffix()
+	{
+		std::string nameSuffix( "_" );
+
+		nameSuffix.append( timestamp() );
+		nameSuffix.push_back( '_' );
+		nameSuffix.append( std::to_string( getpid() ) );
+		nameSuffix.push_back( '_' );
+		nameSuffix.append( std::to_string( mSequence.fetch_add( 1, std::memory_order_relaxed ) ) );
+
+		return nameSuffix;
+	}
+
+	/**
+	 * Get the current local time, formatted for a file name.
+	 * @return The time is returned as YYYYmmddHHMMSS.
+	 */
+	std::string timestamp()
+	{
+		time_t currentTime = time( nullptr );
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( currentTime != mCachedSecond )
+		{
+			struct tm currentTimeStruct;
+
+			localtime_r( &currentTime, &currentTimeStruct );
+			strftime( mTimestamp, sizeof( mTimestamp ), "%Y%m%d%H%M%S", &currentTimeStruct );
+			mCachedSecond = currentTime;
+		}
+
+		return std::string( mTimestamp );
+	}
+};
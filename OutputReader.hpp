@@ -0,0 +1,265 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+
+#include "BufferPool.hpp"
+
+/**
+ * A pull-style reader of the output of a child process.
+ *
+ * The reader is handed to a Command before it is executed and is then
+ * attached to the read end of the output pipe. The consumer reads the
+ * pipe itself, at its own pace, so a slow consumer applies backpressure
+ * simply by not reading; the child blocks once the pipe is full.
+ *
+ * The child must be read to the end before it is waited on, otherwise
+ * a child producing more than a pipe's worth of output never exits.
+ */
+class OutputReader
+{
+public:
+	/**
+	 * A chunk of output held in a buffer of the reader's pool.
+	 * The buffer returns to the pool once the chunk is destroyed.
+	 */
+	class Chunk
+	{
+	private:
+		std::shared_ptr< BufferPool > mPool;
+		char* mData;
+		size_t mSize;
+
+		void _release()
+		{
+			if ( nullptr != mData )
+			{
+				mPool->release( mData );
+				mData = nullptr;
+			}
+
+			mSize = 0;
+		}
+
+	public:
+		friend class OutputReader;
+
+		Chunk()
+		{
+			mData = nullptr;
+			mSize = 0;
+		}
+
+		Chunk( const Chunk& ) = delete;
+		Chunk& operator=( const Chunk& ) = delete;
+
+		Chunk(
+			Chunk&& other )
+		{
+			mPool = std::move( other.mPool );
+			mData = std::exchange( other.mData, nullptr );
+			mSize = std::exchange( other.mSize, 0 );
+		}
+
+		~Chunk()
+		{
+			_release();
+		}
+
+		Chunk& operator=(
+			Chunk&& other )
+		{
+			if ( this != &other )
+			{
+				_release();
+				mPool = std::move( other.mPool );
+				mData = std::exchange( other.mData, nullptr );
+				mSize = std::exchange( other.mSize, 0 );
+			}
+
+			return *this;
+		}
+
+		/**
+		 * Get the bytes of the chunk.
+		 * @return A pointer to the chunk data is returned, null if empty.
+		 */
+		const char* data() const
+		{
+			return mData;
+		}
+
+		/**
+		 * Get the number of bytes in the chunk.
+		 * @return The size of the chunk is returned.
+		 */
+		size_t size() const
+		{
+			return mSize;
+		}
+
+		/**
+		 * Get a view of the chunk, valid while the chunk is held.
+		 * @return A view of the chunk data is returned.
+		 */
+		std::string_view view() const
+		{
+			return std::string_view( mData, mSize );
+		}
+	};
+
+private:
+	std::mutex mMutex;
+	int mFileDescriptor; // Read end of the pipe, -1 if not attached or at its end
+	std::shared_ptr< BufferPool > mPool;
+
+	// Read from the pipe, retrying if interrupted.
+	ssize_t _read(
+		char* buffer,
+		size_t length )
+	{
+		ssize_t bytesRead;
+
+		if ( -1 == mFileDescriptor )
+		{
+			return 0;
+		}
+
+		do
+		{
+			bytesRead = ::read( mFileDescriptor, buffer, length );
+		} while ( ( -1 == bytesRead ) and ( EINTR == errno ) );
+
+		if ( -1 == bytesRead )
+		{
+			return -errno;
+		}
+
+		if ( 0 == bytesRead )
+		{
+			close( mFileDescriptor );
+			mFileDescriptor = -1;
+		}
+
+		return bytesRead;
+	}
+
+public:
+	/**
+	 * Construct a reader not yet attached to a pipe.
+	 * @param pool The pool chunks are read into. If null, then the reader
+	 *             uses a pool of its own. [default: nullptr]
+	 */
+	OutputReader(
+		std::shared_ptr< BufferPool > pool = nullptr )
+	{
+		mFileDescriptor = -1;
+		mPool = ( nullptr == pool ) ? std::make_shared< BufferPool >() : std::move( pool );
+	}
+
+	OutputReader( const OutputReader& ) = delete;
+	OutputReader& operator=( const OutputReader& ) = delete;
+
+	/**
+	 * Destructor to close the pipe.
+	 */
+	~OutputReader()
+	{
+		if ( -1 != mFileDescriptor )
+		{
+			close( mFileDescriptor );
+		}
+	}
+
+	/**
+	 * Check if the reader has reached the end of the output.
+	 * @return True is returned if there is nothing left to read.
+	 */
+	bool atEnd()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return -1 == mFileDescriptor;
+	}
+
+	/**
+	 * Attach the reader to the read end of a pipe, closing any previous one.
+	 * This is called by Command as the child is launched.
+	 * @param fileDescriptor Read end of the pipe, ownership is taken.
+	 */
+	void attach(
+		int fileDescriptor )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( -1 != mFileDescriptor )
+		{
+			close( mFileDescriptor );
+		}
+
+		mFileDescriptor = fileDescriptor;
+	}
+
+	/**
+	 * Read the next chunk of output, blocking until some is available.
+	 * Blocks while every buffer of the pool is held by other chunks.
+	 * @param chunk The chunk to read into; any buffer it holds is reused.
+	 * @return The number of bytes read is returned, zero at the end of the
+	 *         output, else a negative error code is returned.
+	 */
+	ssize_t read(
+		Chunk& chunk )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( -1 == mFileDescriptor )
+		{
+			chunk._release();
+			return 0;
+		}
+
+		if ( mPool != chunk.mPool )
+		{
+			chunk._release();
+			chunk.mPool = mPool;
+		}
+
+		if ( nullptr == chunk.mData )
+		{
+			chunk.mData = mPool->acquire();
+		}
+
+		ssize_t bytesRead = _read( chunk.mData, mPool->bufferSize() );
+		chunk.mSize = ( 0 < bytesRead ) ? static_cast< size_t >( bytesRead ) : 0;
+
+		if ( 0 == chunk.mSize )
+		{
+			chunk._release();
+		}
+
+		return bytesRead;
+	}
+
+	/**
+	 * Read output into a caller supplied buffer, blocking until some is available.
+	 * @param buffer The buffer to read into.
+	 * @param length Size of the buffer in bytes.
+	 * @return The number of bytes read is returned, zero at the end of the
+	 *         output, else a negative error code is returned.
+	 */
+	ssize_t read(
+		char* buffer,
+		size_t length )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return _read( buffer, length );
+	}
+};
@@ -0,0 +1,81 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * A destination for the output of a child process read by the parent.
+ *
+ * The reader asks the sink for a writable region with prepare(), reads
+ * from the pipe straight into it, and then hands the number of bytes
+ * read back with commit(); the data is never copied on its way in.
+ *
+ * A sink is driven by only one thread at a time, but not necessarily
+ * always the same thread. The ChildReaper thread, which must not block,
+ * asks with tryPrepare() instead; a sink that may block overrides it, and
+ * notifyWhenReady(), so that the pipe is left unwatched until it can
+ * accept more data, rather than every other child stalling meanwhile.
+ */
+class OutputSink
+{
+public:
+	virtual ~OutputSink() = default;
+
+	/**
+	 * Called as the child is launched, before any output is read.
+	 */
+	virtual void begin()
+	{
+	}
+
+	/**
+	 * Commit bytes read into the region returned by the last call to prepare().
+	 * @param length Number of bytes read into the region.
+	 */
+	virtual void commit(
+		size_t length ) = 0;
+
+	/**
+	 * Called once the end of the output has been reached.
+	 */
+	virtual void finish()
+	{
+	}
+
+	/**
+	 * Have a callable invoked once tryPrepare() may return a region again;
+	 * at once, should it already. It may be invoked on any thread.
+	 * @param ready The callable to invoke, once.
+	 */
+	virtual void notifyWhenReady(
+		std::function< void() > ready )
+	{
+		ready();
+	}
+
+	/**
+	 * Get a writable region for the next read. A sink that cannot accept
+	 * more data may block here; the pipe is left unread in the meantime.
+	 * @param length Set to the size of the region; must be non-zero.
+	 * @return A pointer to the region is returned.
+	 */
+	virtual char* prepare(
+		size_t& length ) = 0;
+
+	/**
+	 * Get a writable region for the next read, without blocking.
+	 * @param length Set to the size of the region; must be non-zero.
+	 * @return A pointer to the region is returned, else nullptr if the sink
+	 *         cannot accept more data yet; see notifyWhenReady().
+	 */
+	virtual char* tryPrepare(
+		size_t& length )
+	{
+		return prepare( length );
+	}
+};
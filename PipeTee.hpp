@@ -0,0 +1,551 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "StreamSink.hpp"
+
+/**
+ * Copies everything read from one pipe to any number of destinations:
+ * the write ends of other pipes, files, or callbacks.
+ *
+ * Each destination has a staging pipe of its own, at least as large as
+ * the source pipe. Whatever is in the source is tee(2)'d into every
+ * staging pipe and then consumed, and each staging pipe is splice(2)'d
+ * on to its destination; the data never crosses into user space save
+ * for callbacks. A staging pipe is always empty when teed into, which is
+ * what guarantees every destination receives the same bytes; as a tee
+ * always copies from the head of the source, a round is cut to the
+ * shortest copy and the surplus of the others discarded. Should the
+ * kernel be unable to tee or splice, at the start or part way through,
+ * a buffered copy carries on from where the splicing stopped.
+ *
+ * The copying runs in a thread of its own, blocking on the slowest
+ * destination; that destination's pipe fills and backpressure reaches
+ * the producer. Interrupted and partial transfers are carried on with.
+ * A destination that goes away (EPIPE) is dropped, and once every
+ * destination is gone the source is closed. A destination that fails
+ * otherwise is dropped as well, and the source failing stops the copy;
+ * as output is then lost, the error is handed to the finished callback.
+ */
+class PipeTee
+{
+private:
+	static constexpr size_t CopyBufferSize = 64 * 1024;
+
+	struct Destination
+	{
+		int fileDescriptor; // Owned, -1 for a callback or once dropped
+		StreamSink::Callback callback;
+		int staging[ 2 ]; // Staging pipe, -1 when copying
+		bool spliceable; // The staging pipe can be spliced to the file descriptor
+		bool dropped;
+		size_t staged; // Bytes teed into the staging pipe this round
+	};
+
+	int mSource; // Read end of the source pipe, owned
+	std::vector< Destination > mDestinations;
+	int mErrorCode; // The first error by which output was lost, else zero
+	std::function< void( int ) > mFinished;
+	std::thread mThread;
+
+	// Close the file descriptors of a destination and stop writing to it.
+	static void _drop(
+		Destination& destination )
+	{
+		for ( int* fileDescriptor : { &destination.fileDescriptor, &destination.staging[ 0 ], &destination.staging[ 1 ] } )
+		{
+			if ( -1 != *fileDescriptor )
+			{
+				close( *fileDescriptor );
+				*fileDescriptor = -1;
+			}
+		}
+
+		destination.dropped = true;
+	}
+
+	// Read and discard {@param length} bytes from a pipe.
+	// @return False is returned should the bytes not all be read.
+	static bool _discard(
+		int fileDescriptor,
+		size_t length )
+	{
+		char buffer[ 4096 ];
+
+		while ( 0 < length )
+		{
+			ssize_t bytesRead = read( fileDescriptor, buffer, std::min( length, sizeof( buffer ) ) );
+
+			if ( 0 < bytesRead )
+			{
+				length -= static_cast< size_t >( bytesRead );
+			}
+			else if ( ( 0 == bytesRead ) or ( EINTR != errno ) )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Drop a destination upon an error writing to it. Output is lost, and
+	// the error recorded, unless the destination has gone away (EPIPE).
+	void _fail(
+		Destination& destination,
+		int errorCode )
+	{
+		if ( ( -EPIPE != errorCode ) and ( 0 == mErrorCode ) )
+		{
+			mErrorCode = errorCode;
+		}
+
+		_drop( destination );
+	}
+
+	// Move {@param length} bytes from the staging pipe of a destination on to it.
+	// @return Zero is returned on success, else a negative error code.
+	static int _flushStaging(
+		Destination& destination,
+		size_t length )
+	{
+		char buffer[ 4096 ];
+
+		while ( 0 < length )
+		{
+			ssize_t bytesMoved;
+			int errorCode = 0;
+
+			if ( destination.spliceable )
+			{
+				bytesMoved = splice( destination.staging[ 0 ], nullptr, destination.fileDescriptor, nullptr, length, SPLICE_F_MOVE );
+
+				if ( ( -1 == bytesMoved ) and ( EINVAL == errno ) )
+				{
+					// Such as a file opened O_APPEND; copy instead
+					destination.spliceable = false;
+					continue;
+				}
+
+				if ( ( -1 == bytesMoved ) and ( EAGAIN == errno ) )
+				{
+					_awaitWritable( destination.fileDescriptor );
+					continue;
+				}
+			}
+			else
+			{
+				bytesMoved = read( destination.staging[ 0 ], buffer, std::min( length, sizeof( buffer ) ) );
+
+				if ( ( 0 < bytesMoved ) and ( 0 != ( errorCode = _write( destination, buffer, static_cast< size_t >( bytesMoved ) ) ) ) )
+				{
+					return errorCode;
+				}
+			}
+
+			if ( 0 < bytesMoved )
+			{
+				length -= static_cast< size_t >( bytesMoved );
+			}
+			else if ( 0 == bytesMoved )
+			{
+				// The staging pipe holds every byte flushed
+				return -EIO;
+			}
+			else if ( EINTR != errno )
+			{
+				return -errno;
+			}
+		}
+
+		return 0;
+	}
+
+	// Wait for a file descriptor, opened non-blocking, to be writable.
+	static void _awaitWritable(
+		int fileDescriptor )
+	{
+		struct pollfd pollFileDescriptor = { fileDescriptor, POLLOUT, 0 };
+		::poll( &pollFileDescriptor, 1, -1 );
+	}
+
+	// The copying thread
+	void _run()
+	{
+		sigset_t pipeSignal;
+
+		// A destination going away yields EPIPE rather than killing the process
+		sigemptyset( &pipeSignal );
+		sigaddset( &pipeSignal, SIGPIPE );
+		pthread_sigmask( SIG_BLOCK, &pipeSignal, nullptr );
+
+		if ( not _runSpliced() )
+		{
+			_runCopied();
+		}
+
+		close( mSource );
+		mSource = -1;
+
+		for ( Destination& destination : mDestinations )
+		{
+			_drop( destination );
+		}
+
+		// The callback may release the last reference to this tee
+		std::function< void( int ) > finished = std::move( mFinished );
+
+		if ( finished )
+		{
+			finished( mErrorCode );
+		}
+	}
+
+	// Copy through a user space buffer.
+	void _runCopied()
+	{
+		std::vector< char > buffer( CopyBufferSize );
+
+		while ( true )
+		{
+			ssize_t bytesRead = read( mSource, buffer.data(), buffer.size() );
+
+			if ( 0 > bytesRead )
+			{
+				if ( EINTR == errno )
+				{
+					continue;
+				}
+
+				// The rest of the output is lost to every destination
+				if ( 0 == mErrorCode )
+				{
+					mErrorCode = -errno;
+				}
+
+				return;
+			}
+
+			if ( ( 0 == bytesRead ) or ( not _writeAll( buffer.data(), static_cast< size_t >( bytesRead ) ) ) )
+			{
+				return;
+			}
+		}
+	}
+
+	// Copy with tee(2) and splice(2), for as long as the kernel can.
+	// @return False is returned, with nothing of the source consumed but
+	//         what every destination was sent, should the copying have to
+	//         carry on through a user space buffer.
+	bool _runSpliced()
+	{
+		int sourceSize = fcntl( mSource, F_GETPIPE_SZ );
+
+		if ( 0 >= sourceSize )
+		{
+			return false;
+		}
+
+		for ( Destination& destination : mDestinations )
+		{
+			if ( -1 == pipe2( destination.staging, O_CLOEXEC ) )
+			{
+				return false;
+			}
+
+			// Staging must hold everything the source can
+			int stagingSize = fcntl( destination.staging[ 1 ], F_GETPIPE_SZ );
+
+			if ( ( stagingSize < sourceSize ) and ( sourceSize > fcntl( destination.staging[ 1 ], F_SETPIPE_SZ, sourceSize ) ) )
+			{
+				return false;
+			}
+		}
+
+		while ( true )
+		{
+			struct pollfd pollFileDescriptor = { mSource, POLLIN, 0 };
+			int available = 0;
+
+			if ( ( -1 == ::poll( &pollFileDescriptor, 1, -1 ) ) and ( EINTR == errno ) )
+			{
+				continue;
+			}
+
+			if ( ( -1 == ioctl( mSource, FIONREAD, &available ) ) or ( 0 >= available ) )
+			{
+				// Nothing buffered and nothing more coming; else the buffered copy is left to tell
+				return 0 != ( pollFileDescriptor.revents & ( POLLHUP | POLLERR | POLLNVAL ) );
+			}
+
+			size_t length = static_cast< size_t >( available );
+			Destination* last = nullptr;
+
+			// A tee copies from the head of the source, so the round is cut to the shortest copy
+			for ( Destination& destination : mDestinations )
+			{
+				if ( destination.dropped )
+				{
+					continue;
+				}
+
+				if ( nullptr != last )
+				{
+					ssize_t bytesTeed;
+
+					do
+					{
+						bytesTeed = tee( mSource, last->staging[ 1 ], length, 0 );
+					} while ( ( -1 == bytesTeed ) and ( ( EINTR == errno ) or ( EAGAIN == errno ) ) );
+
+					if ( 0 >= bytesTeed )
+					{
+						// Such as EINVAL or ENOSYS, where the kernel cannot tee these pipes;
+						// nothing of this round is consumed, so the staged copies are left unsent
+						return false;
+					}
+
+					last->staged = static_cast< size_t >( bytesTeed );
+					length = std::min( length, last->staged );
+				}
+
+				last = &destination;
+			}
+
+			if ( nullptr == last )
+			{
+				// Every destination has gone away
+				return true;
+			}
+
+			// Consume the round from the source into the last staging pipe
+			last->staged = 0;
+
+			while ( last->staged < length )
+			{
+				ssize_t bytesSpliced = splice( mSource, nullptr, last->staging[ 1 ], nullptr, length - last->staged, SPLICE_F_MOVE );
+
+				if ( 0 < bytesSpliced )
+				{
+					last->staged += static_cast< size_t >( bytesSpliced );
+				}
+				else if ( ( 0 == bytesSpliced ) or ( ( EINTR != errno ) and ( EAGAIN != errno ) ) )
+				{
+					break;
+				}
+			}
+
+			// What was consumed is sent on to every destination, before any buffered copy carries on
+			bool carryOn = ( last->staged == length );
+
+			length = last->staged;
+
+			for ( Destination& destination : mDestinations )
+			{
+				if ( destination.dropped )
+				{
+					continue;
+				}
+
+				int errorCode = _flushStaging( destination, length );
+
+				if ( 0 != errorCode )
+				{
+					_fail( destination, errorCode );
+				}
+				else if ( not _discard( destination.staging[ 0 ], destination.staged - length ) )
+				{
+					// The surplus of the round cannot be cleared for the next
+					carryOn = false;
+				}
+			}
+
+			if ( not carryOn )
+			{
+				return false;
+			}
+		}
+	}
+
+	// Write a whole buffer to a destination.
+	// @return Zero is returned on success, else a negative error code.
+	static int _write(
+		Destination& destination,
+		const char* data,
+		size_t length )
+	{
+		if ( -1 == destination.fileDescriptor )
+		{
+			if ( destination.callback )
+			{
+				destination.callback( data, length );
+			}
+
+			return 0;
+		}
+
+		while ( 0 < length )
+		{
+			ssize_t bytesWritten = write( destination.fileDescriptor, data, length );
+
+			if ( 0 < bytesWritten )
+			{
+				data += bytesWritten;
+				length -= static_cast< size_t >( bytesWritten );
+			}
+			else if ( 0 == bytesWritten )
+			{
+				return -EIO;
+			}
+			else if ( EAGAIN == errno )
+			{
+				_awaitWritable( destination.fileDescriptor );
+			}
+			else if ( EINTR != errno )
+			{
+				return -errno;
+			}
+		}
+
+		return 0;
+	}
+
+	// Write a whole buffer to every destination.
+	// @return False is returned once every destination has gone away.
+	bool _writeAll(
+		const char* data,
+		size_t length )
+	{
+		bool anyLeft = false;
+
+		for ( Destination& destination : mDestinations )
+		{
+			if ( destination.dropped )
+			{
+				continue;
+			}
+
+			int errorCode = _write( destination, data, length );
+
+			if ( 0 == errorCode )
+			{
+				anyLeft = true;
+			}
+			else
+			{
+				_fail( destination, errorCode );
+			}
+		}
+
+		return anyLeft;
+	}
+
+public:
+	/**
+	 * Construct a tee reading from a pipe.
+	 * @param sourceFileDescriptor Read end of the source pipe, ownership is taken.
+	 */
+	explicit PipeTee(
+		int sourceFileDescriptor )
+	{
+		mSource = sourceFileDescriptor;
+		mErrorCode = 0;
+	}
+
+	PipeTee( const PipeTee& ) = delete;
+	PipeTee& operator=( const PipeTee& ) = delete;
+
+	/**
+	 * Destructor to wait for the copying to finish and release the file descriptors.
+	 */
+	~PipeTee()
+	{
+		join();
+
+		if ( -1 != mSource )
+		{
+			close( mSource );
+		}
+
+		for ( Destination& destination : mDestinations )
+		{
+			_drop( destination );
+		}
+	}
+
+	/**
+	 * Add a callback destination, called on the copying thread with each chunk.
+	 * Must be called before start().
+	 * @param callback The callable to invoke with each chunk.
+	 * @return A reference to this PipeTee object is returned.
+	 */
+	PipeTee& addCallback(
+		StreamSink::Callback callback )
+	{
+		mDestinations.push_back( Destination{ -1, std::move( callback ), { -1, -1 }, false, false, 0 } );
+		return *this;
+	}
+
+	/**
+	 * Add a file descriptor destination; the write end of a pipe, a file or a socket.
+	 * Must be called before start().
+	 * @param fileDescriptor The file descriptor to write to, ownership is taken.
+	 * @return A reference to this PipeTee object is returned.
+	 */
+	PipeTee& addFileDescriptor(
+		int fileDescriptor )
+	{
+		mDestinations.push_back( Destination{ fileDescriptor, nullptr, { -1, -1 }, true, false, 0 } );
+		return *this;
+	}
+
+	/**
+	 * Wait for the copying to finish.
+	 */
+	void join()
+	{
+		if ( not mThread.joinable() )
+		{
+			return;
+		}
+
+		// The finished callback may release the last reference to this tee
+		if ( std::this_thread::get_id() == mThread.get_id() )
+		{
+			mThread.detach();
+			return;
+		}
+
+		mThread.join();
+	}
+
+	/**
+	 * Start copying. The file descriptors are closed as the copying finishes.
+	 * @param finished Called on the copying thread once finished; with zero if no output
+	 *                 was lost, else the first error by which a destination failed or
+	 *                 the copy stopped early. A destination gone away (EPIPE) is not one.
+	 *                 [default: nullptr]
+	 */
+	void start(
+		std::function< void( int ) > finished = nullptr )
+	{
+		mFinished = std::move( finished );
+		mThread = std::thread( &PipeTee::_run, this );
+	}
+};
@@ -0,0 +1,253 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Attributes applied to a child process between its creation and the exec
+ * of the application: resource limits, CPU affinity, the nice value, the
+ * I/O priority and the cgroup v2 directory it is placed in. They replace
+ * wrapping the application in prlimit(1), taskset(1), nice(1) or ionice(1),
+ * and the extra exec each of those costs.
+ *
+ * Applying them requires code to run in the child, so a SpawnPlan with
+ * attributes is always launched through clone(2) sharing the memory of the
+ * caller, as vfork(2) does; see SpawnPlan::setProcessAttributes(). Only a
+ * cgroup costs more: clone3(2) creates the child in it, copying the page
+ * tables of the caller as fork(2) does, so in proportion to its size.
+ */
+class ProcessAttributes
+{
+public:
+	// The I/O scheduling classes of ioprio_set(2)
+	enum class IoClass
+	{
+		RealTime = 1,
+		BestEffort = 2,
+		Idle = 3
+	};
+
+private:
+	friend class SpawnPlan;
+
+	static constexpr int IoPriorityClassShift = 13; // IOPRIO_CLASS_SHIFT
+	static constexpr int IoPriorityWhoProcess = 1; // IOPRIO_WHO_PROCESS
+
+	struct ResourceLimit
+	{
+		int resource;
+		struct rlimit limit;
+	};
+
+	std::vector< ResourceLimit > mResourceLimits;
+	cpu_set_t mCpuAffinity;
+	bool mHasCpuAffinity;
+	int mNice;
+	bool mHasNice;
+	int mIoPriority; // Encoded for ioprio_set(2), -1 if not set
+	std::string mCgroupPath; // cgroup v2 directory, empty if not set
+	std::string mCgroupProcsPath; // The cgroup.procs file of the directory
+
+	// Apply the attributes to the calling process; the child, before exec.
+	// Only async-signal-safe calls are made from here.
+	// @param moveToCgroup Write to cgroup.procs, as the child was not created in the cgroup.
+	// @return False is returned, with errno set, should an attribute fail to apply.
+	bool _apply(
+		bool moveToCgroup ) const noexcept
+	{
+		if ( moveToCgroup and ( not mCgroupProcsPath.empty() ) )
+		{
+			int fileDescriptor = open( mCgroupProcsPath.c_str(), O_WRONLY | O_CLOEXEC );
+
+			if ( -1 == fileDescriptor )
+			{
+				return false;
+			}
+
+			// Writing zero moves the writer
+			ssize_t bytesWritten = write( fileDescriptor, "0", 1 );
+			int savedErrno = errno;
+
+			close( fileDescriptor );
+
+			if ( 1 != bytesWritten )
+			{
+				errno = savedErrno;
+				return false;
+			}
+		}
+
+		for ( const ResourceLimit& resourceLimit : mResourceLimits )
+		{
+			if ( 0 != setrlimit( static_cast< decltype( RLIMIT_NOFILE ) >( resourceLimit.resource ), &resourceLimit.limit ) )
+			{
+				return false;
+			}
+		}
+
+		if ( mHasCpuAffinity and ( 0 != sched_setaffinity( 0, sizeof( mCpuAffinity ), &mCpuAffinity ) ) )
+		{
+			return false;
+		}
+
+		if ( mHasNice and ( 0 != setpriority( PRIO_PROCESS, 0, mNice ) ) )
+		{
+			return false;
+		}
+
+#if defined( SYS_ioprio_set )
+		if ( ( -1 != mIoPriority ) and ( 0 != syscall( SYS_ioprio_set, IoPriorityWhoProcess, 0, mIoPriority ) ) )
+		{
+			return false;
+		}
+#endif
+
+		return true;
+	}
+
+public:
+	/**
+	 * Default constructor to no attributes; the child inherits those of the parent.
+	 */
+	ProcessAttributes()
+	{
+		CPU_ZERO( &mCpuAffinity );
+		mHasCpuAffinity = false;
+		mNice = 0;
+		mHasNice = false;
+		mIoPriority = -1;
+	}
+
+	/**
+	 * Get the cgroup v2 directory the child is placed in.
+	 * @return A const reference to the path is returned, empty if not set.
+	 */
+	const std::string& cgroup() const
+	{
+		return mCgroupPath;
+	}
+
+	/**
+	 * Check if no attribute is set.
+	 * @return True is returned if the child inherits every attribute of the parent.
+	 */
+	bool empty() const
+	{
+		return mResourceLimits.empty() and ( not mHasCpuAffinity ) and ( not mHasNice )
+			and ( -1 == mIoPriority ) and mCgroupPath.empty();
+	}
+
+	/**
+	 * Place the child in a cgroup v2 directory; with CLONE_INTO_CGROUP where
+	 * the kernel supports it, else by the child writing to its cgroup.procs.
+	 * @param path Path to the cgroup directory, such as /sys/fs/cgroup/jobs.
+	 *             Empty to leave the child in the cgroup of the parent.
+	 * @return A reference to this ProcessAttributes object is returned.
+	 */
+	ProcessAttributes& setCgroup(
+		const std::string& path )
+	{
+		mCgroupPath = path;
+		mCgroupProcsPath = path.empty() ? std::string() : ( path + "/cgroup.procs" );
+		return *this;
+	}
+
+	/**
+	 * Restrict the child to a set of CPUs, as sched_setaffinity(2) does;
+	 * such as the CPUs of one NUMA node.
+	 * @param cpus The CPU numbers the child may run on. Empty to inherit the affinity of the parent.
+	 * @return A reference to this ProcessAttributes object is returned.
+	 * @throw std::invalid_argument is thrown if a CPU number is out of range.
+	 */
+	ProcessAttributes& setCpuAffinity(
+		const std::vector< int >& cpus )
+	{
+		CPU_ZERO( &mCpuAffinity );
+
+		for ( int cpu : cpus )
+		{
+			if ( ( 0 > cpu ) or ( CPU_SETSIZE <= cpu ) )
+			{
+				throw std::invalid_argument( "CPU " + std::to_string( cpu ) + " is out of range" );
+			}
+
+			CPU_SET( cpu, &mCpuAffinity );
+		}
+
+		mHasCpuAffinity = not cpus.empty();
+		return *this;
+	}
+
+	/**
+	 * Set the I/O scheduling class and priority of the child, as ioprio_set(2) does.
+	 * @param ioClass The I/O scheduling class.
+	 * @param level The priority within the class, from 0 (highest) to 7; ignored for IoClass::Idle.
+	 * @return A reference to this ProcessAttributes object is returned.
+	 * @throw std::invalid_argument is thrown if {@param level} is out of range.
+	 */
+	ProcessAttributes& setIoPriority(
+		IoClass ioClass,
+		int level )
+	{
+		if ( ( 0 > level ) or ( 7 < level ) )
+		{
+			throw std::invalid_argument( "I/O priority level must be within [0, 7]" );
+		}
+
+		mIoPriority = ( static_cast< int >( ioClass ) << IoPriorityClassShift )
+			| ( ( IoClass::Idle == ioClass ) ? 0 : level );
+		return *this;
+	}
+
+	/**
+	 * Set the nice value of the child, as setpriority(2) does.
+	 * Lowering it below that of the parent requires CAP_SYS_NICE.
+	 * @param nice The nice value, from -20 to 19.
+	 * @return A reference to this ProcessAttributes object is returned.
+	 */
+	ProcessAttributes& setNice(
+		int nice )
+	{
+		mNice = nice;
+		mHasNice = true;
+		return *this;
+	}
+
+	/**
+	 * Set a resource limit of the child, as setrlimit(2) does.
+	 * Setting the same resource again replaces its limit.
+	 * @param resource The resource, such as RLIMIT_AS or RLIMIT_NOFILE.
+	 * @param softLimit The soft limit, or RLIM_INFINITY.
+	 * @param hardLimit The hard limit, or RLIM_INFINITY.
+	 * @return A reference to this ProcessAttributes object is returned.
+	 */
+	ProcessAttributes& setResourceLimit(
+		int resource,
+		rlim_t softLimit,
+		rlim_t hardLimit )
+	{
+		for ( ResourceLimit& resourceLimit : mResourceLimits )
+		{
+			if ( resource == resourceLimit.resource )
+			{
+				resourceLimit.limit = { softLimit, hardLimit };
+				return *this;
+			}
+		}
+
+		mResourceLimits.push_back( ResourceLimit{ resource, { softLimit, hardLimit } } );
+		return *this;
+	}
+};
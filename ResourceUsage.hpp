@@ -0,0 +1,75 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <chrono>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+/**
+ * The cost of running a child process; what the kernel accounted to it
+ * through wait4(), along with the wall clock time from its launch until
+ * it was reaped, measured on the monotonic clock.
+ */
+struct ResourceUsage
+{
+private:
+	// Convert a time reported by the kernel.
+	static std::chrono::nanoseconds _toNanoseconds(
+		const struct timeval& time )
+	{
+		return std::chrono::seconds( time.tv_sec ) + std::chrono::microseconds( time.tv_usec );
+	}
+
+public:
+	std::chrono::nanoseconds wallTime; // From launch until reaped
+	std::chrono::nanoseconds userTime; // CPU time spent in user mode
+	std::chrono::nanoseconds systemTime; // CPU time spent in the kernel
+	long maximumResidentSetSize; // Peak resident set size in KiB
+	long majorFaults; // Page faults that required I/O
+	long minorFaults; // Page faults served without I/O
+	long voluntaryContextSwitches; // The child gave up the CPU, such as to block on I/O
+	long involuntaryContextSwitches; // The child was preempted
+
+	/**
+	 * Default constructor to no usage at all.
+	 */
+	ResourceUsage()
+	{
+		wallTime = userTime = systemTime = std::chrono::nanoseconds( 0 );
+		maximumResidentSetSize = 0;
+		majorFaults = minorFaults = 0;
+		voluntaryContextSwitches = involuntaryContextSwitches = 0;
+	}
+
+	/**
+	 * Construct from the usage reported by the kernel.
+	 * @param resourceUsage The resource usage reported by wait4().
+	 * @param elapsed The wall clock time the child ran for.
+	 */
+	ResourceUsage(
+		const struct rusage& resourceUsage,
+		std::chrono::nanoseconds elapsed )
+	{
+		wallTime = elapsed;
+		userTime = _toNanoseconds( resourceUsage.ru_utime );
+		systemTime = _toNanoseconds( resourceUsage.ru_stime );
+		maximumResidentSetSize = resourceUsage.ru_maxrss;
+		majorFaults = resourceUsage.ru_majflt;
+		minorFaults = resourceUsage.ru_minflt;
+		voluntaryContextSwitches = resourceUsage.ru_nvcsw;
+		involuntaryContextSwitches = resourceUsage.ru_nivcsw;
+	}
+
+	/**
+	 * Get the total CPU time of the child.
+	 * @return The sum of the user and system time is returned.
+	 */
+	std::chrono::nanoseconds cpuTime() const
+	{
+		return userTime + systemTime;
+	}
+};
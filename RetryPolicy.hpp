@@ -0,0 +1,150 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+/**
+ * When a failed execution of a Command or CommandPipeline is relaunched:
+ * how many attempts are made, how long to back off between them, and which
+ * failures are transient. A failure to launch is retried by its error code,
+ * EAGAIN on fork or ENOMEM say; an exit by its status or the signal that
+ * killed the child, such as the SIGKILL of the OOM killer.
+ *
+ * The backoff starts at initialBackoff and is multiplied by multiplier after
+ * each attempt, up to maxBackoff; jitter takes a random fraction of up to that
+ * much off of each delay, so that the children of many supervisors failing
+ * together are not relaunched together.
+ */
+struct RetryPolicy
+{
+	unsigned maxAttempts; // Including the first, one to never retry
+	std::chrono::nanoseconds initialBackoff; // Before the second attempt
+	std::chrono::nanoseconds maxBackoff; // Longest delay between attempts
+	double multiplier; // Of the delay after each attempt
+	double jitter; // Fraction of the delay, from zero to one, that may be taken off at random
+	std::vector< int > launchErrors; // Positive errno values of launch failures that are retried
+	std::vector< int > exitStatuses; // Non-zero exit statuses that are retried
+	std::vector< int > signals; // Signals that killed the child that are retried
+
+	// Decides on any other exit, given the exit status and the signal that killed the child, if any
+	std::function< bool( int, int ) > retryExit;
+
+	/**
+	 * Default constructor to a single attempt; nothing is retried.
+	 */
+	RetryPolicy()
+	{
+		maxAttempts = 1;
+		initialBackoff = std::chrono::milliseconds( 10 );
+		maxBackoff = std::chrono::seconds( 1 );
+		multiplier = 2.0;
+		jitter = 0.5;
+		launchErrors = { EAGAIN, ENOMEM };
+	}
+
+	/**
+	 * Construct a policy retrying the failures to launch with EAGAIN or ENOMEM.
+	 * @param maxAttempts The number of attempts, including the first.
+	 * @param initialBackoff The delay before the second attempt.
+	 * @param maxBackoff The longest delay between attempts. [default: 1s]
+	 * @param multiplier Factor the delay grows by after each attempt. [default: 2]
+	 * @param jitter Fraction of each delay that may be taken off at random. [default: 0.5]
+	 */
+	RetryPolicy(
+		unsigned maxAttempts,
+		std::chrono::nanoseconds initialBackoff,
+		std::chrono::nanoseconds maxBackoff = std::chrono::seconds( 1 ),
+		double multiplier = 2.0,
+		double jitter = 0.5 )
+	{
+		this->maxAttempts = maxAttempts;
+		this->initialBackoff = initialBackoff;
+		this->maxBackoff = maxBackoff;
+		this->multiplier = multiplier;
+		this->jitter = jitter;
+		launchErrors = { EAGAIN, ENOMEM };
+	}
+
+	/**
+	 * Get the delay before an attempt.
+	 * @param attempt Number of the attempt about to be made, from 2.
+	 * @return The delay, jitter taken off, is returned.
+	 */
+	std::chrono::nanoseconds backoff(
+		unsigned attempt ) const
+	{
+		thread_local std::minstd_rand generator( std::random_device{}() );
+		double delay = static_cast< double >( initialBackoff.count() );
+
+		for ( unsigned index( 1 ); ++index < attempt; )
+		{
+			delay *= multiplier;
+
+			if ( delay >= static_cast< double >( maxBackoff.count() ) )
+			{
+				break;
+			}
+		}
+
+		delay = std::min( delay, static_cast< double >( maxBackoff.count() ) );
+
+		if ( 0.0 < jitter )
+		{
+			delay -= delay * std::min( jitter, 1.0 ) * std::uniform_real_distribution< double >( 0.0, 1.0 )( generator );
+		}
+
+		return std::chrono::nanoseconds( static_cast< int64_t >( std::max( delay, 0.0 ) ) );
+	}
+
+	/**
+	 * Determine if an exit is retried.
+	 * @param exitStatus The exit status; 128 plus the signal number if killed.
+	 * @param terminatingSignal The signal that killed the child, zero if it exited.
+	 * @return True is returned if the exit is a failure the policy retries.
+	 */
+	bool retriesExit(
+		int exitStatus,
+		int terminatingSignal ) const
+	{
+		if ( 0 == exitStatus )
+		{
+			return false;
+		}
+
+		if ( 0 != terminatingSignal )
+		{
+			if ( signals.end() != std::find( signals.begin(), signals.end(), terminatingSignal ) )
+			{
+				return true;
+			}
+		}
+		else if ( exitStatuses.end() != std::find( exitStatuses.begin(), exitStatuses.end(), exitStatus ) )
+		{
+			return true;
+		}
+
+		return ( nullptr != retryExit ) and retryExit( exitStatus, terminatingSignal );
+	}
+
+	/**
+	 * Determine if a failure to launch is retried.
+	 * @param errorCode The negative error code the launch failed with.
+	 * @return True is returned if the failure is one the policy retries.
+	 */
+	bool retriesLaunch(
+		int errorCode ) const
+	{
+		return ( 0 > errorCode )
+			and ( launchErrors.end() != std::find( launchErrors.begin(), launchErrors.end(), -errorCode ) );
+	}
+};
@@ -0,0 +1,395 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined( COMMAND_ENABLE_COMPRESSION )
+#include <zlib.h>
+#endif
+
+#include "LogFileNamer.hpp"
+
+/**
+ * A log file shared by any number of children, written through one large
+ * buffer and rotated by size or age; in place of a small log file per run.
+ *
+ * Once the active file has reached its maximum size, or maximum age, it
+ * is renamed with a unique suffix from the LogFileNamer inserted before
+ * its extension (jobs.log becomes jobs_${suffix}.log) and a new file is
+ * started. The age is only checked as output is appended, so a quiet log
+ * is rotated by the first output after it has aged.
+ *
+ * Compression writes the files in gzip format through zlib, which must be
+ * compiled in by defining COMMAND_ENABLE_COMPRESSION and linking with -lz.
+ *
+ * A RotatingLog is thread safe; feed it from children through a RotatingLogSink.
+ */
+class RotatingLog
+{
+public:
+	static constexpr size_t DefaultBufferSize = 1024 * 1024;
+
+private:
+	mutable std::mutex mMutex;
+	std::string mPath; // Path of the active file
+	uint64_t mMaximumSize; // Bytes after which the file is rotated, zero for no limit
+	std::chrono::nanoseconds mMaximumAge; // Age after which the file is rotated, zero for no limit
+	bool mCompress; // Write the files in gzip format
+	std::vector< char > mBuffer; // Output not yet written to the file
+	size_t mBuffered; // Bytes held in mBuffer
+	int mFileDescriptor; // The active file, -1 until first written to
+#if defined( COMMAND_ENABLE_COMPRESSION )
+	gzFile mCompressedFile; // The active file when compressing, else nullptr
+#endif
+	uint64_t mFileSize; // Bytes appended to the active file, before compression
+	std::chrono::steady_clock::time_point mOpenTime; // When the active file was opened
+	int mErrorCode; // The first write error, zero if none
+
+	// Close the active file, writing out the buffer first. The mutex must be held.
+	int _close()
+	{
+		int errorCode = _flush();
+
+		if ( -1 == mFileDescriptor )
+		{
+			return errorCode;
+		}
+
+#if defined( COMMAND_ENABLE_COMPRESSION )
+		if ( nullptr != mCompressedFile )
+		{
+			// Closes the file descriptor as well
+			if ( ( Z_OK != gzclose( mCompressedFile ) ) and ( 0 == errorCode ) )
+			{
+				errorCode = -EIO;
+			}
+
+			mCompressedFile = nullptr;
+			mFileDescriptor = -1;
+			return errorCode;
+		}
+#endif
+
+		close( mFileDescriptor );
+		mFileDescriptor = -1;
+		return errorCode;
+	}
+
+	// Write out the buffer. The mutex must be held.
+	int _flush()
+	{
+		int errorCode = 0;
+
+		if ( ( 0 < mBuffered ) and ( -1 != mFileDescriptor ) )
+		{
+			errorCode = _write( mBuffer.data(), mBuffered );
+		}
+
+		mBuffered = 0;
+		return _recordError( errorCode );
+	}
+
+	// Open the active file for appending. The mutex must be held.
+	int _open()
+	{
+		struct stat fileStatus;
+
+		if ( -1 == ( mFileDescriptor = open( mPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666 ) ) )
+		{
+			return _recordError( -errno );
+		}
+
+		// Carry on from where an existing file left off
+		mFileSize = ( 0 == fstat( mFileDescriptor, &fileStatus ) ) ? static_cast< uint64_t >( fileStatus.st_size ) : 0;
+		mOpenTime = std::chrono::steady_clock::now();
+
+#if defined( COMMAND_ENABLE_COMPRESSION )
+		if ( mCompress )
+		{
+			// Appending starts a new gzip member, which gzip reads as one stream
+			if ( nullptr == ( mCompressedFile = gzdopen( mFileDescriptor, "ab" ) ) )
+			{
+				close( mFileDescriptor );
+				mFileDescriptor = -1;
+				return _recordError( -ENOMEM );
+			}
+
+			// The buffer of the log already batches the writes
+			gzbuffer( mCompressedFile, 128 * 1024 );
+		}
+#endif
+
+		return 0;
+	}
+
+	// Keep the first error for errorCode().
+	int _recordError(
+		int errorCode )
+	{
+		if ( ( 0 != errorCode ) and ( 0 == mErrorCode ) )
+		{
+			mErrorCode = errorCode;
+		}
+
+		return errorCode;
+	}
+
+	// Rename the active file out of the way and start a new one. The mutex must be held.
+	int _rotate()
+	{
+		int errorCode = _close();
+
+		if ( 0 != errorCode )
+		{
+			return errorCode;
+		}
+
+		if ( 0 != ::rename( mPath.c_str(), _rotatedPath().c_str() ) )
+		{
+			// Keep appending to the same file rather than lose output
+			_recordError( -errno );
+		}
+
+		return _open();
+	}
+
+	// Get the name the active file is rotated to; the unique suffix
+	// inserted before the extensions of the file name.
+	std::string _rotatedPath() const
+	{
+		size_t nameStart = mPath.rfind( '/' );
+		nameStart = ( std::string::npos == nameStart ) ? 0 : ( nameStart + 1 );
+
+		// A leading dot is part of the name, not an extension
+		size_t extension = mPath.find( '.', nameStart + 1 );
+		std::string suffix = LogFileNamer::instance().suffix();
+
+		if ( std::string::npos == extension )
+		{
+			return mPath + suffix;
+		}
+
+		return mPath.substr( 0, extension ) + suffix + mPath.substr( extension );
+	}
+
+	// Write bytes to the active file. The mutex must be held.
+	int _write(
+		const char* data,
+		size_t length )
+	{
+#if defined( COMMAND_ENABLE_COMPRESSION )
+		if ( nullptr != mCompressedFile )
+		{
+			while ( 0 < length )
+			{
+				unsigned int chunk = static_cast< unsigned int >( std::min< size_t >( length, 1u << 30 ) );
+
+				if ( 0 >= gzwrite( mCompressedFile, data, chunk ) )
+				{
+					return -EIO;
+				}
+
+				data += chunk;
+				length -= chunk;
+			}
+
+			return 0;
+		}
+#endif
+
+		while ( 0 < length )
+		{
+			ssize_t bytesWritten = write( mFileDescriptor, data, length );
+
+			if ( 0 > bytesWritten )
+			{
+				if ( EINTR == errno )
+				{
+					continue;
+				}
+
+				return -errno;
+			}
+
+			data += bytesWritten;
+			length -= static_cast< size_t >( bytesWritten );
+		}
+
+		return 0;
+	}
+
+public:
+	/**
+	 * Construct a log; the file is opened on the first output.
+	 * @param path Path of the active log file.
+	 * @param maximumSize Bytes the file may grow to before it is rotated, zero for no limit. [default: 0]
+	 * @param maximumAge Time the file is written to before it is rotated, zero for no limit. [default: 0]
+	 * @param compress If true, then the files are written in gzip format. [default: false]
+	 * @param bufferSize Size of the buffer output is gathered in. [default: DefaultBufferSize]
+	 * @throw std::invalid_argument is thrown if {@param path} is empty.
+	 * @throw std::runtime_error is thrown if {@param compress} is true
+	 *        without COMMAND_ENABLE_COMPRESSION defined.
+	 */
+	RotatingLog(
+		const std::string& path,
+		uint64_t maximumSize = 0,
+		std::chrono::nanoseconds maximumAge = std::chrono::nanoseconds( 0 ),
+		bool compress = false,
+		size_t bufferSize = DefaultBufferSize )
+	{
+		if ( path.empty() )
+		{
+			throw std::invalid_argument( "Log does not have a file path" );
+		}
+
+#if !defined( COMMAND_ENABLE_COMPRESSION )
+		if ( compress )
+		{
+			throw std::runtime_error( "Log compression requires COMMAND_ENABLE_COMPRESSION" );
+		}
+#endif
+
+		mPath = path;
+		mMaximumSize = maximumSize;
+		mMaximumAge = maximumAge;
+		mCompress = compress;
+		mBuffer.resize( ( 0 == bufferSize ) ? DefaultBufferSize : bufferSize );
+		mBuffered = 0;
+		mFileDescriptor = -1;
+#if defined( COMMAND_ENABLE_COMPRESSION )
+		mCompressedFile = nullptr;
+#endif
+		mFileSize = 0;
+		mErrorCode = 0;
+	}
+
+	RotatingLog( const RotatingLog& ) = delete;
+	RotatingLog& operator=( const RotatingLog& ) = delete;
+
+	/**
+	 * Destructor to write out the buffer and close the file.
+	 */
+	~RotatingLog()
+	{
+		_close();
+	}
+
+	/**
+	 * Append output to the log. A chunk is never split across files;
+	 * the file is rotated before the chunk should it not fit.
+	 * @param data The output to append.
+	 * @param length Number of bytes to append.
+	 * @return Zero is returned on success, else a negative error code is returned.
+	 */
+	int append(
+		const char* data,
+		size_t length )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		int errorCode;
+
+		if ( ( -1 == mFileDescriptor ) and ( 0 != ( errorCode = _open() ) ) )
+		{
+			return errorCode;
+		}
+
+		if ( ( 0 < mFileSize )
+			and ( ( ( 0 != mMaximumSize ) and ( mMaximumSize < mFileSize + length ) )
+				or ( ( 0 < mMaximumAge.count() ) and ( mMaximumAge <= std::chrono::steady_clock::now() - mOpenTime ) ) )
+			and ( 0 != ( errorCode = _rotate() ) ) )
+		{
+			return errorCode;
+		}
+
+		mFileSize += length;
+
+		if ( mBuffer.size() - mBuffered < length )
+		{
+			if ( 0 != ( errorCode = _flush() ) )
+			{
+				return errorCode;
+			}
+
+			// Too large to be worth gathering
+			if ( mBuffer.size() <= length )
+			{
+				return _recordError( _write( data, length ) );
+			}
+		}
+
+		memcpy( mBuffer.data() + mBuffered, data, length );
+		mBuffered += length;
+		return 0;
+	}
+
+	/**
+	 * Get the first error met while writing the log, as the sinks feeding
+	 * it have no way to report one.
+	 * @return Zero is returned if every write succeeded, else a negative error code is returned.
+	 */
+	int errorCode() const
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return mErrorCode;
+	}
+
+	/**
+	 * Write out the buffered output.
+	 * @return Zero is returned on success, else a negative error code is returned.
+	 */
+	int flush()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		int errorCode = _flush();
+
+#if defined( COMMAND_ENABLE_COMPRESSION )
+		if ( ( 0 == errorCode ) and ( nullptr != mCompressedFile ) and ( Z_OK != gzflush( mCompressedFile, Z_SYNC_FLUSH ) ) )
+		{
+			errorCode = _recordError( -EIO );
+		}
+#endif
+
+		return errorCode;
+	}
+
+	/**
+	 * Get the path of the active log file.
+	 * @return A const reference to the path is returned.
+	 */
+	const std::string& path() const
+	{
+		return mPath;
+	}
+
+	/**
+	 * Rotate the log now, should anything have been written to it.
+	 * @return Zero is returned on success, else a negative error code is returned.
+	 */
+	int rotate()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( ( -1 == mFileDescriptor ) or ( 0 == mFileSize ) )
+		{
+			return 0;
+		}
+
+		return _rotate();
+	}
+};
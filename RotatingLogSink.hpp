@@ -0,0 +1,114 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "OutputSink.hpp"
+#include "RotatingLog.hpp"
+
+/**
+ * An OutputSink appending the output of a child to a RotatingLog.
+ *
+ * Only whole lines are handed to the log; the end of a line still being
+ * written by the child is held back until it is complete, so the lines of
+ * children sharing one log are never interleaved. A line longer than the
+ * buffer of the sink is handed over in pieces.
+ */
+class RotatingLogSink : public OutputSink
+{
+public:
+	static constexpr size_t BufferSize = 64 * 1024;
+
+private:
+	std::shared_ptr< RotatingLog > mLog;
+	std::vector< char > mBuffer; // Allocated on the first read
+	size_t mPending; // Bytes of an incomplete line at the start of mBuffer
+
+public:
+	/**
+	 * Construct a sink appending to a log.
+	 * @param log The log to append to, shared with any other sink.
+	 */
+	RotatingLogSink(
+		std::shared_ptr< RotatingLog > log )
+	{
+		mLog = std::move( log );
+		mPending = 0;
+	}
+
+	RotatingLogSink( const RotatingLogSink& ) = delete;
+	RotatingLogSink& operator=( const RotatingLogSink& ) = delete;
+
+	void begin() override
+	{
+		mPending = 0;
+	}
+
+	void commit(
+		size_t length ) override
+	{
+		if ( 0 == length )
+		{
+			return;
+		}
+
+		const char* newline = static_cast< const char* >( memrchr( mBuffer.data() + mPending, '\n', length ) );
+		size_t complete;
+
+		mPending += length;
+
+		if ( nullptr != newline )
+		{
+			complete = static_cast< size_t >( newline - mBuffer.data() ) + 1;
+		}
+		else
+		{
+			// Hand a full buffer over regardless, there is no room to wait in
+			complete = ( mBuffer.size() == mPending ) ? mPending : 0;
+		}
+
+		if ( 0 < complete )
+		{
+			mLog->append( mBuffer.data(), complete );
+			memmove( mBuffer.data(), mBuffer.data() + complete, mPending - complete );
+			mPending -= complete;
+		}
+	}
+
+	void finish() override
+	{
+		if ( 0 < mPending )
+		{
+			mLog->append( mBuffer.data(), mPending );
+			mPending = 0;
+		}
+	}
+
+	/**
+	 * Get the log appended to.
+	 * @return A reference to the shared log is returned.
+	 */
+	const std::shared_ptr< RotatingLog >& log() const
+	{
+		return mLog;
+	}
+
+	char* prepare(
+		size_t& length ) override
+	{
+		if ( mBuffer.empty() )
+		{
+			mBuffer.resize( BufferSize );
+		}
+
+		length = mBuffer.size() - mPending;
+		return mBuffer.data() + mPending;
+	}
+};
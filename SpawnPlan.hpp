@@ -0,0 +1,920 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ProcessAttributes.hpp"
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+#ifndef CLONE_PARENT
+#define CLONE_PARENT 0x00008000
+#endif
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+extern char** environ;
+
+/**
+ * The backends available for launching a child process.
+ */
+enum class SpawnBackend
+{
+	PosixSpawn, // posix_spawn(3) driven by a posix_spawn_file_actions_t
+	Clone3,     // clone(2) with CLONE_VM | CLONE_VFORK | CLONE_PIDFD, or clone3(2) into a cgroup; Linux only
+	SpawnServer // Handed to the SpawnServer helper process if it is running, else PosixSpawn
+};
+
+/**
+ * The stages of launching a child process, as reported upon failure.
+ */
+enum class SpawnStage
+{
+	None,       // The launch has not failed
+	OpenStream, // Opening a file or pipe for a standard stream, in the parent
+	Launch,     // Creating the child; posix_spawn(3) reports every failure as this
+	Attributes, // Applying the session, process group or ProcessAttributes, in the child
+	FileAction, // A dup2() in the child
+	Exec        // Executing the application
+};
+
+/**
+ * A launch plan for a single child process.
+ *
+ * Everything the child requires (the application path, argv, envp and
+ * the list of file descriptor actions) is prepared by the parent, so that
+ * the child only ever performs dup2(), close(), close_range() and exec.
+ * Nothing in the child allocates or touches the parent's heap.
+ *
+ * The clone and vfork paths hand a failure in the child back through a
+ * close on exec error pipe; the parent reads nothing if the exec succeeds,
+ * else the stage that failed and its errno. spawn() therefore fails with
+ * the errno of a missing binary, just as posix_spawn(3) does, rather than
+ * the child exiting with a status indistinguishable from the application's.
+ *
+ * The plan does not take ownership of the application, argument or
+ * environment arrays; they must outlive the call to spawn().
+ */
+class SpawnPlan
+{
+private:
+	friend class SpawnServer;
+
+	// A file descriptor action to be applied in the child, in order.
+	// A negative target file descriptor denotes a close() of fileDescriptor.
+	struct FileAction
+	{
+		int fileDescriptor;
+		int targetFileDescriptor;
+	};
+
+#if defined( __GLIBC__ ) and ( ( 2 < __GLIBC__ ) or ( ( 2 == __GLIBC__ ) and ( 34 <= __GLIBC_MINOR__ ) ) )
+	static constexpr bool PosixCloseFrom = true; // posix_spawn_file_actions_addclosefrom_np() is provided
+#else
+	static constexpr bool PosixCloseFrom = false;
+#endif
+
+	static constexpr size_t ChildStackSize = 32 * 1024; // Of a child sharing our memory, before its arguments
+
+#if defined( __has_feature )
+#if __has_feature( address_sanitizer ) or __has_feature( thread_sanitizer )
+#define SPAWN_PLAN_SANITIZED
+#endif
+#endif
+
+#if defined( __SANITIZE_ADDRESS__ ) or defined( __SANITIZE_THREAD__ ) or defined( SPAWN_PLAN_SANITIZED )
+	// The sanitizers keep state of the thread a child sharing our memory would corrupt, and so fork vfork(2) too
+	static constexpr bool ShareMemory = false;
+#else
+	static constexpr bool ShareMemory = true; // Children of the clone path share our memory
+#endif
+#undef SPAWN_PLAN_SANITIZED
+
+	// Layout of the clone3(2) argument structure
+	struct CloneArguments
+	{
+		uint64_t flags;
+		uint64_t pidFileDescriptor;
+		uint64_t childThreadID;
+		uint64_t parentThreadID;
+		uint64_t exitSignal;
+		uint64_t stack;
+		uint64_t stackSize;
+		uint64_t threadLocalStorage;
+		uint64_t setThreadID;
+		uint64_t setThreadIDSize;
+		uint64_t cgroup;
+	};
+
+	const char* mApplication; // Path or name of the application
+	char* const* mArguments; // Null terminated argument vector
+	char* const* mEnvironment; // Null terminated environment vector
+	bool mSearchPath; // Search PATH for the application
+	SpawnBackend mBackend; // Backend used to launch the child
+	bool mSibling; // Launch the child as a child of our parent (CLONE_PARENT)
+	std::vector< FileAction > mFileActions; // Actions applied in the child
+	int mErrorPipe; // Write end of the error pipe while launching, else -1
+	const ProcessAttributes* mAttributes; // Applied in the child, nullptr if none
+	bool mMoveToCgroup; // The child moves itself into the cgroup, not created in it
+	SpawnStage mFailedStage; // Stage at which the last spawn() failed
+	pid_t mProcessGroup; // Process group the child joins, zero for a new one it leads, -1 to inherit
+	bool mNewSession; // The child leads a new session, and the process group within it
+	int mCloseFrom; // Descriptors from here up, other than the targets, are closed in the child; -1 for none
+	sigset_t mSignalMask; // Of the caller, restored by a child sharing our memory
+
+	// Add the closes of mCloseFrom to the posix_spawn(3) file actions; each
+	// descriptor between the kept targets, then every one above them.
+	// @return Zero is returned on success, else the positive error code.
+	int _addPosixCloseFrom(
+		posix_spawn_file_actions_t& fileActions ) const
+	{
+		int errorCode = 0;
+		int lowest = mCloseFrom;
+		int kept;
+
+		while ( ( 0 == errorCode ) and ( -1 != ( kept = _nextKept( lowest ) ) ) )
+		{
+			// glibc ignores EBADF from these closes, as descriptors in the gaps are seldom open
+			for ( ; ( 0 == errorCode ) and ( lowest < kept ); ++lowest )
+			{
+				errorCode = posix_spawn_file_actions_addclose( &fileActions, lowest );
+			}
+
+			lowest = kept + 1;
+		}
+#if defined( __GLIBC__ ) and ( ( 2 < __GLIBC__ ) or ( ( 2 == __GLIBC__ ) and ( 34 <= __GLIBC_MINOR__ ) ) )
+		if ( 0 == errorCode )
+		{
+			errorCode = posix_spawn_file_actions_addclosefrom_np( &fileActions, lowest );
+		}
+#endif
+		return errorCode;
+	}
+
+	// The only code that runs in the child for the clone and vfork paths.
+	// Only async-signal-safe calls are made from here.
+	[[noreturn]] void _executeChild() const noexcept
+	{
+		if ( mNewSession )
+		{
+			if ( -1 == setsid() )
+			{
+				_failChild( SpawnStage::Attributes );
+			}
+		}
+		else if ( ( -1 != mProcessGroup ) and ( 0 != setpgid( 0, mProcessGroup ) ) )
+		{
+			_failChild( SpawnStage::Attributes );
+		}
+
+		if ( ( nullptr != mAttributes ) and ( not mAttributes->_apply( mMoveToCgroup ) ) )
+		{
+			_failChild( SpawnStage::Attributes );
+		}
+
+		for ( const FileAction& action : mFileActions )
+		{
+			if ( 0 > action.targetFileDescriptor )
+			{
+				close( action.fileDescriptor );
+			}
+			else if ( action.fileDescriptor == action.targetFileDescriptor )
+			{
+				// dup2() is a no-op here; make sure the descriptor survives exec
+				fcntl( action.fileDescriptor, F_SETFD, 0 );
+			}
+			else if ( -1 == dup2( action.fileDescriptor, action.targetFileDescriptor ) )
+			{
+				_failChild( SpawnStage::FileAction );
+			}
+		}
+
+		if ( -1 != mCloseFrom )
+		{
+			_closeFrom();
+		}
+
+		if ( mSearchPath )
+		{
+			execvpe( mApplication, mArguments, mEnvironment );
+		}
+		else
+		{
+			execve( mApplication, mArguments, mEnvironment );
+		}
+
+		_failChild( SpawnStage::Exec );
+	}
+
+	// Create the child with clone3(2) and CLONE_VFORK, but not CLONE_VM, as it
+	// cannot be given a stack of its own from here; at the cost of copying
+	// our page tables as fork(2) does, so in proportion to our size. Only
+	// clone3(2) creates the child in the cgroup of {@param cgroupFD}, if not -1.
+	// The child runs _executeChild() until it execs or exits.
+	// @return The PID of the child is returned, else -1 with errno set.
+	long _cloneCopyingMemory(
+		int cgroupFD,
+		int& pidFileDescriptor ) const
+	{
+#if defined( SYS_clone3 )
+		CloneArguments cloneArguments = {};
+
+		cloneArguments.flags = CLONE_VFORK | CLONE_PIDFD | ( mSibling ? CLONE_PARENT : 0 )
+			| ( ( -1 != cgroupFD ) ? CLONE_INTO_CGROUP : 0 );
+		cloneArguments.pidFileDescriptor = reinterpret_cast< uintptr_t >( &pidFileDescriptor );
+		// A sibling inherits the exit signal of the caller, it may not be given one
+		cloneArguments.exitSignal = mSibling ? 0 : SIGCHLD;
+		cloneArguments.cgroup = ( -1 != cgroupFD ) ? static_cast< uint64_t >( cgroupFD ) : 0;
+
+		long returnValue = syscall( SYS_clone3, &cloneArguments, sizeof( cloneArguments ) );
+
+		if ( 0 == returnValue )
+		{
+			_executeChild();
+		}
+
+		return returnValue;
+#else
+		(void)cgroupFD;
+		(void)pidFileDescriptor;
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	// Create the child with clone(2) sharing our memory, as vfork(2) does, but
+	// on a stack of its own as posix_spawn(3) does; so that no page table is
+	// copied however large we are, and the child cannot overwrite the frames
+	// we return through. Signals are blocked until the child has reset their
+	// handlers, as a handler run in the child would run on our memory.
+	// @return The PID of the child is returned, else -1 with errno set.
+	long _cloneSharingMemory(
+		int& pidFileDescriptor )
+	{
+		size_t pageSize = static_cast< size_t >( sysconf( _SC_PAGESIZE ) );
+		size_t argumentCount = 0;
+
+		while ( nullptr != mArguments[ argumentCount ] )
+		{
+			++argumentCount;
+		}
+
+		// execvpe(3) copies the argument vector onto the stack to run a script
+		size_t stackSize = ChildStackSize + ( argumentCount + 2 ) * sizeof( char* );
+		stackSize = ( stackSize + pageSize - 1 ) / pageSize * pageSize;
+
+		void* stack = mmap( nullptr, stackSize, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0 );
+
+		if ( MAP_FAILED == stack )
+		{
+			return -1;
+		}
+
+		sigset_t allSignals;
+		sigfillset( &allSignals );
+		pthread_sigmask( SIG_SETMASK, &allSignals, &mSignalMask );
+
+		// A sibling inherits the exit signal of the caller
+		int flags = CLONE_VM | CLONE_VFORK | CLONE_PIDFD | ( mSibling ? CLONE_PARENT : SIGCHLD );
+		char* stackTop = static_cast< char* >( stack ) + stackSize;
+		long returnValue = clone( _runChild, stackTop, flags, this, &pidFileDescriptor );
+
+		if ( ( -1 == returnValue ) and ( EINVAL == errno ) )
+		{
+			// A kernel without CLONE_PIDFD, before 5.2
+			pidFileDescriptor = -1;
+			returnValue = clone( _runChild, stackTop, flags & ~CLONE_PIDFD, this );
+		}
+
+		int savedErrno = errno;
+		pthread_sigmask( SIG_SETMASK, &mSignalMask, nullptr );
+		munmap( stack, stackSize );
+		errno = savedErrno;
+		return returnValue;
+	}
+
+	// Close every file descriptor from mCloseFrom up, other than the targets
+	// of the file actions and the error pipe; in as few calls as they allow.
+	// Only async-signal-safe calls are made from here.
+	void _closeFrom() const noexcept
+	{
+		unsigned int lowest = static_cast< unsigned int >( mCloseFrom );
+		int kept;
+
+		do
+		{
+			kept = _nextKept( static_cast< int >( lowest ) );
+
+			if ( ( -1 == kept ) or ( lowest < static_cast< unsigned int >( kept ) ) )
+			{
+				_closeRange( lowest, ( -1 == kept ) ? ~0U : static_cast< unsigned int >( kept ) - 1 );
+			}
+
+			lowest = static_cast< unsigned int >( kept ) + 1;
+		} while ( -1 != kept );
+	}
+
+	// Close the file descriptors from {@param lowest} to {@param highest} inclusive,
+	// one at a time up to the descriptor limit should close_range(2) not be provided.
+	// Only async-signal-safe calls are made from here.
+	static void _closeRange(
+		unsigned int lowest,
+		unsigned int highest ) noexcept
+	{
+#if defined( SYS_close_range )
+		if ( 0 == syscall( SYS_close_range, lowest, highest, 0 ) )
+		{
+			return;
+		}
+#endif
+		struct rlimit limit;
+
+		// Without a limit, that of fs.nr_open by default bounds the descriptors
+		rlim_t count = ( ( 0 == getrlimit( RLIMIT_NOFILE, &limit ) ) and ( RLIM_INFINITY != limit.rlim_cur ) )
+			? limit.rlim_cur : rlim_t( 1024 * 1024 );
+
+		if ( count <= highest )
+		{
+			highest = static_cast< unsigned int >( count ) - 1;
+		}
+
+		for ( unsigned int fileDescriptor( lowest ); ( fileDescriptor <= highest ) and ( fileDescriptor < count ); ++fileDescriptor )
+		{
+			close( static_cast< int >( fileDescriptor ) );
+		}
+	}
+
+	// Get the lowest file descriptor of at least {@param lowest} that is to stay
+	// open through _closeFrom(); a target of the file actions or the error pipe.
+	// @return The descriptor is returned, else -1 if there is none.
+	int _nextKept(
+		int lowest ) const noexcept
+	{
+		int kept = ( lowest <= mErrorPipe ) ? mErrorPipe : -1;
+
+		for ( const FileAction& action : mFileActions )
+		{
+			if ( ( lowest <= action.targetFileDescriptor ) and ( ( -1 == kept ) or ( action.targetFileDescriptor < kept ) ) )
+			{
+				kept = action.targetFileDescriptor;
+			}
+		}
+
+		return kept;
+	}
+
+	// Report a failure through the error pipe and exit the child.
+	// Only async-signal-safe calls are made from here.
+	[[noreturn]] void _failChild(
+		SpawnStage stage ) const noexcept
+	{
+		int32_t report[ 2 ] = { static_cast< int32_t >( stage ), errno };
+		ssize_t ignored = write( mErrorPipe, report, sizeof( report ) );
+
+		(void)ignored;
+		_exit( 127 );
+	}
+
+	// Create the error pipe, clear of the file descriptors targeted by dup2().
+	// @param errorPipe Set to the read and write ends of the pipe.
+	// @return Zero is returned on success, else a negative error code.
+	int _openErrorPipe(
+		int errorPipe[ 2 ] )
+	{
+		int highestTarget = -1;
+
+		if ( 0 != pipe2( errorPipe, O_CLOEXEC ) )
+		{
+			return -errno;
+		}
+
+		for ( const FileAction& action : mFileActions )
+		{
+			highestTarget = ( highestTarget < action.targetFileDescriptor ) ? action.targetFileDescriptor : highestTarget;
+		}
+
+		if ( errorPipe[ 1 ] <= highestTarget )
+		{
+			int writeEnd = fcntl( errorPipe[ 1 ], F_DUPFD_CLOEXEC, highestTarget + 1 );
+			int errorCode = -errno;
+
+			close( errorPipe[ 1 ] );
+
+			if ( -1 == writeEnd )
+			{
+				close( errorPipe[ 0 ] );
+				return errorCode;
+			}
+
+			errorPipe[ 1 ] = writeEnd;
+		}
+
+		return 0;
+	}
+
+	// Read the report of the child from the error pipe, once the child has
+	// exec'd or exited, and release the pipe.
+	// @return Zero is returned if the exec succeeded, else the negated errno of the child.
+	int _readErrorPipe(
+		int errorPipe[ 2 ] )
+	{
+		int32_t report[ 2 ];
+		ssize_t bytesRead;
+
+		close( errorPipe[ 1 ] );
+
+		do
+		{
+			bytesRead = read( errorPipe[ 0 ], report, sizeof( report ) );
+		} while ( ( -1 == bytesRead ) and ( EINTR == errno ) );
+
+		close( errorPipe[ 0 ] );
+		mErrorPipe = -1;
+
+		if ( static_cast< ssize_t >( sizeof( report ) ) != bytesRead )
+		{
+			return 0;
+		}
+
+		mFailedStage = static_cast< SpawnStage >( report[ 0 ] );
+		return -report[ 1 ];
+	}
+
+	// Reap a child that failed to exec. A sibling is not ours to reap;
+	// its PID and pidfd are left for the caller, whose child it is.
+	void _reapFailedChild(
+		pid_t& childProcessID,
+		int& pidFileDescriptor ) const
+	{
+		if ( mSibling )
+		{
+			return;
+		}
+
+		while ( ( -1 == waitpid( childProcessID, nullptr, 0 ) ) and ( EINTR == errno ) )
+		{
+		}
+
+		if ( -1 != pidFileDescriptor )
+		{
+			close( pidFileDescriptor );
+			pidFileDescriptor = -1;
+		}
+
+		childProcessID = 0;
+	}
+
+	// Entry of a child sharing our memory; from _cloneSharingMemory(), or vfork(2)
+	// with the signals blocked as well. The handlers of the caller are reset before
+	// the signals are let through again. Only async-signal-safe calls are made from here.
+	static int _runChild(
+		void* spawnPlan ) noexcept
+	{
+		const SpawnPlan& plan = *static_cast< const SpawnPlan* >( spawnPlan );
+		struct sigaction action;
+
+		for ( int signalNumber( 0 ); ++signalNumber < NSIG; )
+		{
+			if ( ( 0 == sigaction( signalNumber, nullptr, &action ) )
+				and ( SIG_IGN != action.sa_handler ) and ( SIG_DFL != action.sa_handler ) )
+			{
+				action.sa_handler = SIG_DFL;
+				action.sa_flags = 0;
+				sigemptyset( &action.sa_mask );
+				sigaction( signalNumber, &action, nullptr );
+			}
+		}
+
+		sigprocmask( SIG_SETMASK, &plan.mSignalMask, nullptr );
+		plan._executeChild();
+	}
+
+	// Launch the child with clone(2) sharing our memory, falling back to
+	// vfork(2) should it be refused. A child created in its cgroup is
+	// launched with _cloneCopyingMemory() instead, as only clone3(2) can.
+	int _spawnClone3(
+		pid_t& childProcessID,
+		int& pidFileDescriptor )
+	{
+#if defined( __linux__ )
+		int pidFD = -1;
+		int errorPipe[ 2 ];
+		long returnValue = -1;
+		bool intoCgroup = ( nullptr != mAttributes ) and ( not mAttributes->mCgroupPath.empty() );
+		int errorCode = _openErrorPipe( errorPipe );
+
+		if ( 0 != errorCode )
+		{
+			mFailedStage = SpawnStage::Launch;
+			return errorCode;
+		}
+
+		mErrorPipe = errorPipe[ 1 ];
+		mMoveToCgroup = false;
+
+		if ( intoCgroup )
+		{
+			int cgroupFD = open( mAttributes->mCgroupPath.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC );
+
+			if ( -1 == cgroupFD )
+			{
+				errorCode = -errno;
+				close( errorPipe[ 0 ] );
+				close( errorPipe[ 1 ] );
+				mErrorPipe = -1;
+				mFailedStage = SpawnStage::Attributes;
+				return errorCode;
+			}
+
+			returnValue = _cloneCopyingMemory( cgroupFD, pidFD );
+
+			int savedErrno = errno;
+			close( cgroupFD );
+			errno = savedErrno;
+
+			// Only a kernel without clone3(2) or CLONE_INTO_CGROUP has the child move itself
+			mMoveToCgroup = ( -1 == returnValue )
+				and ( ( EINVAL == errno ) or ( E2BIG == errno ) or ( ENOSYS == errno ) or ( EPERM == errno ) );
+		}
+
+		if ( ( not intoCgroup ) or mMoveToCgroup )
+		{
+			returnValue = ShareMemory ? _cloneSharingMemory( pidFD ) : _cloneCopyingMemory( -1, pidFD );
+		}
+
+		if ( 0 < returnValue )
+		{
+			childProcessID = static_cast< pid_t >( returnValue );
+			pidFileDescriptor = pidFD;
+
+			if ( 0 != ( errorCode = _readErrorPipe( errorPipe ) ) )
+			{
+				_reapFailedChild( childProcessID, pidFileDescriptor );
+			}
+
+			return errorCode;
+		}
+
+		errorCode = -errno;
+		close( errorPipe[ 0 ] );
+		close( errorPipe[ 1 ] );
+		mErrorPipe = -1;
+
+		if ( ( -ENOSYS != errorCode ) and ( -EPERM != errorCode ) )
+		{
+			mFailedStage = SpawnStage::Launch;
+			return errorCode;
+		}
+#endif
+		// vfork(2) cannot launch a sibling
+		if ( mSibling )
+		{
+			mFailedStage = SpawnStage::Launch;
+			return -ENOSYS;
+		}
+
+		return _spawnVfork( childProcessID );
+	}
+
+	// Launch the child with posix_spawn(3).
+	int _spawnPosix(
+		pid_t& childProcessID )
+	{
+		posix_spawn_file_actions_t fileActions;
+		posix_spawnattr_t attributes;
+		int errorCode = posix_spawn_file_actions_init( &fileActions );
+
+		if ( 0 != errorCode )
+		{
+			mFailedStage = SpawnStage::Launch;
+			return -errorCode;
+		}
+
+		if ( 0 != ( errorCode = posix_spawnattr_init( &attributes ) ) )
+		{
+			posix_spawn_file_actions_destroy( &fileActions );
+			mFailedStage = SpawnStage::Launch;
+			return -errorCode;
+		}
+
+		if ( mNewSession )
+		{
+			// Since glibc 2.26
+			posix_spawnattr_setflags( &attributes, POSIX_SPAWN_SETSID );
+		}
+		else if ( -1 != mProcessGroup )
+		{
+			posix_spawnattr_setflags( &attributes, POSIX_SPAWN_SETPGROUP );
+			posix_spawnattr_setpgroup( &attributes, mProcessGroup );
+		}
+
+		for ( const FileAction& action : mFileActions )
+		{
+			if ( 0 > action.targetFileDescriptor )
+			{
+				errorCode = posix_spawn_file_actions_addclose(
+					&fileActions, action.fileDescriptor );
+			}
+			else
+			{
+				errorCode = posix_spawn_file_actions_adddup2(
+					&fileActions, action.fileDescriptor, action.targetFileDescriptor );
+			}
+
+			if ( 0 != errorCode )
+			{
+				posix_spawn_file_actions_destroy( &fileActions );
+				posix_spawnattr_destroy( &attributes );
+				mFailedStage = SpawnStage::Launch;
+				return -errorCode;
+			}
+		}
+
+		if ( -1 != mCloseFrom )
+		{
+			errorCode = _addPosixCloseFrom( fileActions );
+
+			if ( 0 != errorCode )
+			{
+				posix_spawn_file_actions_destroy( &fileActions );
+				posix_spawnattr_destroy( &attributes );
+				mFailedStage = SpawnStage::Launch;
+				return -errorCode;
+			}
+		}
+
+		if ( mSearchPath )
+		{
+			errorCode = posix_spawnp( &childProcessID, mApplication,
+				&fileActions, &attributes, mArguments, mEnvironment );
+		}
+		else
+		{
+			errorCode = posix_spawn( &childProcessID, mApplication,
+				&fileActions, &attributes, mArguments, mEnvironment );
+		}
+
+		posix_spawn_file_actions_destroy( &fileActions );
+		posix_spawnattr_destroy( &attributes );
+
+		if ( 0 != errorCode )
+		{
+			mFailedStage = SpawnStage::Launch;
+		}
+
+		return -errorCode;
+	}
+
+	// Launch the child with vfork(2), the signals blocked as for _cloneSharingMemory().
+	int _spawnVfork(
+		pid_t& childProcessID )
+	{
+		int errorPipe[ 2 ];
+		int pidFileDescriptor = -1;
+		int errorCode = _openErrorPipe( errorPipe );
+
+		if ( 0 != errorCode )
+		{
+			mFailedStage = SpawnStage::Launch;
+			return errorCode;
+		}
+
+		mErrorPipe = errorPipe[ 1 ];
+		mMoveToCgroup = true;
+
+		sigset_t allSignals;
+		sigfillset( &allSignals );
+		pthread_sigmask( SIG_SETMASK, &allSignals, &mSignalMask );
+
+		pid_t processID = vfork();
+
+		if ( 0 == processID )
+		{
+			_runChild( this );
+		}
+
+		errorCode = -errno;
+		pthread_sigmask( SIG_SETMASK, &mSignalMask, nullptr );
+
+		if ( 0 > processID )
+		{
+			close( errorPipe[ 0 ] );
+			close( errorPipe[ 1 ] );
+			mErrorPipe = -1;
+			mFailedStage = SpawnStage::Launch;
+			return errorCode;
+		}
+
+		childProcessID = processID;
+
+		if ( 0 != ( errorCode = _readErrorPipe( errorPipe ) ) )
+		{
+			_reapFailedChild( childProcessID, pidFileDescriptor );
+		}
+
+		return errorCode;
+	}
+
+public:
+	/**
+	 * Construct a launch plan.
+	 * @param application Name of, or path to, the application to execute.
+	 *                    An application not starting with '/' is searched for in PATH.
+	 * @param arguments Null terminated argument vector for the application.
+	 * @param environment Null terminated environment vector for the application.
+	 *                    If null, then the environment of the caller is inherited. [default: nullptr]
+	 */
+	SpawnPlan(
+		const char* application,
+		char* const* arguments,
+		char* const* environment = nullptr )
+	{
+		mApplication = application;
+		mArguments = arguments;
+		mEnvironment = ( nullptr == environment ) ? environ : environment;
+		mSearchPath = ( '/' != application[ 0 ] );
+		mBackend = SpawnBackend::PosixSpawn;
+		mSibling = false;
+		mErrorPipe = -1;
+		mAttributes = nullptr;
+		mMoveToCgroup = false;
+		mFailedStage = SpawnStage::None;
+		mProcessGroup = -1;
+		mNewSession = false;
+		mCloseFrom = -1;
+		sigemptyset( &mSignalMask );
+	}
+
+	/**
+	 * Close a file descriptor in the child.
+	 * @param fileDescriptor The file descriptor to close.
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& addClose(
+		int fileDescriptor )
+	{
+		mFileActions.push_back( FileAction{ fileDescriptor, -1 } );
+		return *this;
+	}
+
+	/**
+	 * Duplicate a file descriptor onto another in the child.
+	 * @param fileDescriptor The file descriptor to duplicate.
+	 * @param targetFileDescriptor The file descriptor number it will be visible as in the child.
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& addDup2(
+		int fileDescriptor,
+		int targetFileDescriptor )
+	{
+		mFileActions.push_back( FileAction{ fileDescriptor, targetFileDescriptor } );
+		return *this;
+	}
+
+	/**
+	 * Close every file descriptor from {@param lowest} up in the child, once the
+	 * file actions are applied, other than their targets; as close_range(2)
+	 * does, so that nothing the parent has open leaks into the application.
+	 * Without posix_spawn_file_actions_addclosefrom_np(3), from glibc 2.34,
+	 * the child is launched through clone(2) instead of posix_spawn(3).
+	 * @param lowest The lowest file descriptor to close, -1 for none. [default: -1]
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& closeFrom(
+		int lowest )
+	{
+		mCloseFrom = lowest;
+		return *this;
+	}
+
+	/**
+	 * Get the stage at which the last launch failed.
+	 * @return The stage is returned, SpawnStage::None if the launch succeeded.
+	 */
+	SpawnStage failedStage() const
+	{
+		return mFailedStage;
+	}
+
+	/**
+	 * Select the backend used to launch the child.
+	 * @param backend The backend to use. [default: SpawnBackend::PosixSpawn]
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& setBackend(
+		SpawnBackend backend )
+	{
+		mBackend = backend;
+		return *this;
+	}
+
+	/**
+	 * Apply attributes to the child between its creation and exec. As that
+	 * requires code to run in the child, the child is launched through
+	 * clone(2) sharing our memory regardless of the backend, or vfork(2)
+	 * should that be refused. A cgroup is the exception: the child is created
+	 * in it by clone3(2), which costs a copy of our page tables as fork(2)
+	 * does, so in proportion to our size; the child moves itself instead
+	 * on kernels without CLONE_INTO_CGROUP.
+	 * The attributes are not copied; they must outlive the call to spawn().
+	 * @param attributes The attributes to apply, nullptr for none.
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& setProcessAttributes(
+		const ProcessAttributes* attributes )
+	{
+		mAttributes = ( ( nullptr == attributes ) or attributes->empty() ) ? nullptr : attributes;
+		return *this;
+	}
+
+	/**
+	 * Have the child lead a new session, as setsid(2) does, before the exec
+	 * of the application; and so a new process group, without a controlling
+	 * terminal. This takes the place of any process group set.
+	 * @param newSession If true, the child leads a new session. [default: false]
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& setNewSession(
+		bool newSession )
+	{
+		mNewSession = newSession;
+		return *this;
+	}
+
+	/**
+	 * Place the child in a process group, as setpgid(2) does, before the
+	 * exec of the application.
+	 * @param processGroup The process group to join, zero for a new process group
+	 *                     led by the child, or -1 to stay in that of the caller.
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& setProcessGroup(
+		pid_t processGroup )
+	{
+		mProcessGroup = processGroup;
+		return *this;
+	}
+
+	/**
+	 * Launch the child as a sibling of the caller; a child of the caller's
+	 * parent, which is then the one to reap it. Only clone(2) can do this,
+	 * so it is used regardless of the backend, and without it the launch
+	 * fails with -ENOSYS rather than falling back.
+	 * @param sibling If true, launch the child as a sibling. [default: false]
+	 * @return A reference to this SpawnPlan object is returned.
+	 */
+	SpawnPlan& setSibling(
+		bool sibling )
+	{
+		mSibling = sibling;
+		return *this;
+	}
+
+	/**
+	 * Launch the child process described by this plan.
+	 * @param childProcessID Set to the PID of the child upon success.
+	 * @param pidFileDescriptor Set to a pidfd referring to the child if the backend
+	 *                          provides one, else it is set to -1.
+	 * @return Zero is returned upon success, else a negative error code is returned;
+	 *         the errno of the child should the exec or a dup2() fail, with
+	 *         failedStage() telling which. A sibling that failed to exec is
+	 *         left for the caller to reap, its PID and pidfd set regardless.
+	 */
+	int spawn(
+		pid_t& childProcessID,
+		int& pidFileDescriptor )
+	{
+		pidFileDescriptor = -1;
+		mFailedStage = SpawnStage::None;
+
+		if ( ( SpawnBackend::Clone3 == mBackend ) or mSibling or ( nullptr != mAttributes )
+			or ( ( -1 != mCloseFrom ) and ( not PosixCloseFrom ) ) )
+		{
+			return _spawnClone3( childProcessID, pidFileDescriptor );
+		}
+
+		return _spawnPosix( childProcessID );
+	}
+};
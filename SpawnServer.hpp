@@ -0,0 +1,648 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "SpawnPlan.hpp"
+
+/**
+ * An optional helper process that launches children on our behalf.
+ *
+ * The helper is forked once, by start(), while the calling process is
+ * still small; ideally first thing in main(), before any threads are
+ * created. Launch plans are then serialized to it over a Unix socket,
+ * the file descriptors the child is to receive passed with SCM_RIGHTS,
+ * and the helper launches the child with clone( CLONE_PARENT ). The
+ * child is therefore our child, not the helper's: it is waited on and
+ * signalled exactly like a locally launched one, and its pidfd is passed
+ * back. The cost of a launch no longer depends on the size of the caller.
+ *
+ * Requests are serialized by a mutex; the helper handles one at a time.
+ * Should the helper be unavailable for a request, spawn() says so with
+ * -ENOTCONN and the caller is expected to launch the child itself.
+ *
+ * The helper inherits the standard streams and environment of the caller
+ * as of start(); children searched for in PATH are searched for in the
+ * helper's PATH.
+ */
+class SpawnServer
+{
+private:
+	static constexpr uint32_t MaxFileDescriptors = 16; // Per launch request
+	static constexpr int ServerSocketFD = 3; // Socket number within the helper
+
+	// Fixed part of a launch request, sent along with the file descriptors.
+	// It is followed by actionCount Actions and then by the application,
+	// arguments and environment as consecutive null terminated strings.
+	struct RequestHeader
+	{
+		uint32_t actionCount;
+		uint32_t argumentCount;
+		uint32_t environmentCount;
+		uint32_t fileDescriptorCount;
+		uint64_t payloadLength;
+	};
+
+	// A dup2() of a passed file descriptor onto a target in the child
+	struct Action
+	{
+		int32_t fileDescriptorIndex;
+		int32_t targetFileDescriptor;
+	};
+
+	// The reply to a launch request, sent along with the pidfd if there is one
+	struct Reply
+	{
+		int32_t errorCode;
+		int32_t failedStage; // SpawnStage at which the launch failed
+		int32_t processID; // Also set for a child that failed to exec, for the client to reap
+	};
+
+	std::mutex mMutex;
+	int mSocket; // Our end of the socket, -1 if the helper is not running
+	pid_t mServerProcessID; // PID of the helper
+
+	SpawnServer()
+	{
+		mSocket = -1;
+		mServerProcessID = -1;
+	}
+
+	// Append a null terminated string to a payload.
+	static void _appendString(
+		std::vector< char >& payload,
+		const char* string )
+	{
+		payload.insert( payload.end(), string, string + strlen( string ) + 1 );
+	}
+
+	// Close every file descriptor from {@param lowest} upward.
+	static void _closeFrom(
+		int lowest )
+	{
+#if defined( SYS_close_range )
+		if ( 0 == syscall( SYS_close_range, lowest, ~0U, 0 ) )
+		{
+			return;
+		}
+#endif
+		long highest = sysconf( _SC_OPEN_MAX );
+
+		for ( long fileDescriptor( lowest ); fileDescriptor < highest; ++fileDescriptor )
+		{
+			close( static_cast< int >( fileDescriptor ) );
+		}
+	}
+
+	// Read exactly {@param length} bytes.
+	// @return True is returned on success, false on error or end of stream.
+	static bool _readFully(
+		int socket,
+		void* buffer,
+		size_t length )
+	{
+		char* position = static_cast< char* >( buffer );
+
+		while ( 0 < length )
+		{
+			ssize_t bytesRead = read( socket, position, length );
+
+			if ( 0 < bytesRead )
+			{
+				position += bytesRead;
+				length -= static_cast< size_t >( bytesRead );
+			}
+			else if ( ( 0 == bytesRead ) or ( EINTR != errno ) )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Receive a fixed size message along with any file descriptors passed with it.
+	// The received file descriptors are close-on-exec.
+	// @return True is returned on success, false on error or end of stream.
+	static bool _receive(
+		int socket,
+		void* message,
+		size_t length,
+		std::vector< int >& fileDescriptors )
+	{
+		union
+		{
+			char buffer[ CMSG_SPACE( sizeof( int ) * MaxFileDescriptors ) ];
+			struct cmsghdr align;
+		} control;
+		struct iovec region = { message, length };
+		struct msghdr header = {};
+		ssize_t bytesRead;
+
+		header.msg_iov = &region;
+		header.msg_iovlen = 1;
+		header.msg_control = control.buffer;
+		header.msg_controllen = sizeof( control.buffer );
+
+		do
+		{
+			bytesRead = recvmsg( socket, &header, MSG_CMSG_CLOEXEC );
+		} while ( ( -1 == bytesRead ) and ( EINTR == errno ) );
+
+		if ( 0 >= bytesRead )
+		{
+			return false;
+		}
+
+		for ( struct cmsghdr* controlMessage = CMSG_FIRSTHDR( &header );
+			nullptr != controlMessage;
+			controlMessage = CMSG_NXTHDR( &header, controlMessage ) )
+		{
+			if ( ( SOL_SOCKET == controlMessage->cmsg_level ) and ( SCM_RIGHTS == controlMessage->cmsg_type ) )
+			{
+				size_t count = ( controlMessage->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+				const int* received = reinterpret_cast< const int* >( CMSG_DATA( controlMessage ) );
+				fileDescriptors.insert( fileDescriptors.end(), received, received + count );
+			}
+		}
+
+		// The rest of the message follows without file descriptors
+		return _readFully( socket, static_cast< char* >( message ) + bytesRead, length - static_cast< size_t >( bytesRead ) );
+	}
+
+	// Send a message, passing the given file descriptors with its first byte.
+	// @return True is returned on success.
+	static bool _send(
+		int socket,
+		const void* message,
+		size_t length,
+		const std::vector< int >& fileDescriptors )
+	{
+		union
+		{
+			char buffer[ CMSG_SPACE( sizeof( int ) * MaxFileDescriptors ) ];
+			struct cmsghdr align;
+		} control;
+		const char* position = static_cast< const char* >( message );
+		bool passFileDescriptors = not fileDescriptors.empty();
+
+		while ( 0 < length )
+		{
+			struct iovec region = { const_cast< char* >( position ), length };
+			struct msghdr header = {};
+
+			header.msg_iov = &region;
+			header.msg_iovlen = 1;
+
+			if ( passFileDescriptors )
+			{
+				size_t descriptorsLength = sizeof( int ) * fileDescriptors.size();
+				struct cmsghdr* controlMessage;
+
+				memset( control.buffer, 0, sizeof( control.buffer ) );
+				header.msg_control = control.buffer;
+				header.msg_controllen = CMSG_SPACE( descriptorsLength );
+				controlMessage = CMSG_FIRSTHDR( &header );
+				controlMessage->cmsg_level = SOL_SOCKET;
+				controlMessage->cmsg_type = SCM_RIGHTS;
+				controlMessage->cmsg_len = CMSG_LEN( descriptorsLength );
+				memcpy( CMSG_DATA( controlMessage ), fileDescriptors.data(), descriptorsLength );
+			}
+
+			ssize_t bytesWritten = sendmsg( socket, &header, MSG_NOSIGNAL );
+
+			if ( 0 < bytesWritten )
+			{
+				position += bytesWritten;
+				length -= static_cast< size_t >( bytesWritten );
+				passFileDescriptors = false;
+			}
+			else if ( EINTR != errno )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// The helper process. Serves launch requests until our end of the socket closes.
+	[[noreturn]] static void _serve(
+		int socket )
+	{
+		sigset_t noSignals;
+
+		// Keep nothing of the caller but the standard streams
+		if ( ServerSocketFD != socket )
+		{
+			dup3( socket, ServerSocketFD, O_CLOEXEC );
+		}
+
+		_closeFrom( ServerSocketFD + 1 );
+
+		// Children inherit the signal mask of the helper
+		sigemptyset( &noSignals );
+		sigprocmask( SIG_SETMASK, &noSignals, nullptr );
+
+		while ( _serveRequest( ServerSocketFD ) )
+		{
+		}
+
+		_exit( EXIT_SUCCESS );
+	}
+
+	// Serve a single launch request.
+	// @return False is returned once the socket is closed or broken.
+	static bool _serveRequest(
+		int socket )
+	{
+		RequestHeader requestHeader;
+		std::vector< int > fileDescriptors;
+		std::vector< char > payload;
+		std::vector< char* > strings;
+		Reply reply = { 0, 0, 0 };
+		pid_t childProcessID = 0;
+		int pidFileDescriptor = -1;
+
+		if ( not _receive( socket, &requestHeader, sizeof( requestHeader ), fileDescriptors ) )
+		{
+			return false;
+		}
+
+		payload.resize( requestHeader.payloadLength + 1, '\0' );
+
+		if ( not _readFully( socket, payload.data(), requestHeader.payloadLength ) )
+		{
+			return false;
+		}
+
+		size_t actionsLength = sizeof( Action ) * requestHeader.actionCount;
+		size_t stringCount = 1 + requestHeader.argumentCount + requestHeader.environmentCount;
+		size_t offset = actionsLength;
+
+		// Split the strings; the application, then argv, then envp
+		while ( ( strings.size() < stringCount ) and ( offset < requestHeader.payloadLength ) )
+		{
+			strings.push_back( payload.data() + offset );
+			offset += strlen( payload.data() + offset ) + 1;
+		}
+
+		if ( ( actionsLength > requestHeader.payloadLength ) or ( strings.size() != stringCount ) )
+		{
+			reply.errorCode = -EINVAL;
+		}
+		else
+		{
+			std::vector< char* > arguments( strings.begin() + 1, strings.begin() + 1 + requestHeader.argumentCount );
+			std::vector< char* > environment( strings.begin() + 1 + requestHeader.argumentCount, strings.end() );
+			const Action* actions = reinterpret_cast< const Action* >( payload.data() );
+
+			arguments.push_back( nullptr );
+			environment.push_back( nullptr );
+
+			// The passed descriptors are numbered from the lowest free here, and so may
+			// be the target of an earlier action; the plan of the caller only holds for
+			// sources clear of every target. Move them above the highest target first.
+			int highestTarget = STDERR_FILENO;
+
+			for ( uint32_t index( -1 ); ++index < requestHeader.actionCount; )
+			{
+				Action action;
+				memcpy( &action, actions + index, sizeof( action ) );
+				highestTarget = std::max( highestTarget, static_cast< int >( action.targetFileDescriptor ) );
+			}
+
+			for ( int& fileDescriptor : fileDescriptors )
+			{
+				if ( fileDescriptor <= highestTarget )
+				{
+					int movedFileDescriptor = fcntl( fileDescriptor, F_DUPFD_CLOEXEC, highestTarget + 1 );
+
+					if ( -1 == movedFileDescriptor )
+					{
+						reply.errorCode = -errno;
+						break;
+					}
+
+					close( fileDescriptor );
+					fileDescriptor = movedFileDescriptor;
+				}
+			}
+
+			SpawnPlan spawnPlan( strings[ 0 ], arguments.data(), environment.data() );
+			spawnPlan.setBackend( SpawnBackend::Clone3 );
+			spawnPlan.setSibling( true );
+
+			for ( uint32_t index( -1 ); ( 0 == reply.errorCode ) and ( ++index < requestHeader.actionCount ); )
+			{
+				Action action;
+				memcpy( &action, actions + index, sizeof( action ) );
+
+				if ( ( 0 > action.fileDescriptorIndex )
+					or ( fileDescriptors.size() <= static_cast< size_t >( action.fileDescriptorIndex ) ) )
+				{
+					reply.errorCode = -EINVAL;
+					break;
+				}
+
+				spawnPlan.addDup2( fileDescriptors[ action.fileDescriptorIndex ], action.targetFileDescriptor );
+			}
+
+			if ( 0 == reply.errorCode )
+			{
+				reply.errorCode = spawnPlan.spawn( childProcessID, pidFileDescriptor );
+				reply.failedStage = static_cast< int32_t >( spawnPlan.failedStage() );
+				reply.processID = childProcessID;
+			}
+		}
+
+		for ( int fileDescriptor : fileDescriptors )
+		{
+			close( fileDescriptor );
+		}
+
+		std::vector< int > pidFileDescriptors;
+
+		if ( -1 != pidFileDescriptor )
+		{
+			pidFileDescriptors.push_back( pidFileDescriptor );
+		}
+
+		bool sent = _send( socket, &reply, sizeof( reply ), pidFileDescriptors );
+
+		if ( -1 != pidFileDescriptor )
+		{
+			close( pidFileDescriptor );
+		}
+
+		return sent;
+	}
+
+	// Stop the helper. The mutex must be held.
+	void _stop()
+	{
+		if ( -1 == mSocket )
+		{
+			return;
+		}
+
+		// The helper exits upon the end of the stream
+		close( mSocket );
+		mSocket = -1;
+
+		while ( ( -1 == waitpid( mServerProcessID, nullptr, 0 ) ) and ( EINTR == errno ) )
+		{
+		}
+
+		mServerProcessID = -1;
+	}
+
+public:
+	SpawnServer( const SpawnServer& ) = delete;
+	SpawnServer& operator=( const SpawnServer& ) = delete;
+
+	/**
+	 * Destructor to stop the helper process.
+	 */
+	~SpawnServer()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		_stop();
+	}
+
+	/**
+	 * Get the process wide spawn server.
+	 * @return A reference to the SpawnServer is returned.
+	 */
+	static SpawnServer& instance()
+	{
+		static SpawnServer Instance;
+		return Instance;
+	}
+
+	/**
+	 * Check if the helper process is available.
+	 * @return True is returned if the helper process is running.
+	 */
+	bool running()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		return -1 != mSocket;
+	}
+
+	/**
+	 * Launch a child through the helper process.
+	 * @param spawnPlan The launch plan. Close actions are not needed, nor sent:
+	 *                  the helper holds nothing but the file descriptors passed.
+	 *                  Should the launch fail, its failedStage() is set.
+	 * @param childProcessID Set to the PID of the child upon success.
+	 * @param pidFileDescriptor Set to a pidfd referring to the child, else -1.
+	 * @return Zero is returned upon success; -ENOTCONN if the helper is
+	 *         unavailable for this request, else a negative error code.
+	 */
+	int spawn(
+		SpawnPlan& spawnPlan,
+		pid_t& childProcessID,
+		int& pidFileDescriptor )
+	{
+		RequestHeader requestHeader = {};
+		std::vector< char > payload;
+		std::vector< int > fileDescriptors;
+		std::vector< Action > actions;
+		Reply reply;
+
+		pidFileDescriptor = -1;
+
+		// Process attributes, groups and sessions are not forwarded; such a child is launched locally
+		if ( ( nullptr != spawnPlan.mAttributes ) or ( -1 != spawnPlan.mProcessGroup ) or spawnPlan.mNewSession )
+		{
+			return -ENOTCONN;
+		}
+
+		// The helper holds nothing open but the standard streams for its children, which
+		// only receive the targets on top; a close of the standard streams is not forwarded
+		if ( ( -1 != spawnPlan.mCloseFrom ) and ( STDERR_FILENO >= spawnPlan.mCloseFrom ) )
+		{
+			return -ENOTCONN;
+		}
+
+		for ( const SpawnPlan::FileAction& fileAction : spawnPlan.mFileActions )
+		{
+			if ( 0 > fileAction.targetFileDescriptor )
+			{
+				// Nor is a close of a standard stream, which the child would otherwise inherit
+				if ( STDERR_FILENO >= fileAction.fileDescriptor )
+				{
+					return -ENOTCONN;
+				}
+
+				continue;
+			}
+
+			// Pass each file descriptor once, however many targets it has
+			size_t index( -1 );
+
+			while ( ( ++index < fileDescriptors.size() ) and ( fileDescriptors[ index ] != fileAction.fileDescriptor ) )
+			{
+			}
+
+			if ( fileDescriptors.size() == index )
+			{
+				fileDescriptors.push_back( fileAction.fileDescriptor );
+			}
+
+			actions.push_back( Action{ static_cast< int32_t >( index ), fileAction.targetFileDescriptor } );
+		}
+
+		if ( MaxFileDescriptors < fileDescriptors.size() )
+		{
+			return -ENOTCONN;
+		}
+
+		payload.resize( sizeof( Action ) * actions.size() );
+
+		if ( not actions.empty() )
+		{
+			memcpy( payload.data(), actions.data(), payload.size() );
+		}
+
+		_appendString( payload, spawnPlan.mApplication );
+
+		for ( char* const* argument = spawnPlan.mArguments; nullptr != *argument; ++argument )
+		{
+			_appendString( payload, *argument );
+			++requestHeader.argumentCount;
+		}
+
+		for ( char* const* variable = spawnPlan.mEnvironment; ( nullptr != variable ) and ( nullptr != *variable ); ++variable )
+		{
+			_appendString( payload, *variable );
+			++requestHeader.environmentCount;
+		}
+
+		requestHeader.actionCount = static_cast< uint32_t >( actions.size() );
+		requestHeader.fileDescriptorCount = static_cast< uint32_t >( fileDescriptors.size() );
+		requestHeader.payloadLength = payload.size();
+
+		std::lock_guard< std::mutex > lock( mMutex );
+		std::vector< int > receivedFileDescriptors;
+
+		if ( -1 == mSocket )
+		{
+			return -ENOTCONN;
+		}
+
+		if ( not ( _send( mSocket, &requestHeader, sizeof( requestHeader ), fileDescriptors )
+			and _send( mSocket, payload.data(), payload.size(), std::vector< int >() )
+			and _receive( mSocket, &reply, sizeof( reply ), receivedFileDescriptors ) ) )
+		{
+			// The helper has gone away
+			_stop();
+			return -ENOTCONN;
+		}
+
+		if ( -ENOSYS == reply.errorCode )
+		{
+			// The kernel cannot launch siblings; the helper is of no use
+			_stop();
+			return -ENOTCONN;
+		}
+
+		if ( 0 != reply.errorCode )
+		{
+			for ( int fileDescriptor : receivedFileDescriptors )
+			{
+				close( fileDescriptor );
+			}
+
+			// A sibling that failed to exec is our child; it exits without a signal
+			if ( 0 < reply.processID )
+			{
+				while ( ( -1 == waitpid( reply.processID, nullptr, __WALL ) ) and ( EINTR == errno ) )
+				{
+				}
+			}
+
+			spawnPlan.mFailedStage = static_cast< SpawnStage >( reply.failedStage );
+			return reply.errorCode;
+		}
+
+		childProcessID = reply.processID;
+
+		if ( not receivedFileDescriptors.empty() )
+		{
+			pidFileDescriptor = receivedFileDescriptors[ 0 ];
+		}
+
+		return 0;
+	}
+
+	/**
+	 * Fork the helper process, if it is not already running.
+	 * Call this early, while the process is small and single threaded.
+	 * @return Zero is returned on success, else a negative error code is returned.
+	 */
+	int start()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		int socketPair[ 2 ];
+
+		if ( -1 != mSocket )
+		{
+			return 0;
+		}
+
+		if ( -1 == socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socketPair ) )
+		{
+			return -errno;
+		}
+
+		pid_t processID = fork();
+
+		if ( 0 > processID )
+		{
+			int errorCode = -errno;
+			close( socketPair[ 0 ] );
+			close( socketPair[ 1 ] );
+			return errorCode;
+		}
+
+		if ( 0 == processID )
+		{
+			close( socketPair[ 0 ] );
+			_serve( socketPair[ 1 ] );
+		}
+
+		close( socketPair[ 1 ] );
+		mSocket = socketPair[ 0 ];
+		mServerProcessID = processID;
+
+		return 0;
+	}
+
+	/**
+	 * Stop the helper process. Children it launched are unaffected.
+	 */
+	void stop()
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		_stop();
+	}
+};
@@ -0,0 +1,120 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "BufferPool.hpp"
+#include "OutputSink.hpp"
+
+/**
+ * An OutputSink delivering the output of a child to a callback, chunk by
+ * chunk, as it arrives.
+ *
+ * Each read is made into a buffer taken from a BufferPool and handed to
+ * the callback before the pipe is read again; a slow callback therefore
+ * leaves the pipe unread, and the child blocks once the pipe is full.
+ * The callback is called on the thread reaping the child, which is the
+ * ChildReaper thread for asynchronous executions, and so should be short.
+ * That thread does not wait for a buffer of a pool shared with sinks on
+ * other threads; the pipe is left unread until one is released.
+ */
+class StreamSink : public OutputSink
+{
+public:
+	using Callback = std::function< void( const char* data, size_t length ) >;
+
+private:
+	Callback mCallback;
+	std::shared_ptr< BufferPool > mPool;
+	char* mBuffer; // Buffer handed out by the last prepare(), if not yet committed
+
+public:
+	/**
+	 * Construct a sink calling back for each chunk of output.
+	 * @param callback The callable to invoke with each chunk.
+	 * @param pool The pool to take buffers from. If null, then the sink
+	 *             uses a pool of its own. [default: nullptr]
+	 */
+	StreamSink(
+		Callback callback,
+		std::shared_ptr< BufferPool > pool = nullptr )
+	{
+		mCallback = std::move( callback );
+		mPool = ( nullptr == pool ) ? std::make_shared< BufferPool >() : std::move( pool );
+		mBuffer = nullptr;
+	}
+
+	StreamSink( const StreamSink& ) = delete;
+	StreamSink& operator=( const StreamSink& ) = delete;
+
+	/**
+	 * Destructor to hand back an outstanding buffer.
+	 */
+	~StreamSink()
+	{
+		if ( nullptr != mBuffer )
+		{
+			mPool->release( mBuffer );
+		}
+	}
+
+	void commit(
+		size_t length ) override
+	{
+		char* buffer = mBuffer;
+		mBuffer = nullptr;
+
+		try
+		{
+			if ( ( 0 < length ) and mCallback )
+			{
+				mCallback( buffer, length );
+			}
+		}
+		catch ( ... )
+		{
+			mPool->release( buffer );
+			throw;
+		}
+
+		mPool->release( buffer );
+	}
+
+	void notifyWhenReady(
+		std::function< void() > ready ) override
+	{
+		mPool->notifyWhenAvailable( std::move( ready ) );
+	}
+
+	char* prepare(
+		size_t& length ) override
+	{
+		if ( nullptr == mBuffer )
+		{
+			mBuffer = mPool->acquire();
+		}
+
+		length = mPool->bufferSize();
+
+		return mBuffer;
+	}
+
+	char* tryPrepare(
+		size_t& length ) override
+	{
+		if ( nullptr == mBuffer )
+		{
+			mBuffer = mPool->tryAcquire();
+		}
+
+		length = mPool->bufferSize();
+
+		return mBuffer;
+	}
+};
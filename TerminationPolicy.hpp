@@ -0,0 +1,52 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <chrono>
+#include <signal.h>
+
+/**
+ * How a child process is terminated, whether by Command::terminate() or
+ * upon its timeout: the signal to send first, and how long to give the
+ * child to exit before escalating to SIGKILL.
+ *
+ * With processGroup set, the child is launched as the leader of a new
+ * process group and every signal is sent to the whole group, so that the
+ * processes it started itself are terminated along with it.
+ */
+struct TerminationPolicy
+{
+	int signalNumber; // Sent first
+	std::chrono::nanoseconds gracePeriod; // Until SIGKILL is sent, zero to never escalate
+	bool processGroup; // Signal the process group led by the child
+
+	/**
+	 * Default constructor to SIGTERM, without escalation, to the child alone.
+	 */
+	TerminationPolicy()
+	{
+		signalNumber = SIGTERM;
+		gracePeriod = std::chrono::nanoseconds( 0 );
+		processGroup = false;
+	}
+
+	/**
+	 * Construct a policy.
+	 * @param signalNumber The signal sent first.
+	 * @param gracePeriod The time the child is given to exit before SIGKILL
+	 *                    is sent, zero to never escalate.
+	 * @param processGroup If true, signal the process group led by the child. [default: false]
+	 */
+	TerminationPolicy(
+		int signalNumber,
+		std::chrono::nanoseconds gracePeriod,
+		bool processGroup = false )
+	{
+		this->signalNumber = signalNumber;
+		this->gracePeriod = gracePeriod;
+		this->processGroup = processGroup;
+	}
+};
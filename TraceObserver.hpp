@@ -0,0 +1,50 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <chrono>
+#include <sys/types.h>
+
+/**
+ * A receiver of the events traced through the life of each child process,
+ * when tracing is enabled; see CommandTrace.
+ *
+ * Events are delivered on whichever thread they occur on: the launching
+ * thread for the spawn events, and the reaping thread for the others.
+ * An observer must therefore be thread safe, and should be quick about it.
+ */
+class TraceObserver
+{
+public:
+	enum class Event
+	{
+		PreSpawn, // A Command is about to be launched
+		Spawned, // The child has been launched
+		ExecFailed, // The child could not be launched
+		FirstOutput, // The first output of the child was read by the parent
+		Exit // The child has been reaped
+	};
+
+	struct Record
+	{
+		Event event;
+		std::chrono::steady_clock::time_point time; // When the event occurred
+		std::chrono::nanoseconds latency; // Since the pre-spawn for Spawned and ExecFailed,
+		                                  // since the launch for FirstOutput and Exit, else zero
+		const char* application; // The application of the Command for the spawn events, else nullptr
+		pid_t processID; // PID of the child, zero before it is launched
+		int value; // The errno for ExecFailed, the exit status for Exit, else zero
+	};
+
+	virtual ~TraceObserver() = default;
+
+	/**
+	 * Receive an event.
+	 * @param record The event and its details; only valid for the duration of the call.
+	 */
+	virtual void onEvent(
+		const Record& record ) = 0;
+};
@@ -0,0 +1,343 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "TraceObserver.hpp"
+
+/**
+ * The default trace observer; process wide counters of each event
+ * and latency histograms, all kept with relaxed atomics so recording
+ * never takes a lock.
+ */
+class TraceStatistics : public TraceObserver
+{
+public:
+	/**
+	 * A histogram of latencies in power of two buckets of nanoseconds;
+	 * bucket N counts the latencies in [2^(N-1), 2^N).
+	 */
+	class Histogram
+	{
+	private:
+		static constexpr size_t BucketCount = 64;
+
+		std::atomic< uint64_t > mBuckets[ BucketCount ];
+		std::atomic< uint64_t > mCount;
+		std::atomic< uint64_t > mMaximum;
+		std::atomic< uint64_t > mTotal;
+
+	public:
+		/**
+		 * Default constructor to an empty histogram.
+		 */
+		Histogram()
+		{
+			reset();
+		}
+
+		Histogram( const Histogram& ) = delete;
+		Histogram& operator=( const Histogram& ) = delete;
+
+		/**
+		 * Get the number of latencies recorded.
+		 * @return The number of latencies recorded is returned.
+		 */
+		uint64_t count() const
+		{
+			return mCount.load( std::memory_order_relaxed );
+		}
+
+		/**
+		 * Get the largest latency recorded.
+		 * @return The largest latency is returned, zero if none has been recorded.
+		 */
+		std::chrono::nanoseconds maximum() const
+		{
+			return std::chrono::nanoseconds( mMaximum.load( std::memory_order_relaxed ) );
+		}
+
+		/**
+		 * Get a summary of the histogram as a JSON object; the count, and the
+		 * mean, 50th, 90th and 99th percentiles and maximum in nanoseconds.
+		 * @return The JSON text of the summary is returned.
+		 */
+		std::string json() const
+		{
+			return "{\"count\":" + std::to_string( count() )
+				+ ",\"meanNs\":" + std::to_string( mean().count() )
+				+ ",\"p50Ns\":" + std::to_string( percentile( 50.0 ).count() )
+				+ ",\"p90Ns\":" + std::to_string( percentile( 90.0 ).count() )
+				+ ",\"p99Ns\":" + std::to_string( percentile( 99.0 ).count() )
+				+ ",\"maximumNs\":" + std::to_string( maximum().count() ) + "}";
+		}
+
+		/**
+		 * Get the mean latency recorded.
+		 * @return The mean latency is returned, zero if none has been recorded.
+		 */
+		std::chrono::nanoseconds mean() const
+		{
+			uint64_t count = this->count();
+			return std::chrono::nanoseconds( ( 0 == count ) ? 0 : ( mTotal.load( std::memory_order_relaxed ) / count ) );
+		}
+
+		/**
+		 * Get an upper bound on a percentile of the latencies recorded.
+		 * @param percentile The percentile, in the range [0, 100].
+		 * @return The upper bound of the bucket the percentile falls in, or the
+		 *         maximum if lower, is returned; zero if no latency has been recorded.
+		 */
+		std::chrono::nanoseconds percentile(
+			double percentile ) const
+		{
+			uint64_t count = this->count();
+			uint64_t rank = static_cast< uint64_t >( ( percentile / 100.0 ) * static_cast< double >( count ) );
+			uint64_t seen = 0;
+
+			if ( 0 == count )
+			{
+				return std::chrono::nanoseconds( 0 );
+			}
+
+			for ( size_t index( -1 ); ++index < BucketCount; )
+			{
+				seen += mBuckets[ index ].load( std::memory_order_relaxed );
+
+				if ( seen > rank )
+				{
+					// The bucket may reach past every latency recorded into it
+					return ( BucketCount - 1 == index ) ? maximum()
+						: std::min( maximum(), std::chrono::nanoseconds( ( uint64_t( 1 ) << index ) - 1 ) );
+				}
+			}
+
+			return maximum();
+		}
+
+		/**
+		 * Record a latency.
+		 * @param latency The latency to record; negative latencies are recorded as zero.
+		 */
+		void record(
+			std::chrono::nanoseconds latency )
+		{
+			uint64_t value = ( 0 < latency.count() ) ? static_cast< uint64_t >( latency.count() ) : 0;
+			size_t bucket = 0;
+			uint64_t maximum = mMaximum.load( std::memory_order_relaxed );
+
+			while ( ( bucket < BucketCount - 1 ) and ( ( uint64_t( 1 ) << bucket ) <= value ) )
+			{
+				++bucket;
+			}
+
+			mBuckets[ bucket ].fetch_add( 1, std::memory_order_relaxed );
+			mCount.fetch_add( 1, std::memory_order_relaxed );
+			mTotal.fetch_add( value, std::memory_order_relaxed );
+
+			while ( ( maximum < value ) and ( not mMaximum.compare_exchange_weak( maximum, value, std::memory_order_relaxed ) ) )
+			{
+			}
+		}
+
+		/**
+		 * Empty the histogram.
+		 */
+		void reset()
+		{
+			for ( size_t index( -1 ); ++index < BucketCount; )
+			{
+				mBuckets[ index ].store( 0, std::memory_order_relaxed );
+			}
+
+			mCount.store( 0, std::memory_order_relaxed );
+			mMaximum.store( 0, std::memory_order_relaxed );
+			mTotal.store( 0, std::memory_order_relaxed );
+		}
+	};
+
+private:
+	std::atomic< uint64_t > mPreSpawns;
+	std::atomic< uint64_t > mSpawns;
+	std::atomic< uint64_t > mExecFailures;
+	std::atomic< uint64_t > mFirstOutputs;
+	std::atomic< uint64_t > mExits;
+	std::atomic< uint64_t > mFailedExits; // Exits with a non-zero status
+	Histogram mSpawnLatency; // Pre-spawn to spawned; the overhead of the Command itself
+	Histogram mFirstOutputLatency; // Launch to first output
+	Histogram mRunTime; // Launch to exit
+
+public:
+	/**
+	 * Default constructor to zeroed statistics.
+	 */
+	TraceStatistics()
+	{
+		reset();
+	}
+
+	/**
+	 * Get the number of children that could not be launched.
+	 * @return The count is returned.
+	 */
+	uint64_t execFailures() const
+	{
+		return mExecFailures.load( std::memory_order_relaxed );
+	}
+
+	/**
+	 * Get the number of children reaped.
+	 * @return The count is returned.
+	 */
+	uint64_t exits() const
+	{
+		return mExits.load( std::memory_order_relaxed );
+	}
+
+	/**
+	 * Get the number of children reaped with a non-zero exit status.
+	 * @return The count is returned.
+	 */
+	uint64_t failedExits() const
+	{
+		return mFailedExits.load( std::memory_order_relaxed );
+	}
+
+	/**
+	 * Get the latencies from launch to the first output read by the parent.
+	 * @return A reference to the histogram is returned.
+	 */
+	const Histogram& firstOutputLatency() const
+	{
+		return mFirstOutputLatency;
+	}
+
+	/**
+	 * Get the number of children whose output was first read by the parent.
+	 * @return The count is returned.
+	 */
+	uint64_t firstOutputs() const
+	{
+		return mFirstOutputs.load( std::memory_order_relaxed );
+	}
+
+	/**
+	 * Get every counter and a summary of every histogram as one JSON object,
+	 * for results to be compared across runs by a machine; such as those of
+	 * a benchmark launching a child or a pipeline over and over.
+	 * @return The JSON text of the statistics is returned.
+	 */
+	std::string json() const
+	{
+		return "{\"preSpawns\":" + std::to_string( preSpawns() )
+			+ ",\"spawns\":" + std::to_string( spawns() )
+			+ ",\"execFailures\":" + std::to_string( execFailures() )
+			+ ",\"firstOutputs\":" + std::to_string( firstOutputs() )
+			+ ",\"exits\":" + std::to_string( exits() )
+			+ ",\"failedExits\":" + std::to_string( failedExits() )
+			+ ",\"spawnLatency\":" + mSpawnLatency.json()
+			+ ",\"firstOutputLatency\":" + mFirstOutputLatency.json()
+			+ ",\"runTime\":" + mRunTime.json() + "}";
+	}
+
+	/**
+	 * Record an event.
+	 * @param record The event and its details.
+	 */
+	void onEvent(
+		const Record& record ) override
+	{
+		switch ( record.event )
+		{
+			case Event::PreSpawn:
+				mPreSpawns.fetch_add( 1, std::memory_order_relaxed );
+				break;
+
+			case Event::Spawned:
+				mSpawns.fetch_add( 1, std::memory_order_relaxed );
+				mSpawnLatency.record( record.latency );
+				break;
+
+			case Event::ExecFailed:
+				mExecFailures.fetch_add( 1, std::memory_order_relaxed );
+				break;
+
+			case Event::FirstOutput:
+				mFirstOutputs.fetch_add( 1, std::memory_order_relaxed );
+				mFirstOutputLatency.record( record.latency );
+				break;
+
+			case Event::Exit:
+				mExits.fetch_add( 1, std::memory_order_relaxed );
+				mRunTime.record( record.latency );
+
+				if ( 0 != record.value )
+				{
+					mFailedExits.fetch_add( 1, std::memory_order_relaxed );
+				}
+				break;
+		}
+	}
+
+	/**
+	 * Get the number of Commands about to be launched.
+	 * @return The count is returned.
+	 */
+	uint64_t preSpawns() const
+	{
+		return mPreSpawns.load( std::memory_order_relaxed );
+	}
+
+	/**
+	 * Zero every counter and histogram.
+	 */
+	void reset()
+	{
+		mPreSpawns.store( 0, std::memory_order_relaxed );
+		mSpawns.store( 0, std::memory_order_relaxed );
+		mExecFailures.store( 0, std::memory_order_relaxed );
+		mFirstOutputs.store( 0, std::memory_order_relaxed );
+		mExits.store( 0, std::memory_order_relaxed );
+		mFailedExits.store( 0, std::memory_order_relaxed );
+		mSpawnLatency.reset();
+		mFirstOutputLatency.reset();
+		mRunTime.reset();
+	}
+
+	/**
+	 * Get the run times of the children, from launch to exit.
+	 * @return A reference to the histogram is returned.
+	 */
+	const Histogram& runTime() const
+	{
+		return mRunTime;
+	}
+
+	/**
+	 * Get the latencies from pre-spawn to spawned; the time spent by the
+	 * Command building the log paths, environment and PATH resolution, and
+	 * launching the child.
+	 * @return A reference to the histogram is returned.
+	 */
+	const Histogram& spawnLatency() const
+	{
+		return mSpawnLatency;
+	}
+
+	/**
+	 * Get the number of children launched.
+	 * @return The count is returned.
+	 */
+	uint64_t spawns() const
+	{
+		return mSpawns.load( std::memory_order_relaxed );
+	}
+};
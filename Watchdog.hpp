@@ -0,0 +1,171 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <signal.h>
+#include <thread>
+
+#include "ChildProcess.hpp"
+#include "TerminationPolicy.hpp"
+
+/**
+ * A process wide service that terminates children at a deadline, from a
+ * single thread: the timeouts of Commands, and the SIGKILL that follows
+ * the grace period of a TerminationPolicy.
+ *
+ * Only weak references to the children are kept, so a child reaped
+ * before its deadline costs nothing more than its entry. Signals go
+ * through ChildProcess::sendSignal(), and never reach a reaped child.
+ * The thread is only started on the first schedule().
+ */
+class Watchdog
+{
+private:
+	// A termination due at a deadline
+	struct Alarm
+	{
+		std::weak_ptr< ChildProcess > childProcess;
+		TerminationPolicy terminationPolicy;
+	};
+
+	std::mutex mMutex;
+	std::condition_variable mCondition; // Signalled upon a new earliest deadline and shutdown
+	std::multimap< std::chrono::steady_clock::time_point, Alarm > mAlarms; // By deadline
+	std::thread mThread;
+	bool mStop;
+
+	Watchdog()
+	{
+		mStop = false;
+	}
+
+	// The watchdog loop
+	void _run()
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		while ( not mStop )
+		{
+			if ( mAlarms.empty() )
+			{
+				mCondition.wait( lock );
+				continue;
+			}
+
+			auto alarm = mAlarms.begin();
+
+			if ( std::chrono::steady_clock::now() < alarm->first )
+			{
+				mCondition.wait_until( lock, alarm->first );
+				continue;
+			}
+
+			std::shared_ptr< ChildProcess > childProcess = alarm->second.childProcess.lock();
+			TerminationPolicy terminationPolicy = alarm->second.terminationPolicy;
+
+			mAlarms.erase( alarm );
+
+			if ( nullptr != childProcess )
+			{
+				// Without the lock, as an escalation is scheduled from here
+				lock.unlock();
+				terminate( childProcess, terminationPolicy );
+				childProcess.reset();
+				lock.lock();
+			}
+		}
+	}
+
+public:
+	Watchdog( const Watchdog& ) = delete;
+	Watchdog& operator=( const Watchdog& ) = delete;
+
+	/**
+	 * Destructor to stop the watchdog thread.
+	 * Pending terminations are dropped.
+	 */
+	~Watchdog()
+	{
+		{
+			std::lock_guard< std::mutex > lock( mMutex );
+
+			if ( not mThread.joinable() )
+			{
+				return;
+			}
+
+			mStop = true;
+			mCondition.notify_one();
+		}
+
+		mThread.join();
+	}
+
+	/**
+	 * Get the process wide watchdog.
+	 * @return A reference to the Watchdog is returned.
+	 */
+	static Watchdog& instance()
+	{
+		static Watchdog Instance;
+		return Instance;
+	}
+
+	/**
+	 * Terminate a child at a deadline, unless it has been reaped by then.
+	 * @param childProcess The child process to terminate.
+	 * @param deadline When to terminate the child.
+	 * @param terminationPolicy How to terminate the child.
+	 */
+	void schedule(
+		const std::shared_ptr< ChildProcess >& childProcess,
+		std::chrono::steady_clock::time_point deadline,
+		const TerminationPolicy& terminationPolicy )
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+
+		if ( not mThread.joinable() )
+		{
+			mThread = std::thread( &Watchdog::_run, this );
+		}
+
+		auto alarm = mAlarms.emplace( deadline, Alarm{ childProcess, terminationPolicy } );
+
+		// Only a new earliest deadline changes how long the loop sleeps for
+		if ( mAlarms.begin() == alarm )
+		{
+			mCondition.notify_one();
+		}
+	}
+
+	/**
+	 * Terminate a child now: send the signal of the policy, and schedule
+	 * SIGKILL for the end of its grace period.
+	 * @param childProcess The child process to terminate.
+	 * @param terminationPolicy How to terminate the child.
+	 * @return Zero is returned on success, else a negative error code is returned;
+	 *         -ESRCH should the child have already been reaped.
+	 */
+	static int terminate(
+		const std::shared_ptr< ChildProcess >& childProcess,
+		const TerminationPolicy& terminationPolicy )
+	{
+		int errorCode = childProcess->sendSignal( terminationPolicy.signalNumber, terminationPolicy.processGroup );
+
+		if ( ( 0 == errorCode ) and ( 0 < terminationPolicy.gracePeriod.count() ) and ( SIGKILL != terminationPolicy.signalNumber ) )
+		{
+			instance().schedule( childProcess, std::chrono::steady_clock::now() + terminationPolicy.gracePeriod,
+				TerminationPolicy( SIGKILL, std::chrono::nanoseconds( 0 ), terminationPolicy.processGroup ) );
+		}
+
+		return errorCode;
+	}
+};
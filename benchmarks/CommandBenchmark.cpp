@@ -0,0 +1,386 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+
+/**
+ * Benchmarks of launching and waiting on children, and of moving data
+ * through pipelines. Each benchmark prints one JSON object on a line of its
+ * own: its parameters, the wall clock time of the run and the TraceStatistics
+ * gathered over it; so that runs are compared by a machine, across changes
+ * and across hosts.
+ *
+ * Every run makes a fixed number of iterations, after a tenth as many that
+ * are not measured, so that the page cache, the ExecutableCache and the
+ * children of the ChildReaper are warm; results of a quiet host repeat.
+ *
+ * The spawn.backend benchmarks launch through each SpawnBackend, and by the
+ * vfork(2) and fork(2) with execv(2) that Command used before SpawnPlan, as
+ * references; with the parent small, and again with a GiB of it resident,
+ * to weigh whatever each copies of the parent. The references are not
+ * traced, so only their wall times are of note.
+ *
+ * The pipeline benchmarks run a chain of cat(1), and a gzip(1) between two
+ * stages, with the pipe buffers of the kernel default and again enlarged
+ * by setPipeBufferSize(); the throughput is of the bytes into the pipeline.
+ *
+ *     command_benchmark [--iterations N] [--list] [name prefix ...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "CaptureBuffer.hpp"
+#include "Command.hpp"
+#include "CommandPipeline.hpp"
+#include "CommandTrace.hpp"
+#include "SpawnServer.hpp"
+
+namespace
+{
+
+// Bytes moved through every pipeline benchmark
+constexpr uint64_t PipelineBytes = 64 * 1024 * 1024;
+
+// Bytes of the parent resident for the large parent spawn.backend benchmarks
+constexpr size_t LargeResidentBytes = size_t( 1024 ) * 1024 * 1024;
+
+struct Benchmark
+{
+	std::string name;
+	std::string parameters; // JSON members describing the benchmark, without the braces
+	unsigned iterations; // By default
+	std::function< uint64_t( unsigned ) > run; // Runs the iterations; the bytes moved are returned
+	size_t residentBytes = 0; // Touched by the parent for the run, to weigh copying its page tables
+};
+
+// Stop the benchmarks should a child not run as expected; the results would be meaningless.
+void _check(
+	bool condition,
+	const std::string& name,
+	const char* what )
+{
+	if ( not condition )
+	{
+		fprintf( stderr, "%s: %s\n", name.c_str(), what );
+		exit( EXIT_FAILURE );
+	}
+}
+
+// Launch and wait on a Command, over and over.
+std::function< uint64_t( unsigned ) > _spawn(
+	const std::string& name,
+	Command command )
+{
+	return [ name, command ]( unsigned iterations ) mutable
+	{
+		for ( unsigned iteration( -1 ); ++iteration < iterations; )
+		{
+			_check( 0 == command.executeAndWait(), name, "the child failed" );
+		}
+
+		return uint64_t( 0 );
+	};
+}
+
+// Launch /bin/true as Command did before SpawnPlan, by {@param launch} (vfork or fork)
+// and execv(2), and wait on it with waitpid(2); the reference for the backends.
+std::function< uint64_t( unsigned ) > _reference(
+	const std::string& name,
+	pid_t ( *launch )() )
+{
+	return [ name, launch ]( unsigned iterations )
+	{
+		char* const arguments[] = { const_cast< char* >( "/bin/true" ), nullptr };
+
+		for ( unsigned iteration( -1 ); ++iteration < iterations; )
+		{
+			int status = 0;
+			pid_t processID = launch();
+
+			if ( 0 == processID )
+			{
+				execv( arguments[ 0 ], arguments );
+				_exit( 127 );
+			}
+
+			_check( ( 0 < processID ) and ( processID == waitpid( processID, &status, 0 ) ) and ( 0 == status ),
+				name, "the child failed" );
+		}
+
+		return uint64_t( 0 );
+	};
+}
+
+// Launch and wait on /bin/true from several threads at once, each with a Command of its own.
+std::function< uint64_t( unsigned ) > _concurrentWaiters(
+	const std::string& name,
+	unsigned threadCount )
+{
+	return [ name, threadCount ]( unsigned iterations )
+	{
+		std::vector< std::thread > threads;
+
+		for ( unsigned index( -1 ); ++index < threadCount; )
+		{
+			// The iterations are shared out, the first threads taking any left over
+			unsigned share = iterations / threadCount + ( ( index < iterations % threadCount ) ? 1 : 0 );
+
+			threads.emplace_back( [ name, share ]()
+			{
+				Command command( "/bin/true" );
+
+				for ( unsigned iteration( -1 ); ++iteration < share; )
+				{
+					_check( 0 == command.executeAndWait(), name, "the child failed" );
+				}
+			} );
+		}
+
+		for ( std::thread& thread : threads )
+		{
+			thread.join();
+		}
+
+		return uint64_t( 0 );
+	};
+}
+
+// Move PipelineBytes of /dev/zero from head(1) through cat(1) stages into wc(1), which counts them.
+std::function< uint64_t( unsigned ) > _pipeline(
+	const std::string& name,
+	unsigned stageCount,
+	size_t pipeBufferSize )
+{
+	return [ name, stageCount, pipeBufferSize ]( unsigned iterations )
+	{
+		std::shared_ptr< CaptureBuffer > counted = std::make_shared< CaptureBuffer >();
+		CommandPipeline pipeline;
+
+		pipeline.appendCommand( Command( "head", { "-c", std::to_string( PipelineBytes ), "/dev/zero" } ) );
+
+		for ( unsigned index( 2 ); index < stageCount; ++index )
+		{
+			pipeline.appendCommand( Command( "cat" ) );
+		}
+
+		pipeline.appendCommand( Command( "wc", { "-c" } ).captureStdout( counted ) );
+		pipeline.setPipeBufferSize( pipeBufferSize );
+
+		for ( unsigned iteration( -1 ); ++iteration < iterations; )
+		{
+			_check( 0 == pipeline.executeAndWait(), name, "a stage failed" );
+			_check( PipelineBytes == strtoull( counted->str().c_str(), nullptr, 10 ), name, "bytes were lost" );
+		}
+
+		return PipelineBytes * iterations;
+	};
+}
+
+// Compress PipelineBytes of /dev/zero from head(1) by gzip(1) into wc(1),
+// the bytes through the first pipe outnumbering those through the second.
+std::function< uint64_t( unsigned ) > _compression(
+	const std::string& name,
+	size_t pipeBufferSize )
+{
+	return [ name, pipeBufferSize ]( unsigned iterations )
+	{
+		std::shared_ptr< CaptureBuffer > counted = std::make_shared< CaptureBuffer >();
+		CommandPipeline pipeline;
+
+		pipeline.appendCommand( Command( "head", { "-c", std::to_string( PipelineBytes ), "/dev/zero" } ) );
+		pipeline.appendCommand( Command( "gzip", { "-1" } ) );
+		pipeline.appendCommand( Command( "wc", { "-c" } ).captureStdout( counted ) );
+		pipeline.setPipeBufferSize( pipeBufferSize );
+
+		for ( unsigned iteration( -1 ); ++iteration < iterations; )
+		{
+			_check( 0 == pipeline.executeAndWait(), name, "a stage failed" );
+			_check( 0 != strtoull( counted->str().c_str(), nullptr, 10 ), name, "nothing was compressed" );
+		}
+
+		return PipelineBytes * iterations;
+	};
+}
+
+std::vector< Benchmark > _benchmarks()
+{
+	std::vector< Benchmark > benchmarks;
+	Command largeEnvironment( "/bin/true" );
+	unsigned threadCount = std::max( 2u, std::min( 16u, std::thread::hardware_concurrency() ) );
+
+	for ( unsigned index( -1 ); ++index < 512; )
+	{
+		largeEnvironment.setEnvironmentVariable( "BENCHMARK_VARIABLE_" + std::to_string( index ), std::string( 64, 'x' ) );
+	}
+
+	benchmarks.push_back( { "spawn.absolutePath", "\"application\":\"/bin/true\"", 500,
+		_spawn( "spawn.absolutePath", Command( "/bin/true" ) ) } );
+	benchmarks.push_back( { "spawn.pathLookup", "\"application\":\"true\"", 500,
+		_spawn( "spawn.pathLookup", Command( "true" ) ) } );
+	benchmarks.push_back( { "spawn.largeEnvironment", "\"application\":\"/bin/true\",\"variables\":512", 500,
+		_spawn( "spawn.largeEnvironment", largeEnvironment ) } );
+	benchmarks.push_back( { "waiters.concurrent", "\"threads\":" + std::to_string( threadCount ), 1000,
+		_concurrentWaiters( "waiters.concurrent", threadCount ) } );
+
+	for ( size_t residentBytes : { size_t( 0 ), LargeResidentBytes } )
+	{
+		std::string suffix = ( 0 == residentBytes ) ? "" : ".largeParent";
+		std::string resident = ",\"residentBytes\":" + std::to_string( residentBytes );
+		unsigned count = ( 0 == residentBytes ) ? 500 : 100;
+		std::vector< std::pair< std::string, SpawnBackend > > backends = {
+			{ "posixSpawn", SpawnBackend::PosixSpawn }, { "clone3", SpawnBackend::Clone3 } };
+
+		if ( SpawnServer::instance().running() )
+		{
+			backends.push_back( { "spawnServer", SpawnBackend::SpawnServer } );
+		}
+
+		for ( const auto& backend : backends )
+		{
+			std::string name = "spawn.backend." + backend.first + suffix;
+
+			benchmarks.push_back( { name, "\"backend\":\"" + backend.first + "\"" + resident, count,
+				_spawn( name, Command( "/bin/true" ).setSpawnBackend( backend.second ) ), residentBytes } );
+		}
+
+		benchmarks.push_back( { "spawn.backend.referenceVfork" + suffix, "\"backend\":\"vfork\"" + resident, count,
+			_reference( "spawn.backend.referenceVfork" + suffix, &vfork ), residentBytes } );
+		benchmarks.push_back( { "spawn.backend.referenceFork" + suffix, "\"backend\":\"fork\"" + resident, count,
+			_reference( "spawn.backend.referenceFork" + suffix, &fork ), residentBytes } );
+	}
+
+	// Zero for the kernel default; the larger are clamped to /proc/sys/fs/pipe-max-size
+	for ( size_t pipeBufferSize : { size_t( 0 ), size_t( 256 * 1024 ), size_t( 1024 * 1024 ) } )
+	{
+		std::string suffix = ( 0 == pipeBufferSize ) ? "" : ".pipe" + std::to_string( pipeBufferSize / 1024 ) + "k";
+		std::string sizes = ",\"bytes\":" + std::to_string( PipelineBytes ) + ",\"pipeBufferSize\":" + std::to_string( pipeBufferSize );
+
+		for ( unsigned stageCount : { 2u, 4u, 8u } )
+		{
+			std::string name = "pipeline.stages" + std::to_string( stageCount ) + suffix;
+
+			benchmarks.push_back( { name, "\"stages\":" + std::to_string( stageCount ) + sizes,
+				10, _pipeline( name, stageCount, pipeBufferSize ) } );
+		}
+
+		benchmarks.push_back( { "pipeline.gzip" + suffix, "\"stages\":3" + sizes,
+			10, _compression( "pipeline.gzip" + suffix, pipeBufferSize ) } );
+	}
+
+	return benchmarks;
+}
+
+// Determine if a benchmark is selected by the name prefixes given, every benchmark if none are.
+bool _isSelected(
+	const std::string& name,
+	const std::vector< std::string >& prefixes )
+{
+	if ( prefixes.empty() )
+	{
+		return true;
+	}
+
+	for ( const std::string& prefix : prefixes )
+	{
+		if ( 0 == name.compare( 0, prefix.size(), prefix ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // namespace
+
+int main(
+	int argc,
+	char** argv )
+{
+	unsigned iterations = 0; // Zero for the default of each benchmark
+	bool list = false;
+	std::vector< std::string > prefixes;
+
+	for ( int index( 0 ); ++index < argc; )
+	{
+		if ( ( 0 == strcmp( "--iterations", argv[ index ] ) ) and ( index + 1 < argc ) )
+		{
+			iterations = static_cast< unsigned >( strtoul( argv[ ++index ], nullptr, 10 ) );
+		}
+		else if ( 0 == strcmp( "--list", argv[ index ] ) )
+		{
+			list = true;
+		}
+		else
+		{
+			prefixes.emplace_back( argv[ index ] );
+		}
+	}
+
+	// Forked while the process is still small and single threaded
+	if ( 0 != SpawnServer::instance().start() )
+	{
+		fprintf( stderr, "The spawn server could not be started; spawn.backend.spawnServer is skipped\n" );
+	}
+
+	for ( Benchmark& benchmark : _benchmarks() )
+	{
+		if ( not _isSelected( benchmark.name, prefixes ) )
+		{
+			continue;
+		}
+
+		if ( list )
+		{
+			printf( "%s\n", benchmark.name.c_str() );
+			continue;
+		}
+
+		unsigned count = ( 0 == iterations ) ? benchmark.iterations : iterations;
+		TraceStatistics& statistics = CommandTrace::instance().statistics();
+
+		std::unique_ptr< char[] > resident( ( 0 == benchmark.residentBytes ) ? nullptr : new char[ benchmark.residentBytes ] );
+
+		// A byte of every page, so that each is mapped
+		for ( size_t offset( 0 ); offset < benchmark.residentBytes; offset += 4096 )
+		{
+			static_cast< volatile char* >( resident.get() )[ offset ] = 1;
+		}
+
+		benchmark.run( std::max( 1u, count / 10 ) );
+		statistics.reset();
+
+		auto start = std::chrono::steady_clock::now();
+		uint64_t bytes = benchmark.run( count );
+		auto wallTime = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start );
+
+		printf( "{\"benchmark\":\"%s\",%s,\"iterations\":%u,\"wallNs\":%lld,\"perIterationNs\":%lld",
+			benchmark.name.c_str(), benchmark.parameters.c_str(), count,
+			static_cast< long long >( wallTime.count() ), static_cast< long long >( wallTime.count() / count ) );
+
+		if ( 0 != bytes )
+		{
+			printf( ",\"bytesPerSecond\":%.0f", static_cast< double >( bytes ) * 1e9 / static_cast< double >( wallTime.count() ) );
+		}
+
+		printf( ",\"statistics\":%s}\n", statistics.json().c_str() );
+		fflush( stdout );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+
+/**
+ * Tests of the CommandGraph, each running real processes: a diamond fanned
+ * out through a PipeTee and in again on numbered descriptors or /dev/fd
+ * paths, branches that must run concurrently, a cycle rejected before any
+ * stage is started, and a failing stage tearing down its siblings.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "CaptureBuffer.hpp"
+#include "Command.hpp"
+#include "CommandGraph.hpp"
+
+namespace
+{
+
+unsigned gFailures = 0;
+
+// Count a failure, should {@param condition} not hold.
+void _expect(
+	bool condition,
+	const char* test,
+	const std::string& what )
+{
+	if ( not condition )
+	{
+		fprintf( stderr, "%s: %s\n", test, what.c_str() );
+		++gFailures;
+	}
+}
+
+// Wall clock milliseconds since {@param start}.
+long long _elapsed(
+	std::chrono::steady_clock::time_point start )
+{
+	return std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now() - start ).count();
+}
+
+// One source teed into two sorts, joined again by paste(1) reading /dev/fd paths.
+void _testDiamondByPath()
+{
+	std::shared_ptr< CaptureBuffer > merged = std::make_shared< CaptureBuffer >();
+	CommandGraph graph;
+
+	graph.addStage( "source", Command( "printf", { "b\\na\\nc\\n" } ) )
+		.addStage( "ascending", Command( "sort" ) )
+		.addStage( "descending", Command( "sort", { "-r" } ) )
+		.addStage( "merge", Command( "paste" ).captureStdout( merged ) )
+		.connect( "source", "ascending" )
+		.connect( "source", "descending" )
+		.connectAsArgument( "ascending", "merge" )
+		.connectAsArgument( "descending", "merge" );
+
+	int exitStatus = graph.executeAndWait();
+
+	_expect( 0 == exitStatus, "diamond by path", "exit status " + std::to_string( exitStatus ) );
+	_expect( "a\tc\nb\tb\nc\ta\n" == merged->str(), "diamond by path", "merged " + merged->str() );
+}
+
+// One source teed into two filters, joined again on descriptors 3 and 4 of the consumer.
+void _testDiamondByDescriptor()
+{
+	std::shared_ptr< CaptureBuffer > merged = std::make_shared< CaptureBuffer >();
+	CommandGraph graph;
+
+	graph.addStage( "source", Command( "printf", { "one\\ntwo\\nthree\\n" } ) )
+		.addStage( "first", Command( "head", { "-n", "1" } ) )
+		.addStage( "last", Command( "tail", { "-n", "1" } ) )
+		.addStage( "merge", Command( "sh", { "-c", "cat <&3; cat <&4" } ).captureStdout( merged ) )
+		.connect( "source", "first" )
+		.connect( "source", "last" )
+		.connect( "first", "merge", 3 )
+		.connect( "last", "merge", 4 );
+
+	int exitStatus = graph.executeAndWait();
+
+	_expect( 0 == exitStatus, "diamond by descriptor", "exit status " + std::to_string( exitStatus ) );
+	_expect( "one\nthree\n" == merged->str(), "diamond by descriptor", "merged " + merged->str() );
+}
+
+// Two branches each sleeping half a second are joined in about as long, not twice as long.
+void _testConcurrentBranches()
+{
+	std::shared_ptr< CaptureBuffer > merged = std::make_shared< CaptureBuffer >();
+	CommandGraph graph;
+
+	graph.addStage( "left", Command( "sh", { "-c", "sleep 0.5; echo left" } ) )
+		.addStage( "right", Command( "sh", { "-c", "sleep 0.5; echo right" } ) )
+		.addStage( "merge", Command( "paste" ).captureStdout( merged ) )
+		.connectAsArgument( "left", "merge" )
+		.connectAsArgument( "right", "merge" );
+
+	auto start = std::chrono::steady_clock::now();
+	int exitStatus = graph.executeAndWait();
+	long long elapsed = _elapsed( start );
+
+	_expect( 0 == exitStatus, "concurrent branches", "exit status " + std::to_string( exitStatus ) );
+	_expect( "left\tright\n" == merged->str(), "concurrent branches", "merged " + merged->str() );
+	_expect( 900 > elapsed, "concurrent branches", "took " + std::to_string( elapsed ) + " ms" );
+}
+
+// A cycle is refused by execute() with no stage started.
+void _testCycle()
+{
+	CommandGraph graph;
+
+	graph.addStage( "first", Command( "cat" ) )
+		.addStage( "second", Command( "cat" ) )
+		.addStage( "third", Command( "cat" ) )
+		.connect( "first", "second" )
+		.connect( "second", "third" )
+		.connect( "third", "first" );
+
+	int errorCode = graph.execute();
+
+	_expect( -EINVAL == errorCode, "cycle", "execute returned " + std::to_string( errorCode ) );
+	_expect( not graph.isRunning(), "cycle", "a stage is running" );
+	_expect( graph.stageResults().empty(), "cycle", "a stage was started" );
+}
+
+// A failing stage has the stages still running terminated, not waited out.
+void _testTearDown()
+{
+	CommandGraph graph;
+
+	graph.addStage( "source", Command( "sleep", { "30" } ) )
+		.addStage( "sibling", Command( "sleep", { "30" } ) )
+		.addStage( "failing", Command( "sh", { "-c", "sleep 0.2; exit 3" } ) )
+		.addStage( "consumer", Command( "cat" ) )
+		.connect( "source", "consumer" )
+		.connect( "failing", "consumer", 3 );
+
+	auto start = std::chrono::steady_clock::now();
+	int exitStatus = graph.executeAndWait();
+	long long elapsed = _elapsed( start );
+	std::vector< CommandGraph::StageResult > results = graph.stageResults();
+
+	_expect( 3 == exitStatus, "tear down", "exit status " + std::to_string( exitStatus ) );
+	_expect( 10000 > elapsed, "tear down", "took " + std::to_string( elapsed ) + " ms" );
+	_expect( 4 == results.size(), "tear down", std::to_string( results.size() ) + " results" );
+
+	if ( 4 == results.size() )
+	{
+		_expect( 3 == results[ graph.stageIndex( "failing" ) ].exitStatus, "tear down", "the failing stage is misreported" );
+		_expect( not results[ graph.stageIndex( "failing" ) ].tornDown, "tear down", "the failing stage was torn down" );
+
+		for ( const char* name : { "source", "sibling", "consumer" } )
+		{
+			_expect( results[ graph.stageIndex( name ) ].tornDown, "tear down", std::string( name ) + " was not torn down" );
+		}
+	}
+
+	_expect( not graph.isRunning(), "tear down", "a stage is running" );
+}
+
+} // namespace
+
+int main()
+{
+	_testDiamondByPath();
+	_testDiamondByDescriptor();
+	_testConcurrentBranches();
+	_testCycle();
+	_testTearDown();
+
+	if ( 0 != gFailures )
+	{
+		fprintf( stderr, "%u failures\n", gFailures );
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+
+/**
+ * Tests of a Command shared between threads, each running real processes:
+ * concurrent executes of which only one launches, a terminate landing in the
+ * launch delivered once the child exists, several threads waiting on and
+ * polling the one child, and a missing binary reported as such.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Command.hpp"
+#include "SpawnPlan.hpp"
+
+namespace
+{
+
+constexpr size_t NumberThreads = 8;
+
+unsigned gFailures = 0;
+
+// Count a failure, should {@param condition} not hold.
+void _expect(
+	bool condition,
+	const char* test,
+	const std::string& what )
+{
+	if ( not condition )
+	{
+		fprintf( stderr, "%s: %s\n", test, what.c_str() );
+		++gFailures;
+	}
+}
+
+// Wall clock milliseconds since {@param start}.
+long long _elapsed(
+	std::chrono::steady_clock::time_point start )
+{
+	return std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Of threads executing one command at once, one launches it; the others lose with -ECANCELED.
+void _testConcurrentExecute()
+{
+	Command command( "sleep", { "0.5" } );
+	std::atomic< bool > go( false );
+	std::atomic< size_t > launched( 0 );
+	std::atomic< size_t > cancelled( 0 );
+	std::vector< std::thread > threads;
+
+	for ( size_t index( -1 ); ++index < NumberThreads; )
+	{
+		threads.emplace_back( [ & ]()
+		{
+			while ( not go.load() )
+			{
+			}
+
+			int errorCode = command.execute();
+
+			if ( 0 == errorCode )
+			{
+				++launched;
+			}
+			else if ( -ECANCELED == errorCode )
+			{
+				++cancelled;
+			}
+		} );
+	}
+
+	go.store( true );
+
+	for ( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+
+	_expect( 1 == launched.load(), "concurrent execute", std::to_string( launched.load() ) + " launched" );
+	_expect( ( NumberThreads - 1 ) == cancelled.load(), "concurrent execute", std::to_string( cancelled.load() ) + " cancelled" );
+
+	int exitStatus = command.wait();
+	_expect( 0 == exitStatus, "concurrent execute", "exit status " + std::to_string( exitStatus ) );
+}
+
+// A terminate requested while another thread is launching the command is
+// delivered once the child exists, rather than lost to the launch. The launch
+// is held in Spawning by its stdin being a FIFO, the opening of which blocks
+// until the FIFO has a writer.
+void _testTerminateDuringSpawn()
+{
+	char directoryPath[] = "/tmp/CommandTest.XXXXXX";
+
+	if ( nullptr == mkdtemp( directoryPath ) )
+	{
+		_expect( false, "terminate during spawn", "mkdtemp failed" );
+		return;
+	}
+
+	std::string fifoPath = std::string( directoryPath ) + "/stdin";
+	Command command( "sleep", { "30" } );
+	int errorCode = 0;
+
+	_expect( 0 == mkfifo( fifoPath.c_str(), 0600 ), "terminate during spawn", "mkfifo failed" );
+	command.setStdinFromFile( fifoPath );
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread launcher( [ & ]() { errorCode = command.execute(); } );
+
+	// A command is reported running from the start of its launch
+	while ( not command.isRunning() )
+	{
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+
+	int terminateCode = command.terminate();
+	int writer = open( fifoPath.c_str(), O_WRONLY | O_CLOEXEC );
+
+	launcher.join();
+
+	int exitStatus = command.wait();
+	long long elapsed = _elapsed( start );
+
+	close( writer );
+	unlink( fifoPath.c_str() );
+	rmdir( directoryPath );
+
+	_expect( 0 == terminateCode, "terminate during spawn", "terminate " + std::to_string( terminateCode ) );
+	_expect( 0 == errorCode, "terminate during spawn", "execute " + std::to_string( errorCode ) );
+	_expect( ( 128 + SIGTERM ) == exitStatus, "terminate during spawn", "exit status " + std::to_string( exitStatus ) );
+	_expect( 10000 > elapsed, "terminate during spawn", "took " + std::to_string( elapsed ) + " ms" );
+}
+
+// Threads waiting on and polling the one child all see it run and exit, with its status.
+void _testConcurrentWait()
+{
+	Command command( "sh", { "-c", "sleep 0.3; exit 3" } );
+	std::atomic< size_t > exited( 0 );
+	std::vector< std::thread > threads;
+
+	int errorCode = command.execute();
+	_expect( 0 == errorCode, "concurrent wait", "execute " + std::to_string( errorCode ) );
+	_expect( command.isRunning(), "concurrent wait", "not running once executed" );
+
+	for ( size_t index( -1 ); ++index < NumberThreads; )
+	{
+		threads.emplace_back( [ &, index ]()
+		{
+			int exitStatus;
+
+			// Half wait on the child, half poll it
+			if ( 0 == ( index % 2 ) )
+			{
+				exitStatus = command.wait();
+			}
+			else
+			{
+				while ( command.isRunning() )
+				{
+					std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+				}
+
+				exitStatus = command.exitStatus();
+			}
+
+			if ( 3 == exitStatus )
+			{
+				++exited;
+			}
+		} );
+	}
+
+	for ( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+
+	_expect( NumberThreads == exited.load(), "concurrent wait", std::to_string( exited.load() ) + " saw exit status 3" );
+	_expect( not command.isRunning(), "concurrent wait", "still running" );
+	_expect( 3 == command.wait(), "concurrent wait", "a later wait lost the exit status" );
+}
+
+// A binary that does not exist fails to launch with -ENOENT, rather than
+// exiting 127; at the exec where the backend can tell, as clone(2) can but
+// posix_spawn(3) cannot.
+void _testMissingBinary(
+	const char* test,
+	SpawnBackend backend,
+	SpawnStage expected )
+{
+	Command command( "/nonexistent/binary" );
+
+	command.setSpawnBackend( backend );
+
+	int errorCode = command.execute();
+
+	_expect( -ENOENT == errorCode, test, "execute " + std::to_string( errorCode ) );
+	_expect( expected == command.failedSpawnStage(), test, "failed at stage "
+		+ std::to_string( static_cast< int >( command.failedSpawnStage() ) ) );
+	_expect( not command.isRunning(), test, "running" );
+
+	// Left to be executed again
+	errorCode = command.execute();
+	_expect( -ENOENT == errorCode, test, "execute again " + std::to_string( errorCode ) );
+}
+
+} // namespace
+
+int main()
+{
+	_testConcurrentExecute();
+	_testTerminateDuringSpawn();
+	_testConcurrentWait();
+	_testMissingBinary( "missing binary posixSpawn", SpawnBackend::PosixSpawn, SpawnStage::Launch );
+	_testMissingBinary( "missing binary clone3", SpawnBackend::Clone3, SpawnStage::Exec );
+
+	if ( 0 != gFailures )
+	{
+		fprintf( stderr, "%u failures\n", gFailures );
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+
+/**
+ * Tests of the FileDescriptorPlan as applied by every SpawnBackend, the
+ * SpawnServer included; which is handed the descriptors of a plan over a
+ * socket, and receives them at numbers of its own choosing that a plan of
+ * 4>file; 5>&1 then collides with.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+#include "CaptureBuffer.hpp"
+#include "Command.hpp"
+#include "FileDescriptorPlan.hpp"
+#include "SpawnServer.hpp"
+
+namespace
+{
+
+// A descriptor of the parent left open on exec, for closeOthers() to close
+constexpr int LeakedFileDescriptor = 40;
+
+unsigned gFailures = 0;
+
+// Count a failure, should {@param actual} not be {@param expected}.
+void _expect(
+	const std::string& expected,
+	const std::string& actual,
+	const std::string& test )
+{
+	if ( expected != actual )
+	{
+		fprintf( stderr, "%s: expected [%s], got [%s]\n", test.c_str(), expected.c_str(), actual.c_str() );
+		++gFailures;
+	}
+}
+
+// The contents of the file at {@param filePath}.
+std::string _read(
+	const std::string& filePath )
+{
+	std::ifstream file( filePath );
+	return std::string( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
+}
+
+// Launch the script {@param script} by sh(1), through {@param backend} with {@param plan}.
+// @return The stdout of the child is returned, or its stderr if {@param captureStderr}.
+std::string _run(
+	SpawnBackend backend,
+	const FileDescriptorPlan& plan,
+	const std::string& script,
+	bool captureStderr = false )
+{
+	Command command( "sh", { "-c", script } );
+
+	command.setSpawnBackend( backend ).setFileDescriptorPlan( plan );
+
+	if ( captureStderr )
+	{
+		command.captureStderr();
+	}
+	else
+	{
+		command.captureStdout();
+	}
+
+	if ( 0 != command.executeAndWait() )
+	{
+		return "exit status " + std::to_string( command.exitStatus() );
+	}
+
+	return std::string( ( captureStderr ? command.capturedStderr() : command.capturedStdout() )->view() );
+}
+
+void _testBackend(
+	const std::string& name,
+	SpawnBackend backend,
+	const std::string& filePath )
+{
+	// A file and a copy of stdout on the numbers the SpawnServer receives descriptors at
+	std::string output = _run( backend, FileDescriptorPlan().redirectToFile( 4, filePath ).duplicate( 5, STDOUT_FILENO ),
+		"echo file >&4; echo stdout >&5" );
+
+	_expect( "stdout\n", output, name + " 4>file; 5>&1" );
+	_expect( "file\n", _read( filePath ), name + " 4>file; 5>&1 file" );
+
+	_expect( "out\nerr\n", _run( backend, FileDescriptorPlan().mergeStderrIntoStdout(), "echo out; echo err >&2" ),
+		name + " 2>&1" );
+
+	// Writing to a closed stdout fails, rather than going wherever the parent's stdout does
+	_expect( "failed\n", _run( backend, FileDescriptorPlan().close( STDOUT_FILENO ),
+		"echo lost 2>/dev/null || echo failed >&2", true ), name + " 1>&-" );
+
+	std::string probe = "[ -e /dev/fd/" + std::to_string( LeakedFileDescriptor ) + " ] && echo open || echo closed";
+
+	// The SpawnServer was forked before the descriptor was opened; its children are handed only those of the plan
+	if ( SpawnBackend::SpawnServer != backend )
+	{
+		_expect( "open\n", _run( backend, FileDescriptorPlan(), probe ), name + " inherited" );
+	}
+
+	_expect( "closed\n", _run( backend, FileDescriptorPlan().closeOthers(), probe ), name + " closeOthers" );
+}
+
+} // namespace
+
+int main()
+{
+	// Forked while the process is still small and single threaded
+	int errorCode = SpawnServer::instance().start();
+
+	if ( ( 0 != errorCode ) or not SpawnServer::instance().running() )
+	{
+		fprintf( stderr, "The spawn server could not be started: %d\n", errorCode );
+		return EXIT_FAILURE;
+	}
+
+	char filePath[] = "/tmp/FileDescriptorPlanTest.XXXXXX";
+	int fileDescriptor = mkstemp( filePath );
+
+	if ( ( 0 > fileDescriptor ) or ( LeakedFileDescriptor != fcntl( STDIN_FILENO, F_DUPFD, LeakedFileDescriptor ) ) )
+	{
+		perror( "FileDescriptorPlanTest" );
+		return EXIT_FAILURE;
+	}
+
+	close( fileDescriptor );
+
+	_testBackend( "posixSpawn", SpawnBackend::PosixSpawn, filePath );
+	_testBackend( "clone3", SpawnBackend::Clone3, filePath );
+	_testBackend( "spawnServer", SpawnBackend::SpawnServer, filePath );
+
+	unlink( filePath );
+	SpawnServer::instance().stop();
+
+	if ( 0 != gFailures )
+	{
+		fprintf( stderr, "%u failures\n", gFailures );
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
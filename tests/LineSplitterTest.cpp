@@ -0,0 +1,277 @@
+/**
+ * Copyright ©2022. Brent Weichel. All Rights Reserved.
+ * Permission to use, copy, modify, and/or distribute this software, in whole
+ * or part by any means, without express prior written agreement is prohibited.
+ */
+
+/**
+ * Tests of the LineSplitter against a scalar reference, splitting the whole
+ * of an output at once; built once for each scan the host can run, AVX2,
+ * SSE2 and scalar, as selected by the flags of the target. The output is fed
+ * in chunks of random sizes, of the widths of the scans either side, and cut
+ * at every delimiter or terminator, so that records and fields straddle the
+ * chunks and the tails of the vector loops are each run.
+ *
+ *     line_splitter_test [seed]
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LineSplitter.hpp"
+
+namespace
+{
+
+// Exit status by which ctest marks a test skipped
+constexpr int SkippedStatus = 77;
+
+// The delimiter of the fields
+constexpr char Delimiter = ',';
+
+unsigned gFailures = 0;
+
+// Records, each of its fields; a record alone is of one field.
+using Records = std::vector< std::vector< std::string > >;
+
+// Split the whole of {@param output} one byte at a time; what the splitter must agree with.
+Records _reference(
+	const std::string& output,
+	bool splitFields )
+{
+	Records records;
+	std::vector< std::string > fields( 1 );
+
+	for ( char byte : output )
+	{
+		if ( '\n' == byte )
+		{
+			records.push_back( std::move( fields ) );
+			fields.assign( 1, std::string() );
+		}
+		else if ( splitFields and ( Delimiter == byte ) )
+		{
+			fields.emplace_back();
+		}
+		else
+		{
+			fields.back().push_back( byte );
+		}
+	}
+
+	// As CaptureBuffer::lines(), no empty record follows a final terminator
+	if ( not output.empty() and ( '\n' != output.back() ) )
+	{
+		records.push_back( std::move( fields ) );
+	}
+
+	return records;
+}
+
+// Feed {@param output} to a splitter, cut at each of {@param cuts}, and finish it.
+Records _split(
+	const std::string& output,
+	const std::vector< size_t >& cuts,
+	bool splitFields )
+{
+	Records records;
+	LineSplitter splitter = splitFields
+		? LineSplitter( Delimiter, [ &records ]( const std::vector< std::string_view >& fields )
+			{
+				records.emplace_back( fields.begin(), fields.end() );
+			} )
+		: LineSplitter( [ &records ]( std::string_view record )
+			{
+				records.push_back( { std::string( record ) } );
+			} );
+
+	// Each chunk is copied out, so that a view kept past the call of the callback is caught by ASan
+	size_t offset = 0;
+
+	for ( size_t cut : cuts )
+	{
+		std::vector< char > chunk( output.begin() + offset, output.begin() + cut );
+
+		splitter.feed( chunk.data(), chunk.size() );
+		offset = cut;
+	}
+
+	std::vector< char > chunk( output.begin() + offset, output.end() );
+
+	splitter.feed( chunk.data(), chunk.size() );
+	splitter.finish();
+	return records;
+}
+
+// Compare the splitter with the reference over one output and its cuts, both with and without fields.
+void _check(
+	const char* name,
+	const std::string& output,
+	const std::vector< size_t >& cuts )
+{
+	for ( bool splitFields : { false, true } )
+	{
+		if ( _reference( output, splitFields ) != _split( output, cuts, splitFields ) )
+		{
+			fprintf( stderr, "%s: %s of a %zu byte output in %zu chunks differ from the reference\n",
+				name, splitFields ? "fields" : "records", output.size(), cuts.size() + 1 );
+			++gFailures;
+		}
+	}
+}
+
+// Cut {@param output} into chunks of {@param size} bytes.
+std::vector< size_t > _cutEvery(
+	const std::string& output,
+	size_t size )
+{
+	std::vector< size_t > cuts;
+
+	for ( size_t cut( size ); cut < output.size(); cut += size )
+	{
+		cuts.push_back( cut );
+	}
+
+	return cuts;
+}
+
+// Outputs of runs of bytes between terminators and delimiters, and the chunks of random sizes.
+void _testRandom(
+	std::mt19937& generator )
+{
+	// Short runs reach a terminator or delimiter in every block; long ones are scanned in whole blocks
+	for ( unsigned maximumRun : { 2u, 8u, 40u, 200u } )
+	{
+		for ( unsigned round( -1 ); ++round < 200; )
+		{
+			std::string output;
+			size_t length = std::uniform_int_distribution< size_t >( 0, 4096 )( generator );
+
+			while ( output.size() < length )
+			{
+				output.append( std::uniform_int_distribution< size_t >( 0, maximumRun )( generator ), 'x' );
+				output.push_back( ( 0 == generator() % 3 ) ? Delimiter : '\n' );
+			}
+
+			// Half of the outputs end without a terminator, a record left for finish()
+			if ( 0 == round % 2 )
+			{
+				output.append( generator() % 40, 'y' );
+			}
+
+			std::vector< size_t > cuts;
+
+			for ( size_t cut( 0 ); ( cut += std::uniform_int_distribution< size_t >( 1, 100 )( generator ) ) < output.size(); )
+			{
+				cuts.push_back( cut );
+			}
+
+			_check( "random chunks", output, cuts );
+
+			for ( size_t size : { 1, 15, 16, 17, 31, 32, 33, 64 } )
+			{
+				_check( "fixed chunks", output, _cutEvery( output, size ) );
+			}
+		}
+	}
+}
+
+// Records and fields straddling chunks, each chunk ending just after, or just
+// before, a delimiter or terminator; the first chunk then has its last byte one.
+void _testStraddling()
+{
+	const std::string output = "alpha,beta,gamma\n,,\n" + std::string( 100, 'z' ) + ",delta\nlast,field";
+
+	for ( size_t index( -1 ); ++index < output.size(); )
+	{
+		if ( ( '\n' == output[ index ] ) or ( Delimiter == output[ index ] ) )
+		{
+			_check( "cut after a delimiter", output, { index + 1 } );
+			_check( "cut before a delimiter", output, { index } );
+		}
+	}
+
+	// Every cut of one record long enough to straddle with a carry through several chunks
+	for ( size_t first( 0 ); ++first < output.size(); )
+	{
+		for ( size_t second( first ); ++second < output.size(); second += 7 )
+		{
+			_check( "cut twice", output, { first, second } );
+		}
+	}
+}
+
+// A terminator or delimiter at every offset of runs either side of the
+// 16 and 32 byte blocks, so that it is found in a block or its scalar tail.
+void _testTails()
+{
+	for ( char found : { '\n', Delimiter } )
+	{
+		for ( size_t run( -1 ); ++run < 100; )
+		{
+			std::string output = std::string( run, 'x' ) + found + std::string( run % 37, 'y' ) + "\n";
+
+			_check( "tails", output, {} );
+			_check( "tails after a carry", output, { 1 } );
+			_check( "tails without a terminator", output.substr( 0, output.size() - 1 ), {} );
+		}
+	}
+}
+
+// A splitter finished, or reset, starts the next output afresh.
+void _testReuse()
+{
+	Records records;
+	LineSplitter splitter( Delimiter, [ &records ]( const std::vector< std::string_view >& fields )
+	{
+		records.emplace_back( fields.begin(), fields.end() );
+	} );
+
+	splitter.feed( "a,b\nc,", 6 );
+	splitter.finish();
+	splitter.feed( "dropped", 7 );
+	splitter.reset();
+	splitter.feed( "e\n", 2 );
+
+	if ( Records( { { "a", "b" }, { "c", "" }, { "e" } } ) != records )
+	{
+		fprintf( stderr, "reuse: the records of a finished or reset splitter leaked into the next output\n" );
+		++gFailures;
+	}
+}
+
+} // namespace
+
+int main(
+	int argc,
+	char** argv )
+{
+#if defined( __AVX2__ )
+	if ( not __builtin_cpu_supports( "avx2" ) )
+	{
+		fprintf( stderr, "The host cannot run AVX2; skipped\n" );
+		return SkippedStatus;
+	}
+#endif
+
+	uint32_t seed = ( 1 < argc ) ? static_cast< uint32_t >( strtoul( argv[ 1 ], nullptr, 10 ) ) : 20220101;
+	std::mt19937 generator( seed );
+
+	_testRandom( generator );
+	_testStraddling();
+	_testTails();
+	_testReuse();
+
+	if ( 0 != gFailures )
+	{
+		fprintf( stderr, "%u failures, seed %u\n", gFailures, seed );
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}